@@ -45,6 +45,9 @@
 /* Amount of ms we wait between CLCC calls */
 #define POLL_CLCC_INTERVAL 500
 
+/* Upper limit for the CLCC poll backoff */
+#define POLL_CLCC_MAX_INTERVAL 2000
+
  /* Amount of time we give for CLIP to arrive before we commence CLCC poll */
 #define CLIP_INTERVAL 200
 
@@ -64,7 +67,6 @@ static const char *atd_prefix[] = { "+COLP:", NULL };
 struct voicecall_data {
 	GSList *calls;
 	unsigned int local_release;
-	unsigned int clcc_source;
 	GAtChat *chat;
 	unsigned int vendor;
 	unsigned int tone_duration;
@@ -87,8 +89,6 @@ struct change_state_req {
 	int affected_types;
 };
 
-static gboolean poll_clcc(gpointer user_data);
-
 static int class_to_call_type(int cls)
 {
 	switch (cls) {
@@ -163,6 +163,7 @@ static void clcc_poll_cb(gboolean ok, GAtResult *result, gpointer user_data)
 
 		ofono_error("We are polling CLCC and received an error");
 		ofono_error("All bets are off for call management");
+		ofono_voicecall_poll_done(vc, FALSE);
 		return;
 	}
 
@@ -259,22 +260,16 @@ static void clcc_poll_cb(gboolean ok, GAtResult *result, gpointer user_data)
 	vd->local_release = 0;
 
 poll_again:
-	if (poll_again && !vd->clcc_source)
-		vd->clcc_source = g_timeout_add(POLL_CLCC_INTERVAL,
-						poll_clcc, vc);
+	ofono_voicecall_poll_done(vc, poll_again);
 }
 
-static gboolean poll_clcc(gpointer user_data)
+static void poll_clcc(struct ofono_voicecall *vc)
 {
-	struct ofono_voicecall *vc = user_data;
 	struct voicecall_data *vd = ofono_voicecall_get_data(vc);
 
-	g_at_chat_send(vd->chat, "AT+CLCC", clcc_prefix,
-				clcc_poll_cb, vc, NULL);
-
-	vd->clcc_source = 0;
-
-	return FALSE;
+	if (g_at_chat_send(vd->chat, "AT+CLCC", clcc_prefix,
+				clcc_poll_cb, vc, NULL) == 0)
+		ofono_voicecall_poll_done(vc, FALSE);
 }
 
 static void generic_cb(gboolean ok, GAtResult *result, gpointer user_data)
@@ -297,8 +292,7 @@ static void generic_cb(gboolean ok, GAtResult *result, gpointer user_data)
 		}
 	}
 
-	g_at_chat_send(vd->chat, "AT+CLCC", clcc_prefix,
-			clcc_poll_cb, req->vc, NULL);
+	ofono_voicecall_poll_request(req->vc, 0);
 
 	/* We have to callback after we schedule a poll if required */
 	req->cb(&error, req->data);
@@ -316,8 +310,7 @@ static void release_id_cb(gboolean ok, GAtResult *result,
 	if (ok)
 		vd->local_release = 1 << req->id;
 
-	g_at_chat_send(vd->chat, "AT+CLCC", clcc_prefix,
-			clcc_poll_cb, req->vc, NULL);
+	ofono_voicecall_poll_request(req->vc, 0);
 
 	/* We have to callback after we schedule a poll if required */
 	req->cb(&error, req->data);
@@ -382,9 +375,7 @@ static void atd_cb(gboolean ok, GAtResult *result, gpointer user_data)
 	if (validity != 2)
 		ofono_voicecall_notify(vc, call);
 
-	if (!vd->clcc_source)
-		vd->clcc_source = g_timeout_add(POLL_CLCC_INTERVAL,
-						poll_clcc, vc);
+	ofono_voicecall_poll_request(vc, POLL_CLCC_INTERVAL);
 
 out:
 	cb(&error, cbd->data);
@@ -676,7 +667,7 @@ static void ring_notify(GAtResult *result, gpointer user_data)
 	}
 
 	/* We don't know the call type, we must run clcc */
-	vd->clcc_source = g_timeout_add(CLIP_INTERVAL, poll_clcc, vc);
+	ofono_voicecall_poll_request(vc, CLIP_INTERVAL);
 	vd->flags = FLAG_NEED_CLIP | FLAG_NEED_CNAP | FLAG_NEED_CDIP;
 }
 
@@ -729,7 +720,7 @@ static void cring_notify(GAtResult *result, gpointer user_data)
 	 * So we wait, and schedule the clcc call.  If the CLIP arrives
 	 * earlier, we announce the call there
 	 */
-	vd->clcc_source = g_timeout_add(CLIP_INTERVAL, poll_clcc, vc);
+	ofono_voicecall_poll_request(vc, CLIP_INTERVAL);
 	vd->flags = FLAG_NEED_CLIP | FLAG_NEED_CNAP | FLAG_NEED_CDIP;
 
 	DBG("");
@@ -952,40 +943,151 @@ static void ccwa_notify(GAtResult *result, gpointer user_data)
 	if (call->type == 0) /* Only notify voice calls */
 		ofono_voicecall_notify(vc, call);
 
-	if (vd->clcc_source == 0)
-		vd->clcc_source = g_timeout_add(POLL_CLCC_INTERVAL,
-						poll_clcc, vc);
+	ofono_voicecall_poll_request(vc, POLL_CLCC_INTERVAL);
 }
 
 static void no_carrier_notify(GAtResult *result, gpointer user_data)
 {
 	struct ofono_voicecall *vc = user_data;
-	struct voicecall_data *vd = ofono_voicecall_get_data(vc);
 
-	g_at_chat_send(vd->chat, "AT+CLCC", clcc_prefix,
-			clcc_poll_cb, vc, NULL);
+	ofono_voicecall_poll_request(vc, 0);
 }
 
 static void no_answer_notify(GAtResult *result, gpointer user_data)
 {
 	struct ofono_voicecall *vc = user_data;
-	struct voicecall_data *vd = ofono_voicecall_get_data(vc);
 
-	g_at_chat_send(vd->chat, "AT+CLCC", clcc_prefix,
-			clcc_poll_cb, vc, NULL);
+	ofono_voicecall_poll_request(vc, 0);
 }
 
 static void busy_notify(GAtResult *result, gpointer user_data)
 {
 	struct ofono_voicecall *vc = user_data;
-	struct voicecall_data *vd = ofono_voicecall_get_data(vc);
 
 	/* Call was rejected, most likely due to network congestion
 	 * or UDUB on the other side
 	 * TODO: Handle UDUB or other conditions somehow
 	 */
-	g_at_chat_send(vd->chat, "AT+CLCC", clcc_prefix,
-			clcc_poll_cb, vc, NULL);
+	ofono_voicecall_poll_request(vc, 0);
+}
+
+static void clcc_notify(GAtResult *result, gpointer user_data)
+{
+	struct ofono_voicecall *vc = user_data;
+	struct voicecall_data *vd = ofono_voicecall_get_data(vc);
+	GAtResultIter iter;
+	int id, dir, status, type, mpty;
+	const char *num = "";
+	int num_type = 129;
+	struct ofono_call *call;
+	struct ofono_call old;
+	GSList *l;
+
+	/*
+	 * Some modems report call state changes with unsolicited +CLCC,
+	 * one line per call and in the same format as the AT+CLCC response.
+	 * Apply it to the call list directly instead of querying the modem.
+	 */
+	g_at_result_iter_init(&iter, result);
+
+	if (!g_at_result_iter_next(&iter, "+CLCC:"))
+		return;
+
+	if (!g_at_result_iter_next_number(&iter, &id) || id == 0)
+		return;
+
+	if (!g_at_result_iter_next_number(&iter, &dir))
+		return;
+
+	if (!g_at_result_iter_next_number(&iter, &status))
+		return;
+
+	if (!g_at_result_iter_next_number(&iter, &type))
+		return;
+
+	if (!g_at_result_iter_next_number(&iter, &mpty))
+		return;
+
+	if (g_at_result_iter_next_string(&iter, &num))
+		g_at_result_iter_next_number(&iter, &num_type);
+
+	DBG("%d %d %d %d %s", id, dir, status, type, num);
+
+	ofono_voicecall_poll_event(vc);
+
+	l = g_slist_find_custom(vd->calls, GINT_TO_POINTER(id),
+				at_util_call_compare_by_id);
+	call = l ? l->data : NULL;
+
+	/* Released calls are reported with status 6 by e.g. SIMCom */
+	if (status > CALL_STATUS_WAITING) {
+		enum ofono_disconnect_reason reason;
+
+		if (call == NULL)
+			return;
+
+		if (vd->local_release & (1 << id))
+			reason = OFONO_DISCONNECT_REASON_LOCAL_HANGUP;
+		else
+			reason = OFONO_DISCONNECT_REASON_REMOTE_HANGUP;
+
+		if (!call->type)
+			ofono_voicecall_disconnected(vc, id, reason, NULL);
+
+		vd->local_release &= ~(1 << id);
+		vd->calls = g_slist_remove(vd->calls, call);
+		g_free(call);
+		return;
+	}
+
+	if (call == NULL) {
+		call = g_try_new(struct ofono_call, 1);
+		if (call == NULL)
+			return;
+
+		ofono_call_init(call);
+		call->id = id;
+		call->direction = dir;
+		call->status = status;
+		call->type = type;
+		strncpy(call->phone_number.number, num,
+				OFONO_MAX_PHONE_NUMBER_LENGTH);
+		call->phone_number.type = num_type;
+		call->clip_validity = num[0] ? 0 : 2;
+
+		vd->calls = g_slist_insert_sorted(vd->calls, call,
+						at_util_call_compare);
+
+		/* new call, signal it */
+		if (call->type == 0)
+			ofono_voicecall_notify(vc, call);
+
+		return;
+	}
+
+	old = *call;
+	call->direction = dir;
+	call->status = status;
+	call->type = type;
+
+	/* Don't lose the number learned from CLIP or an earlier +CLCC */
+	if (num[0]) {
+		strncpy(call->phone_number.number, num,
+				OFONO_MAX_PHONE_NUMBER_LENGTH);
+		call->phone_number.type = num_type;
+
+		if (call->clip_validity == 2)
+			call->clip_validity = 0;
+	}
+
+	/* If the CLIP never arrives, signal the incoming call here */
+	if (status == CALL_STATUS_INCOMING && (vd->flags & FLAG_NEED_CLIP)) {
+		if (call->type == 0)
+			ofono_voicecall_notify(vc, call);
+
+		vd->flags &= ~FLAG_NEED_CLIP;
+	} else if (memcmp(call, &old, sizeof(old)) && call->type == 0)
+		ofono_voicecall_notify(vc, call);
 }
 
 static void cssi_notify(GAtResult *result, gpointer user_data)
@@ -1086,6 +1188,7 @@ static void at_voicecall_initialized(gboolean ok, GAtResult *result,
 	g_at_chat_register(vd->chat, "NO ANSWER",
 				no_answer_notify, FALSE, vc, NULL);
 	g_at_chat_register(vd->chat, "BUSY", busy_notify, FALSE, vc, NULL);
+	g_at_chat_register(vd->chat, "+CLCC:", clcc_notify, FALSE, vc, NULL);
 
 	g_at_chat_register(vd->chat, "+CSSI:", cssi_notify, FALSE, vc, NULL);
 	g_at_chat_register(vd->chat, "+CSSU:", cssu_notify, FALSE, vc, NULL);
@@ -1111,6 +1214,8 @@ static int at_voicecall_probe(struct ofono_voicecall *vc, unsigned int vendor,
 	vd->tone_duration = TONE_DURATION;
 
 	ofono_voicecall_set_data(vc, vd);
+	ofono_voicecall_poll_init(vc, poll_clcc, POLL_CLCC_INTERVAL,
+						POLL_CLCC_MAX_INTERVAL);
 
 	g_at_chat_send(vd->chat, "AT+CRC=1", NULL, NULL, NULL, NULL);
 	g_at_chat_send(vd->chat, "AT+CLIP=1", NULL, NULL, NULL, NULL);
@@ -1140,9 +1245,6 @@ static void at_voicecall_remove(struct ofono_voicecall *vc)
 {
 	struct voicecall_data *vd = ofono_voicecall_get_data(vc);
 
-	if (vd->clcc_source)
-		g_source_remove(vd->clcc_source);
-
 	if (vd->vts_source)
 		g_source_remove(vd->vts_source);
 
@@ -34,11 +34,11 @@
 #define MAX_NESTING 2 /* a(uss) */
 #define HEADER_SIZE (sizeof(struct mbim_message_header) + \
 					sizeof(struct mbim_fragment_header))
+#define MIN_BUF_SIZE 64
 
 static const char CONTAINER_TYPE_ARRAY	= 'a';
 static const char CONTAINER_TYPE_STRUCT	= 'r';
 static const char CONTAINER_TYPE_DATABUF = 'd';
-static const char *simple_types = "syqut";
 
 struct mbim_message {
 	int ref_count;
@@ -123,6 +123,20 @@ static int get_basic_size(const char type)
 	}
 }
 
+static inline bool is_simple_type(const char type)
+{
+	switch (type) {
+	case 's':
+	case 'y':
+	case 'q':
+	case 'u':
+	case 't':
+		return true;
+	default:
+		return false;
+	}
+}
+
 static bool is_fixed_size(const char *sig_start, const char *sig_end)
 {
 	while (sig_start <= sig_end) {
@@ -172,6 +186,20 @@ static bool _iter_copy_string(struct mbim_message_iter *iter,
 	while (offset >= iov_start + iter->iov[i].iov_len)
 		iov_start += iter->iov[i++].iov_len;
 
+	/*
+	 * Most strings don't cross a fragment boundary, on little endian
+	 * CPUs those can be converted straight out of the fragment
+	 */
+	if (L_CPU_TO_LE16(0x8000) == 0x8000 &&
+			offset - iov_start + len <= iter->iov[i].iov_len) {
+		const void *src = iter->iov[i].iov_base + offset - iov_start;
+
+		if (!((uintptr_t) src & 1)) {
+			*out = l_utf8_from_utf16(src, len);
+			return true;
+		}
+	}
+
 	tocopy = iter->iov[i].iov_len - (offset - iov_start);
 
 	if (tocopy > remaining)
@@ -191,6 +219,7 @@ static bool _iter_copy_string(struct mbim_message_iter *iter,
 		memcpy(dest, iter->iov[i].iov_base, tocopy);
 		remaining -= tocopy;
 		dest += tocopy;
+		i += 1;
 	}
 
 	/* Strings are in UTF16-LE, so convert to UTF16-CPU first if needed */
@@ -398,7 +427,15 @@ static bool _iter_enter_struct(struct mbim_message_iter *iter,
 		return false;
 
 	sig_start = iter->sig_start + iter->sig_pos + 1;
-	sig_end = _signature_end(iter->sig_start + iter->sig_pos);
+
+	/* Array elements span the whole array signature, no need to scan */
+	if (iter->container_type == CONTAINER_TYPE_ARRAY)
+		sig_end = iter->sig_start + iter->sig_len - 1;
+	else
+		sig_end = _signature_end(iter->sig_start + iter->sig_pos);
+
+	if (!sig_end || *sig_end != ')')
+		return false;
 
 	/* TODO: support fixed size structures */
 	if (is_fixed_size(sig_start, sig_end))
@@ -456,7 +493,7 @@ static bool message_iter_next_entry_valist(struct mbim_message_iter *orig,
 	void *arg;
 
 	while (signature < orig->sig_start + orig->sig_len) {
-		if (strchr(simple_types, *signature)) {
+		if (is_simple_type(*signature)) {
 			arg = va_arg(args, void *);
 			if (!_iter_next_entry_basic(iter, *signature, arg))
 				return false;
@@ -705,9 +742,19 @@ struct mbim_message *_mbim_message_build(const void *header,
 {
 	struct mbim_message *msg;
 	struct mbim_message_header *hdr = (struct mbim_message_header *) header;
-	struct mbim_message_iter iter;
-	bool r = false;
+	uint32_t type = L_LE32_TO_CPU(hdr->type);
+	size_t begin = _mbim_information_buffer_offset(type);
+	const uint8_t *data;
+
+	/*
+	 * UUID, CID, status or command type and the information buffer
+	 * length sit at fixed offsets ("16yuuu" or "16yuu" for indications)
+	 * at the start of the first fragment, read them directly
+	 */
+	if (!begin || !n_frags || frags[0].iov_len < begin)
+		return NULL;
 
+	data = frags[0].iov_base;
 	msg = l_new(struct mbim_message, 1);
 
 	msg->ref_count = 1;
@@ -716,42 +763,18 @@ struct mbim_message *_mbim_message_build(const void *header,
 	msg->n_frags = n_frags;
 	msg->sealed = true;
 
-	switch (L_LE32_TO_CPU(hdr->type)) {
-	case MBIM_COMMAND_DONE:
-		_iter_init_internal(&iter, CONTAINER_TYPE_STRUCT,
-						"16yuuu", NULL,
-						frags, n_frags,
-						frags[0].iov_len, 0, 0, 0);
-		r = mbim_message_iter_next_entry(&iter, msg->uuid, &msg->cid,
-						&msg->status,
-						&msg->info_buf_len);
-		break;
-	case MBIM_COMMAND_MSG:
-		_iter_init_internal(&iter, CONTAINER_TYPE_STRUCT,
-						"16yuuu", NULL,
-						frags, n_frags,
-						frags[0].iov_len, 0, 0, 0);
-		r = mbim_message_iter_next_entry(&iter, msg->uuid, &msg->cid,
-						&msg->command_type,
-						&msg->info_buf_len);
-		break;
-	case MBIM_INDICATE_STATUS_MSG:
-		_iter_init_internal(&iter, CONTAINER_TYPE_STRUCT,
-						"16yuu", NULL,
-						frags, n_frags,
-						frags[0].iov_len, 0, 0, 0);
-		r = mbim_message_iter_next_entry(&iter, msg->uuid, &msg->cid,
-						&msg->info_buf_len);
-		break;
-	default:
-		break;
-	}
+	memcpy(msg->uuid, data, 16);
+	msg->cid = l_get_le32(data + 16);
 
-	if (!r) {
-		l_free(msg);
-		msg = NULL;
+	if (type == MBIM_INDICATE_STATUS_MSG) {
+		msg->info_buf_len = l_get_le32(data + 20);
+		return msg;
 	}
 
+	/* status for MBIM_COMMAND_DONE, command_type for MBIM_COMMAND_MSG */
+	msg->status = l_get_le32(data + 20);
+	msg->info_buf_len = l_get_le32(data + 24);
+
 	return msg;
 }
 
@@ -958,9 +981,15 @@ static inline size_t grow_buf(void **buf, size_t *buf_size, size_t *pos,
 {
 	size_t size = align_len(*pos, alignment);
 
+	/* Grow geometrically so that appending isn't a realloc per field */
 	if (size + len > *buf_size) {
-		*buf = l_realloc(*buf, size + len);
-		*buf_size = size + len;
+		size_t new_size = *buf_size ? *buf_size * 2 : MIN_BUF_SIZE;
+
+		while (new_size < size + len)
+			new_size *= 2;
+
+		*buf = l_realloc(*buf, new_size);
+		*buf_size = new_size;
 	}
 
 	if (size - *pos > 0)
@@ -981,6 +1010,66 @@ static inline size_t grow_buf(void **buf, size_t *buf_size, size_t *pos,
 #define GROW_OBUF(c) \
 	grow_buf(&c->obuf, &c->obuf_size, &c->obuf_pos, 4, 4)
 
+/*
+ * Estimate how much of the static buffer a signature takes up.  Strings,
+ * arrays and structures only contribute their offset / length pairs here,
+ * their contents go into the data buffer.
+ */
+static size_t signature_static_size(const char *sig, const char *sig_end)
+{
+	size_t size = 0;
+	const char *end;
+
+	while (sig < sig_end) {
+		switch (*sig) {
+		case '0' ... '9':
+			end = _signature_end(sig);
+			if (!end)
+				return size;
+
+			size += strtol(sig, NULL, 10);
+			sig = end + 1;
+			continue;
+		case '(':
+			end = _signature_end(sig);
+			break;
+		case 'a':
+			end = _signature_end(sig + 1);
+			break;
+		case 's':
+		case 'v':
+			end = sig;
+			break;
+		default:
+			size = align_len(size, get_alignment(*sig) ? : 1) +
+							get_basic_size(*sig);
+			sig += 1;
+			continue;
+		}
+
+		if (!end)
+			return size;
+
+		size = align_len(size, 4) + 8;
+		sig = end + 1;
+	}
+
+	return size;
+}
+
+static void container_reserve(struct container *container,
+					const char *signature, size_t extra)
+{
+	size_t size = extra + signature_static_size(signature,
+					signature + strlen(signature));
+
+	if (size <= container->sbuf_size)
+		return;
+
+	container->sbuf = l_realloc(container->sbuf, size);
+	container->sbuf_size = size;
+}
+
 static void add_offset_and_length(struct container *container,
 					uint32_t offset, uint32_t len)
 {
@@ -1062,7 +1151,7 @@ bool mbim_message_builder_append_basic(struct mbim_message_builder *builder,
 	if (unlikely(!builder))
 		return false;
 
-	if (unlikely(!strchr(simple_types, type)))
+	if (unlikely(!is_simple_type(type)))
 		return false;
 
 	alignment = get_alignment(type);
@@ -1235,6 +1324,7 @@ bool mbim_message_builder_enter_struct(struct mbim_message_builder *builder,
 	strcpy(container->signature, signature);
 	container->sigindex = 0;
 	container->container_type = CONTAINER_TYPE_STRUCT;
+	container_reserve(container, signature, 0);
 
 	return true;
 }
@@ -1370,6 +1460,7 @@ bool mbim_message_builder_enter_databuf(struct mbim_message_builder *builder,
 	strcpy(container->signature, signature);
 	container->sigindex = 0;
 	container->container_type = CONTAINER_TYPE_DATABUF;
+	container_reserve(container, signature, 0);
 
 	return true;
 }
@@ -1480,6 +1571,8 @@ static bool append_arguments(struct mbim_message *message,
 		return false;
 
 	builder = mbim_message_builder_new(message);
+	container_reserve(&builder->stack[0], signature,
+					builder->stack[0].base_offset);
 
 	stack[stack_index].type = CONTAINER_TYPE_STRUCT;
 	stack[stack_index].sig_start = signature;
@@ -37,6 +37,8 @@
 #include "mbim-message.h"
 #include "mbim-private.h"
 
+#include "src/capture.h"
+
 #define MAX_CONTROL_TRANSFER 4096
 #define HEADER_SIZE (sizeof(struct mbim_message_header) + \
 					sizeof(struct mbim_fragment_header))
@@ -168,10 +170,15 @@ static void message_assembly_free(struct message_assembly *assembly)
 	l_free(assembly);
 }
 
+/*
+ * Fragments are kept in place, the message takes over the buffers as its
+ * iovecs.  *frag is cleared once the assembly owns the buffer, otherwise
+ * (the fragment got rejected) the caller can keep reusing it.
+ */
 static struct mbim_message *message_assembly_add(
 					struct message_assembly *assembly,
 					const void *header,
-					void *frag, size_t frag_len)
+					void **frag, size_t frag_len)
 {
 	const struct mbim_message_header *msg_hdr = header;
 	const struct mbim_fragment_header *frag_hdr = header +
@@ -198,10 +205,17 @@ static struct mbim_message *message_assembly_add(
 		if (n_frags == 1) {
 			struct iovec *iov = l_new(struct iovec, 1);
 
-			iov[0].iov_base = frag;
+			iov[0].iov_base = *frag;
 			iov[0].iov_len = frag_len;
 
-			return _mbim_message_build(header, iov, 1);
+			message = _mbim_message_build(header, iov, 1);
+			if (!message) {
+				l_free(iov);
+				return NULL;
+			}
+
+			*frag = NULL;
+			return message;
 		}
 
 		node = l_new(struct message_assembly_node, 1);
@@ -210,8 +224,9 @@ static struct mbim_message *message_assembly_add(
 		node->iov = l_new(struct iovec, n_frags);
 		node->n_iov = n_frags;
 		node->cur_iov = cur_frag;
-		node->iov[node->cur_iov].iov_base = frag;
+		node->iov[node->cur_iov].iov_base = *frag;
 		node->iov[node->cur_iov].iov_len = frag_len;
+		*frag = NULL;
 
 		l_queue_push_head(assembly->transactions, node);
 
@@ -225,8 +240,9 @@ static struct mbim_message *message_assembly_add(
 		return NULL;
 
 	node->cur_iov = cur_frag;
-	node->iov[node->cur_iov].iov_base = frag;
+	node->iov[node->cur_iov].iov_base = *frag;
 	node->iov[node->cur_iov].iov_len = frag_len;
+	*frag = NULL;
 
 	if (node->cur_iov + 1 < node->n_iov)
 		return NULL;
@@ -494,6 +510,7 @@ static bool command_write_handler(struct l_io *io, void *user_data)
 
 		l_util_hexdump(false, buf, written, device->debug_handler,
 				device->debug_data);
+		capture_data(CAPTURE_MBIM, fd, CAPTURE_OUT, buf, written);
 	} else {
 		/* TODO: Handle fragmented writes */
 		l_util_debug(device->debug_handler, device->debug_data,
@@ -690,10 +707,23 @@ static bool command_read_handler(struct l_io *io, void *user_data)
 		return true;
 
 	device->header_offset = 0;
+
+	if (capture_active) {
+		iov[0].iov_base = device->header;
+		iov[0].iov_len = header_size;
+		iov[1].iov_base = device->segment;
+		iov[1].iov_len = L_LE32_TO_CPU(hdr->len) - header_size;
+		capture_datav(CAPTURE_MBIM, fd, CAPTURE_IN, iov, 2);
+	}
+
 	message = message_assembly_add(device->assembly, device->header,
-					device->segment,
+					&device->segment,
 					L_LE32_TO_CPU(hdr->len) - header_size);
-	device->segment = l_malloc(device->max_segment_size - HEADER_SIZE);
+
+	/* Rejected fragments leave the segment buffer to be reused */
+	if (!device->segment)
+		device->segment = l_malloc(device->max_segment_size -
+								HEADER_SIZE);
 
 	if (!message)
 		return true;
@@ -40,6 +40,9 @@
 #include "qmi.h"
 #include "ctl.h"
 
+#include "src/capture.h"
+#include "src/probes.h"
+
 typedef void (*qmi_message_func_t)(uint16_t message, uint16_t length,
 					const void *buffer, void *user_data);
 
@@ -95,9 +98,14 @@ struct qmi_service {
 	GList *notify_list;
 };
 
+/* Most requests fit into the inline buffer */
+#define QMI_PARAM_INLINE_SIZE 128
+
 struct qmi_param {
 	void *data;
 	uint16_t length;
+	uint16_t size;
+	uint8_t buf[QMI_PARAM_INLINE_SIZE];
 };
 
 struct qmi_result {
@@ -106,6 +114,7 @@ struct qmi_result {
 	uint16_t error;
 	const void *data;
 	uint16_t length;
+	uint16_t tlv[256];	/* TLV offset + 1 or zero if missing */
 };
 
 struct qmi_request {
@@ -659,12 +668,17 @@ static gboolean can_write_data(GIOChannel *channel, GIOCondition cond,
 
 	__hexdump('>', req->buf, bytes_written,
 				device->debug_func, device->debug_data);
+	capture_data(CAPTURE_QMI, device->fd, CAPTURE_OUT,
+					req->buf, bytes_written);
 
 	__debug_msg(' ', req->buf, bytes_written,
 				device->debug_func, device->debug_data);
 
 	hdr = req->buf;
 
+	OFONO_PROBE4(qmi_request, device->fd, req->tid, hdr->service,
+								hdr->client);
+
 	if (hdr->service == QMI_SERVICE_CONTROL)
 		g_queue_push_tail(device->control_queue, req);
 	else
@@ -729,6 +743,55 @@ static uint16_t __request_submit(struct qmi_device *device,
 	return req->tid;
 }
 
+static void result_init(struct qmi_result *result, uint16_t message,
+					const void *data, uint16_t length)
+{
+	uint16_t offset = 0;
+
+	result->message = message;
+	result->result = 0;
+	result->error = 0;
+	result->data = data;
+	result->length = length;
+
+	memset(result->tlv, 0, sizeof(result->tlv));
+
+	/*
+	 * Index the TLVs once, so that each qmi_result_get_* call is
+	 * a table lookup rather than a scan of the whole message.
+	 * The first TLV of each type wins, like it did with tlv_get().
+	 */
+	while (length - offset > QMI_TLV_HDR_SIZE) {
+		const struct qmi_tlv_hdr *tlv = data + offset;
+		uint16_t tlv_length = GUINT16_FROM_LE(tlv->length);
+
+		if (tlv_length > length - offset - QMI_TLV_HDR_SIZE)
+			break;
+
+		if (!result->tlv[tlv->type])
+			result->tlv[tlv->type] = offset + 1;
+
+		offset += QMI_TLV_HDR_SIZE + tlv_length;
+	}
+}
+
+static const void *result_tlv_get(const struct qmi_result *result,
+					uint8_t type, uint16_t *length)
+{
+	const struct qmi_tlv_hdr *tlv;
+	uint16_t offset = result->tlv[type];
+
+	if (!offset)
+		return NULL;
+
+	tlv = result->data + offset - 1;
+
+	if (length)
+		*length = GUINT16_FROM_LE(tlv->length);
+
+	return tlv->value;
+}
+
 static void service_notify(gpointer key, gpointer value, gpointer user_data)
 {
 	struct qmi_service *service = value;
@@ -755,11 +818,7 @@ static void handle_indication(struct qmi_device *device,
 	if (service_type == QMI_SERVICE_CONTROL)
 		return;
 
-	result.result = 0;
-	result.error = 0;
-	result.message = message;
-	result.data = data;
-	result.length = length;
+	result_init(&result, message, data, length);
 
 	if (client_id == 0xff) {
 		g_hash_table_foreach(device->service_list,
@@ -848,6 +907,9 @@ static void handle_packet(struct qmi_device *device,
 		g_queue_delete_link(device->service_queue, list);
 	}
 
+	OFONO_PROBE4(qmi_response, device->fd, req->tid, hdr->service,
+								message);
+
 	if (req->callback)
 		req->callback(message, length, data, req->user_data);
 
@@ -872,6 +934,7 @@ static gboolean received_data(GIOChannel *channel, GIOCondition cond,
 
 	__hexdump('<', buf, bytes_read,
 				device->debug_func, device->debug_data);
+	capture_data(CAPTURE_QMI, device->fd, CAPTURE_IN, buf, bytes_read);
 
 	offset = 0;
 
@@ -1650,6 +1713,9 @@ struct qmi_param *qmi_param_new(void)
 	if (!param)
 		return NULL;
 
+	param->data = param->buf;
+	param->size = sizeof(param->buf);
+
 	return param;
 }
 
@@ -1658,7 +1724,9 @@ void qmi_param_free(struct qmi_param *param)
 	if (!param)
 		return;
 
-	g_free(param->data);
+	if (param->data != param->buf)
+		g_free(param->data);
+
 	g_free(param);
 }
 
@@ -1666,7 +1734,7 @@ bool qmi_param_append(struct qmi_param *param, uint8_t type,
 					uint16_t length, const void *data)
 {
 	struct qmi_tlv_hdr *tlv;
-	void *ptr;
+	unsigned int needed;
 
 	if (!param || !type)
 		return false;
@@ -1677,23 +1745,37 @@ bool qmi_param_append(struct qmi_param *param, uint8_t type,
 	if (!data)
 		return false;
 
-	if (param->data)
-		ptr = g_try_realloc(param->data,
-				param->length + QMI_TLV_HDR_SIZE + length);
-	else
-		ptr = g_try_malloc(QMI_TLV_HDR_SIZE + length);
-
-	if (!ptr)
+	needed = param->length + QMI_TLV_HDR_SIZE + length;
+	if (needed > G_MAXUINT16)
 		return false;
 
-	tlv = ptr + param->length;
+	if (needed > param->size) {
+		unsigned int size = MAX(needed, 2u * param->size);
+		void *ptr;
+
+		size = MIN(size, G_MAXUINT16);
+
+		if (param->data == param->buf) {
+			ptr = g_try_malloc(size);
+			if (ptr)
+				memcpy(ptr, param->buf, param->length);
+		} else
+			ptr = g_try_realloc(param->data, size);
+
+		if (!ptr)
+			return false;
+
+		param->data = ptr;
+		param->size = size;
+	}
+
+	tlv = param->data + param->length;
 
 	tlv->type = type;
 	tlv->length = GUINT16_TO_LE(length);
 	memcpy(tlv->value, data, length);
 
-	param->data = ptr;
-	param->length += QMI_TLV_HDR_SIZE + length;
+	param->length = needed;
 
 	return true;
 }
@@ -1806,7 +1888,7 @@ const void *qmi_result_get(struct qmi_result *result, uint8_t type,
 	if (!result || !type)
 		return NULL;
 
-	return tlv_get(result->data, result->length, type, length);
+	return result_tlv_get(result, type, length);
 }
 
 char *qmi_result_get_string(struct qmi_result *result, uint8_t type)
@@ -1817,7 +1899,7 @@ char *qmi_result_get_string(struct qmi_result *result, uint8_t type)
 	if (!result || !type)
 		return NULL;
 
-	ptr = tlv_get(result->data, result->length, type, &len);
+	ptr = result_tlv_get(result, type, &len);
 	if (!ptr)
 		return NULL;
 
@@ -1833,7 +1915,7 @@ bool qmi_result_get_uint8(struct qmi_result *result, uint8_t type,
 	if (!result || !type)
 		return false;
 
-	ptr = tlv_get(result->data, result->length, type, &len);
+	ptr = result_tlv_get(result, type, &len);
 	if (!ptr)
 		return false;
 
@@ -1852,7 +1934,7 @@ bool qmi_result_get_int16(struct qmi_result *result, uint8_t type,
 	if (!result || !type)
 		return false;
 
-	ptr = tlv_get(result->data, result->length, type, &len);
+	ptr = result_tlv_get(result, type, &len);
 	if (!ptr)
 		return false;
 
@@ -1873,7 +1955,7 @@ bool qmi_result_get_uint16(struct qmi_result *result, uint8_t type,
 	if (!result || !type)
 		return false;
 
-	ptr = tlv_get(result->data, result->length, type, &len);
+	ptr = result_tlv_get(result, type, &len);
 	if (!ptr)
 		return false;
 
@@ -1895,7 +1977,7 @@ bool qmi_result_get_uint32(struct qmi_result *result, uint8_t type,
 	if (!result || !type)
 		return false;
 
-	ptr = tlv_get(result->data, result->length, type, &len);
+	ptr = result_tlv_get(result, type, &len);
 	if (!ptr)
 		return false;
 
@@ -1917,7 +1999,7 @@ bool qmi_result_get_uint64(struct qmi_result *result, uint8_t type,
 	if (!result || !type)
 		return false;
 
-	ptr = tlv_get(result->data, result->length, type, &len);
+	ptr = result_tlv_get(result, type, &len);
 	if (!ptr)
 		return false;
 
@@ -2251,11 +2333,9 @@ static void service_send_callback(uint16_t message, uint16_t length,
 	uint16_t len;
 	struct qmi_result result;
 
-	result.message = message;
-	result.data = buffer;
-	result.length = length;
+	result_init(&result, message, buffer, length);
 
-	result_code = tlv_get(buffer, length, 0x02, &len);
+	result_code = result_tlv_get(&result, 0x02, &len);
 	if (!result_code)
 		goto done;
 
@@ -403,9 +403,11 @@ static void ril_cops_cb(struct ril_msg *message, gpointer user_data)
 	struct ofono_network_operator op;
 	struct parcel rilp;
 	int num_params;
-	char *lalpha;
-	char *salpha;
-	char *numeric;
+	struct parcel_str str;
+	struct parcel_scratch lalpha_buf, salpha_buf, numeric_buf;
+	const char *lalpha;
+	const char *salpha;
+	const char *numeric;
 
 	DBG("");
 
@@ -436,9 +438,16 @@ static void ril_cops_cb(struct ril_msg *message, gpointer user_data)
 		goto error;
 	}
 
-	lalpha = parcel_r_string(&rilp);
-	salpha = parcel_r_string(&rilp);
-	numeric = parcel_r_string(&rilp);
+	parcel_scratch_init(&lalpha_buf);
+	parcel_scratch_init(&salpha_buf);
+	parcel_scratch_init(&numeric_buf);
+
+	parcel_r_str(&rilp, &str);
+	lalpha = parcel_str_utf8(&rilp, &str, &lalpha_buf);
+	parcel_r_str(&rilp, &str);
+	salpha = parcel_str_utf8(&rilp, &str, &salpha_buf);
+	parcel_r_str(&rilp, &str);
+	numeric = parcel_str_utf8(&rilp, &str, &numeric_buf);
 
 	g_ril_append_print_buf(nd->ril,
 				"(lalpha=%s, salpha=%s, numeric=%s)",
@@ -446,10 +455,11 @@ static void ril_cops_cb(struct ril_msg *message, gpointer user_data)
 
 	g_ril_print_response(nd->ril, message);
 
-	if ((lalpha == NULL && salpha == NULL) || numeric == NULL) {
-		g_free(lalpha);
-		g_free(salpha);
-		g_free(numeric);
+	if (rilp.malformed || (lalpha == NULL && salpha == NULL) ||
+			numeric == NULL) {
+		parcel_scratch_free(&lalpha_buf);
+		parcel_scratch_free(&salpha_buf);
+		parcel_scratch_free(&numeric_buf);
 		goto error;
 	}
 
@@ -458,9 +468,9 @@ static void ril_cops_cb(struct ril_msg *message, gpointer user_data)
 	op.status = OPERATOR_STATUS_CURRENT;
 	op.tech = ril_tech_to_access_tech(nd->tech);
 
-	g_free(lalpha);
-	g_free(salpha);
-	g_free(numeric);
+	parcel_scratch_free(&lalpha_buf);
+	parcel_scratch_free(&salpha_buf);
+	parcel_scratch_free(&numeric_buf);
 
 	CALLBACK_WITH_SUCCESS(cb, &op, cbd->data);
 	return;
@@ -489,6 +499,7 @@ static void ril_cops_list_cb(struct ril_msg *message, gpointer user_data)
 	struct netreg_data *nd = cbd->user;
 	struct ofono_network_operator *ops;
 	struct parcel rilp;
+	struct parcel_scratch lalpha_buf, salpha_buf, numeric_buf, status_buf;
 	int num_ops;
 	unsigned int i = 0;
 	unsigned int num_strings;
@@ -531,33 +542,46 @@ static void ril_cops_list_cb(struct ril_msg *message, gpointer user_data)
 	DBG("noperators = %d", num_ops);
 	ops = g_new0(struct ofono_network_operator, num_ops);
 
+	/* The same buffers are reused for every operator */
+	parcel_scratch_init(&lalpha_buf);
+	parcel_scratch_init(&salpha_buf);
+	parcel_scratch_init(&numeric_buf);
+	parcel_scratch_init(&status_buf);
+
 	for (i = 0; num_ops; num_ops--) {
-		char *lalpha;
-		char *salpha;
-		char *numeric;
-		char *status;
+		struct parcel_str str;
+		const char *lalpha;
+		const char *salpha;
+		const char *numeric;
+		const char *status;
 		int tech = -1;
 
-		lalpha = parcel_r_string(&rilp);
-		salpha = parcel_r_string(&rilp);
-		numeric = parcel_r_string(&rilp);
-		status = parcel_r_string(&rilp);
+		parcel_r_str(&rilp, &str);
+		lalpha = parcel_str_utf8(&rilp, &str, &lalpha_buf);
+		parcel_r_str(&rilp, &str);
+		salpha = parcel_str_utf8(&rilp, &str, &salpha_buf);
+		parcel_r_str(&rilp, &str);
+		numeric = parcel_str_utf8(&rilp, &str, &numeric_buf);
+		parcel_r_str(&rilp, &str);
+		status = parcel_str_utf8(&rilp, &str, &status_buf);
 
 		/*
 		 * MTK: additional string with technology: 2G/3G are the only
 		 * valid values currently.
 		 */
 		if (g_ril_vendor(nd->ril) == OFONO_RIL_VENDOR_MTK) {
-			char *t = parcel_r_string(&rilp);
+			parcel_r_str(&rilp, &str);
 
-			if (strcmp(t, "3G") == 0)
+			if (parcel_str_equal(&str, "3G"))
 				tech = ACCESS_TECHNOLOGY_UTRAN;
 			else
 				tech = ACCESS_TECHNOLOGY_GSM;
-
-			g_free(t);
 		}
 
+		/* Don't look at any of it if a string was badly encoded */
+		if (rilp.malformed)
+			break;
+
 		if (lalpha == NULL && salpha == NULL)
 			goto next;
 
@@ -572,13 +596,13 @@ static void ril_cops_list_cb(struct ril_msg *message, gpointer user_data)
 		ops[i].tech = tech;
 
 		/* Set the proper status  */
-		if (!strcmp(status, "unknown"))
+		if (strcmp(status, "unknown") == 0)
 			ops[i].status = OPERATOR_STATUS_UNKNOWN;
-		else if (!strcmp(status, "available"))
+		else if (strcmp(status, "available") == 0)
 			ops[i].status = OPERATOR_STATUS_AVAILABLE;
-		else if (!strcmp(status, "current"))
+		else if (strcmp(status, "current") == 0)
 			ops[i].status = OPERATOR_STATUS_CURRENT;
-		else if (!strcmp(status, "forbidden"))
+		else if (strcmp(status, "forbidden") == 0)
 			ops[i].status = OPERATOR_STATUS_FORBIDDEN;
 
 		i++;
@@ -587,15 +611,21 @@ next:
 				" numeric=%s status=%s]",
 				print_buf,
 				lalpha, salpha, numeric, status);
-		g_free(lalpha);
-		g_free(salpha);
-		g_free(numeric);
-		g_free(status);
 	}
 
+	parcel_scratch_free(&lalpha_buf);
+	parcel_scratch_free(&salpha_buf);
+	parcel_scratch_free(&numeric_buf);
+	parcel_scratch_free(&status_buf);
+
 	g_ril_append_print_buf(nd->ril, "%s}", print_buf);
 	g_ril_print_response(nd->ril, message);
 
+	if (rilp.malformed) {
+		g_free(ops);
+		goto error;
+	}
+
 	CALLBACK_WITH_SUCCESS(cb, i, ops, cbd->data);
 	g_free(ops);
 	return;
@@ -26,6 +26,7 @@
 
 #include <glib.h>
 #include <gril.h>
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <arpa/inet.h>
@@ -80,21 +81,20 @@ gchar *ril_util_get_netmask(const gchar *address)
 void ril_util_build_deactivate_data_call(GRil *gril, struct parcel *rilp,
 						int cid, unsigned int reason)
 {
-	char *cid_str = NULL;
-	char *reason_str = NULL;
+	char cid_str[12];
+	char reason_str[12];
 
-	cid_str = g_strdup_printf("%d", cid);
-	reason_str = g_strdup_printf("%d", reason);
+	snprintf(cid_str, sizeof(cid_str), "%d", cid);
+	snprintf(reason_str, sizeof(reason_str), "%u", reason);
 
-	parcel_init(rilp);
+	parcel_init_sized(rilp, PARCEL_INT32_SIZE +
+					parcel_string_size(cid_str) +
+					parcel_string_size(reason_str));
 	parcel_w_int32(rilp, 2);
 	parcel_w_string(rilp, cid_str);
 	parcel_w_string(rilp, reason_str);
 
 	g_ril_append_print_buf(gril, "(%s,%s)", cid_str, reason_str);
-
-	g_free(cid_str);
-	g_free(reason_str);
 }
 
 const char *ril_util_gprs_proto_to_ril_string(enum ofono_gprs_proto proto)
@@ -107,10 +107,57 @@ struct change_state_cbd {
 
 static void send_get_sim_status(struct ofono_sim *sim);
 
+/* Largest response to a single SIM IO command */
+#define SIM_IO_RESPONSE_MAX 256
+
+static int hex_value(uint16_t c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+
+	return -1;
+}
+
+/* Decodes the hex string straight from the parcel */
+static long decode_sim_io_response(const struct parcel_str *hex,
+					unsigned char *response)
+{
+	size_t i;
+
+	if (hex->len % 2 || hex->len / 2 > SIM_IO_RESPONSE_MAX)
+		return -1;
+
+	for (i = 0; i < hex->len; i += 2) {
+		int hi = hex_value(hex->data[i]);
+		int lo = hex_value(hex->data[i + 1]);
+
+		if (hi < 0 || lo < 0)
+			return -1;
+
+		response[i / 2] = (hi << 4) | lo;
+	}
+
+	return hex->len / 2;
+}
+
+/*
+ * response must have room for SIM_IO_RESPONSE_MAX bytes, or be NULL if
+ * the caller is not interested. len is -1 if there was no response.
+ */
 static gboolean parse_sim_io(GRil *ril, struct ril_msg *message,
-				int *sw1, int *sw2, char **hex_response)
+				int *sw1, int *sw2,
+				unsigned char *response, long *len)
 {
 	struct parcel rilp;
+	struct parcel_str hex;
+	struct parcel_scratch scratch;
+	const char *hex_str;
 
 	/*
 	 * Minimum length of SIM_IO_Response is 12:
@@ -128,14 +175,27 @@ static gboolean parse_sim_io(GRil *ril, struct ril_msg *message,
 	*sw1 = parcel_r_int32(&rilp);
 	*sw2 = parcel_r_int32(&rilp);
 
-	*hex_response = parcel_r_string(&rilp);
+	parcel_r_str(&rilp, &hex);
 
-	g_ril_append_print_buf(ril, "(sw1=0x%.2X,sw2=0x%.2X,%s)",
-				*sw1, *sw2, *hex_response);
+	/* Validate it even if nobody is going to see the trace */
+	parcel_scratch_init(&scratch);
+	hex_str = parcel_str_utf8(&rilp, &hex, &scratch);
+	g_ril_append_print_buf(ril, "(sw1=0x%.2X,sw2=0x%.2X,%s)", *sw1, *sw2,
+				hex_str);
 	g_ril_print_response(ril, message);
+	parcel_scratch_free(&scratch);
+
+	if (rilp.malformed)
+		return FALSE;
+
+	*len = -1;
+
+	if (response == NULL || hex.data == NULL)
+		return TRUE;
 
-	if (rilp.malformed) {
-		g_free(*hex_response);
+	*len = decode_sim_io_response(&hex, response);
+	if (*len < 0) {
+		ofono_error("Invalid SIM IO response from RILD");
 		return FALSE;
 	}
 
@@ -148,8 +208,7 @@ static void ril_file_info_cb(struct ril_msg *message, gpointer user_data)
 	ofono_sim_file_info_cb_t cb = cbd->cb;
 	struct sim_data *sd = cbd->user;
 	int sw1, sw2;
-	char *hex_response;
-	unsigned char *response = NULL;
+	unsigned char response[SIM_IO_RESPONSE_MAX];
 	long len;
 	gboolean ok = FALSE;
 	int flen = 0, rlen = 0, str = 0;
@@ -169,18 +228,9 @@ static void ril_file_info_cb(struct ril_msg *message, gpointer user_data)
 	 *
 	 */
 
-	if (parse_sim_io(sd->ril, message, &sw1, &sw2, &hex_response) == FALSE)
+	if (parse_sim_io(sd->ril, message, &sw1, &sw2, response, &len) == FALSE)
 		goto error;
 
-	if (hex_response != NULL) {
-		response = decode_hex(hex_response, -1, &len, -1);
-		g_free(hex_response);
-		hex_response = NULL;
-
-		if (response == NULL)
-			goto error;
-	}
-
 	/*
 	 * SIM app file not found || USIM app file not found
 	 * See 3gpp TS 51.011, 9.4.4, and ETSI TS 102 221, 10.2.1.5.3
@@ -206,9 +256,6 @@ static void ril_file_info_cb(struct ril_msg *message, gpointer user_data)
 		ofono_error("Error reply, invalid values: sw1: %02x sw2: %02x",
 				sw1, sw2);
 
-		g_free(response);
-		response = NULL;
-
 		memset(&error, 0, sizeof(error));
 		error.type = OFONO_ERROR_TYPE_SIM;
 		error.error = (sw1 << 8) | sw2;
@@ -217,7 +264,7 @@ static void ril_file_info_cb(struct ril_msg *message, gpointer user_data)
 		return;
 	}
 
-	if (len < 0)
+	if (len <= 0)
 		goto error;
 
 	if (response[0] == 0x62) {
@@ -230,8 +277,6 @@ static void ril_file_info_cb(struct ril_msg *message, gpointer user_data)
 						&flen, &rlen, &str,
 						access, &file_status);
 
-	g_free(response);
-
 	if (!ok)
 		goto error;
 
@@ -240,7 +285,6 @@ static void ril_file_info_cb(struct ril_msg *message, gpointer user_data)
 	return;
 
 error:
-	g_free(response);
 	CALLBACK_WITH_FAILURE(cb, -1, -1, -1, NULL,
 				EF_STATUS_INVALIDATED, cbd->data);
 }
@@ -294,6 +338,49 @@ done:
 	return encode_hex(comm_path, len, 0);
 }
 
+/* Request parcels up to this many 32-bit words are built on the stack */
+#define SIM_IO_PARCEL_INLINE 64
+
+/* All SIM IO requests share the same layout, so it is sized up front */
+static void sim_io_parcel(struct sim_data *sd, struct parcel *rilp,
+				uint32_t *buf, int cmd, int fileid,
+				const char *hex_path, int p1, int p2, int p3,
+				const char *hex_data)
+{
+	gboolean mtk = g_ril_vendor(sd->ril) == OFONO_RIL_VENDOR_MTK;
+	size_t size = 5 * PARCEL_INT32_SIZE +
+				parcel_string_size(hex_path) +
+				parcel_string_size(hex_data) +
+				parcel_string_size(NULL) +
+				parcel_string_size(sd->aid_str);
+
+	if (mtk)
+		size += PARCEL_INT32_SIZE;
+
+	if (size <= SIM_IO_PARCEL_INLINE * sizeof(uint32_t))
+		parcel_init_buf(rilp, buf, size);
+	else
+		parcel_init_sized(rilp, size);
+
+	parcel_w_int32(rilp, cmd);
+	parcel_w_int32(rilp, fileid);
+	parcel_w_string(rilp, hex_path);
+	parcel_w_int32(rilp, p1);
+	parcel_w_int32(rilp, p2);
+	parcel_w_int32(rilp, p3);
+	parcel_w_string(rilp, hex_data);	/* data; only for writes */
+	parcel_w_string(rilp, NULL);		/* pin2; only for FDN/BDN */
+	parcel_w_string(rilp, sd->aid_str);	/* AID (Application ID) */
+
+	/*
+	 * sessionId, specific to latest MTK modems (harmless for older ones).
+	 * It looks like this field selects one or another SIM application, but
+	 * we use only one at a time so using zero here seems safe.
+	 */
+	if (mtk)
+		parcel_w_int32(rilp, 0);
+}
+
 static void ril_sim_read_info(struct ofono_sim *sim, int fileid,
 				const unsigned char *path,
 				unsigned int path_len,
@@ -302,6 +389,7 @@ static void ril_sim_read_info(struct ofono_sim *sim, int fileid,
 	struct sim_data *sd = ofono_sim_get_data(sim);
 	struct cb_data *cbd = cb_data_new(cb, data, sd);
 	struct parcel rilp;
+	uint32_t buf[SIM_IO_PARCEL_INLINE];
 	char *hex_path;
 
 	DBG("file %04x", fileid);
@@ -313,14 +401,6 @@ static void ril_sim_read_info(struct ofono_sim *sim, int fileid,
 		goto error;
 	}
 
-	parcel_init(&rilp);
-
-	parcel_w_int32(&rilp, CMD_GET_RESPONSE);
-	parcel_w_int32(&rilp, fileid);
-	parcel_w_string(&rilp, hex_path);
-	parcel_w_int32(&rilp, 0);           /* P1 */
-	parcel_w_int32(&rilp, 0);           /* P2 */
-
 	/*
 	 * TODO: review parameters values used by Android.
 	 * The values of P1-P3 in this code were based on
@@ -329,18 +409,8 @@ static void ril_sim_read_info(struct ofono_sim *sim, int fileid,
 	 * NOTE:
 	 * GET_RESPONSE_EF_SIZE_BYTES == 15; !255
 	 */
-	parcel_w_int32(&rilp, 15);         /* P3 - max length */
-	parcel_w_string(&rilp, NULL);       /* data; only req'd for writes */
-	parcel_w_string(&rilp, NULL);       /* pin2; only req'd for writes */
-	parcel_w_string(&rilp, sd->aid_str); /* AID (Application ID) */
-
-	/*
-	 * sessionId, specific to latest MTK modems (harmless for older ones).
-	 * It looks like this field selects one or another SIM application, but
-	 * we use only one at a time so using zero here seems safe.
-	 */
-	if (g_ril_vendor(sd->ril) == OFONO_RIL_VENDOR_MTK)
-		parcel_w_int32(&rilp, 0);
+	sim_io_parcel(sd, &rilp, buf, CMD_GET_RESPONSE, fileid, hex_path,
+							0, 0, 15, NULL);
 
 	g_ril_append_print_buf(sd->ril, "(cmd=0x%.2X,efid=0x%.4X,path=%s,"
 					"0,0,15,(null),pin2=(null),aid=%s)",
@@ -364,9 +434,8 @@ static void ril_file_io_cb(struct ril_msg *message, gpointer user_data)
 	ofono_sim_read_cb_t cb = cbd->cb;
 	struct sim_data *sd = cbd->user;
 	int sw1, sw2;
-	char *hex_response;
-	unsigned char *response = NULL;
-	size_t len;
+	unsigned char response[SIM_IO_RESPONSE_MAX];
+	long len;
 
 	if (message->error != RIL_E_SUCCESS) {
 		ofono_error("RILD reply failure: %s",
@@ -374,27 +443,18 @@ static void ril_file_io_cb(struct ril_msg *message, gpointer user_data)
 		goto error;
 	}
 
-	if (parse_sim_io(sd->ril, message, &sw1, &sw2, &hex_response) == FALSE)
+	if (parse_sim_io(sd->ril, message, &sw1, &sw2, response, &len) == FALSE)
 		goto error;
 
-	if (hex_response == NULL)
-		goto error;
-
-	response = decode_hex(hex_response, -1, &len, -1);
-	g_free(hex_response);
-	hex_response = NULL;
-
-	if (response == NULL || len == 0) {
+	if (len <= 0) {
 		ofono_error("Null SIM IO response from RILD");
 		goto error;
 	}
 
 	CALLBACK_WITH_SUCCESS(cb, response, len, cbd->data);
-	g_free(response);
 	return;
 
 error:
-	g_free(response);
 	CALLBACK_WITH_FAILURE(cb, NULL, 0, cbd->data);
 }
 
@@ -404,7 +464,7 @@ static void ril_file_write_cb(struct ril_msg *message, gpointer user_data)
 	ofono_sim_write_cb_t cb = cbd->cb;
 	struct sim_data *sd = cbd->user;
 	int sw1, sw2;
-	char *hex_response;
+	long len;
 
 	if (message->error != RIL_E_SUCCESS) {
 		ofono_error("%s: RILD reply failure: %s",
@@ -412,11 +472,9 @@ static void ril_file_write_cb(struct ril_msg *message, gpointer user_data)
 		goto error;
 	}
 
-	if (parse_sim_io(sd->ril, message, &sw1, &sw2, &hex_response) == FALSE)
+	if (parse_sim_io(sd->ril, message, &sw1, &sw2, NULL, &len) == FALSE)
 		goto error;
 
-	g_free(hex_response);
-
 	if ((sw1 != 0x90 && sw1 != 0x91 && sw1 != 0x92 && sw1 != 0x9f) ||
 			(sw1 == 0x90 && sw2 != 0x00)) {
 		struct ofono_error error;
@@ -447,6 +505,7 @@ static void ril_sim_read_binary(struct ofono_sim *sim, int fileid,
 	struct cb_data *cbd = cb_data_new(cb, data, sd);
 	char *hex_path;
 	struct parcel rilp;
+	uint32_t buf[SIM_IO_PARCEL_INLINE];
 
 	DBG("file %04x", fileid);
 
@@ -457,20 +516,8 @@ static void ril_sim_read_binary(struct ofono_sim *sim, int fileid,
 		goto error;
 	}
 
-	parcel_init(&rilp);
-	parcel_w_int32(&rilp, CMD_READ_BINARY);
-	parcel_w_int32(&rilp, fileid);
-	parcel_w_string(&rilp, hex_path);
-	parcel_w_int32(&rilp, start >> 8);   /* P1 */
-	parcel_w_int32(&rilp, start & 0xff); /* P2 */
-	parcel_w_int32(&rilp, length);         /* P3 */
-	parcel_w_string(&rilp, NULL);          /* data; only req'd for writes */
-	parcel_w_string(&rilp, NULL);          /* pin2; only req'd for writes */
-	parcel_w_string(&rilp, sd->aid_str);
-
-	/* sessionId, specific to latest MTK modems (harmless for older ones) */
-	if (g_ril_vendor(sd->ril) == OFONO_RIL_VENDOR_MTK)
-		parcel_w_int32(&rilp, 0);
+	sim_io_parcel(sd, &rilp, buf, CMD_READ_BINARY, fileid, hex_path,
+				start >> 8, start & 0xff, length, NULL);
 
 	g_ril_append_print_buf(sd->ril, "(cmd=0x%.2X,efid=0x%.4X,path=%s,"
 					"%d,%d,%d,(null),pin2=(null),aid=%s)",
@@ -498,6 +545,7 @@ static void ril_sim_read_record(struct ofono_sim *sim, int fileid,
 	struct cb_data *cbd = cb_data_new(cb, data, sd);
 	char *hex_path;
 	struct parcel rilp;
+	uint32_t buf[SIM_IO_PARCEL_INLINE];
 
 	DBG("file %04x", fileid);
 
@@ -508,20 +556,8 @@ static void ril_sim_read_record(struct ofono_sim *sim, int fileid,
 		goto error;
 	}
 
-	parcel_init(&rilp);
-	parcel_w_int32(&rilp, CMD_READ_RECORD);
-	parcel_w_int32(&rilp, fileid);
-	parcel_w_string(&rilp, hex_path);
-	parcel_w_int32(&rilp, record);      /* P1 */
-	parcel_w_int32(&rilp, 4);           /* P2 */
-	parcel_w_int32(&rilp, length);      /* P3 */
-	parcel_w_string(&rilp, NULL);       /* data; only req'd for writes */
-	parcel_w_string(&rilp, NULL);       /* pin2; only req'd for writes */
-	parcel_w_string(&rilp, sd->aid_str); /* AID (Application ID) */
-
-	/* sessionId, specific to latest MTK modems (harmless for older ones) */
-	if (g_ril_vendor(sd->ril) == OFONO_RIL_VENDOR_MTK)
-		parcel_w_int32(&rilp, 0);
+	sim_io_parcel(sd, &rilp, buf, CMD_READ_RECORD, fileid, hex_path,
+						record, 4, length, NULL);
 
 	g_ril_append_print_buf(sd->ril, "(cmd=0x%.2X,efid=0x%.4X,path=%s,"
 					"%d,%d,%d,(null),pin2=(null),aid=%s)",
@@ -549,6 +585,7 @@ static void ril_sim_update_binary(struct ofono_sim *sim, int fileid,
 	struct cb_data *cbd = cb_data_new(cb, data, sd);
 	char *hex_path;
 	struct parcel rilp;
+	uint32_t buf[SIM_IO_PARCEL_INLINE];
 	char *hex_data;
 	int p1, p2;
 
@@ -565,20 +602,8 @@ static void ril_sim_update_binary(struct ofono_sim *sim, int fileid,
 	p2 = start & 0xff;
 	hex_data = encode_hex(value, length, 0);
 
-	parcel_init(&rilp);
-	parcel_w_int32(&rilp, CMD_UPDATE_BINARY);
-	parcel_w_int32(&rilp, fileid);
-	parcel_w_string(&rilp, hex_path);
-	parcel_w_int32(&rilp, p1);		/* P1 */
-	parcel_w_int32(&rilp, p2);		/* P2 */
-	parcel_w_int32(&rilp, length);		/* P3 (Lc) */
-	parcel_w_string(&rilp, hex_data);	/* data */
-	parcel_w_string(&rilp, NULL);		/* pin2; only for FDN/BDN */
-	parcel_w_string(&rilp, sd->aid_str);	/* AID (Application ID) */
-
-	/* sessionId, specific to latest MTK modems (harmless for older ones) */
-	if (g_ril_vendor(sd->ril) == OFONO_RIL_VENDOR_MTK)
-		parcel_w_int32(&rilp, 0);
+	sim_io_parcel(sd, &rilp, buf, CMD_UPDATE_BINARY, fileid, hex_path,
+						p1, p2, length, hex_data);
 
 	g_ril_append_print_buf(sd->ril, "(cmd=0x%02X,efid=0x%04X,path=%s,"
 					"%d,%d,%d,%s,pin2=(null),aid=%s),",
@@ -608,6 +633,7 @@ static void update_record(struct ofono_sim *sim, int fileid,
 	struct cb_data *cbd = cb_data_new(cb, data, sd);
 	char *hex_path;
 	struct parcel rilp;
+	uint32_t buf[SIM_IO_PARCEL_INLINE];
 	char *hex_data;
 
 	DBG("file 0x%04x", fileid);
@@ -621,20 +647,8 @@ static void update_record(struct ofono_sim *sim, int fileid,
 
 	hex_data = encode_hex(value, length, 0);
 
-	parcel_init(&rilp);
-	parcel_w_int32(&rilp, CMD_UPDATE_RECORD);
-	parcel_w_int32(&rilp, fileid);
-	parcel_w_string(&rilp, hex_path);
-	parcel_w_int32(&rilp, record);	/* P1 */
-	parcel_w_int32(&rilp, access_mode);	/* P2 (access mode) */
-	parcel_w_int32(&rilp, length);	/* P3 (Lc) */
-	parcel_w_string(&rilp, hex_data);	/* data */
-	parcel_w_string(&rilp, NULL);		/* pin2; only for FDN/BDN */
-	parcel_w_string(&rilp, sd->aid_str);	/* AID (Application ID) */
-
-	/* sessionId, specific to latest MTK modems (harmless for older ones) */
-	if (g_ril_vendor(sd->ril) == OFONO_RIL_VENDOR_MTK)
-		parcel_w_int32(&rilp, 0);
+	sim_io_parcel(sd, &rilp, buf, CMD_UPDATE_RECORD, fileid, hex_path,
+					record, access_mode, length, hex_data);
 
 	g_ril_append_print_buf(sd->ril, "(cmd=0x%02X,efid=0x%04X,path=%s,"
 					"%d,%d,%d,%s,pin2=(null),aid=%s)",
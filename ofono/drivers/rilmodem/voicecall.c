@@ -150,6 +150,7 @@ static void clcc_poll_cb(struct ril_msg *message, gpointer user_data)
 			message->error != RIL_E_RADIO_NOT_AVAILABLE) {
 		ofono_error("We are polling CLCC and received an error");
 		ofono_error("All bets are off for call management");
+		ofono_voicecall_poll_done(vc, FALSE);
 		return;
 	}
 
@@ -305,19 +306,22 @@ no_calls:
 
 	vd->calls = calls;
 	vd->local_release = 0;
+
+	/*
+	 * RIL reports every call state change with
+	 * RIL_UNSOL_RESPONSE_CALL_STATE_CHANGED, calls in a transient
+	 * state don't need to be polled.
+	 */
+	ofono_voicecall_poll_done(vc, FALSE);
 }
 
-gboolean ril_poll_clcc(gpointer user_data)
+void ril_poll_clcc(struct ofono_voicecall *vc)
 {
-	struct ofono_voicecall *vc = user_data;
 	struct ril_voicecall_data *vd = ofono_voicecall_get_data(vc);
 
-	g_ril_send(vd->ril, RIL_REQUEST_GET_CURRENT_CALLS, NULL,
-			clcc_poll_cb, vc, NULL);
-
-	vd->clcc_source = 0;
-
-	return FALSE;
+	if (g_ril_send(vd->ril, RIL_REQUEST_GET_CURRENT_CALLS, NULL,
+			clcc_poll_cb, vc, NULL) <= 0)
+		ofono_voicecall_poll_done(vc, FALSE);
 }
 
 static void generic_cb(struct ril_msg *message, gpointer user_data)
@@ -348,8 +352,7 @@ static void generic_cb(struct ril_msg *message, gpointer user_data)
 	}
 
 out:
-	g_ril_send(vd->ril, RIL_REQUEST_GET_CURRENT_CALLS, NULL,
-			clcc_poll_cb, req->vc, NULL);
+	ofono_voicecall_poll_request(req->vc, 0);
 
 	/* We have to callback after we schedule a poll if required */
 	if (req->cb)
@@ -408,9 +411,7 @@ static void rild_cb(struct ril_msg *message, gpointer user_data)
 	g_ril_print_response_no_args(vd->ril, message);
 
 	/* CLCC will update the oFono call list with proper ids  */
-	if (!vd->clcc_source)
-		vd->clcc_source = g_timeout_add(POLL_CLCC_INTERVAL,
-						ril_poll_clcc, vc);
+	ofono_voicecall_poll_request(vc, POLL_CLCC_INTERVAL);
 
 	/* we cannot answer just yet since we don't know the call id */
 	vd->cb = cb;
@@ -595,9 +596,7 @@ void ril_call_state_notify(struct ril_msg *message, gpointer user_data)
 	g_ril_print_unsol_no_args(vd->ril, message);
 
 	/* Just need to request the call list again */
-	ril_poll_clcc(vc);
-
-	return;
+	ofono_voicecall_poll_request(vc, 0);
 }
 
 static void ril_ss_notify(struct ril_msg *message, gpointer user_data)
@@ -796,7 +795,7 @@ static gboolean ril_delayed_register(gpointer user_data)
 	ofono_voicecall_register(vc);
 
 	/* Initialize call list */
-	ril_poll_clcc(vc);
+	ofono_voicecall_poll_request(vc, 0);
 
 	/* Unsol when call state changes */
 	g_ril_register(vd->ril, RIL_UNSOL_RESPONSE_CALL_STATE_CHANGED,
@@ -833,6 +832,8 @@ int ril_voicecall_probe(struct ofono_voicecall *vc, unsigned int vendor,
 	clear_dtmf_queue(vd);
 
 	ofono_voicecall_set_data(vc, vd);
+	ofono_voicecall_poll_init(vc, ril_poll_clcc, POLL_CLCC_INTERVAL,
+							POLL_CLCC_INTERVAL);
 
 	g_idle_add(ril_delayed_register, vc);
 
@@ -843,9 +844,6 @@ void ril_voicecall_remove(struct ofono_voicecall *vc)
 {
 	struct ril_voicecall_data *vd = ofono_voicecall_get_data(vc);
 
-	if (vd->clcc_source)
-		g_source_remove(vd->clcc_source);
-
 	g_slist_free_full(vd->calls, g_free);
 
 	ofono_voicecall_set_data(vc, NULL);
@@ -23,7 +23,6 @@ struct ril_voicecall_data {
 	GSList *calls;
 	/* Call local hangup indicator, one bit per call (1 << call_id) */
 	unsigned int local_release;
-	unsigned int clcc_source;
 	GRil *ril;
 	unsigned int vendor;
 	unsigned char flags;
@@ -63,4 +62,4 @@ void ril_release_all_active(struct ofono_voicecall *vc,
 				ofono_voicecall_cb_t cb, void *data);
 
 void ril_call_state_notify(struct ril_msg *message, gpointer user_data);
-gboolean ril_poll_clcc(gpointer user_data);
+void ril_poll_clcc(struct ofono_voicecall *vc);
@@ -35,6 +35,7 @@
 #include "ringbuffer.h"
 #include "gatchat.h"
 #include "gatio.h"
+#include "probes.h"
 
 /* #define WRITE_SCHEDULER_DEBUG 1 */
 
@@ -440,6 +441,8 @@ static void at_chat_finish_command(struct at_chat *p, gboolean ok, char *final)
 	if (cmd == NULL)
 		return;
 
+	OFONO_PROBE3(at_done, p, cmd->id, ok);
+
 	p->cmd_bytes_written = 0;
 
 	if (g_queue_peek_head(p->command_queue))
@@ -919,6 +922,8 @@ static gboolean can_write_data(gpointer data)
 		chat->syntax->set_hint(chat->syntax,
 					G_AT_SYNTAX_EXPECT_SHORT_PROMPT);
 
+	OFONO_PROBE3(at_send, chat, cmd->id, cmd->cmd);
+
 	/* Full command submitted, update timer */
 	if (chat->wakeup_timer)
 		g_timer_start(chat->wakeup_timer);
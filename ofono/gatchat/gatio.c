@@ -35,6 +35,7 @@
 #include "ringbuffer.h"
 #include "gatio.h"
 #include "gatutil.h"
+#include "capture.h"
 
 struct _GAtIO {
 	gint ref_count;				/* Ref count */
@@ -55,8 +56,11 @@ struct _GAtIO {
 	GAtDisconnectFunc write_done_func;	/* tx empty notifier */
 	gpointer write_done_data;		/* tx empty data */
 	gboolean destroyed;			/* Re-entrancy guard */
+	guint capture_channel;			/* Channel in captures */
 };
 
+static guint capture_channels;
+
 static void read_watcher_destroy_notify(gpointer user_data)
 {
 	GAtIO *io = user_data;
@@ -112,8 +116,11 @@ static gboolean received_data(GIOChannel *channel, GIOCondition cond,
 
 		total_read += rbytes;
 
-		if (rbytes > 0)
+		if (rbytes > 0) {
+			capture_data(CAPTURE_AT, io->capture_channel,
+						CAPTURE_IN, buf, rbytes);
 			ring_buffer_write_advance(io->buf, rbytes);
+		}
 
 	} while (status == G_IO_STATUS_NORMAL && rbytes > 0 &&
 					read_count < io->max_read_attempts);
@@ -149,6 +156,8 @@ gsize g_at_io_write(GAtIO *io, const gchar *data, gsize count)
 
 	g_at_util_debug_chat(FALSE, data, bytes_written,
 				io->debugf, io->debug_data);
+	capture_data(CAPTURE_AT, io->capture_channel, CAPTURE_OUT,
+							data, bytes_written);
 
 	return bytes_written;
 }
@@ -195,6 +204,7 @@ static GAtIO *create_io(GIOChannel *channel, GIOFlags flags)
 
 	io->ref_count = 1;
 	io->debugf = NULL;
+	io->capture_channel = ++capture_channels;
 
 	if (flags & G_IO_FLAG_NONBLOCK) {
 		io->max_read_attempts = 3;
@@ -38,6 +38,7 @@
 #include "ringbuffer.h"
 #include "gatmux.h"
 #include "gsm0710.h"
+#include "capture.h"
 
 static const char *cmux_prefix[] = { "+CMUX:", NULL };
 static const char *none_prefix[] = { NULL };
@@ -55,6 +56,9 @@ typedef void (*GAtMuxWriteFrame)(GAtMux *mux, guint8 dlc, guint8 control,
 #define BITMAP_SIZE 8
 #define MUX_CHANNEL_BUFFER_SIZE 4096
 #define MUX_BUFFER_SIZE 4096
+#define MUX_WRITE_BUFFER_SIZE 4096
+#define MUX_WRITE_QUEUE_SIZE 1024	/* Power of 2 */
+#define MUX_SCHED_QUANTUM 256		/* Bytes per round per unit of weight */
 
 struct _GAtMuxChannel
 {
@@ -65,6 +69,19 @@ struct _GAtMuxChannel
 	GSList *sources;
 	gboolean throttled;
 	guint dlc;
+	GAtMuxPriority priority;
+	guint weight;
+	guint latency_budget;		/* ms, 0 if none */
+	int deficit;			/* Bytes it may still send this round */
+	gint64 pending_since;		/* Waiting for the tty since, or 0 */
+	GAtMuxChannelStats stats;
+};
+
+/* Frame sitting in the mux write buffer */
+struct mux_frame {
+	guint8 dlc;			/* 0 for control frames */
+	int len;			/* Bytes not yet written */
+	gint64 since;			/* When the DLC started waiting */
 };
 
 struct _GAtMuxWatch
@@ -89,6 +106,16 @@ struct _GAtMux {
 	void *driver_data;			/* Driver data */
 	char buf[MUX_BUFFER_SIZE];		/* Buffer on the main mux */
 	int buf_used;				/* Bytes of buf being used */
+	guint8 *wbuf;				/* Frames waiting for the tty */
+	int wbuf_size;				/* Bytes allocated for wbuf */
+	int wbuf_used;				/* Bytes of wbuf being used */
+	gboolean batch;				/* Collecting frames in wbuf */
+	struct mux_frame wqueue[MUX_WRITE_QUEUE_SIZE];	/* Frames in wbuf */
+	guint wqueue_first;			/* Oldest frame in wqueue */
+	guint wqueue_len;			/* Frames in wqueue */
+	guint64 queued;				/* Bytes passed to raw_write */
+	GAtMuxChannel *writer;			/* Channel being written */
+	int sched_next;				/* Round robin position */
 	gboolean shutdown;
 };
 
@@ -224,6 +251,8 @@ static void dispatch_sources(GAtMuxChannel *channel, GIOCondition condition)
 	g_slist_free_full(refs, (GDestroyNotify) g_source_unref);
 }
 
+static void wakeup_writer(GAtMux *mux);
+
 static gboolean received_data(GIOChannel *channel, GIOCondition cond,
 							gpointer data)
 {
@@ -249,9 +278,15 @@ static gboolean received_data(GIOChannel *channel, GIOCondition cond,
 
 		memset(mux->newdata, 0, BITMAP_SIZE);
 
+		/* Control responses generated by the driver go out together */
+		mux->batch = TRUE;
 		nread = mux->driver->feed_data(mux, mux->buf, mux->buf_used);
+		mux->batch = FALSE;
 		mux->buf_used -= nread;
 
+		if (mux->wbuf_used > 0)
+			wakeup_writer(mux);
+
 		if (mux->buf_used > 0)
 			memmove(mux->buf, mux->buf + nread, mux->buf_used);
 
@@ -288,50 +323,318 @@ static void write_watcher_destroy_notify(gpointer user_data)
 	mux->write_watch = 0;
 }
 
-static gboolean can_write_data(GIOChannel *chan, GIOCondition cond,
-				gpointer data)
+static void account_frame(GAtMux *mux, guint8 dlc, int len, gint64 since,
+							gint64 now)
 {
-	GAtMux *mux = data;
-	int dlc;
+	GAtMuxChannel *channel;
+	guint wait;
 
-	if (cond & (G_IO_NVAL | G_IO_HUP | G_IO_ERR))
+	if (dlc < 1 || dlc > MAX_CHANNELS)
+		return;
+
+	channel = mux->dlcs[dlc-1];
+	if (channel == NULL)
+		return;
+
+	wait = now > since ? now - since : 0;
+
+	channel->stats.frames++;
+	channel->stats.bytes += len;
+	channel->stats.total_wait += wait;
+
+	if (channel->stats.max_wait < wait)
+		channel->stats.max_wait = wait;
+}
+
+static void queue_frame(GAtMux *mux, int len)
+{
+	GAtMuxChannel *writer = mux->writer;
+	struct mux_frame *frame;
+
+	if (mux->wqueue_len == MUX_WRITE_QUEUE_SIZE) {
+		/* Can't happen with the current sizes, just don't track it */
+		frame = mux->wqueue + ((mux->wqueue_first + mux->wqueue_len -
+					1) & (MUX_WRITE_QUEUE_SIZE - 1));
+		frame->len += len;
+		return;
+	}
+
+	frame = mux->wqueue + ((mux->wqueue_first + mux->wqueue_len) &
+						(MUX_WRITE_QUEUE_SIZE - 1));
+	mux->wqueue_len++;
+
+	frame->len = len;
+
+	if (writer) {
+		frame->dlc = writer->dlc;
+		frame->since = writer->pending_since;
+
+		if (++writer->stats.queue_depth >
+					writer->stats.max_queue_depth)
+			writer->stats.max_queue_depth =
+					writer->stats.queue_depth;
+	} else {
+		frame->dlc = 0;
+		frame->since = 0;
+	}
+
+	if (frame->since == 0)
+		frame->since = g_get_monotonic_time();
+}
+
+static void dequeue_frames(GAtMux *mux, gsize bytes_written)
+{
+	gint64 now = g_get_monotonic_time();
+
+	while (bytes_written > 0 && mux->wqueue_len > 0) {
+		struct mux_frame *frame = mux->wqueue + mux->wqueue_first;
+		GAtMuxChannel *channel = NULL;
+
+		if ((gsize) frame->len > bytes_written) {
+			frame->len -= bytes_written;
+			break;
+		}
+
+		bytes_written -= frame->len;
+
+		if (frame->dlc >= 1 && frame->dlc <= MAX_CHANNELS)
+			channel = mux->dlcs[frame->dlc-1];
+
+		if (channel && channel->stats.queue_depth > 0)
+			channel->stats.queue_depth--;
+
+		account_frame(mux, frame->dlc, frame->len, frame->since, now);
+
+		mux->wqueue_first = (mux->wqueue_first + 1) &
+						(MUX_WRITE_QUEUE_SIZE - 1);
+		mux->wqueue_len--;
+	}
+}
+
+/*
+ * Pushes as much of the write buffer to the tty as it takes.  Whatever
+ * remains (a partial write) stays at the start of the buffer and goes
+ * out first next time, so frames are never interleaved.
+ */
+static void flush_write_buffer(GAtMux *mux)
+{
+	gsize bytes_written = 0;
+
+	if (mux->wbuf_used == 0)
+		return;
+
+	g_io_channel_write_chars(mux->channel, (gchar *) mux->wbuf,
+					mux->wbuf_used, &bytes_written, NULL);
+
+	debug(mux, "flushed %d of %d bytes", (int) bytes_written,
+							mux->wbuf_used);
+
+	dequeue_frames(mux, bytes_written);
+	mux->wbuf_used -= bytes_written;
+
+	if (mux->wbuf_used > 0)
+		memmove(mux->wbuf, mux->wbuf + bytes_written, mux->wbuf_used);
+	else if (mux->wbuf_size > MUX_WRITE_BUFFER_SIZE) {
+		/* Done with the backlog, back to the normal size */
+		mux->wbuf = g_realloc(mux->wbuf, MUX_WRITE_BUFFER_SIZE);
+		mux->wbuf_size = MUX_WRITE_BUFFER_SIZE;
+	}
+}
+
+static void clear_write_buffer(GAtMux *mux)
+{
+	int i;
+
+	for (i = 0; i < MAX_CHANNELS; i++) {
+		if (mux->dlcs[i])
+			mux->dlcs[i]->stats.queue_depth = 0;
+	}
+
+	mux->wbuf_used = 0;
+	mux->wqueue_first = 0;
+	mux->wqueue_len = 0;
+}
+
+static gboolean channel_wants_write(GAtMuxChannel *channel)
+{
+	GSList *l;
+
+	if (channel->throttled)
 		return FALSE;
 
-	debug(mux, "can write data");
+	for (l = channel->sources; l; l = l->next) {
+		GAtMuxWatch *source = l->data;
 
-	for (dlc = 0; dlc < MAX_CHANNELS; dlc += 1) {
-		GAtMuxChannel *channel = mux->dlcs[dlc];
+		if ((source->condition & G_IO_OUT) &&
+				!g_source_is_destroyed(&source->source))
+			return TRUE;
+	}
 
-		if (channel == NULL)
-			continue;
+	return FALSE;
+}
+
+/* Returns the number of bytes the channel has queued */
+static int service_channel(GAtMux *mux, int index)
+{
+	GAtMuxChannel *channel = mux->dlcs[index];
+	guint64 queued = mux->queued;
+
+	debug(mux, "dispatching write sources: %p", channel);
+
+	dispatch_sources(channel, G_IO_OUT);
+
+	/* The channel may have been closed by the callback */
+	if (mux->dlcs[index] != channel)
+		return 0;
+
+	if (channel_wants_write(channel))
+		channel->pending_since = g_get_monotonic_time();
+	else
+		channel->pending_since = 0;
+
+	return mux->queued - queued;
+}
+
+static gboolean write_buffer_full(GAtMux *mux)
+{
+	return mux->wbuf_used >= MUX_WRITE_BUFFER_SIZE / 2;
+}
+
+/*
+ * Control channels are served first, in every wakeup.  Then come the
+ * channels which have been waiting longer than their latency budget,
+ * and the rest share what is left of the write buffer in proportion
+ * to their weights (deficit round robin).
+ */
+static void schedule_writes(GAtMux *mux)
+{
+	gboolean served[MAX_CHANNELS];
+	gint64 now = g_get_monotonic_time();
+	gboolean waiting;
+	gboolean progress;
+	int i, n;
 
-		debug(mux, "checking channel for write: %p", channel);
+	memset(served, 0, sizeof(served));
 
-		if (channel->throttled)
+	for (i = 0; i < MAX_CHANNELS; i++) {
+		GAtMuxChannel *channel = mux->dlcs[i];
+
+		if (channel == NULL || channel->throttled)
 			continue;
 
-		debug(mux, "dispatching write sources: %p", channel);
+		if (channel->priority != G_AT_MUX_PRIORITY_CONTROL)
+			continue;
 
-		dispatch_sources(channel, G_IO_OUT);
+		service_channel(mux, i);
+		served[i] = TRUE;
 	}
 
-	for (dlc = 0; dlc < MAX_CHANNELS; dlc += 1) {
-		GAtMuxChannel *channel = mux->dlcs[dlc];
-		GSList *l;
-		GAtMuxWatch *source;
+	for (i = 0; i < MAX_CHANNELS; i++) {
+		GAtMuxChannel *channel = mux->dlcs[i];
 
-		if (channel == NULL)
+		if (channel == NULL || served[i] || !channel->latency_budget)
 			continue;
 
-		if (channel->throttled)
+		if (channel->pending_since == 0 || now - channel->pending_since
+				< (gint64) channel->latency_budget * 1000)
 			continue;
 
-		for (l = channel->sources; l; l = l->next) {
-			source = l->data;
+		if (!channel_wants_write(channel))
+			continue;
+
+		debug(mux, "channel %p over its latency budget", channel);
+
+		channel->deficit -= service_channel(mux, i);
+		served[i] = TRUE;
+	}
+
+	do {
+		waiting = FALSE;
+		progress = FALSE;
+
+		for (n = 0; n < MAX_CHANNELS && !write_buffer_full(mux); n++) {
+			GAtMuxChannel *channel;
+
+			i = (mux->sched_next + n) % MAX_CHANNELS;
+			channel = mux->dlcs[i];
+
+			if (channel == NULL || served[i])
+				continue;
+
+			if (!channel_wants_write(channel)) {
+				/* Nothing to send, nothing to save up */
+				channel->deficit = 0;
+				continue;
+			}
+
+			channel->deficit += channel->weight * MUX_SCHED_QUANTUM;
+
+			if (channel->deficit <= 0) {
+				waiting = TRUE;
+				continue;
+			}
+
+			served[i] = TRUE;
+			progress = TRUE;
+
+			while (channel->deficit > 0 && !write_buffer_full(mux)) {
+				int queued = service_channel(mux, i);
+
+				if (mux->dlcs[i] != channel)
+					break;
+
+				channel->deficit -= queued;
 
-			if (source->condition & G_IO_OUT)
-				return TRUE;
+				if (!channel_wants_write(channel)) {
+					channel->deficit = 0;
+					break;
+				}
+
+				if (queued == 0)
+					break;
+			}
 		}
+
+		/* Whoever didn't get a turn goes first next time */
+		mux->sched_next = (mux->sched_next + n) % MAX_CHANNELS;
+	} while (waiting && !progress && !write_buffer_full(mux));
+}
+
+static gboolean can_write_data(GIOChannel *chan, GIOCondition cond,
+				gpointer data)
+{
+	GAtMux *mux = data;
+	int dlc;
+
+	if (cond & (G_IO_NVAL | G_IO_HUP | G_IO_ERR))
+		return FALSE;
+
+	debug(mux, "can write data");
+
+	/* Finish what was left over from the last wakeup first */
+	flush_write_buffer(mux);
+
+	if (mux->wbuf_used > 0)
+		return TRUE;
+
+	/*
+	 * Frames written by the DLC sources are collected in wbuf and
+	 * sent to the tty with a single write once all of them had
+	 * their chance to run.
+	 */
+	mux->batch = TRUE;
+	schedule_writes(mux);
+	mux->batch = FALSE;
+	flush_write_buffer(mux);
+
+	if (mux->wbuf_used > 0)
+		return TRUE;
+
+	for (dlc = 0; dlc < MAX_CHANNELS; dlc += 1) {
+		GAtMuxChannel *channel = mux->dlcs[dlc];
+
+		if (channel && channel_wants_write(channel))
+			return TRUE;
 	}
 
 	return FALSE;
@@ -353,13 +656,56 @@ static void wakeup_writer(GAtMux *mux)
 
 int g_at_mux_raw_write(GAtMux *mux, const void *data, int towrite)
 {
-	gssize count = towrite;
-	gsize bytes_written;
+	int len = towrite;
+	gsize bytes_written = 0;
 
-	g_io_channel_write_chars(mux->channel, (gchar *) data,
-					count, &bytes_written, NULL);
+	mux->queued += towrite;
 
-	return bytes_written;
+	/* Straight to the tty unless there is something to queue behind */
+	if (!mux->batch && mux->wbuf_used == 0) {
+		g_io_channel_write_chars(mux->channel, (gchar *) data,
+					towrite, &bytes_written, NULL);
+
+		if (bytes_written == (gsize) towrite) {
+			if (mux->writer)
+				account_frame(mux, mux->writer->dlc, towrite,
+					mux->writer->pending_since ?
+					mux->writer->pending_since :
+					g_get_monotonic_time(),
+					g_get_monotonic_time());
+
+			return len;
+		}
+
+		/* The tty took only a part, the rest goes out later */
+		data = (const guint8 *) data + bytes_written;
+		towrite -= bytes_written;
+	}
+
+	if (mux->wbuf_used + towrite > mux->wbuf_size)
+		flush_write_buffer(mux);
+
+	/*
+	 * The tty isn't keeping up. Frames can't be dropped without
+	 * breaking the DLC, so hold on to this one until it can be sent.
+	 */
+	if (mux->wbuf_used + towrite > mux->wbuf_size) {
+		while (mux->wbuf_used + towrite > mux->wbuf_size)
+			mux->wbuf_size *= 2;
+
+		debug(mux, "write buffer full, growing to %d bytes",
+							mux->wbuf_size);
+		mux->wbuf = g_realloc(mux->wbuf, mux->wbuf_size);
+	}
+
+	memcpy(mux->wbuf + mux->wbuf_used, data, towrite);
+	mux->wbuf_used += towrite;
+	queue_frame(mux, towrite);
+
+	if (!mux->batch)
+		wakeup_writer(mux);
+
+	return len;
 }
 
 void g_at_mux_feed_dlc_data(GAtMux *mux, guint8 dlc,
@@ -381,6 +727,7 @@ void g_at_mux_feed_dlc_data(GAtMux *mux, guint8 dlc,
 	if (channel == NULL)
 		return;
 
+	capture_data(CAPTURE_MUX, dlc, CAPTURE_IN, data, tofeed);
 	written = ring_buffer_write(channel->buffer, data, tofeed);
 
 	if (written < 0)
@@ -485,12 +832,9 @@ static GIOStatus channel_read(GIOChannel *channel, gchar *buf, gsize count,
 					gsize *bytes_read, GError **err)
 {
 	GAtMuxChannel *mux_channel = (GAtMuxChannel *) channel;
-	unsigned int avail = ring_buffer_len_no_wrap(mux_channel->buffer);
-
-	if (avail > count)
-		avail = count;
 
-	*bytes_read = ring_buffer_read(mux_channel->buffer, buf, avail);
+	/* ring_buffer_read takes care of the wrap around */
+	*bytes_read = ring_buffer_read(mux_channel->buffer, buf, count);
 
 	if (*bytes_read == 0)
 		return G_IO_STATUS_AGAIN;
@@ -504,8 +848,13 @@ static GIOStatus channel_write(GIOChannel *channel, const gchar *buf,
 	GAtMuxChannel *mux_channel = (GAtMuxChannel *) channel;
 	GAtMux *mux = mux_channel->mux;
 
+	mux->writer = mux_channel;
+	capture_data(CAPTURE_MUX, mux_channel->dlc, CAPTURE_OUT, buf, count);
+
 	if (mux->driver->write)
 		mux->driver->write(mux, mux_channel->dlc, buf, count);
+
+	mux->writer = NULL;
 	*bytes_written = count;
 
 	return G_IO_STATUS_NORMAL;
@@ -522,7 +871,11 @@ static GIOStatus channel_close(GIOChannel *channel, GError **err)
 	GAtMuxChannel *mux_channel = (GAtMuxChannel *) channel;
 	GAtMux *mux = mux_channel->mux;
 
-	debug(mux, "closing channel: %d", mux_channel->dlc);
+	debug(mux, "closing channel: %d, %u frames %" G_GUINT64_FORMAT
+		" bytes, max queue %u, max wait %u us", mux_channel->dlc,
+		mux_channel->stats.frames, mux_channel->stats.bytes,
+		mux_channel->stats.max_queue_depth,
+		mux_channel->stats.max_wait);
 
 	dispatch_sources(mux_channel, G_IO_NVAL);
 
@@ -559,6 +912,9 @@ static GSource *channel_create_watch(GIOChannel *channel,
 
 	watch->condition = condition;
 
+	if ((watch->condition & G_IO_OUT) && dlc->pending_since == 0)
+		dlc->pending_since = g_get_monotonic_time();
+
 	if ((watch->condition & G_IO_OUT) && dlc->throttled == FALSE)
 		wakeup_writer(mux);
 
@@ -611,6 +967,14 @@ GAtMux *g_at_mux_new(GIOChannel *channel, const GAtMuxDriver *driver)
 	mux->driver = driver;
 	mux->shutdown = TRUE;
 
+	mux->wbuf = g_try_malloc(MUX_WRITE_BUFFER_SIZE);
+	if (mux->wbuf == NULL) {
+		g_free(mux);
+		return NULL;
+	}
+
+	mux->wbuf_size = MUX_WRITE_BUFFER_SIZE;
+
 	mux->channel = channel;
 	g_io_channel_ref(channel);
 
@@ -642,6 +1006,7 @@ void g_at_mux_unref(GAtMux *mux)
 		if (mux->driver->remove)
 			mux->driver->remove(mux);
 
+		g_free(mux->wbuf);
 		g_free(mux);
 	}
 }
@@ -690,6 +1055,13 @@ gboolean g_at_mux_shutdown(GAtMux *mux)
 	if (mux->write_watch > 0)
 		g_source_remove(mux->write_watch);
 
+	/*
+	 * Last chance for the queued frames.  From here on the close
+	 * frames go straight to the tty.
+	 */
+	flush_write_buffer(mux);
+	clear_write_buffer(mux);
+
 	for (i = 0; i < MAX_CHANNELS; i++) {
 		if (mux->dlcs[i] == NULL)
 			continue;
@@ -700,6 +1072,13 @@ gboolean g_at_mux_shutdown(GAtMux *mux)
 	if (mux->driver->shutdown)
 		mux->driver->shutdown(mux);
 
+	/* Whatever the tty doesn't take now is lost */
+	flush_write_buffer(mux);
+	clear_write_buffer(mux);
+
+	if (mux->write_watch > 0)
+		g_source_remove(mux->write_watch);
+
 	mux->shutdown = TRUE;
 
 	return TRUE;
@@ -765,6 +1144,8 @@ GIOChannel *g_at_mux_create_channel(GAtMux *mux)
 	mux_channel->dlc = i+1;
 	mux_channel->buffer = ring_buffer_new(MUX_CHANNEL_BUFFER_SIZE);
 	mux_channel->throttled = FALSE;
+	mux_channel->priority = G_AT_MUX_PRIORITY_NORMAL;
+	mux_channel->weight = 1;
 
 	mux->dlcs[i] = mux_channel;
 
@@ -773,6 +1154,71 @@ GIOChannel *g_at_mux_create_channel(GAtMux *mux)
 	return channel;
 }
 
+const guint8 *g_at_mux_channel_peek(GIOChannel *channel, gsize *len)
+{
+	GAtMuxChannel *mux_channel = (GAtMuxChannel *) channel;
+	int avail;
+
+	if (channel == NULL || channel->funcs != &channel_funcs) {
+		*len = 0;
+		return NULL;
+	}
+
+	avail = ring_buffer_len_no_wrap(mux_channel->buffer);
+	*len = avail;
+
+	if (avail == 0)
+		return NULL;
+
+	return ring_buffer_read_ptr(mux_channel->buffer, 0);
+}
+
+void g_at_mux_channel_consume(GIOChannel *channel, gsize len)
+{
+	GAtMuxChannel *mux_channel = (GAtMuxChannel *) channel;
+
+	if (channel == NULL || channel->funcs != &channel_funcs)
+		return;
+
+	ring_buffer_drain(mux_channel->buffer, len);
+}
+
+gboolean g_at_mux_channel_set_priority(GIOChannel *channel,
+					GAtMuxPriority priority, guint weight,
+					guint latency_budget)
+{
+	GAtMuxChannel *mux_channel = (GAtMuxChannel *) channel;
+
+	if (channel == NULL || channel->funcs != &channel_funcs)
+		return FALSE;
+
+	if (weight == 0)
+		return FALSE;
+
+	debug(mux_channel->mux, "channel %d priority %d weight %u budget %u",
+			mux_channel->dlc, priority, weight, latency_budget);
+
+	mux_channel->priority = priority;
+	mux_channel->weight = weight;
+	mux_channel->latency_budget = latency_budget;
+	mux_channel->deficit = 0;
+
+	return TRUE;
+}
+
+gboolean g_at_mux_channel_get_stats(GIOChannel *channel,
+					GAtMuxChannelStats *stats)
+{
+	GAtMuxChannel *mux_channel = (GAtMuxChannel *) channel;
+
+	if (channel == NULL || channel->funcs != &channel_funcs)
+		return FALSE;
+
+	*stats = mux_channel->stats;
+
+	return TRUE;
+}
+
 static void msd_free(gpointer user_data)
 {
 	struct mux_setup_data *msd = user_data;
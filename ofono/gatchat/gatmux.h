@@ -34,6 +34,8 @@ struct _GAtMux;
 typedef struct _GAtMux GAtMux;
 typedef struct _GAtMuxDriver GAtMuxDriver;
 typedef enum _GAtMuxChannelStatus GAtMuxChannelStatus;
+typedef enum _GAtMuxPriority GAtMuxPriority;
+typedef struct _GAtMuxChannelStats GAtMuxChannelStats;
 typedef void (*GAtMuxSetupFunc)(GAtMux *mux, gpointer user_data);
 
 enum _GAtMuxDlcStatus {
@@ -43,6 +45,20 @@ enum _GAtMuxDlcStatus {
 	G_AT_MUX_DLC_STATUS_DV = 0x80,
 };
 
+enum _GAtMuxPriority {
+	G_AT_MUX_PRIORITY_NORMAL = 0,
+	G_AT_MUX_PRIORITY_CONTROL,
+};
+
+struct _GAtMuxChannelStats {
+	guint queue_depth;		/* Frames waiting in the mux */
+	guint max_queue_depth;
+	guint frames;			/* Frames sent to the tty */
+	guint64 bytes;
+	guint64 total_wait;		/* Microseconds */
+	guint max_wait;			/* Microseconds */
+};
+
 struct _GAtMuxDriver {
 	void (*remove)(GAtMux *mux);
 	gboolean (*startup)(GAtMux *mux);
@@ -71,6 +87,37 @@ gboolean g_at_mux_set_debug(GAtMux *mux, GAtDebugFunc func, gpointer user_data);
 
 GIOChannel *g_at_mux_create_channel(GAtMux *mux);
 
+/*!
+ * Gives direct access to the data received on a channel created with
+ * g_at_mux_create_channel, without copying it out of the channel buffer.
+ * Returns the longest contiguous block of pending data and its length,
+ * or NULL if there is nothing to read.  The data stays in the channel
+ * until released with g_at_mux_channel_consume, which may be called
+ * repeatedly to walk through the whole buffer.
+ */
+const guint8 *g_at_mux_channel_peek(GIOChannel *channel, gsize *len);
+void g_at_mux_channel_consume(GIOChannel *channel, gsize len);
+
+/*!
+ * Sets how a channel shares the tty with the other channels of the mux.
+ * Control channels are always served first.  Normal channels share the
+ * remaining bandwidth in proportion to their weight, except that a
+ * channel which has been waiting longer than latency_budget milliseconds
+ * goes ahead of the others (0 means no budget).  By default a channel is
+ * normal, with weight 1 and no latency budget.
+ */
+gboolean g_at_mux_channel_set_priority(GIOChannel *channel,
+					GAtMuxPriority priority, guint weight,
+					guint latency_budget);
+
+/*!
+ * Returns the queue depth and wait time statistics of a channel.  The
+ * wait time of a frame is counted from the moment the channel asked to
+ * write until the frame was written to the tty.
+ */
+gboolean g_at_mux_channel_get_stats(GIOChannel *channel,
+					GAtMuxChannelStats *stats);
+
 /*!
  * Multiplexer driver integration functions
  */
@@ -117,6 +117,8 @@ struct _GAtServer {
 	gpointer debug_data;			/* Data to pass to debug func */
 	GHashTable *command_list;		/* List of AT commands */
 	GQueue *write_queue;			/* Write buffer queue */
+	GString *response;			/* Reply being assembled */
+	guint response_depth;			/* Nested response_begin */
 	guint max_read_attempts;		/* Max reads per select */
 	enum ParserState parser_state;
 	gboolean destroyed;			/* Re-entrancy guard */
@@ -145,7 +147,7 @@ static struct ring_buffer *allocate_next(GAtServer *server)
 	return buf;
 }
 
-static void send_common(GAtServer *server, const char *buf, unsigned int len)
+static void queue_output(GAtServer *server, const char *buf, gsize len)
 {
 	gsize towrite = len;
 	gsize bytes_written = 0;
@@ -153,6 +155,10 @@ static void send_common(GAtServer *server, const char *buf, unsigned int len)
 
 	write_buf = g_queue_peek_tail(server->write_queue);
 
+	/* Keep the reply contiguous so that it goes out in one write */
+	if (ring_buffer_len(write_buf) == 0)
+		ring_buffer_reset(write_buf);
+
 	while (bytes_written < towrite) {
 		gsize wbytes = MIN((gsize)ring_buffer_avail(write_buf),
 						towrite - bytes_written);
@@ -169,7 +175,45 @@ static void send_common(GAtServer *server, const char *buf, unsigned int len)
 				bytes_written < towrite)
 			write_buf = allocate_next(server);
 	}
+}
+
+/*
+ * While a command line is being processed, everything sent back to the
+ * client is assembled in server->response and handed to the writer in
+ * one go once the processing is done.
+ */
+static inline void response_begin(GAtServer *server)
+{
+	server->response_depth++;
+}
 
+static void response_flush(GAtServer *server)
+{
+	if (server->write_queue == NULL || server->response->len == 0)
+		return;
+
+	queue_output(server, server->response->str, server->response->len);
+	g_string_truncate(server->response, 0);
+	server_wakeup_writer(server);
+}
+
+static void response_end(GAtServer *server)
+{
+	if (--server->response_depth == 0)
+		response_flush(server);
+}
+
+static void send_common(GAtServer *server, const char *buf, unsigned int len)
+{
+	if (server->write_queue == NULL)
+		return;
+
+	if (server->response_depth > 0) {
+		g_string_append_len(server->response, buf, len);
+		return;
+	}
+
+	queue_output(server, buf, len);
 	server_wakeup_writer(server);
 }
 
@@ -232,8 +276,11 @@ void g_at_server_send_final(GAtServer *server, GAtServerResult result)
 	server->last_result = result;
 
 	if (result == G_AT_SERVER_RESULT_OK) {
-		if (server->final_async)
+		if (server->final_async) {
+			response_begin(server);
 			server_parse_line(server);
+			response_end(server);
+		}
 
 		return;
 	}
@@ -251,6 +298,13 @@ void g_at_server_send_ext_final(GAtServer *server, const char *result)
 void g_at_server_send_intermediate(GAtServer *server, const char *result)
 {
 	send_result_common(server, result);
+
+	/*
+	 * Intermediate results like CONNECT are usually followed by a
+	 * switch to another mode as soon as they have been written out,
+	 * don't hold them back.
+	 */
+	response_flush(server);
 }
 
 void g_at_server_send_unsolicited(GAtServer *server, const char *result)
@@ -1024,6 +1078,7 @@ static void new_bytes(struct ring_buffer *rbuf, gpointer user_data)
 	}
 
 	p->in_read_handler = TRUE;
+	response_begin(p);
 
 	while (p->io && (p->read_so_far < len)) {
 		gsize rbytes = MIN(len - p->read_so_far, wrap - p->read_so_far);
@@ -1101,6 +1156,7 @@ static void new_bytes(struct ring_buffer *rbuf, gpointer user_data)
 		}
 	}
 
+	response_end(p);
 	p->in_read_handler = FALSE;
 
 	if (p->destroyed)
@@ -1179,6 +1235,10 @@ static void g_at_server_cleanup(GAtServer *server)
 {
 	/* Cleanup pending data to write */
 	write_queue_free(server->write_queue);
+	server->write_queue = NULL;
+
+	g_string_free(server->response, TRUE);
+	server->response = NULL;
 
 	g_hash_table_destroy(server->command_list);
 	server->command_list = NULL;
@@ -1265,6 +1325,8 @@ GAtServer *g_at_server_new(GIOChannel *io)
 	if (!server->write_queue)
 		goto error;
 
+	server->response = g_string_sized_new(BUF_SIZE);
+
 	if (allocate_next(server) == NULL)
 		goto error;
 
@@ -1285,6 +1347,9 @@ error:
 	if (server->write_queue)
 		write_queue_free(server->write_queue);
 
+	if (server->response)
+		g_string_free(server->response, TRUE);
+
 	if (server)
 		g_free(server);
 
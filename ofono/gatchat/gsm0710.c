@@ -195,12 +195,21 @@ int gsm0710_advanced_fill_frame(guint8 *frame, guint8 dlc, guint8 type,
 	}
 
 	while (len > 0) {
-		temp = *data++ & 0xFF;
-		--len;
+		int run = 0;
+
+		/* Copy everything up to the next byte needing a quote */
+		while (run < len && data[run] != 0x7E && data[run] != 0x7D)
+			run++;
+
+		memcpy(frame + size, data, run);
+		size += run;
+		data += run;
+		len -= run;
+
+		if (len > 0) {
+			temp = *data++ & 0xFF;
+			--len;
 
-		if (temp != 0x7E && temp != 0x7D) {
-			frame[size++] = temp;
-		} else {
 			frame[size++] = 0x7D;
 			frame[size++] = (temp ^ 0x20);
 		}
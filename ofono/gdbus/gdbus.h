@@ -41,6 +41,7 @@ typedef struct GDBusMethodTable GDBusMethodTable;
 typedef struct GDBusSignalTable GDBusSignalTable;
 typedef struct GDBusPropertyTable GDBusPropertyTable;
 typedef struct GDBusSecurityTable GDBusSecurityTable;
+typedef struct GDBusCacheStats GDBusCacheStats;
 
 typedef void (* GDBusWatchFunction) (DBusConnection *connection,
 							void *user_data);
@@ -218,6 +219,15 @@ struct GDBusSecurityTable {
 void g_dbus_set_flags(int flags);
 int g_dbus_get_flags(void);
 
+struct GDBusCacheStats {
+	unsigned int introspect_hits;
+	unsigned int introspect_misses;
+	unsigned int objects_hits;
+	unsigned int objects_misses;
+};
+
+void g_dbus_get_cache_stats(GDBusCacheStats *stats);
+
 gboolean g_dbus_register_interface(DBusConnection *connection,
 					const char *path, const char *name,
 					const GDBusMethodTable *methods,
@@ -32,6 +32,7 @@
 #include <dbus/dbus.h>
 
 #include "gdbus.h"
+#include "probes.h"
 
 #define info(fmt...)
 #define error(fmt...)
@@ -52,20 +53,31 @@ struct generic_data {
 	DBusConnection *conn;
 	char *path;
 	GSList *interfaces;
+	GHashTable *interface_table;
 	GSList *objects;
 	GSList *added;
 	GSList *removed;
 	guint process_id;
 	gboolean pending_prop;
 	char *introspect;
+	DBusMessage *managed_objects;
 	struct generic_data *parent;
 };
 
+struct method_data {
+	const GDBusMethodTable *method;
+	char *signature;
+	struct method_data *next;
+};
+
 struct interface_data {
 	char *name;
 	const GDBusMethodTable *methods;
 	const GDBusSignalTable *signals;
 	const GDBusPropertyTable *properties;
+	struct method_data *method_data;
+	GHashTable *method_table;
+	GHashTable *property_table;
 	GSList *pending_prop;
 	void *user_data;
 	GDBusDestroyFunction destroy;
@@ -87,6 +99,7 @@ struct property_data {
 static int global_flags = 0;
 static struct generic_data *root;
 static GSList *pending = NULL;
+static GDBusCacheStats cache_stats;
 
 static gboolean process_changes(gpointer user_data);
 static void process_properties_from_interface(struct generic_data *data,
@@ -236,9 +249,12 @@ static DBusMessage *introspect(DBusConnection *connection,
 	struct generic_data *data = user_data;
 	DBusMessage *reply;
 
-	if (data->introspect == NULL)
+	if (data->introspect == NULL) {
+		cache_stats.introspect_misses++;
 		generate_introspection_xml(connection, data,
 						dbus_message_get_path(message));
+	} else
+		cache_stats.introspect_hits++;
 
 	reply = dbus_message_new_method_return(message);
 	if (reply == NULL)
@@ -256,8 +272,17 @@ static DBusHandlerResult process_message(DBusConnection *connection,
 {
 	DBusMessage *reply;
 
+	OFONO_PROBE4(dbus_method_entry, dbus_message_get_sender(message),
+					dbus_message_get_serial(message),
+					dbus_message_get_interface(message),
+					method->name);
+
 	reply = method->function(connection, message, iface_user_data);
 
+	OFONO_PROBE3(dbus_method_exit, dbus_message_get_sender(message),
+					dbus_message_get_serial(message),
+					reply != NULL);
+
 	if (method->flags & G_DBUS_METHOD_FLAG_NOREPLY) {
 		if (reply != NULL)
 			dbus_message_unref(reply);
@@ -594,21 +619,91 @@ static void emit_interfaces_added(struct generic_data *data)
 	dbus_message_unref(signal);
 }
 
-static struct interface_data *find_interface(GSList *interfaces,
+static struct interface_data *find_interface(struct generic_data *data,
 						const char *name)
 {
-	GSList *list;
-
 	if (name == NULL)
 		return NULL;
 
-	for (list = interfaces; list; list = list->next) {
-		struct interface_data *iface = list->data;
-		if (!strcmp(name, iface->name))
-			return iface;
+	return g_hash_table_lookup(data->interface_table, name);
+}
+
+static char *args_signature(const GDBusArgInfo *args)
+{
+	GString *sig = g_string_new(NULL);
+
+	for (; args && args->signature; args++)
+		g_string_append(sig, args->signature);
+
+	return g_string_free(sig, FALSE);
+}
+
+/*
+ * Builds the lookup tables used for dispatching method calls and
+ * property requests. Methods are hashed by name, with the overloads
+ * (if any) chained in the order of the method table. Input signatures
+ * get concatenated upfront so that matching the incoming message takes
+ * a single string comparison.
+ */
+static void interface_build_tables(struct interface_data *iface)
+{
+	const GDBusMethodTable *method;
+	const GDBusPropertyTable *property;
+	struct method_data *md;
+	int n = 0;
+
+	for (method = iface->methods; method &&
+			method->name && method->function; method++)
+		n++;
+
+	iface->method_data = g_new0(struct method_data, n + 1);
+	iface->method_table = g_hash_table_new(g_str_hash, g_str_equal);
+
+	for (md = iface->method_data, method = iface->methods;
+					md < iface->method_data + n;
+					md++, method++) {
+		struct method_data *prev;
+
+		md->method = method;
+		md->signature = args_signature(method->in_args);
+
+		prev = g_hash_table_lookup(iface->method_table, method->name);
+		if (prev == NULL) {
+			g_hash_table_insert(iface->method_table,
+					(gpointer) method->name, md);
+			continue;
+		}
+
+		while (prev->next)
+			prev = prev->next;
+
+		prev->next = md;
 	}
 
-	return NULL;
+	iface->property_table = g_hash_table_new(g_str_hash, g_str_equal);
+
+	for (property = iface->properties; property && property->name;
+								property++) {
+		/* The first one wins, like it always did */
+		if (g_hash_table_lookup(iface->property_table,
+						property->name) == NULL)
+			g_hash_table_insert(iface->property_table,
+					(gpointer) property->name,
+					(gpointer) property);
+	}
+}
+
+static void interface_free(struct interface_data *iface)
+{
+	struct method_data *md;
+
+	for (md = iface->method_data; md->method; md++)
+		g_free(md->signature);
+
+	g_free(iface->method_data);
+	g_hash_table_destroy(iface->method_table);
+	g_hash_table_destroy(iface->property_table);
+	g_free(iface);
 }
 
 static gboolean g_dbus_args_have_signature(const GDBusArgInfo *args,
@@ -632,6 +727,23 @@ static gboolean g_dbus_args_have_signature(const GDBusArgInfo *args,
 	return TRUE;
 }
 
+/*
+ * The GetManagedObjects reply is cached by the object implementing
+ * ObjectManager and covers its whole subtree, so any change to the
+ * interfaces or property values of an object drops the cached replies
+ * of all its ancestors.
+ */
+static void invalidate_objects(struct generic_data *data)
+{
+	for (; data != NULL; data = data->parent) {
+		if (data->managed_objects == NULL)
+			continue;
+
+		dbus_message_unref(data->managed_objects);
+		data->managed_objects = NULL;
+	}
+}
+
 static void add_pending(struct generic_data *data)
 {
 	if (data->process_id > 0)
@@ -646,13 +758,15 @@ static gboolean remove_interface(struct generic_data *data, const char *name)
 {
 	struct interface_data *iface;
 
-	iface = find_interface(data->interfaces, name);
+	iface = find_interface(data, name);
 	if (iface == NULL)
 		return FALSE;
 
 	process_properties_from_interface(data, iface);
+	invalidate_objects(data);
 
 	data->interfaces = g_slist_remove(data->interfaces, iface);
+	g_hash_table_remove(data->interface_table, iface->name);
 
 	if (iface->destroy) {
 		iface->destroy(iface->user_data);
@@ -666,18 +780,18 @@ static gboolean remove_interface(struct generic_data *data, const char *name)
 	if (g_slist_find(data->added, iface)) {
 		data->added = g_slist_remove(data->added, iface);
 		g_free(iface->name);
-		g_free(iface);
+		interface_free(iface);
 		return TRUE;
 	}
 
 	if (data->parent == NULL) {
 		g_free(iface->name);
-		g_free(iface);
+		interface_free(iface);
 		return TRUE;
 	}
 
 	data->removed = g_slist_prepend(data->removed, iface->name);
-	g_free(iface);
+	interface_free(iface);
 
 	add_pending(data);
 
@@ -728,29 +842,27 @@ static struct generic_data *invalidate_parent_data(DBusConnection *conn,
 
 	data->objects = g_slist_prepend(data->objects, child);
 	child->parent = data;
+	invalidate_objects(data);
 
 done:
 	g_free(parent_path);
 	return data;
 }
 
-static inline const GDBusPropertyTable *find_property(const GDBusPropertyTable *properties,
-							const char *name)
+static inline const GDBusPropertyTable *find_property(
+				struct interface_data *iface, const char *name)
 {
 	const GDBusPropertyTable *p;
 
-	for (p = properties; p && p->name; p++) {
-		if (strcmp(name, p->name) != 0)
-			continue;
+	if (name == NULL)
+		return NULL;
 
-		if (check_experimental(p->flags,
+	p = g_hash_table_lookup(iface->property_table, name);
+	if (p == NULL || check_experimental(p->flags,
 					G_DBUS_PROPERTY_FLAG_EXPERIMENTAL))
-			break;
-
-		return p;
-	}
+		return NULL;
 
-	return NULL;
+	return p;
 }
 
 static DBusMessage *properties_get(DBusConnection *connection,
@@ -769,12 +881,12 @@ static DBusMessage *properties_get(DBusConnection *connection,
 					DBUS_TYPE_INVALID))
 		return NULL;
 
-	iface = find_interface(data->interfaces, interface);
+	iface = find_interface(data, interface);
 	if (iface == NULL)
 		return g_dbus_create_error(message, DBUS_ERROR_INVALID_ARGS,
 				"No such interface '%s'", interface);
 
-	property = find_property(iface->properties, name);
+	property = find_property(iface, name);
 	if (property == NULL)
 		return g_dbus_create_error(message, DBUS_ERROR_INVALID_ARGS,
 				"No such property '%s'", name);
@@ -820,7 +932,7 @@ static DBusMessage *properties_get_all(DBusConnection *connection,
 					DBUS_TYPE_INVALID))
 		return NULL;
 
-	iface = find_interface(data->interfaces, interface);
+	iface = find_interface(data, interface);
 	if (iface == NULL)
 		return g_dbus_create_error(message, DBUS_ERROR_INVALID_ARGS,
 					"No such interface '%s'", interface);
@@ -875,12 +987,12 @@ static DBusMessage *properties_set(DBusConnection *connection,
 
 	dbus_message_iter_recurse(&iter, &sub);
 
-	iface = find_interface(data->interfaces, interface);
+	iface = find_interface(data, interface);
 	if (iface == NULL)
 		return g_dbus_create_error(message, DBUS_ERROR_INVALID_ARGS,
 					"No such interface '%s'", interface);
 
-	property = find_property(iface->properties, name);
+	property = find_property(iface, name);
 	if (property == NULL)
 		return g_dbus_create_error(message,
 						DBUS_ERROR_UNKNOWN_PROPERTY,
@@ -1016,8 +1128,10 @@ static void generic_unregister(DBusConnection *connection, void *user_data)
 	struct generic_data *data = user_data;
 	struct generic_data *parent = data->parent;
 
-	if (parent != NULL)
+	if (parent != NULL) {
 		parent->objects = g_slist_remove(parent->objects, data);
+		invalidate_objects(parent);
+	}
 
 	if (data->process_id > 0) {
 		g_source_remove(data->process_id);
@@ -1029,6 +1143,9 @@ static void generic_unregister(DBusConnection *connection, void *user_data)
 	g_slist_free(data->objects);
 
 	dbus_connection_unref(data->conn);
+	g_hash_table_destroy(data->interface_table);
+	if (data->managed_objects)
+		dbus_message_unref(data->managed_objects);
 	g_free(data->introspect);
 	g_free(data->path);
 	g_free(data);
@@ -1039,28 +1156,33 @@ static DBusHandlerResult generic_message(DBusConnection *connection,
 {
 	struct generic_data *data = user_data;
 	struct interface_data *iface;
-	const GDBusMethodTable *method;
-	const char *interface;
+	struct method_data *md;
+	const char *interface, *member, *signature;
+
+	if (dbus_message_get_type(message) != DBUS_MESSAGE_TYPE_METHOD_CALL)
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
 	interface = dbus_message_get_interface(message);
 
-	iface = find_interface(data->interfaces, interface);
+	iface = find_interface(data, interface);
 	if (iface == NULL)
 		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
-	for (method = iface->methods; method &&
-			method->name && method->function; method++) {
+	member = dbus_message_get_member(message);
+	if (member == NULL)
+		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
-		if (dbus_message_is_method_call(message, iface->name,
-							method->name) == FALSE)
-			continue;
+	signature = dbus_message_get_signature(message);
+
+	for (md = g_hash_table_lookup(iface->method_table, member); md;
+							md = md->next) {
+		const GDBusMethodTable *method = md->method;
 
 		if (check_experimental(method->flags,
 					G_DBUS_METHOD_FLAG_EXPERIMENTAL))
 			return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
-		if (g_dbus_args_have_signature(method->in_args,
-							message) == FALSE)
+		if (strcmp(md->signature, signature) != 0)
 			continue;
 
 		if (check_privilege(connection, message, method,
@@ -1128,6 +1250,23 @@ static DBusMessage *get_objects(DBusConnection *connection,
 	DBusMessageIter iter;
 	DBusMessageIter array;
 
+	if (data->managed_objects) {
+		cache_stats.objects_hits++;
+
+		/* The copy gets a new serial when it's sent */
+		reply = dbus_message_copy(data->managed_objects);
+		if (reply == NULL)
+			return NULL;
+
+		dbus_message_set_reply_serial(reply,
+					dbus_message_get_serial(message));
+		dbus_message_set_destination(reply,
+					dbus_message_get_sender(message));
+		return reply;
+	}
+
+	cache_stats.objects_misses++;
+
 	reply = dbus_message_new_method_return(message);
 	if (reply == NULL)
 		return NULL;
@@ -1153,6 +1292,8 @@ static DBusMessage *get_objects(DBusConnection *connection,
 
 	dbus_message_iter_close_container(&iter, &array);
 
+	data->managed_objects = dbus_message_ref(reply);
+
 	return reply;
 }
 
@@ -1213,8 +1354,11 @@ done:
 	iface->properties = properties;
 	iface->user_data = user_data;
 	iface->destroy = destroy;
+	interface_build_tables(iface);
 
 	data->interfaces = g_slist_append(data->interfaces, iface);
+	g_hash_table_insert(data->interface_table, iface->name, iface);
+	invalidate_objects(data);
 	if (data->parent == NULL)
 		return TRUE;
 
@@ -1241,6 +1385,7 @@ static struct generic_data *object_path_ref(DBusConnection *connection,
 	data = g_new0(struct generic_data, 1);
 	data->conn = dbus_connection_ref(connection);
 	data->path = g_strdup(path);
+	data->interface_table = g_hash_table_new(g_str_hash, g_str_equal);
 	data->refcount = 1;
 
 	data->introspect = g_strdup(DBUS_INTROSPECT_1_0_XML_DOCTYPE_DECL_NODE "<node></node>");
@@ -1248,6 +1393,7 @@ static struct generic_data *object_path_ref(DBusConnection *connection,
 	if (!dbus_connection_register_object_path(connection, path,
 						&generic_table, data)) {
 		dbus_connection_unref(data->conn);
+		g_hash_table_destroy(data->interface_table);
 		g_free(data->path);
 		g_free(data->introspect);
 		g_free(data);
@@ -1302,7 +1448,7 @@ static gboolean check_signal(DBusConnection *conn, const char *path,
 		return FALSE;
 	}
 
-	iface = find_interface(data->interfaces, interface);
+	iface = find_interface(data, interface);
 	if (iface == NULL) {
 		error("dbus_connection_emit_signal: %s does not implement %s",
 				path, interface);
@@ -1341,7 +1487,7 @@ gboolean g_dbus_register_interface(DBusConnection *connection,
 	if (data == NULL)
 		return FALSE;
 
-	if (find_interface(data->interfaces, name)) {
+	if (find_interface(data, name)) {
 		object_path_unref(connection, path);
 		return FALSE;
 	}
@@ -1352,7 +1498,7 @@ gboolean g_dbus_register_interface(DBusConnection *connection,
 		return FALSE;
 	}
 
-	if (properties != NULL && !find_interface(data->interfaces,
+	if (properties != NULL && !find_interface(data,
 						DBUS_INTERFACE_PROPERTIES))
 		add_interface(data, DBUS_INTERFACE_PROPERTIES,
 				properties_methods, properties_signals, NULL,
@@ -1500,6 +1646,10 @@ gboolean g_dbus_send_message(DBusConnection *connection, DBusMessage *message)
 	/* Flush pending signal to guarantee message order */
 	g_dbus_flush(connection);
 
+	OFONO_PROBE3(dbus_send, dbus_message_get_destination(message),
+				dbus_message_get_reply_serial(message),
+				dbus_message_get_type(message));
+
 	result = dbus_connection_send(connection, message, NULL);
 
 out:
@@ -1735,7 +1885,7 @@ void g_dbus_emit_property_changed(DBusConnection *connection,
 					(void **) &data) || data == NULL)
 		return;
 
-	iface = find_interface(data->interfaces, interface);
+	iface = find_interface(data, interface);
 	if (iface == NULL)
 		return;
 
@@ -1746,13 +1896,15 @@ void g_dbus_emit_property_changed(DBusConnection *connection,
 	if (root && g_slist_find(data->added, iface))
 		return;
 
-	property = find_property(iface->properties, name);
+	property = find_property(iface, name);
 	if (property == NULL) {
 		error("Could not find property %s in %p", name,
 							iface->properties);
 		return;
 	}
 
+	invalidate_objects(data);
+
 	if (g_slist_find(iface->pending_prop, (void *) property) != NULL)
 		return;
 
@@ -1776,7 +1928,7 @@ gboolean g_dbus_get_properties(DBusConnection *connection, const char *path,
 					(void **) &data) || data == NULL)
 		return FALSE;
 
-	iface = find_interface(data->interfaces, interface);
+	iface = find_interface(data, interface);
 	if (iface == NULL)
 		return FALSE;
 
@@ -1821,3 +1973,8 @@ int g_dbus_get_flags(void)
 {
 	return global_flags;
 }
+
+void g_dbus_get_cache_stats(GDBusCacheStats *stats)
+{
+	*stats = cache_stats;
+}
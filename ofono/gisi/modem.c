@@ -23,6 +23,7 @@
 #include <config.h>
 #endif
 
+#define _GNU_SOURCE
 #include <stdint.h>
 #include <string.h>
 #include <sys/types.h>
@@ -38,6 +39,12 @@
 #include "modem.h"
 #include "socket.h"
 
+#include "src/capture.h"
+
+/* Datagrams drained per wakeup, the length field of Phonet is 16 bits */
+#define ISI_RX_BATCH	8
+#define ISI_RX_MAX_LEN	65536
+
 #define ISIDBG(m, fmt, ...)				\
 	if ((m) != NULL && (m)->debug != NULL)		\
 		m->debug("gisi: "fmt, ##__VA_ARGS__);
@@ -56,6 +63,18 @@ struct _GIsiServiceMux {
 };
 typedef struct _GIsiServiceMux GIsiServiceMux;
 
+/*
+ * Receive buffers are allocated once per modem and shared by both
+ * channels.  The pages only become resident once the kernel writes
+ * into them, so the worst case size doesn't cost anything up front.
+ */
+struct isi_rx_pool {
+	struct mmsghdr msgs[ISI_RX_BATCH];
+	struct iovec iov[ISI_RX_BATCH];
+	struct sockaddr_pn addr[ISI_RX_BATCH];
+	uint32_t buf[ISI_RX_BATCH][ISI_RX_MAX_LEN / 4];
+};
+
 struct _GIsiModem {
 	unsigned index;
 	uint8_t device;
@@ -69,6 +88,8 @@ struct _GIsiModem {
 	GIsiNotifyFunc trace;
 	void *opaque;
 	unsigned long flags;
+	struct isi_rx_pool *rx;
+	gboolean *destroyed;
 };
 
 struct _GIsiPending {
@@ -276,12 +297,56 @@ static void firewall_notify_handle(GIsiModem *modem, GIsiMessage *msg)
 	ISIDBG(modem, "firewall blocked message 0x%02X", id);
 }
 
+static void isi_dispatch(GIsiModem *modem, int fd, struct sockaddr_pn *addr,
+				const void *buf, size_t len)
+{
+	GIsiServiceMux *mux;
+	GIsiMessage msg;
+	unsigned key;
+
+	if (len < 2)
+		return;
+
+	capture_data(CAPTURE_ISI, addr->spn_resource, CAPTURE_IN, buf, len);
+
+	msg.addr = addr;
+	msg.error = 0;
+	msg.data = buf;
+	msg.len = len;
+
+	if (modem->trace != NULL)
+		modem->trace(&msg, NULL);
+
+	key = addr->spn_resource;
+	mux = g_hash_table_lookup(modem->services, GINT_TO_POINTER(key));
+	if (mux == NULL) {
+		/*
+		 * Unfortunately, the FW report has the wrong
+		 * resource ID in the N900 modem.
+		 */
+		if (key == PN_FIREWALL)
+			firewall_notify_handle(modem, &msg);
+
+		return;
+	}
+
+	msg.version = &mux->version;
+
+	if (g_isi_msg_id(&msg) == COMMON_MESSAGE)
+		common_message_decode(mux, &msg);
+
+	service_dispatch(mux, &msg, fd == modem->ind_fd);
+}
+
 static gboolean isi_callback(GIOChannel *channel, GIOCondition cond,
 				gpointer data)
 {
 	GIsiModem *modem = data;
-	int len;
+	struct isi_rx_pool *rx = modem->rx;
+	gboolean destroyed = FALSE;
 	int fd;
+	int n;
+	int i;
 
 	if (cond & (G_IO_NVAL|G_IO_HUP)) {
 		ISIDBG(modem, "Unexpected event on PhoNet channel %p", channel);
@@ -289,49 +354,28 @@ static gboolean isi_callback(GIOChannel *channel, GIOCondition cond,
 	}
 
 	fd = g_io_channel_unix_get_fd(channel);
-	len = g_isi_phonet_peek_length(channel);
-
-	if (len > 0) {
-		struct sockaddr_pn addr;
-		uint32_t buf[(len + 3) / 4];
-
-		GIsiServiceMux *mux;
-		GIsiMessage msg;
-		unsigned key;
-
-		len = g_isi_phonet_read(channel, buf, len, &addr);
-		if (len < 2)
-			return TRUE;
-
-		msg.addr = &addr;
-		msg.error = 0;
-		msg.data = buf;
-		msg.len = len;
-
-		if (modem->trace != NULL)
-			modem->trace(&msg, NULL);
-
-		key = addr.spn_resource;
-		mux = g_hash_table_lookup(modem->services,
-						GINT_TO_POINTER(key));
-		if (mux == NULL) {
-			/*
-			 * Unfortunately, the FW report has the wrong
-			 * resource ID in the N900 modem.
-			 */
-			if (key == PN_FIREWALL)
-				firewall_notify_handle(modem, &msg);
-
-			return TRUE;
-		}
 
-		msg.version = &mux->version;
+	for (i = 0; i < ISI_RX_BATCH; i++) {
+		rx->msgs[i].msg_hdr.msg_namelen = sizeof(rx->addr[i]);
+		rx->msgs[i].msg_hdr.msg_flags = 0;
+	}
+
+	/* Drain whatever has queued up since the last wakeup */
+	n = g_isi_phonet_read_batch(channel, rx->msgs, ISI_RX_BATCH);
+	if (n <= 0)
+		return TRUE;
 
-		if (g_isi_msg_id(&msg) == COMMON_MESSAGE)
-			common_message_decode(mux, &msg);
+	/* Handlers are free to destroy the modem */
+	modem->destroyed = &destroyed;
 
-		service_dispatch(mux, &msg, fd == modem->ind_fd);
-	}
+	for (i = 0; i < n && !destroyed; i++)
+		isi_dispatch(modem, fd, rx->addr + i, rx->buf[i],
+						rx->msgs[i].msg_len);
+
+	if (destroyed)
+		return FALSE;
+
+	modem->destroyed = NULL;
 	return TRUE;
 }
 
@@ -475,6 +519,7 @@ GIsiModem *g_isi_modem_create(unsigned index)
 	GIsiModem *modem;
 	GIOChannel *inds;
 	GIOChannel *reqs;
+	int i;
 
 	if (index == 0) {
 		errno = ENODEV;
@@ -495,6 +540,27 @@ GIsiModem *g_isi_modem_create(unsigned index)
 		return NULL;
 	}
 
+	modem->rx = g_try_new(struct isi_rx_pool, 1);
+	if (modem->rx == NULL) {
+		g_io_channel_unref(reqs);
+		g_io_channel_unref(inds);
+		g_free(modem);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	for (i = 0; i < ISI_RX_BATCH; i++) {
+		struct msghdr *hdr = &modem->rx->msgs[i].msg_hdr;
+
+		modem->rx->iov[i].iov_base = modem->rx->buf[i];
+		modem->rx->iov[i].iov_len = sizeof(modem->rx->buf[i]);
+
+		memset(hdr, 0, sizeof(*hdr));
+		hdr->msg_name = modem->rx->addr + i;
+		hdr->msg_iov = modem->rx->iov + i;
+		hdr->msg_iovlen = 1;
+	}
+
 	modem->req_fd = g_io_channel_unix_get_fd(reqs);
 	modem->req_watch = g_io_add_watch(reqs,
 					G_IO_IN|G_IO_ERR|G_IO_HUP|G_IO_NVAL,
@@ -647,6 +713,10 @@ void g_isi_modem_destroy(GIsiModem *modem)
 	if (modem->req_watch > 0)
 		g_source_remove(modem->req_watch);
 
+	if (modem->destroyed != NULL)
+		*modem->destroyed = TRUE;
+
+	g_free(modem->rx);
 	g_free(modem);
 }
 
@@ -805,6 +875,9 @@ GIsiPending *g_isi_request_vsendto(GIsiModem *modem, struct sockaddr_pn *dst,
 	if (modem->trace != NULL)
 		vtrace(dst, _iov, 1 + iovlen, len, modem->trace);
 
+	capture_datav(CAPTURE_ISI, dst->spn_resource, CAPTURE_OUT,
+							_iov, 1 + iovlen);
+
 	ret = sendmsg(modem->req_fd, &msg, MSG_NOSIGNAL);
 	if (ret == -1)
 		goto error;
@@ -1122,6 +1195,9 @@ int g_isi_modem_vsendto(GIsiModem *modem, struct sockaddr_pn *dst,
 	if (modem->trace != NULL)
 		vtrace(dst, iov, iovlen, len, modem->trace);
 
+	capture_datav(CAPTURE_ISI, dst->spn_resource, CAPTURE_OUT,
+							iov, iovlen);
+
 	ret = sendmsg(modem->req_fd, &msg, MSG_NOSIGNAL);
 	if (ret == -1)
 		return -errno;
@@ -23,6 +23,7 @@
 #include <config.h>
 #endif
 
+#define _GNU_SOURCE
 #include <stdint.h>
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -91,3 +92,10 @@ ssize_t g_isi_phonet_read(GIOChannel *channel, void *restrict buf, size_t len,
 
 	return ret;
 }
+
+int g_isi_phonet_read_batch(GIOChannel *channel, struct mmsghdr *msgs,
+				unsigned int vlen)
+{
+	return recvmmsg(g_io_channel_unix_get_fd(channel), msgs, vlen,
+			MSG_DONTWAIT, NULL);
+}
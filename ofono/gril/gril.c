@@ -42,6 +42,7 @@
 #include "ringbuffer.h"
 #include "gril.h"
 #include "grilutil.h"
+#include "probes.h"
 
 #define RIL_TRACE(ril, fmt, arg...) do {	\
 	if (ril->trace == TRUE)			\
@@ -364,6 +365,9 @@ static void handle_response(struct ril_s *p, struct ril_msg *message)
 			found = TRUE;
 			message->req = req->req;
 
+			OFONO_PROBE4(ril_response, p->slot, message->serial_no,
+					message->req, message->error);
+
 			if (message->error != RIL_E_SUCCESS)
 				RIL_TRACE(p, "[%d,%04d]< %s failed %s",
 					p->slot, message->serial_no,
@@ -730,8 +734,9 @@ out:
 	ril->req_bytes_written += bytes_written;
 	if (bytes_written < towrite)
 		return TRUE;
-	else
-		ril->req_bytes_written = 0;
+
+	ril->req_bytes_written = 0;
+	OFONO_PROBE3(ril_request, ril->slot, req->id, req->req);
 
 	return FALSE;
 }
@@ -1049,6 +1054,7 @@ void g_ril_init_parcel(const struct ril_msg *message, struct parcel *rilp)
 	rilp->capacity = message->buf_len;
 	rilp->offset = 0;
 	rilp->malformed = 0;
+	rilp->borrowed = 1;
 }
 
 GRil *g_ril_new_with_ucred(const char *sock_path, enum ofono_ril_vendor vendor,
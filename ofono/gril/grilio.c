@@ -35,6 +35,7 @@
 #include "ringbuffer.h"
 #include "grilio.h"
 #include "grilutil.h"
+#include "capture.h"
 
 struct _GRilIO {
 	gint ref_count;				/* Ref count */
@@ -113,8 +114,12 @@ static gboolean received_data(GIOChannel *channel, GIOCondition cond,
 
 		total_read += rbytes;
 
-		if (rbytes > 0)
+		if (rbytes > 0) {
+			capture_data(CAPTURE_RIL,
+					g_io_channel_unix_get_fd(channel),
+					CAPTURE_IN, buf, rbytes);
 			ring_buffer_write_advance(io->buf, rbytes);
+		}
 
 	} while (status == G_IO_STATUS_NORMAL && rbytes > 0 &&
 					read_count < io->max_read_attempts);
@@ -150,6 +155,8 @@ gsize g_ril_io_write(GRilIO *io, const gchar *data, gsize count)
 
 	g_ril_util_debug_hexdump(FALSE, (guchar *) data, bytes_written,
 				io->debugf, io->debug_data);
+	capture_data(CAPTURE_RIL, g_io_channel_unix_get_fd(io->channel),
+					CAPTURE_OUT, data, bytes_written);
 
 	return bytes_written;
 }
@@ -46,6 +46,116 @@
 
 typedef uint16_t char16_t;
 
+/* Smallest code point for each UTF-8 sequence length, to catch overlongs */
+static const uint32_t utf8_min[] = { 0, 0x80, 0x800, 0x10000 };
+
+static const char *utf8_next(const char *str, uint32_t *cp)
+{
+	const unsigned char *u = (const unsigned char *) str;
+	uint32_t c = u[0];
+	int n, i;
+
+	if (c < 0x80) {
+		*cp = c;
+		return str + 1;
+	} else if ((c & 0xe0) == 0xc0) {
+		n = 1;
+		c &= 0x1f;
+	} else if ((c & 0xf0) == 0xe0) {
+		n = 2;
+		c &= 0x0f;
+	} else if ((c & 0xf8) == 0xf0) {
+		n = 3;
+		c &= 0x07;
+	} else {
+		return NULL;
+	}
+
+	/* This also stops at the terminating zero */
+	for (i = 1; i <= n; i++) {
+		if ((u[i] & 0xc0) != 0x80)
+			return NULL;
+
+		c = (c << 6) | (u[i] & 0x3f);
+	}
+
+	if (c < utf8_min[n] || (c >= 0xd800 && c <= 0xdfff) || c > 0x10ffff)
+		return NULL;
+
+	*cp = c;
+	return str + n + 1;
+}
+
+/* Returns the number of UTF-16 code units, out may be NULL to just count */
+static long utf8_to_utf16(const char *str, uint16_t *out)
+{
+	long len = 0;
+	uint32_t c;
+
+	while (*str) {
+		str = utf8_next(str, &c);
+		if (str == NULL)
+			return -1;
+
+		if (c < 0x10000) {
+			if (out)
+				out[len] = c;
+
+			len += 1;
+		} else {
+			if (out) {
+				out[len] = 0xd800 + ((c - 0x10000) >> 10);
+				out[len + 1] = 0xdc00 + ((c - 0x10000) & 0x3ff);
+			}
+
+			len += 2;
+		}
+	}
+
+	return len;
+}
+
+/* out must have room for len * 3 + 1 bytes */
+static int utf16_to_utf8(const uint16_t *in, size_t len, char *out)
+{
+	size_t i;
+
+	for (i = 0; i < len && in[i]; i++) {
+		uint32_t c = in[i];
+
+		if (c >= 0xdc00 && c <= 0xdfff)
+			return -1;
+
+		if (c >= 0xd800 && c <= 0xdbff) {
+			if (i + 1 == len || in[i + 1] < 0xdc00 ||
+						in[i + 1] > 0xdfff)
+				return -1;
+
+			c = 0x10000 + ((c - 0xd800) << 10) +
+						(in[++i] - 0xdc00);
+		}
+
+		if (c < 0x80) {
+			*out++ = c;
+		} else if (c < 0x800) {
+			*out++ = 0xc0 | (c >> 6);
+			*out++ = 0x80 | (c & 0x3f);
+		} else if (c < 0x10000) {
+			*out++ = 0xe0 | (c >> 12);
+			*out++ = 0x80 | ((c >> 6) & 0x3f);
+			*out++ = 0x80 | (c & 0x3f);
+		} else {
+			*out++ = 0xf0 | (c >> 18);
+			*out++ = 0x80 | ((c >> 12) & 0x3f);
+			*out++ = 0x80 | ((c >> 6) & 0x3f);
+			*out++ = 0x80 | (c & 0x3f);
+		}
+	}
+
+	*out = 0;
+	return 0;
+}
+
 void parcel_init(struct parcel *p)
 {
 	p->data = g_malloc0(sizeof(int32_t));
@@ -53,18 +163,63 @@ void parcel_init(struct parcel *p)
 	p->capacity = sizeof(int32_t);
 	p->offset = 0;
 	p->malformed = 0;
+	p->borrowed = 0;
+}
+
+/*
+ * Write into caller provided memory, which must be 4-byte aligned. If the
+ * data doesn't fit after all, it is moved to the heap.
+ */
+void parcel_init_buf(struct parcel *p, void *buf, size_t size)
+{
+	p->data = buf;
+	p->size = 0;
+	p->capacity = size;
+	p->offset = 0;
+	p->malformed = 0;
+	p->borrowed = 1;
+}
+
+/* For requests whose size is known up front, see parcel_string_size */
+void parcel_init_sized(struct parcel *p, size_t size)
+{
+	p->data = g_malloc(size);
+	p->size = 0;
+	p->capacity = size;
+	p->offset = 0;
+	p->malformed = 0;
+	p->borrowed = 0;
 }
 
 void parcel_grow(struct parcel *p, size_t size)
 {
-	char *new = g_realloc(p->data, p->capacity + size);
-	p->data = new;
-	p->capacity += size;
+	size_t capacity = MAX(p->capacity * 2, p->capacity + size);
+
+	if (p->borrowed) {
+		char *new = g_malloc(capacity);
+
+		memcpy(new, p->data, p->size);
+		p->data = new;
+		p->borrowed = 0;
+	} else {
+		p->data = g_realloc(p->data, capacity);
+	}
+
+	p->capacity = capacity;
+}
+
+static void parcel_reserve(struct parcel *p, size_t len)
+{
+	if (p->offset + len > p->capacity)
+		parcel_grow(p, p->offset + len - p->capacity);
 }
 
 void parcel_free(struct parcel *p)
 {
-	g_free(p->data);
+	if (!p->borrowed)
+		g_free(p->data);
+
+	p->data = NULL;
 	p->size = 0;
 	p->capacity = 0;
 	p->offset = 0;
@@ -90,134 +245,115 @@ int32_t parcel_r_int32(struct parcel *p)
 
 int parcel_w_int32(struct parcel *p, int32_t val)
 {
-	for (;;) {
-
-		if (p->offset + sizeof(int32_t) < p->capacity) {
-			/* There's enough space */
-			*((int32_t *) (void *) (p->data + p->offset)) = val;
-			p->offset += sizeof(int32_t);
-			p->size += sizeof(int32_t);
-			break;
-		} else {
-			/* Grow data and retry */
-			parcel_grow(p, sizeof(int32_t));
-		}
-	}
+	parcel_reserve(p, sizeof(int32_t));
+
+	*((int32_t *) (void *) (p->data + p->offset)) = val;
+	p->offset += sizeof(int32_t);
+	p->size += sizeof(int32_t);
+
 	return 0;
 }
 
+/* Number of bytes parcel_w_string will write for str */
+size_t parcel_string_size(const char *str)
+{
+	long len16 = str ? utf8_to_utf16(str, NULL) : -1;
+
+	if (len16 < 0)
+		return sizeof(int32_t);
+
+	return sizeof(int32_t) + PAD_SIZE((len16 + 1) * sizeof(char16_t));
+}
+
+/* Converts straight into the parcel, without an intermediate copy */
 int parcel_w_string(struct parcel *p, const char *str)
 {
-	gunichar2 *gs16;
-	glong gs16_len;
+	long len16;
 	size_t len;
-	size_t gs16_size;
+	size_t padded;
 
 	if (str == NULL) {
 		parcel_w_int32(p, -1);
 		return 0;
 	}
 
-	gs16 = g_utf8_to_utf16(str, -1, NULL, &gs16_len, NULL);
-
-	if (parcel_w_int32(p, gs16_len) == -1)
+	len16 = utf8_to_utf16(str, NULL);
+	if (len16 < 0) {
+		ofono_error("%s: wrong UTF8 coding", __func__);
+		parcel_w_int32(p, -1);
 		return -1;
+	}
 
-	gs16_size = gs16_len * sizeof(char16_t);
-	len = gs16_size + sizeof(char16_t);
-	for (;;) {
-		size_t padded = PAD_SIZE(len);
-
-		if (p->offset + len < p->capacity) {
-			/* There's enough space */
-			memcpy(p->data + p->offset, gs16, gs16_size);
-			*((char16_t *) (void *)
-				(p->data + p->offset + gs16_size)) = 0;
-			p->offset += padded;
-			p->size += padded;
-			if (padded != len) {
-
-#if BYTE_ORDER == BIG_ENDIAN
-				static const uint32_t mask[4] = {
-					0x00000000, 0xffffff00,
-					0xffff0000, 0xff000000
-				};
-#endif
-#if BYTE_ORDER == LITTLE_ENDIAN
-				static const uint32_t mask[4] = {
-					0x00000000, 0x00ffffff,
-					0x0000ffff, 0x000000ff
-				};
-#endif
+	parcel_w_int32(p, len16);
 
-				*((uint32_t *) (void *)
-					(p->data + p->offset - 4)) &=
-							mask[padded - len];
-			}
-			break;
+	len = (len16 + 1) * sizeof(char16_t);
+	padded = PAD_SIZE(len);
+	parcel_reserve(p, padded);
 
-		} else {
-			/* Grow data and retry */
-			parcel_grow(p, padded);
-		}
-	}
+	utf8_to_utf16(str, (uint16_t *) (void *) (p->data + p->offset));
+	memset(p->data + p->offset + len - sizeof(char16_t), 0,
+				padded - len + sizeof(char16_t));
+
+	p->offset += padded;
+	p->size += padded;
 
-	g_free(gs16);
 	return 0;
 }
 
-char *parcel_r_string(struct parcel *p)
+void parcel_r_str(struct parcel *p, struct parcel_str *str)
 {
-	char *ret;
 	int len16 = parcel_r_int32(p);
-	int strbytes;
+	size_t strbytes;
+
+	str->data = NULL;
+	str->len = 0;
 
 	if (p->malformed)
-		return NULL;
+		return;
 
 	/* This is how a null string is sent */
 	if (len16 < 0)
-		return NULL;
+		return;
 
 	strbytes = PAD_SIZE((len16 + 1) * sizeof(char16_t));
-	if (p->offset + strbytes > p->size) {
+	if ((size_t) len16 > p->size || p->offset + strbytes > p->size) {
 		ofono_error("%s: parcel is too small", __func__);
 		p->malformed = 1;
-		return NULL;
+		return;
 	}
 
-	ret = g_utf16_to_utf8((gunichar2 *) (void *) (p->data + p->offset),
-				len16, NULL, NULL, NULL);
-	if (ret == NULL) {
-		ofono_error("%s: wrong UTF16 coding", __func__);
-		p->malformed = 1;
-		return NULL;
-	}
+	str->data = (const uint16_t *) (void *) (p->data + p->offset);
+	str->len = len16;
 
 	p->offset += strbytes;
-
-	return ret;
 }
 
-void parcel_skip_string(struct parcel *p)
+char *parcel_r_string(struct parcel *p)
 {
-	int len16 = parcel_r_int32(p);
-	int strbytes;
+	struct parcel_str str;
+	char *ret;
 
-	if (p->malformed)
-		return;
+	parcel_r_str(p, &str);
+	if (str.data == NULL)
+		return NULL;
 
-	/* This is how a null string is sent */
-	if (len16 < 0)
-		return;
+	ret = g_malloc(str.len * 3 + 1);
 
-	strbytes = PAD_SIZE((len16 + 1) * sizeof(char16_t));
-	if (p->offset + strbytes > p->size) {
+	if (utf16_to_utf8(str.data, str.len, ret) < 0) {
+		ofono_error("%s: wrong UTF16 coding", __func__);
 		p->malformed = 1;
-		return;
+		g_free(ret);
+		return NULL;
 	}
 
-	p->offset += strbytes;
+	return ret;
+}
+
+void parcel_skip_string(struct parcel *p)
+{
+	struct parcel_str str;
+
+	parcel_r_str(p, &str);
 }
 
 int parcel_w_raw(struct parcel *p, const void *data, size_t len)
@@ -228,20 +364,12 @@ int parcel_w_raw(struct parcel *p, const void *data, size_t len)
 	}
 
 	parcel_w_int32(p, len);
+	parcel_reserve(p, len);
 
-	for (;;) {
+	memcpy(p->data + p->offset, data, len);
+	p->offset += len;
+	p->size += len;
 
-		if (p->offset + len < p->capacity) {
-			/* There's enough space */
-			memcpy(p->data + p->offset, data, len);
-			p->offset += len;
-			p->size += len;
-			break;
-		} else {
-			/* Grow data and retry */
-			parcel_grow(p, len);
-		}
-	}
 	return 0;
 }
 
@@ -298,3 +426,64 @@ char **parcel_r_strv(struct parcel *p)
 
 	return strv;
 }
+
+/* Compares against an ASCII string without converting */
+int parcel_str_equal(const struct parcel_str *str, const char *ascii)
+{
+	size_t i;
+
+	if (str->data == NULL || ascii == NULL)
+		return str->data == NULL && ascii == NULL;
+
+	for (i = 0; i < str->len; i++)
+		if (!ascii[i] || str->data[i] != (unsigned char) ascii[i])
+			return 0;
+
+	return ascii[i] == 0;
+}
+
+void parcel_scratch_init(struct parcel_scratch *s)
+{
+	s->buf = s->inline_buf;
+	s->size = sizeof(s->inline_buf);
+}
+
+void parcel_scratch_free(struct parcel_scratch *s)
+{
+	if (s->buf != s->inline_buf)
+		g_free(s->buf);
+
+	parcel_scratch_init(s);
+}
+
+/*
+ * Returns the string in UTF-8, valid until the scratch buffer is used
+ * again, or NULL for a null string or wrong UTF-16 coding. The latter
+ * marks the parcel as malformed.
+ */
+const char *parcel_str_utf8(struct parcel *p, const struct parcel_str *str,
+					struct parcel_scratch *s)
+{
+	size_t need;
+
+	if (str->data == NULL)
+		return NULL;
+
+	need = str->len * 3 + 1;
+
+	if (need > s->size) {
+		if (s->buf != s->inline_buf)
+			g_free(s->buf);
+
+		s->buf = g_malloc(need);
+		s->size = need;
+	}
+
+	if (utf16_to_utf8(str->data, str->len, s->buf) < 0) {
+		ofono_error("%s: wrong UTF16 coding", __func__);
+		p->malformed = 1;
+		return NULL;
+	}
+
+	return s->buf;
+}
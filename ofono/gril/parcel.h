@@ -31,19 +31,53 @@ struct parcel {
 	size_t capacity;
 	size_t size;
 	int malformed;
+	int borrowed;		/* data is owned by someone else */
 };
 
+/*
+ * String inside a parcel, valid as long as the parcel data is. The UTF-16
+ * data is neither copied nor converted until parcel_str_utf8 is called.
+ */
+struct parcel_str {
+	const uint16_t *data;	/* NULL for a null string */
+	size_t len;		/* In UTF-16 code units */
+};
+
+#define PARCEL_SCRATCH_SIZE 128
+
+/*
+ * Reusable UTF-8 conversion buffer. Strings which fit the inline buffer
+ * are converted without touching the heap. Must not be copied.
+ */
+struct parcel_scratch {
+	char *buf;
+	size_t size;
+	char inline_buf[PARCEL_SCRATCH_SIZE];
+};
+
+#define PARCEL_INT32_SIZE sizeof(int32_t)
+
 void parcel_init(struct parcel *p);
+void parcel_init_buf(struct parcel *p, void *buf, size_t size);
+void parcel_init_sized(struct parcel *p, size_t size);
 void parcel_grow(struct parcel *p, size_t size);
 void parcel_free(struct parcel *p);
 int32_t parcel_r_int32(struct parcel *p);
 int parcel_w_int32(struct parcel *p, int32_t val);
+size_t parcel_string_size(const char *str);
 int parcel_w_string(struct parcel *p, const char *str);
 char *parcel_r_string(struct parcel *p);
+void parcel_r_str(struct parcel *p, struct parcel_str *str);
 void parcel_skip_string(struct parcel *p);
 int parcel_w_raw(struct parcel *p, const void *data, size_t len);
 void *parcel_r_raw(struct parcel *p,  int *len);
 size_t parcel_data_avail(struct parcel *p);
 char **parcel_r_strv(struct parcel *p);
 
+int parcel_str_equal(const struct parcel_str *str, const char *ascii);
+void parcel_scratch_init(struct parcel_scratch *s);
+void parcel_scratch_free(struct parcel_scratch *s);
+const char *parcel_str_utf8(struct parcel *p, const struct parcel_str *str,
+					struct parcel_scratch *s);
+
 #endif
@@ -174,6 +174,9 @@ const char *ofono_dbus_access_method_name(enum ofono_dbus_access_intf intf,
 ofono_bool_t ofono_dbus_access_method_allowed(const char *sender,
 	enum ofono_dbus_access_intf iface, int method, const char *arg);
 
+/* Since 1.29+git4 - drops cached decisions after a policy change */
+void ofono_dbus_access_invalidate(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -194,6 +194,33 @@ void ofono_voicecall_ringback_tone_notify(struct ofono_voicecall *vc,
 ofono_bool_t ofono_voicecall_is_emergency_number(struct ofono_voicecall *vc,
 						const char *number);
 
+/*
+ * Call list tracking for drivers that have to query the call list
+ * (e.g. AT+CLCC or RIL_REQUEST_GET_CURRENT_CALLS). The driver registers
+ * its query function and asks for queries with ofono_voicecall_poll_request
+ * instead of issuing them directly. Requests made while a query is in
+ * progress are merged into one follow-up query. The driver reports the
+ * completion of each query with ofono_voicecall_poll_done, passing TRUE
+ * if some calls are still in a transient state, in which case the query
+ * is repeated with exponential backoff until either the state settles
+ * or a call state indication reported by ofono_voicecall_poll_event
+ * makes it unnecessary. Drivers whose modems report every call state
+ * change never pass TRUE (rilmodem) or never query at all (ifxmodem
+ * with +XCALLSTAT).
+ */
+typedef void (*ofono_voicecall_query_cb_t)(struct ofono_voicecall *vc);
+
+/* Since mer/1.29+git1 */
+void ofono_voicecall_poll_init(struct ofono_voicecall *vc,
+				ofono_voicecall_query_cb_t query,
+				unsigned int min_interval_ms,
+				unsigned int max_interval_ms);
+void ofono_voicecall_poll_request(struct ofono_voicecall *vc,
+						unsigned int delay_ms);
+void ofono_voicecall_poll_event(struct ofono_voicecall *vc);
+void ofono_voicecall_poll_done(struct ofono_voicecall *vc,
+						ofono_bool_t transient);
+
 #ifdef __cplusplus
 }
 #endif
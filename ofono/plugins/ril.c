@@ -286,6 +286,7 @@ static void ril_send_power(struct ril_data *rd, ofono_bool_t online,
 	ofono_modem_online_cb_t cb;
 	GDestroyNotify notify = NULL;
 	struct parcel rilp;
+	uint32_t buf[2];
 
 	if (cbd != NULL) {
 		notify = g_free;
@@ -294,7 +295,7 @@ static void ril_send_power(struct ril_data *rd, ofono_bool_t online,
 
 	DBG("(online = 1, offline = 0)): %i", online);
 
-	parcel_init(&rilp);
+	parcel_init_buf(&rilp, buf, sizeof(buf));
 	parcel_w_int32(&rilp, 1);
 	parcel_w_int32(&rilp, online);
 
@@ -26,6 +26,10 @@
 #include <dbusaccess_policy.h>
 #include <dbusaccess_peer.h>
 
+#include <gutil_inotify.h>
+
+#include <sys/inotify.h>
+
 struct sailfish_access_intf {
 	const char *name;
 };
@@ -45,6 +49,7 @@ struct sailfish_access_intf_policy {
 /* File name is external for unit testing */
 const char *sailfish_access_config_file = "/etc/ofono/dbusaccess.conf";
 static GHashTable* access_table = NULL;
+static GUtilInotifyWatchCallback *config_watch = NULL;
 static const char *default_access_policy = DA_POLICY_VERSION "; "
 	"* = deny; "
 	"group(sailfish-radio) | group(privileged) = allow";
@@ -183,6 +188,23 @@ static void sailfish_access_intf_free(gpointer user_data)
 	g_free(intf);
 }
 
+static void sailfish_access_config_changed(GUtilInotifyWatch *watch,
+		guint mask, guint cookie, const char *name, void *user_data)
+{
+	char *file = g_path_get_basename(sailfish_access_config_file);
+
+	if (!g_strcmp0(name, file)) {
+		DBG("'%s' changed (0x%04x)", name, mask);
+		g_hash_table_remove_all(access_table);
+		sailfish_access_load_config();
+
+		/* Cached decisions were made under the old policy */
+		ofono_dbus_access_invalidate();
+	}
+
+	g_free(file);
+}
+
 static enum ofono_dbus_access sailfish_access_method_access(const char *sender,
 				enum ofono_dbus_access_intf intf,
 				int method, const char *arg)
@@ -226,9 +248,15 @@ static int sailfish_access_init(void)
 	DBG("");
 	ret = ofono_dbus_access_plugin_register(&sailfish_access_plugin);
 	if (ret == 0) {
+		char *dir = g_path_get_dirname(sailfish_access_config_file);
+
 		access_table = g_hash_table_new_full(g_direct_hash,
 			g_direct_equal, NULL, sailfish_access_intf_free);
 		sailfish_access_load_config();
+		config_watch = gutil_inotify_watch_callback_new(dir,
+			IN_CLOSE_WRITE | IN_DELETE | IN_MOVE,
+			sailfish_access_config_changed, NULL);
+		g_free(dir);
 	}
 	return ret;
 }
@@ -237,6 +265,8 @@ static void sailfish_access_exit(void)
 {
 	DBG("");
 	ofono_dbus_access_plugin_unregister(&sailfish_access_plugin);
+	gutil_inotify_watch_callback_free(config_watch);
+	config_watch = NULL;
 	da_peer_flush(OFONO_BUS, NULL);
 	if (access_table) {
 		g_hash_table_destroy(access_table);
@@ -280,6 +280,11 @@ static void setup_internal_mux(struct ofono_modem *modem)
 	for (i = 0; i < NUM_DLC; i++) {
 		GIOChannel *channel = g_at_mux_create_channel(data->mux);
 
+		/* Keep call control responsive while PPP is busy */
+		if (i == VOICE_DLC || i == SMS_DLC)
+			g_at_mux_channel_set_priority(channel,
+					G_AT_MUX_PRIORITY_CONTROL, 1, 0);
+
 		data->dlcs[i] = create_chat(channel, modem, dlc_prefixes[i]);
 		if (data->dlcs[i] == NULL) {
 			ofono_error("Failed to create channel");
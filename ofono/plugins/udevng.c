@@ -38,6 +38,15 @@
 #include <ofono/modem.h>
 #include <ofono/log.h>
 
+/*
+ * A modem is probed as soon as all the interfaces listed for its driver
+ * in expected_list have appeared. Modems of other drivers, or those which
+ * never expose all of them, are probed once their own interfaces have
+ * stopped appearing for UDEV_SETTLE_MS, the same quiet period that used
+ * to apply to all the devices at once. A modem is probed only once.
+ */
+#define UDEV_SETTLE_MS 1000
+
 enum modem_type {
 	MODEM_TYPE_USB,
 	MODEM_TYPE_SERIAL,
@@ -56,6 +65,8 @@ struct modem_info {
 	};
 	struct ofono_modem *modem;
 	const char *sysattr;
+	guint settle;
+	gint64 first_uevent;
 };
 
 struct device_info {
@@ -1332,6 +1343,36 @@ static struct {
 	{ }
 };
 
+/*
+ * Number of tty, net and usbmisc (cdc-wdm) devices that the setup
+ * function makes use of on a fully enumerated modem. setup_huawei() and
+ * setup_sierra() also succeed with just the AT ports, that's why their
+ * readiness can't be judged by calling them.
+ */
+static const struct {
+	const char *driver;
+	unsigned int tty;
+	unsigned int net;
+	unsigned int usbmisc;
+} expected_list[] = {
+	{ "gobi",	1, 1, 1 },
+	{ "sierra",	1, 1, 1 },
+	{ "huawei",	2, 1, 1 },
+	{ "telitqmi",	0, 1, 1 },
+	{ "quectelqmi",	2, 1, 1 },
+	{ "mbim",	0, 1, 1 },
+	{ "mbm",	2, 1, 0 },
+	{ "hso",	2, 1, 0 },
+	{ "xmm7xxx",	1, 1, 0 },
+	{ "gemalto",	2, 1, 0 },
+	{ "telit",	2, 0, 0 },
+	{ "quectel",	2, 0, 0 },
+	{ "simcom",	2, 0, 0 },
+	{ "zte",	2, 0, 0 },
+	{ "icera",	2, 0, 0 },
+	{ }
+};
+
 static GHashTable *modem_list;
 
 static const char *get_sysattr(const char *driver)
@@ -1374,6 +1415,9 @@ static void destroy_modem(gpointer data)
 
 	DBG("%s", modem->syspath);
 
+	if (modem->settle)
+		g_source_remove(modem->settle);
+
 	ofono_modem_remove(modem->modem);
 
 	switch (modem->type) {
@@ -1480,7 +1524,7 @@ static struct udev_device* get_serial_modem_device(struct udev_device *dev)
  * - The modem consists of only a single interface
  * - The device must have an OFONO_DRIVER property from udev
  */
-static void add_serial_device(struct udev_device *dev)
+static struct modem_info *add_serial_device(struct udev_device *dev)
 {
 	const char *syspath, *devpath, *devname, *devnode;
 	struct modem_info *modem;
@@ -1492,7 +1536,7 @@ static void add_serial_device(struct udev_device *dev)
 	mdev = get_serial_modem_device(dev);
 	if (!mdev) {
 		DBG("Device is missing required OFONO_DRIVER property");
-		return;
+		return NULL;
 	}
 
 	driver = udev_device_get_property_value(mdev, "OFONO_DRIVER");
@@ -1504,18 +1548,19 @@ static void add_serial_device(struct udev_device *dev)
 	devnode = udev_device_get_devnode(dev);
 
 	if (!syspath || !devpath)
-		return;
+		return NULL;
 
 	modem = g_hash_table_lookup(modem_list, syspath);
 	if (modem == NULL) {
 		modem = g_try_new0(struct modem_info, 1);
 		if (modem == NULL)
-			return;
+			return NULL;
 
 		modem->type = MODEM_TYPE_SERIAL;
 		modem->syspath = g_strdup(syspath);
 		modem->devname = g_strdup(devname);
 		modem->driver = g_strdup(driver);
+		modem->first_uevent = g_get_monotonic_time();
 
 		g_hash_table_replace(modem_list, modem->syspath, modem);
 	}
@@ -1528,7 +1573,7 @@ static void add_serial_device(struct udev_device *dev)
 
 	info = g_try_new0(struct serial_device_info, 1);
 	if (info == NULL)
-		return;
+		return NULL;
 
 	info->devpath = g_strdup(devpath);
 	info->devnode = g_strdup(devnode);
@@ -1536,11 +1581,14 @@ static void add_serial_device(struct udev_device *dev)
 	info->dev = udev_device_ref(dev);
 
 	modem->serial = info;
+
+	return modem;
 }
 
-static void add_device(const char *syspath, const char *devname,
-			const char *driver, const char *vendor,
-			const char *model, struct udev_device *device)
+static struct modem_info *add_device(const char *syspath,
+			const char *devname, const char *driver,
+			const char *vendor, const char *model,
+			struct udev_device *device)
 {
 	struct udev_device *usb_interface;
 	const char *devpath, *devnode, *interface, *number;
@@ -1551,25 +1599,25 @@ static void add_device(const char *syspath, const char *devname,
 
 	devpath = udev_device_get_syspath(device);
 	if (devpath == NULL)
-		return;
+		return NULL;
 
 	devnode = udev_device_get_devnode(device);
 	if (devnode == NULL) {
 		devnode = udev_device_get_property_value(device, "INTERFACE");
 		if (devnode == NULL)
-			return;
+			return NULL;
 	}
 
 	usb_interface = udev_device_get_parent_with_subsystem_devtype(device,
 						"usb", "usb_interface");
 	if (usb_interface == NULL)
-		return;
+		return NULL;
 
 	modem = g_hash_table_lookup(modem_list, syspath);
 	if (modem == NULL) {
 		modem = g_try_new0(struct modem_info, 1);
 		if (modem == NULL)
-			return;
+			return NULL;
 
 		modem->type = MODEM_TYPE_USB;
 		modem->syspath = g_strdup(syspath);
@@ -1579,6 +1627,7 @@ static void add_device(const char *syspath, const char *devname,
 		modem->model = g_strdup(model);
 
 		modem->sysattr = get_sysattr(driver);
+		modem->first_uevent = g_get_monotonic_time();
 
 		g_hash_table_replace(modem_list, modem->syspath, modem);
 	}
@@ -1617,7 +1666,7 @@ static void add_device(const char *syspath, const char *devname,
 
 	info = g_try_new0(struct device_info, 1);
 	if (info == NULL)
-		return;
+		return NULL;
 
 	info->devpath = g_strdup(devpath);
 	info->devnode = g_strdup(devnode);
@@ -1629,6 +1678,8 @@ static void add_device(const char *syspath, const char *devname,
 
 	modem->devices = g_slist_insert_sorted(modem->devices, info,
 							compare_device);
+
+	return modem;
 }
 
 static struct {
@@ -1713,7 +1764,57 @@ static struct {
 	{ }
 };
 
-static void check_usb_device(struct udev_device *device)
+/*
+ * vendor_list indexed by "drv:vid:pid", with vid and/or pid left empty
+ * for entries which don't specify them. The value is the position in
+ * vendor_list plus one, later entries take precedence over earlier ones.
+ */
+static GHashTable *vendor_index;
+
+static char *vendor_key(const char *drv, const char *vid, const char *pid)
+{
+	return g_strconcat(drv, ":", vid ? vid : "", ":", pid ? pid : "",
+									NULL);
+}
+
+static void vendor_index_init(void)
+{
+	unsigned int i;
+
+	vendor_index = g_hash_table_new_full(g_str_hash, g_str_equal,
+							g_free, NULL);
+
+	for (i = 0; vendor_list[i].driver; i++)
+		g_hash_table_replace(vendor_index,
+					vendor_key(vendor_list[i].drv,
+							vendor_list[i].vid,
+							vendor_list[i].pid),
+					GUINT_TO_POINTER(i + 1));
+}
+
+static guint vendor_index_lookup(const char *drv, const char *vid,
+							const char *pid)
+{
+	char *key = vendor_key(drv, vid, pid);
+	guint i = GPOINTER_TO_UINT(g_hash_table_lookup(vendor_index, key));
+
+	g_free(key);
+	return i;
+}
+
+static const char *find_vendor_driver(const char *drv, const char *vendor,
+							const char *model)
+{
+	guint i = vendor_index_lookup(drv, NULL, NULL);
+	guint j = vendor_index_lookup(drv, vendor, NULL);
+	guint k = vendor_index_lookup(drv, vendor, model);
+
+	i = MAX(i, MAX(j, k));
+
+	return i ? vendor_list[i - 1].driver : NULL;
+}
+
+static struct modem_info *check_usb_device(struct udev_device *device)
 {
 	struct udev_device *usb_device;
 	const char *syspath, *devname, *driver;
@@ -1722,15 +1823,15 @@ static void check_usb_device(struct udev_device *device)
 	usb_device = udev_device_get_parent_with_subsystem_devtype(device,
 							"usb", "usb_device");
 	if (usb_device == NULL)
-		return;
+		return NULL;
 
 	syspath = udev_device_get_syspath(usb_device);
 	if (syspath == NULL)
-		return;
+		return NULL;
 
 	devname = udev_device_get_devnode(usb_device);
 	if (devname == NULL)
-		return;
+		return NULL;
 
 	vendor = udev_device_get_property_value(usb_device, "ID_VENDOR_ID");
 	model = udev_device_get_property_value(usb_device, "ID_MODEL_ID");
@@ -1748,7 +1849,6 @@ static void check_usb_device(struct udev_device *device)
 
 	if (driver == NULL) {
 		const char *drv;
-		unsigned int i;
 
 		drv = udev_device_get_property_value(device, "ID_USB_DRIVER");
 		if (drv == NULL) {
@@ -1758,11 +1858,11 @@ static void check_usb_device(struct udev_device *device)
 
 				parent = udev_device_get_parent(device);
 				if (parent == NULL)
-					return;
+					return NULL;
 
 				drv = udev_device_get_driver(parent);
 				if (drv == NULL)
-					return;
+					return NULL;
 			}
 		}
 
@@ -1770,33 +1870,17 @@ static void check_usb_device(struct udev_device *device)
 		DBG("%s [%s:%s]", drv, vendor, model);
 
 		if (vendor == NULL || model == NULL)
-			return;
-
-		for (i = 0; vendor_list[i].driver; i++) {
-			if (g_str_equal(vendor_list[i].drv, drv) == FALSE)
-				continue;
-
-			if (vendor_list[i].vid) {
-				if (!g_str_equal(vendor_list[i].vid, vendor))
-					continue;
-			}
-
-			if (vendor_list[i].pid) {
-				if (!g_str_equal(vendor_list[i].pid, model))
-					continue;
-			}
-
-			driver = vendor_list[i].driver;
-		}
+			return NULL;
 
+		driver = find_vendor_driver(drv, vendor, model);
 		if (driver == NULL)
-			return;
+			return NULL;
 	}
 
-	add_device(syspath, devname, driver, vendor, model, device);
+	return add_device(syspath, devname, driver, vendor, model, device);
 }
 
-static void check_device(struct udev_device *device)
+static struct modem_info *check_device(struct udev_device *device)
 {
 	const char *bus;
 
@@ -1804,54 +1888,63 @@ static void check_device(struct udev_device *device)
 	if (bus == NULL) {
 		bus = udev_device_get_subsystem(device);
 		if (bus == NULL)
-			return;
+			return NULL;
 	}
 
 	if ((g_str_equal(bus, "usb") == TRUE) ||
 			(g_str_equal(bus, "usbmisc") == TRUE))
-		check_usb_device(device);
+		return check_usb_device(device);
 	else
-		add_serial_device(device);
+		return add_serial_device(device);
 
 }
 
-static gboolean create_modem(gpointer key, gpointer value, gpointer user_data)
+static gboolean probe_modem(struct modem_info *modem)
 {
-	struct modem_info *modem = value;
-	const char *syspath = key;
 	unsigned int i;
 
-	if (modem->modem != NULL)
-		return FALSE;
-
-	DBG("%s", syspath);
+	DBG("%s", modem->syspath);
 
 	if (modem->devices == NULL)
-		return TRUE;
+		return FALSE;
 
 	DBG("driver=%s", modem->driver);
 
 	modem->modem = ofono_modem_create(NULL, modem->driver);
 	if (modem->modem == NULL)
-		return TRUE;
+		return FALSE;
 
 	for (i = 0; driver_list[i].name; i++) {
 		if (g_str_equal(driver_list[i].name, modem->driver) == FALSE)
 			continue;
 
-		if (driver_list[i].setup(modem) == TRUE) {
-			ofono_modem_set_string(modem->modem, "SystemPath",
-								syspath);
-			if (ofono_modem_register(modem->modem) < 0) {
-				DBG("could not register modem '%s'", modem->driver);
-				return TRUE;
-			}
+		if (driver_list[i].setup(modem) == FALSE)
+			return FALSE;
 
+		ofono_modem_set_string(modem->modem, "SystemPath",
+							modem->syspath);
+		if (ofono_modem_register(modem->modem) < 0) {
+			DBG("could not register modem '%s'", modem->driver);
 			return FALSE;
 		}
+
+		DBG("%s created %d ms after its first uevent",
+			modem->syspath, (int) ((g_get_monotonic_time() -
+						modem->first_uevent) / 1000));
+		return TRUE;
 	}
 
-	return TRUE;
+	return FALSE;
+}
+
+static gboolean create_modem(gpointer key, gpointer value, gpointer user_data)
+{
+	struct modem_info *modem = value;
+
+	if (modem->modem != NULL)
+		return FALSE;
+
+	return !probe_modem(modem);
 }
 
 static void enumerate_devices(struct udev *context)
@@ -1895,19 +1988,71 @@ static void enumerate_devices(struct udev *context)
 static struct udev *udev_ctx;
 static struct udev_monitor *udev_mon;
 static guint udev_watch = 0;
-static guint udev_delay = 0;
 
-static gboolean check_modem_list(gpointer user_data)
+static gboolean modem_settled(gpointer user_data)
 {
-	udev_delay = 0;
+	struct modem_info *modem = user_data;
 
-	DBG("");
+	modem->settle = 0;
 
-	g_hash_table_foreach_remove(modem_list, create_modem, NULL);
+	if (!probe_modem(modem))
+		g_hash_table_remove(modem_list, modem->syspath);
 
 	return FALSE;
 }
 
+static gboolean modem_complete(struct modem_info *modem)
+{
+	unsigned int tty = 0, net = 0, usbmisc = 0;
+	unsigned int i;
+	GSList *list;
+
+	if (modem->type != MODEM_TYPE_USB)
+		return FALSE;
+
+	for (i = 0; expected_list[i].driver; i++) {
+		if (g_str_equal(expected_list[i].driver, modem->driver))
+			break;
+	}
+
+	if (expected_list[i].driver == NULL)
+		return FALSE;
+
+	for (list = modem->devices; list; list = list->next) {
+		struct device_info *info = list->data;
+
+		if (g_strcmp0(info->subsystem, "tty") == 0)
+			tty++;
+		else if (g_strcmp0(info->subsystem, "net") == 0)
+			net++;
+		else if (g_strcmp0(info->subsystem, "usbmisc") == 0)
+			usbmisc++;
+	}
+
+	return tty >= expected_list[i].tty && net >= expected_list[i].net &&
+					usbmisc >= expected_list[i].usbmisc;
+}
+
+static void modem_event(struct modem_info *modem)
+{
+	if (modem->modem != NULL) {
+		DBG("%s: interface added after the modem was created",
+							modem->syspath);
+		return;
+	}
+
+	if (modem->settle)
+		g_source_remove(modem->settle);
+
+	if (modem_complete(modem)) {
+		modem->settle = 0;
+		modem_settled(modem);
+		return;
+	}
+
+	modem->settle = g_timeout_add(UDEV_SETTLE_MS, modem_settled, modem);
+}
+
 static gboolean udev_event(GIOChannel *channel, GIOCondition cond,
 							gpointer user_data)
 {
@@ -1929,12 +2074,11 @@ static gboolean udev_event(GIOChannel *channel, GIOCondition cond,
 		return TRUE;
 
 	if (g_str_equal(action, "add") == TRUE) {
-		if (udev_delay > 0)
-			g_source_remove(udev_delay);
-
-		check_device(device);
+		struct modem_info *modem;
 
-		udev_delay = g_timeout_add_seconds(1, check_modem_list, NULL);
+		modem = check_device(device);
+		if (modem)
+			modem_event(modem);
 	} else if (g_str_equal(action, "remove") == TRUE)
 		remove_device(device);
 
@@ -1988,6 +2132,7 @@ static int detect_init(void)
 
 	modem_list = g_hash_table_new_full(g_str_hash, g_str_equal,
 						NULL, destroy_modem);
+	vendor_index_init();
 
 	udev_monitor_filter_add_match_subsystem_devtype(udev_mon, "tty", NULL);
 	udev_monitor_filter_add_match_subsystem_devtype(udev_mon, "usb", NULL);
@@ -2005,9 +2150,6 @@ static int detect_init(void)
 
 static void detect_exit(void)
 {
-	if (udev_delay > 0)
-		g_source_remove(udev_delay);
-
 	if (udev_watch > 0)
 		g_source_remove(udev_watch);
 
@@ -2017,6 +2159,7 @@ static void detect_exit(void)
 	udev_monitor_filter_remove(udev_mon);
 
 	g_hash_table_destroy(modem_list);
+	g_hash_table_destroy(vendor_index);
 
 	udev_monitor_unref(udev_mon);
 	udev_unref(udev_ctx);
@@ -0,0 +1,315 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2021 Jolla Ltd. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "capture.h"
+
+struct capture_ring {
+	uint8_t *buf;
+	size_t size;
+	size_t head;		/* Oldest record */
+	size_t used;
+	size_t max_record;
+	unsigned int count;
+	unsigned long dropped;
+};
+
+struct capture_ring *capture_active;
+
+static uint64_t capture_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Both of these take care of the wrap around */
+static size_t ring_put(struct capture_ring *ring, size_t pos,
+					const void *data, size_t len)
+{
+	size_t n = ring->size - pos;
+
+	if (n >= len) {
+		memcpy(ring->buf + pos, data, len);
+	} else {
+		memcpy(ring->buf + pos, data, n);
+		memcpy(ring->buf, (const uint8_t *) data + n, len - n);
+	}
+
+	return (pos + len) % ring->size;
+}
+
+static size_t ring_get(const struct capture_ring *ring, size_t pos,
+						void *data, size_t len)
+{
+	size_t n = ring->size - pos;
+
+	if (n >= len) {
+		memcpy(data, ring->buf + pos, len);
+	} else {
+		memcpy(data, ring->buf + pos, n);
+		memcpy((uint8_t *) data + n, ring->buf, len - n);
+	}
+
+	return (pos + len) % ring->size;
+}
+
+struct capture_ring *capture_ring_new(size_t size)
+{
+	struct capture_ring *ring;
+
+	if (size <= sizeof(struct capture_record))
+		return NULL;
+
+	ring = calloc(1, sizeof(*ring));
+	if (!ring)
+		return NULL;
+
+	ring->buf = malloc(size);
+	if (!ring->buf) {
+		free(ring);
+		return NULL;
+	}
+
+	ring->size = size;
+	return ring;
+}
+
+void capture_ring_free(struct capture_ring *ring)
+{
+	if (!ring)
+		return;
+
+	free(ring->buf);
+	free(ring);
+}
+
+static void capture_ring_drop_oldest(struct capture_ring *ring)
+{
+	struct capture_record rec;
+	size_t len;
+
+	ring_get(ring, ring->head, &rec, sizeof(rec));
+	len = sizeof(rec) + rec.length;
+
+	ring->head = (ring->head + len) % ring->size;
+	ring->used -= len;
+	ring->count--;
+	ring->dropped++;
+}
+
+void capture_ring_addv(struct capture_ring *ring,
+			enum capture_transport transport, unsigned int channel,
+			enum capture_direction direction,
+			const struct iovec *iov, unsigned int iovcnt)
+{
+	struct capture_record rec;
+	size_t len = 0;
+	size_t pos;
+	unsigned int i;
+
+	for (i = 0; i < iovcnt; i++)
+		len += iov[i].iov_len;
+
+	if (sizeof(rec) + len > ring->size) {
+		ring->dropped++;
+		return;
+	}
+
+	while (ring->size - ring->used < sizeof(rec) + len)
+		capture_ring_drop_oldest(ring);
+
+	rec.usec = capture_now();
+	rec.length = len;
+	rec.channel = channel;
+	rec.transport = transport;
+	rec.direction = direction;
+
+	pos = (ring->head + ring->used) % ring->size;
+	pos = ring_put(ring, pos, &rec, sizeof(rec));
+
+	for (i = 0; i < iovcnt; i++)
+		pos = ring_put(ring, pos, iov[i].iov_base, iov[i].iov_len);
+
+	ring->used += sizeof(rec) + len;
+	ring->count++;
+
+	if (len > ring->max_record)
+		ring->max_record = len;
+}
+
+unsigned int capture_ring_count(const struct capture_ring *ring)
+{
+	return ring ? ring->count : 0;
+}
+
+unsigned long capture_ring_dropped(const struct capture_ring *ring)
+{
+	return ring ? ring->dropped : 0;
+}
+
+void capture_ring_foreach(const struct capture_ring *ring,
+				capture_func_t func, void *user_data)
+{
+	struct capture_record rec;
+	uint8_t *data;
+	size_t pos;
+	unsigned int i;
+
+	if (!ring || !ring->count)
+		return;
+
+	/* Records may wrap around, hand them out in one piece */
+	data = malloc(ring->max_record ? ring->max_record : 1);
+	if (!data)
+		return;
+
+	pos = ring->head;
+
+	for (i = 0; i < ring->count; i++) {
+		pos = ring_get(ring, pos, &rec, sizeof(rec));
+		pos = ring_get(ring, pos, data, rec.length);
+		func(&rec, data, user_data);
+	}
+
+	free(data);
+}
+
+static void capture_write_record(const struct capture_record *rec,
+					const void *data, void *user_data)
+{
+	FILE *f = user_data;
+
+	fwrite(rec, sizeof(*rec), 1, f);
+	fwrite(data, rec->length, 1, f);
+}
+
+/*
+ * The capture contains whatever went over the wire, PINs and SMS
+ * bodies included, so only the owner gets to read it.
+ */
+int capture_ring_save(const struct capture_ring *ring, const char *path)
+{
+	FILE *f;
+	int err = 0;
+	int fd;
+
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+	if (fd < 0)
+		return -errno;
+
+	/* The file may have existed with wider permissions */
+	if (fchmod(fd, S_IRUSR | S_IWUSR) < 0) {
+		err = -errno;
+		close(fd);
+		return err;
+	}
+
+	f = fdopen(fd, "w");
+	if (!f) {
+		err = -errno;
+		close(fd);
+		return err;
+	}
+
+	fwrite(CAPTURE_MAGIC, strlen(CAPTURE_MAGIC), 1, f);
+	capture_ring_foreach(ring, capture_write_record, f);
+
+	if (ferror(f))
+		err = -EIO;
+
+	if (fclose(f) && !err)
+		err = -errno;
+
+	return err;
+}
+
+int capture_load(const char *path, capture_func_t func, void *user_data)
+{
+	FILE *f = fopen(path, "r");
+	char magic[sizeof(CAPTURE_MAGIC) - 1];
+	struct capture_record rec;
+	uint8_t *data = NULL;
+	size_t data_size = 0;
+	int count = 0;
+
+	if (!f)
+		return -errno;
+
+	if (fread(magic, sizeof(magic), 1, f) != 1 ||
+			memcmp(magic, CAPTURE_MAGIC, sizeof(magic))) {
+		fclose(f);
+		return -EINVAL;
+	}
+
+	while (fread(&rec, sizeof(rec), 1, f) == 1) {
+		if (rec.length > data_size) {
+			uint8_t *tmp = realloc(data, rec.length);
+
+			if (!tmp) {
+				count = -ENOMEM;
+				break;
+			}
+
+			data = tmp;
+			data_size = rec.length;
+		}
+
+		/* Truncated file, keep what we have */
+		if (rec.length && fread(data, rec.length, 1, f) != 1)
+			break;
+
+		func(&rec, data, user_data);
+		count++;
+	}
+
+	free(data);
+	fclose(f);
+
+	return count;
+}
+
+int capture_start(size_t size)
+{
+	struct capture_ring *ring = capture_ring_new(size);
+
+	if (!ring)
+		return -ENOMEM;
+
+	capture_ring_free(capture_active);
+	capture_active = ring;
+
+	return 0;
+}
+
+void capture_stop(void)
+{
+	capture_ring_free(capture_active);
+	capture_active = NULL;
+}
@@ -0,0 +1,113 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2021 Jolla Ltd. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#ifndef OFONO_CAPTURE_H
+#define OFONO_CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+/*
+ * Protocol trace capture. Transports append the data they send and
+ * receive to a single in-memory ring which drops the oldest records
+ * when full. The ring can be saved to a file and fed back through the
+ * parsers by unit/bench-replay. Nothing is recorded unless capturing
+ * has been started, a disabled capture point costs one pointer check.
+ *
+ * Doesn't depend on glib so that the ell based drivers can use it too.
+ */
+
+enum capture_transport {
+	CAPTURE_AT = 1,		/* GAtIO, channel is the GAtIO number */
+	CAPTURE_MUX,		/* GAtMux, channel is the DLCI */
+	CAPTURE_RIL,		/* GRilIO, channel is the fd */
+	CAPTURE_QMI,		/* QMI, channel is the fd */
+	CAPTURE_MBIM,		/* MBIM, channel is the fd */
+	CAPTURE_ISI,		/* ISI, channel is the Phonet resource */
+};
+
+enum capture_direction {
+	CAPTURE_IN,
+	CAPTURE_OUT,
+};
+
+/*
+ * Record header as stored in the ring and in capture files (host byte
+ * order), followed by length bytes of data. Files start with
+ * CAPTURE_MAGIC.
+ */
+struct capture_record {
+	uint64_t usec;		/* CLOCK_MONOTONIC */
+	uint32_t length;
+	uint16_t channel;
+	uint8_t transport;
+	uint8_t direction;
+};
+
+#define CAPTURE_MAGIC "OFNOCAP1"
+#define CAPTURE_DEFAULT_SIZE (4 * 1024 * 1024)
+
+struct capture_ring;
+
+typedef void (*capture_func_t)(const struct capture_record *rec,
+					const void *data, void *user_data);
+
+struct capture_ring *capture_ring_new(size_t size);
+void capture_ring_free(struct capture_ring *ring);
+void capture_ring_addv(struct capture_ring *ring,
+			enum capture_transport transport, unsigned int channel,
+			enum capture_direction direction,
+			const struct iovec *iov, unsigned int iovcnt);
+unsigned int capture_ring_count(const struct capture_ring *ring);
+unsigned long capture_ring_dropped(const struct capture_ring *ring);
+void capture_ring_foreach(const struct capture_ring *ring,
+				capture_func_t func, void *user_data);
+int capture_ring_save(const struct capture_ring *ring, const char *path);
+
+/* Returns the number of records or negative errno */
+int capture_load(const char *path, capture_func_t func, void *user_data);
+
+/* The ring the capture points write to, NULL when not capturing */
+extern struct capture_ring *capture_active;
+
+int capture_start(size_t size);
+void capture_stop(void);
+
+static inline void capture_datav(enum capture_transport transport,
+					unsigned int channel,
+					enum capture_direction direction,
+					const struct iovec *iov,
+					unsigned int iovcnt)
+{
+	if (capture_active)
+		capture_ring_addv(capture_active, transport, channel,
+						direction, iov, iovcnt);
+}
+
+static inline void capture_data(enum capture_transport transport,
+					unsigned int channel,
+					enum capture_direction direction,
+					const void *data, size_t len)
+{
+	if (capture_active) {
+		struct iovec iov = { (void *) data, len };
+
+		capture_ring_addv(capture_active, transport, channel,
+						direction, &iov, 1);
+	}
+}
+
+#endif /* OFONO_CAPTURE_H */
@@ -41,6 +41,9 @@
 #define SETTINGS_STORE "cbs"
 #define SETTINGS_GROUP "Settings"
 
+/* Ordinary pages processed per main loop iteration */
+#define CBS_PAGE_BATCH 16
+
 static GSList *g_drivers = NULL;
 
 enum etws_topic_type {
@@ -68,7 +71,10 @@ struct ofono_cbs {
 	GSList *efcbmir_contents;
 	unsigned short efcbmid_length;
 	GSList *efcbmid_contents;
+	struct cbs_topic_set *efcbmid_set;
 	gboolean efcbmid_update;
+	GQueue page_queue;
+	guint page_source;
 	guint reset_source;
 	int lac;
 	int ci;
@@ -171,10 +177,19 @@ static void cbs_dispatch_text(struct ofono_cbs *cbs, enum sms_class cls,
 				DBUS_TYPE_INVALID);
 }
 
-void ofono_cbs_notify(struct ofono_cbs *cbs, const unsigned char *pdu,
-				int pdu_len)
+/*
+ * 3GPP 23.041 Section 9.4.1.2.2: 1100 - 18FF hex is the range for
+ * ETWS, CMAS and the other public warning systems
+ */
+static inline gboolean cbs_is_warning(const struct cbs *c)
 {
-	struct cbs c;
+	return c->message_identifier >= 0x1100 &&
+				c->message_identifier <= 0x18ff;
+}
+
+static void cbs_process_page(struct ofono_cbs *cbs, const struct cbs *page)
+{
+	struct cbs c = *page;
 	enum sms_class cls;
 	gboolean udhi;
 	gboolean comp;
@@ -186,12 +201,7 @@ void ofono_cbs_notify(struct ofono_cbs *cbs, const unsigned char *pdu,
 	if (cbs->assembly == NULL)
 		return;
 
-	if (!cbs_decode(pdu, pdu_len, &c)) {
-		ofono_error("Unable to decode CBS PDU");
-		return;
-	}
-
-	if (cbs_topic_in_range(c.message_identifier, cbs->efcbmid_contents)) {
+	if (cbs_topic_set_contains(cbs->efcbmid_set, c.message_identifier)) {
 		if (cbs->sim == NULL)
 			return;
 
@@ -275,6 +285,70 @@ out:
 	g_slist_free_full(cbs_list, g_free);
 }
 
+static void cbs_clear_page_queue(struct ofono_cbs *cbs)
+{
+	if (cbs->page_source) {
+		g_source_remove(cbs->page_source);
+		cbs->page_source = 0;
+	}
+
+	while (!g_queue_is_empty(&cbs->page_queue))
+		g_free(g_queue_pop_head(&cbs->page_queue));
+}
+
+static gboolean cbs_process_page_queue(gpointer user_data)
+{
+	struct ofono_cbs *cbs = user_data;
+	int i;
+
+	for (i = 0; i < CBS_PAGE_BATCH; i++) {
+		struct cbs *c = g_queue_pop_head(&cbs->page_queue);
+
+		if (c == NULL)
+			break;
+
+		cbs_process_page(cbs, c);
+		g_free(c);
+	}
+
+	if (!g_queue_is_empty(&cbs->page_queue))
+		return G_SOURCE_CONTINUE;
+
+	cbs->page_source = 0;
+	return G_SOURCE_REMOVE;
+}
+
+void ofono_cbs_notify(struct ofono_cbs *cbs, const unsigned char *pdu,
+				int pdu_len)
+{
+	struct cbs c;
+
+	if (cbs->assembly == NULL)
+		return;
+
+	if (!cbs_decode(pdu, pdu_len, &c)) {
+		ofono_error("Unable to decode CBS PDU");
+		return;
+	}
+
+	/*
+	 * Warnings are handled right away, everything else waits until
+	 * the pages received in the same burst have been looked at. That
+	 * way a storm of ordinary broadcasts can't hold up an alert.
+	 */
+	if (cbs_is_warning(&c)) {
+		DBG("Warning %hu, %u queued", c.message_identifier,
+					g_queue_get_length(&cbs->page_queue));
+		cbs_process_page(cbs, &c);
+		return;
+	}
+
+	g_queue_push_tail(&cbs->page_queue, g_memdup(&c, sizeof(c)));
+
+	if (!cbs->page_source)
+		cbs->page_source = g_idle_add(cbs_process_page_queue, cbs);
+}
+
 static DBusMessage *cbs_get_properties(DBusConnection *conn,
 					DBusMessage *msg, void *data)
 {
@@ -600,6 +674,8 @@ static void cbs_unregister(struct ofono_atom *atom)
 		cbs->efcbmid_length = 0;
 		g_slist_free_full(cbs->efcbmid_contents, g_free);
 		cbs->efcbmid_contents = NULL;
+		cbs_topic_set_free(cbs->efcbmid_set);
+		cbs->efcbmid_set = NULL;
 	}
 
 	if (cbs->sim_context) {
@@ -619,6 +695,7 @@ static void cbs_unregister(struct ofono_atom *atom)
 	}
 
 	cbs->powered = FALSE;
+	cbs_clear_page_queue(cbs);
 
 	if (cbs->settings) {
 		storage_close(cbs->imsi, SETTINGS_STORE, cbs->settings, TRUE);
@@ -653,6 +730,7 @@ static void cbs_remove(struct ofono_atom *atom)
 	if (cbs->driver != NULL && cbs->driver->remove != NULL)
 		cbs->driver->remove(cbs);
 
+	cbs_clear_page_queue(cbs);
 	cbs_assembly_free(cbs->assembly);
 	cbs->assembly = NULL;
 
@@ -676,6 +754,7 @@ struct ofono_cbs *ofono_cbs_create(struct ofono_modem *modem,
 		return NULL;
 
 	cbs->assembly = cbs_assembly_new();
+	g_queue_init(&cbs->page_queue);
 	cbs->atom = __ofono_modem_add_atom(modem, OFONO_ATOM_TYPE_CBS,
 						cbs_remove, cbs);
 
@@ -874,6 +953,7 @@ static void sim_cbmid_read_cb(int ok, int length, int record,
 		goto done;
 
 	cbs->efcbmid_contents = g_slist_reverse(contents);
+	cbs->efcbmid_set = cbs_topic_set_new(cbs->efcbmid_contents);
 
 	str = cbs_topic_ranges_to_string(cbs->efcbmid_contents);
 	DBG("Got cbmid: %s", str);
@@ -901,6 +981,8 @@ static void cbs_efcbmid_changed(int id, void *userdata)
 		cbs->efcbmid_length = 0;
 		g_slist_free_full(cbs->efcbmid_contents, g_free);
 		cbs->efcbmid_contents = NULL;
+		cbs_topic_set_free(cbs->efcbmid_set);
+		cbs->efcbmid_set = NULL;
 	}
 
 	cbs->efcbmid_update = TRUE;
@@ -16,10 +16,40 @@
 
 #include "ofono.h"
 
+#include <gdbus.h>
+
 #include <errno.h>
 #include <string.h>
 
+/*
+ * Access decisions are cached per sender. Unique bus names are never
+ * reused, so a decision stays valid until the sender leaves the bus,
+ * the set of plugins changes or a plugin tells us that its policy has
+ * changed.
+ *
+ * Arguments come straight from the client (e.g. the property name of
+ * SetProperty is checked before it's validated) so the number of
+ * decisions which depend on one is capped per sender. Once the cap is
+ * reached such calls are checked without caching.
+ */
+#define DBUS_ACCESS_MAX_ARG_DECISIONS 32
+
+struct dbus_access_key {
+	enum ofono_dbus_access_intf intf;
+	int method;
+	const char *arg;
+};
+
+struct dbus_access_sender {
+	char *name;
+	guint watch_id;
+	GHashTable *decisions;
+	guint arg_decisions;
+};
+
 static GSList *dbus_access_plugins = NULL;
+static GHashTable *dbus_access_cache = NULL;
+static struct ofono_dbus_access_cache_stats dbus_access_cache_stats;
 
 const char *ofono_dbus_access_intf_name(enum ofono_dbus_access_intf intf)
 {
@@ -208,7 +238,100 @@ const char *ofono_dbus_access_method_name(enum ofono_dbus_access_intf intf,
 	return NULL;
 }
 
-ofono_bool_t ofono_dbus_access_method_allowed(const char *sender,
+static guint dbus_access_key_hash(gconstpointer data)
+{
+	const struct dbus_access_key *key = data;
+	guint hash = key->intf * 31 + key->method;
+
+	return key->arg ? (hash ^ g_str_hash(key->arg)) : hash;
+}
+
+static gboolean dbus_access_key_equal(gconstpointer a, gconstpointer b)
+{
+	const struct dbus_access_key *k1 = a;
+	const struct dbus_access_key *k2 = b;
+
+	return k1->intf == k2->intf && k1->method == k2->method &&
+					!g_strcmp0(k1->arg, k2->arg);
+}
+
+static struct dbus_access_key *dbus_access_key_new
+				(const struct dbus_access_key *key)
+{
+	gsize len = key->arg ? (strlen(key->arg) + 1) : 0;
+	struct dbus_access_key *copy = g_malloc(sizeof(*copy) + len);
+
+	copy->intf = key->intf;
+	copy->method = key->method;
+	if (key->arg) {
+		char *arg = (char *)(copy + 1);
+
+		memcpy(arg, key->arg, len);
+		copy->arg = arg;
+	} else {
+		copy->arg = NULL;
+	}
+	return copy;
+}
+
+static void dbus_access_sender_free(gpointer data)
+{
+	struct dbus_access_sender *entry = data;
+
+	if (entry->watch_id) {
+		g_dbus_remove_watch(ofono_dbus_get_connection(),
+							entry->watch_id);
+	}
+	g_hash_table_destroy(entry->decisions);
+	g_free(entry->name);
+	g_slice_free(struct dbus_access_sender, entry);
+}
+
+static void dbus_access_sender_gone(DBusConnection *conn, void *user_data)
+{
+	struct dbus_access_sender *entry = user_data;
+
+	DBG("%s is gone", entry->name);
+	g_hash_table_remove(dbus_access_cache, entry->name);
+}
+
+static struct dbus_access_sender *dbus_access_sender_get(const char *sender)
+{
+	struct dbus_access_sender *entry;
+	DBusConnection *conn;
+
+	if (dbus_access_cache) {
+		entry = g_hash_table_lookup(dbus_access_cache, sender);
+		if (entry)
+			return entry;
+	}
+
+	/* Without a connection we can't tell when the sender is gone */
+	conn = ofono_dbus_get_connection();
+	if (!conn)
+		return NULL;
+
+	entry = g_slice_new0(struct dbus_access_sender);
+	entry->name = g_strdup(sender);
+	entry->watch_id = g_dbus_add_disconnect_watch(conn, entry->name,
+				dbus_access_sender_gone, entry, NULL);
+	if (!entry->watch_id) {
+		g_free(entry->name);
+		g_slice_free(struct dbus_access_sender, entry);
+		return NULL;
+	}
+
+	entry->decisions = g_hash_table_new_full(dbus_access_key_hash,
+					dbus_access_key_equal, g_free, NULL);
+	if (!dbus_access_cache) {
+		dbus_access_cache = g_hash_table_new_full(g_str_hash,
+				g_str_equal, NULL, dbus_access_sender_free);
+	}
+	g_hash_table_insert(dbus_access_cache, entry->name, entry);
+	return entry;
+}
+
+static ofono_bool_t dbus_access_check(const char *sender,
 					enum ofono_dbus_access_intf intf,
 					int method, const char *arg)
 {
@@ -233,6 +356,64 @@ ofono_bool_t ofono_dbus_access_method_allowed(const char *sender,
 	return TRUE;
 }
 
+ofono_bool_t ofono_dbus_access_method_allowed(const char *sender,
+					enum ofono_dbus_access_intf intf,
+					int method, const char *arg)
+{
+	struct dbus_access_sender *entry;
+	struct dbus_access_key key;
+	gpointer value;
+	ofono_bool_t allowed;
+
+	if (!dbus_access_plugins)
+		return TRUE;
+
+	entry = sender ? dbus_access_sender_get(sender) : NULL;
+	if (!entry)
+		return dbus_access_check(sender, intf, method, arg);
+
+	key.intf = intf;
+	key.method = method;
+	key.arg = arg;
+	value = g_hash_table_lookup(entry->decisions, &key);
+	if (value) {
+		dbus_access_cache_stats.hits++;
+		return GPOINTER_TO_INT(value) - 1;
+	}
+
+	if (arg) {
+		if (entry->arg_decisions >= DBUS_ACCESS_MAX_ARG_DECISIONS) {
+			dbus_access_cache_stats.uncached++;
+			return dbus_access_check(sender, intf, method, arg);
+		}
+		entry->arg_decisions++;
+	}
+
+	dbus_access_cache_stats.misses++;
+	allowed = dbus_access_check(sender, intf, method, arg);
+	g_hash_table_insert(entry->decisions, dbus_access_key_new(&key),
+					GINT_TO_POINTER(allowed + 1));
+	return allowed;
+}
+
+void ofono_dbus_access_invalidate(void)
+{
+	if (dbus_access_cache) {
+		DBG("");
+		dbus_access_cache_stats.flushes++;
+		g_hash_table_destroy(dbus_access_cache);
+		dbus_access_cache = NULL;
+	}
+}
+
+void __ofono_dbus_access_get_cache_stats
+			(struct ofono_dbus_access_cache_stats *stats)
+{
+	*stats = dbus_access_cache_stats;
+	stats->senders = dbus_access_cache ?
+		g_hash_table_size(dbus_access_cache) : 0;
+}
+
 /**
  * Returns 0 if both are equal;
  * <0 if a comes before b;
@@ -266,6 +447,7 @@ int ofono_dbus_access_plugin_register
 		DBG("%s", plugin->name);
 		dbus_access_plugins = g_slist_insert_sorted(dbus_access_plugins,
 				(void*)plugin, ofono_dbus_access_plugin_sort);
+		ofono_dbus_access_invalidate();
 		return 0;
 	}
 }
@@ -277,6 +459,7 @@ void ofono_dbus_access_plugin_unregister
 		DBG("%s", plugin->name);
 		dbus_access_plugins = g_slist_remove(dbus_access_plugins,
 								plugin);
+		ofono_dbus_access_invalidate();
 	}
 }
 
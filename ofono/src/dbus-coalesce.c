@@ -0,0 +1,617 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2021 Jolla Ltd. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include <gdbus.h>
+
+#include "ofono.h"
+
+/*
+ * Optional coalescing of PropertyChanged signals.
+ *
+ * When enabled in main.conf, property changes submitted through
+ * __ofono_dbus_coalesce_property_changed() are held for a short
+ * period of time (or until the main loop becomes idle) and only the
+ * last value of each property is emitted. All signals which are due
+ * are sent in one go. Individual properties may additionally have
+ * a minimum interval between two signals and, for numeric values,
+ * a hysteresis (minimum change worth reporting):
+ *
+ *   [PropertyChanged]
+ *   Coalesce=true
+ *   Delay=100
+ *   org.ofono.NetworkRegistration.Strength=1000,3
+ *
+ * The per-property value is "interval[,hysteresis]", interval being
+ * in milliseconds. When coalescing is disabled (the default) signals
+ * are emitted immediately, exactly as ofono_dbus_signal_property_changed
+ * would do.
+ */
+
+#define COALESCE_CONFIG_FILE            "main.conf"
+#define COALESCE_CONFIG_GROUP           "PropertyChanged"
+#define COALESCE_CONFIG_KEY_ENABLE      "Coalesce"
+#define COALESCE_CONFIG_KEY_DELAY       "Delay"
+
+/* Used for Strength unless configured otherwise */
+#define COALESCE_STRENGTH_INTERVAL_MS   (1000)
+#define COALESCE_STRENGTH_HYSTERESIS    (2)
+
+struct dbus_coalesce_policy {
+	char *interface;
+	char *name;
+	guint interval_ms;
+	guint hysteresis;
+};
+
+struct dbus_coalesce_value {
+	int type;
+	union {
+		dbus_bool_t b;
+		unsigned char y;
+		dbus_int16_t n;
+		dbus_uint16_t q;
+		dbus_int32_t i;
+		dbus_uint32_t u;
+		dbus_int64_t x;
+		dbus_uint64_t t;
+		double d;
+		char *s;
+	} v;
+};
+
+struct dbus_coalesce_prop {
+	char *key;
+	char *path;
+	char *interface;
+	char *name;
+	const struct dbus_coalesce_policy *policy;
+	struct dbus_coalesce_value last;
+	struct dbus_coalesce_value pending;
+	gboolean has_last;
+	gboolean has_pending;
+	gint64 last_emit;
+	gint64 due;
+};
+
+static gboolean coalesce_enabled;
+static guint coalesce_delay_ms;
+static GSList *coalesce_policies;
+static GHashTable *coalesce_props;
+static GSList *coalesce_queue;
+static guint coalesce_flush_id;
+static gint64 coalesce_flush_due;
+static struct ofono_dbus_coalesce_stats coalesce_stats;
+
+static void dbus_coalesce_flush(gboolean force);
+
+static gboolean dbus_coalesce_type_is_numeric(int type)
+{
+	switch (type) {
+	case DBUS_TYPE_BYTE:
+	case DBUS_TYPE_INT16:
+	case DBUS_TYPE_UINT16:
+	case DBUS_TYPE_INT32:
+	case DBUS_TYPE_UINT32:
+	case DBUS_TYPE_INT64:
+	case DBUS_TYPE_UINT64:
+	case DBUS_TYPE_DOUBLE:
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+static gboolean dbus_coalesce_type_is_string(int type)
+{
+	return type == DBUS_TYPE_STRING || type == DBUS_TYPE_OBJECT_PATH ||
+					type == DBUS_TYPE_SIGNATURE;
+}
+
+static gboolean dbus_coalesce_type_supported(int type)
+{
+	return type == DBUS_TYPE_BOOLEAN ||
+		dbus_coalesce_type_is_numeric(type) ||
+		dbus_coalesce_type_is_string(type);
+}
+
+static void dbus_coalesce_value_clear(struct dbus_coalesce_value *val)
+{
+	if (dbus_coalesce_type_is_string(val->type))
+		g_free(val->v.s);
+
+	memset(val, 0, sizeof(*val));
+}
+
+static void dbus_coalesce_value_set(struct dbus_coalesce_value *val,
+					int type, const void *value)
+{
+	dbus_coalesce_value_clear(val);
+	val->type = type;
+
+	switch (type) {
+	case DBUS_TYPE_BOOLEAN:
+		val->v.b = *(const dbus_bool_t *) value;
+		break;
+	case DBUS_TYPE_BYTE:
+		val->v.y = *(const unsigned char *) value;
+		break;
+	case DBUS_TYPE_INT16:
+		val->v.n = *(const dbus_int16_t *) value;
+		break;
+	case DBUS_TYPE_UINT16:
+		val->v.q = *(const dbus_uint16_t *) value;
+		break;
+	case DBUS_TYPE_INT32:
+		val->v.i = *(const dbus_int32_t *) value;
+		break;
+	case DBUS_TYPE_UINT32:
+		val->v.u = *(const dbus_uint32_t *) value;
+		break;
+	case DBUS_TYPE_INT64:
+		val->v.x = *(const dbus_int64_t *) value;
+		break;
+	case DBUS_TYPE_UINT64:
+		val->v.t = *(const dbus_uint64_t *) value;
+		break;
+	case DBUS_TYPE_DOUBLE:
+		val->v.d = *(const double *) value;
+		break;
+	default:
+		val->v.s = g_strdup(*(const char **) value);
+		break;
+	}
+}
+
+static void dbus_coalesce_value_copy(struct dbus_coalesce_value *dest,
+				const struct dbus_coalesce_value *src)
+{
+	dbus_coalesce_value_clear(dest);
+	*dest = *src;
+
+	if (dbus_coalesce_type_is_string(src->type))
+		dest->v.s = g_strdup(src->v.s);
+}
+
+static double dbus_coalesce_value_number(const struct dbus_coalesce_value *v)
+{
+	switch (v->type) {
+	case DBUS_TYPE_BYTE:
+		return v->v.y;
+	case DBUS_TYPE_INT16:
+		return v->v.n;
+	case DBUS_TYPE_UINT16:
+		return v->v.q;
+	case DBUS_TYPE_INT32:
+		return v->v.i;
+	case DBUS_TYPE_UINT32:
+		return v->v.u;
+	case DBUS_TYPE_INT64:
+		return v->v.x;
+	case DBUS_TYPE_UINT64:
+		return v->v.t;
+	case DBUS_TYPE_DOUBLE:
+		return v->v.d;
+	}
+
+	return 0;
+}
+
+static gboolean dbus_coalesce_value_equal(const struct dbus_coalesce_value *v1,
+				const struct dbus_coalesce_value *v2)
+{
+	if (v1->type != v2->type)
+		return FALSE;
+
+	if (v1->type == DBUS_TYPE_BOOLEAN)
+		return !v1->v.b == !v2->v.b;
+
+	if (dbus_coalesce_type_is_string(v1->type))
+		return !g_strcmp0(v1->v.s, v2->v.s);
+
+	return dbus_coalesce_value_number(v1) ==
+				dbus_coalesce_value_number(v2);
+}
+
+/* Returns TRUE if the change is too small to be worth reporting */
+static gboolean dbus_coalesce_within_hysteresis(
+				const struct dbus_coalesce_prop *prop,
+				const struct dbus_coalesce_value *val)
+{
+	double diff;
+
+	if (!prop->policy || !prop->policy->hysteresis || !prop->has_last ||
+				!dbus_coalesce_type_is_numeric(val->type) ||
+				prop->last.type != val->type)
+		return FALSE;
+
+	diff = dbus_coalesce_value_number(val) -
+				dbus_coalesce_value_number(&prop->last);
+
+	return ABS(diff) < prop->policy->hysteresis;
+}
+
+static const struct dbus_coalesce_policy *dbus_coalesce_find_policy
+				(const char *interface, const char *name)
+{
+	GSList *l;
+
+	for (l = coalesce_policies; l; l = l->next) {
+		const struct dbus_coalesce_policy *policy = l->data;
+
+		if (!strcmp(policy->name, name) &&
+				!strcmp(policy->interface, interface))
+			return policy;
+	}
+
+	return NULL;
+}
+
+static void dbus_coalesce_policy_free(gpointer data)
+{
+	struct dbus_coalesce_policy *policy = data;
+
+	g_free(policy->interface);
+	g_free(policy->name);
+	g_free(policy);
+}
+
+static void dbus_coalesce_prop_free(gpointer data)
+{
+	struct dbus_coalesce_prop *prop = data;
+
+	dbus_coalesce_value_clear(&prop->last);
+	dbus_coalesce_value_clear(&prop->pending);
+	g_free(prop->key);
+	g_free(prop->path);
+	g_free(prop->interface);
+	g_free(prop->name);
+	g_free(prop);
+}
+
+static char *dbus_coalesce_key(const char *path, const char *interface,
+							const char *name)
+{
+	return g_strconcat(path, " ", interface, " ", name, NULL);
+}
+
+static gboolean dbus_coalesce_flush_cb(gpointer user_data)
+{
+	coalesce_flush_id = 0;
+	dbus_coalesce_flush(FALSE);
+	return G_SOURCE_REMOVE;
+}
+
+static void dbus_coalesce_schedule(gint64 due, gint64 now)
+{
+	if (due < now)
+		due = now;
+
+	if (coalesce_flush_id) {
+		/* Don't let a later flush delay the one which is due now */
+		if (coalesce_flush_due <= due)
+			return;
+
+		g_source_remove(coalesce_flush_id);
+	}
+
+	coalesce_flush_due = due;
+	if (due > now) {
+		guint ms = (guint) ((due - now + 999) / 1000);
+
+		coalesce_flush_id = g_timeout_add(ms,
+					dbus_coalesce_flush_cb, NULL);
+	} else {
+		coalesce_flush_id = g_idle_add(dbus_coalesce_flush_cb, NULL);
+	}
+}
+
+static void dbus_coalesce_emit(struct dbus_coalesce_prop *prop, gint64 now)
+{
+	struct dbus_coalesce_value *val = &prop->pending;
+	const void *value = &val->v;
+
+	ofono_dbus_signal_property_changed(ofono_dbus_get_connection(),
+				prop->path, prop->interface, prop->name,
+				val->type, value);
+
+	coalesce_stats.emitted++;
+	dbus_coalesce_value_copy(&prop->last, val);
+	dbus_coalesce_value_clear(val);
+	prop->has_last = TRUE;
+	prop->has_pending = FALSE;
+	prop->last_emit = now;
+}
+
+static void dbus_coalesce_flush(gboolean force)
+{
+	const gint64 now = g_get_monotonic_time();
+	GSList *queue = g_slist_reverse(coalesce_queue);
+	GSList *l;
+	gint64 next = 0;
+
+	coalesce_queue = NULL;
+	if (coalesce_flush_id) {
+		g_source_remove(coalesce_flush_id);
+		coalesce_flush_id = 0;
+	}
+
+	for (l = queue; l; l = l->next) {
+		struct dbus_coalesce_prop *prop = l->data;
+
+		if (!force && prop->due > now) {
+			coalesce_queue = g_slist_prepend(coalesce_queue, prop);
+			if (!next || prop->due < next)
+				next = prop->due;
+			continue;
+		}
+
+		dbus_coalesce_emit(prop, now);
+	}
+
+	g_slist_free(queue);
+
+	if (coalesce_queue)
+		dbus_coalesce_schedule(next, now);
+}
+
+static void dbus_coalesce_dequeue(struct dbus_coalesce_prop *prop)
+{
+	if (prop->has_pending) {
+		coalesce_queue = g_slist_remove(coalesce_queue, prop);
+		dbus_coalesce_value_clear(&prop->pending);
+		prop->has_pending = FALSE;
+	}
+}
+
+int __ofono_dbus_coalesce_property_changed(DBusConnection *conn,
+					const char *path,
+					const char *interface,
+					const char *name,
+					int type, const void *value)
+{
+	struct dbus_coalesce_prop *prop;
+	struct dbus_coalesce_value val;
+	gint64 now;
+	char *key;
+
+	if (!coalesce_enabled || !dbus_coalesce_type_supported(type))
+		return ofono_dbus_signal_property_changed(conn, path,
+					interface, name, type, value);
+
+	key = dbus_coalesce_key(path, interface, name);
+	prop = g_hash_table_lookup(coalesce_props, key);
+	if (prop) {
+		g_free(key);
+	} else {
+		prop = g_new0(struct dbus_coalesce_prop, 1);
+		prop->key = key;
+		prop->path = g_strdup(path);
+		prop->interface = g_strdup(interface);
+		prop->name = g_strdup(name);
+		prop->policy = dbus_coalesce_find_policy(interface, name);
+		g_hash_table_insert(coalesce_props, prop->key, prop);
+	}
+
+	memset(&val, 0, sizeof(val));
+	dbus_coalesce_value_set(&val, type, value);
+
+	if (prop->has_last && (dbus_coalesce_value_equal(&prop->last, &val) ||
+			dbus_coalesce_within_hysteresis(prop, &val))) {
+		/* Clients already have this value (or close enough) */
+		dbus_coalesce_dequeue(prop);
+		dbus_coalesce_value_clear(&val);
+		coalesce_stats.suppressed++;
+		return 0;
+	}
+
+	now = g_get_monotonic_time();
+
+	if (prop->has_pending) {
+		/* Replace the value that hasn't been emitted yet */
+		dbus_coalesce_value_clear(&prop->pending);
+		coalesce_stats.suppressed++;
+	} else {
+		prop->due = now + coalesce_delay_ms * 1000;
+		if (prop->policy && prop->has_last) {
+			const gint64 earliest = prop->last_emit +
+				prop->policy->interval_ms * (gint64) 1000;
+
+			if (prop->due < earliest)
+				prop->due = earliest;
+		}
+
+		prop->has_pending = TRUE;
+		coalesce_queue = g_slist_prepend(coalesce_queue, prop);
+	}
+
+	prop->pending = val;
+	dbus_coalesce_schedule(prop->due, now);
+	return 0;
+}
+
+void __ofono_dbus_coalesce_cancel(const char *path, const char *interface)
+{
+	GHashTableIter it;
+	gpointer value;
+
+	if (!coalesce_props)
+		return;
+
+	g_hash_table_iter_init(&it, coalesce_props);
+	while (g_hash_table_iter_next(&it, NULL, &value)) {
+		struct dbus_coalesce_prop *prop = value;
+
+		if (strcmp(prop->path, path))
+			continue;
+
+		if (interface && strcmp(prop->interface, interface))
+			continue;
+
+		dbus_coalesce_dequeue(prop);
+		g_hash_table_iter_remove(&it);
+	}
+}
+
+void __ofono_dbus_coalesce_flush(void)
+{
+	dbus_coalesce_flush(TRUE);
+}
+
+void __ofono_dbus_coalesce_set_policy(const char *interface,
+			const char *name, unsigned int interval_ms,
+			unsigned int hysteresis)
+{
+	struct dbus_coalesce_policy *policy = (struct dbus_coalesce_policy *)
+				dbus_coalesce_find_policy(interface, name);
+	GHashTableIter it;
+	gpointer value;
+
+	if (!policy) {
+		policy = g_new0(struct dbus_coalesce_policy, 1);
+		policy->interface = g_strdup(interface);
+		policy->name = g_strdup(name);
+		coalesce_policies = g_slist_append(coalesce_policies, policy);
+	}
+
+	DBG("%s.%s %u ms, hysteresis %u", interface, name, interval_ms,
+								hysteresis);
+	policy->interval_ms = interval_ms;
+	policy->hysteresis = hysteresis;
+
+	if (!coalesce_props)
+		return;
+
+	g_hash_table_iter_init(&it, coalesce_props);
+	while (g_hash_table_iter_next(&it, NULL, &value)) {
+		struct dbus_coalesce_prop *prop = value;
+
+		if (!strcmp(prop->name, name) &&
+				!strcmp(prop->interface, interface))
+			prop->policy = policy;
+	}
+}
+
+ofono_bool_t __ofono_dbus_coalesce_enabled(void)
+{
+	return coalesce_enabled;
+}
+
+void __ofono_dbus_coalesce_get_stats(struct ofono_dbus_coalesce_stats *stats)
+{
+	*stats = coalesce_stats;
+}
+
+static void dbus_coalesce_parse_policy(GKeyFile *conf, const char *key)
+{
+	const char *dot = strrchr(key, '.');
+	char *value;
+	char **vals;
+	char *interface;
+	unsigned int interval, hysteresis = 0;
+
+	if (!dot || dot == key || !dot[1])
+		return;
+
+	value = g_key_file_get_string(conf, COALESCE_CONFIG_GROUP, key, NULL);
+	if (!value)
+		return;
+
+	vals = g_strsplit(value, ",", 2);
+	interval = atoi(vals[0]);
+	if (vals[1])
+		hysteresis = atoi(vals[1]);
+
+	interface = g_strndup(key, dot - key);
+	__ofono_dbus_coalesce_set_policy(interface, dot + 1, interval,
+								hysteresis);
+	g_free(interface);
+	g_strfreev(vals);
+	g_free(value);
+}
+
+static void dbus_coalesce_load_config(void)
+{
+	GKeyFile *conf = g_key_file_new();
+	char *fn = g_build_filename(ofono_config_dir(), COALESCE_CONFIG_FILE,
+									NULL);
+
+	if (g_key_file_load_from_file(conf, fn, 0, NULL)) {
+		char **keys = g_key_file_get_keys(conf, COALESCE_CONFIG_GROUP,
+								NULL, NULL);
+		gboolean enable;
+		int ival;
+
+		if (ofono_conf_get_boolean(conf, COALESCE_CONFIG_GROUP,
+				COALESCE_CONFIG_KEY_ENABLE, &enable))
+			coalesce_enabled = enable;
+
+		if (ofono_conf_get_integer(conf, COALESCE_CONFIG_GROUP,
+				COALESCE_CONFIG_KEY_DELAY, &ival) && ival >= 0)
+			coalesce_delay_ms = ival;
+
+		if (keys) {
+			char **ptr;
+
+			for (ptr = keys; *ptr; ptr++)
+				dbus_coalesce_parse_policy(conf, *ptr);
+
+			g_strfreev(keys);
+		}
+	}
+
+	g_key_file_free(conf);
+	g_free(fn);
+}
+
+void __ofono_dbus_coalesce_init(void)
+{
+	coalesce_props = g_hash_table_new_full(g_str_hash, g_str_equal,
+					NULL, dbus_coalesce_prop_free);
+
+	if (!dbus_coalesce_find_policy(OFONO_NETWORK_REGISTRATION_INTERFACE,
+								"Strength"))
+		__ofono_dbus_coalesce_set_policy(
+				OFONO_NETWORK_REGISTRATION_INTERFACE,
+				"Strength", COALESCE_STRENGTH_INTERVAL_MS,
+				COALESCE_STRENGTH_HYSTERESIS);
+
+	dbus_coalesce_load_config();
+	DBG("%s, delay %u ms", coalesce_enabled ? "enabled" : "disabled",
+							coalesce_delay_ms);
+}
+
+void __ofono_dbus_coalesce_cleanup(void)
+{
+	dbus_coalesce_flush(TRUE);
+
+	DBG("%u signal(s) emitted, %u suppressed", coalesce_stats.emitted,
+						coalesce_stats.suppressed);
+
+	g_hash_table_destroy(coalesce_props);
+	coalesce_props = NULL;
+	g_slist_free_full(coalesce_policies, dbus_coalesce_policy_free);
+	coalesce_policies = NULL;
+	coalesce_enabled = FALSE;
+	coalesce_delay_ms = 0;
+	memset(&coalesce_stats, 0, sizeof(coalesce_stats));
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 8
+ * indent-tabs-mode: t
+ * End:
+ */
@@ -36,6 +36,9 @@ struct gprs_filter_request {
 	GSList *filter_link;
 	guint pending_id;
 	guint next_id;
+	GSourceFunc sync_next;
+	gboolean in_process;
+	gint64 start;
 	ofono_destroy_func destroy;
 	void* user_data;
 };
@@ -58,6 +61,16 @@ struct gprs_filter_chain {
 
 static GSList *gprs_filter_list = NULL;
 
+static void gprs_filter_latency_add(struct gprs_filter_request *req)
+{
+	const struct ofono_gprs_filter *f = req->filter_link->data;
+
+	if (req->chain)
+		__ofono_metrics_filter_done(
+				ofono_gprs_get_modem(req->chain->gprs),
+				"gprs-filter", f->name, req->start);
+}
+
 static void gprs_filter_request_init(struct gprs_filter_request *req,
 		const struct gprs_filter_request_fn *fn,
 		struct gprs_filter_chain *chain, struct ofono_gprs_context *gc,
@@ -166,32 +179,77 @@ static void gprs_filter_request_complete(struct gprs_filter_request *req,
 	gprs_filter_request_unref(req);
 }
 
-static void gprs_filter_request_process(struct gprs_filter_request *req)
+static GSList *gprs_filter_request_find(struct gprs_filter_request *req,
+								GSList *l)
 {
-	GSList *l = req->filter_link;
-	const struct ofono_gprs_filter *f = l->data;
-	const struct gprs_filter_request_fn *fn = req->fn;
-
-	while (f && !fn->can_process(f)) {
+	while (l && !req->fn->can_process(l->data)) {
 		l = l->next;
-		f = l ? l->data : NULL;
 	}
+	return l;
+}
+
+static gboolean gprs_filter_request_continue_cb(gpointer data);
+
+static void gprs_filter_request_process(struct gprs_filter_request *req)
+{
+	GSList *l = gprs_filter_request_find(req, req->filter_link);
 
 	gprs_filter_request_ref(req);
-	if (f) {
-		req->filter_link = l;
-		req->pending_id = fn->process(f, req);
-	} else {
+	if (!l) {
 		gprs_filter_request_complete(req, TRUE);
 	}
+
+	while (l) {
+		GSourceFunc next;
+
+		req->filter_link = l;
+		req->start = g_get_monotonic_time();
+		req->in_process = TRUE;
+		req->pending_id = req->fn->process(l->data, req);
+		req->in_process = FALSE;
+
+		next = req->sync_next;
+		if (!next) {
+			/* The filter will call us back later */
+			break;
+		}
+
+		req->sync_next = NULL;
+		req->pending_id = 0;
+		if (!req->chain) {
+			/* Request has been canceled by the callback */
+			break;
+		}
+
+		/*
+		 * The filter has completed synchronously. Go straight
+		 * to the next one without a round trip through the main
+		 * loop. The final result is still delivered from idle
+		 * callback, as it always has been.
+		 */
+		if (next == gprs_filter_request_continue_cb) {
+			l = gprs_filter_request_find(req, l->next);
+			if (l) {
+				continue;
+			}
+		}
+		req->next_id = g_idle_add(next, req);
+		break;
+	}
 	gprs_filter_request_unref(req);
 }
 
 static void gprs_filter_request_next(struct gprs_filter_request *req,
 							GSourceFunc fn)
 {
+	gprs_filter_latency_add(req);
 	req->pending_id = 0;
-	req->next_id = g_idle_add(fn, req);
+	if (req->in_process) {
+		/* Picked up by gprs_filter_request_process() */
+		req->sync_next = fn;
+	} else {
+		req->next_id = g_idle_add(fn, req);
+	}
 }
 
 static gboolean gprs_filter_request_continue_cb(gpointer data)
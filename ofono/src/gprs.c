@@ -49,6 +49,7 @@
 #include "simutil.h"
 #include "util.h"
 #include "watch_p.h"
+#include "probes.h"
 
 #define GPRS_FLAG_ATTACHING 0x1
 #define GPRS_FLAG_RECHECK 0x2
@@ -72,6 +73,7 @@ struct ofono_gprs {
 	int status;
 	int flags;
 	int bearer;
+	gint64 attach_started; /* for the request metrics */
 	guint suspend_timeout;
 	struct idmap *pid_map;
 	unsigned int last_context_id;
@@ -140,6 +142,8 @@ struct pri_context {
 	struct ofono_gprs_primary_context context;
 	struct ofono_gprs_context *context_driver;
 	struct ofono_gprs *gprs;
+	gint64 request_started;
+	enum ofono_metrics_op request_op; /* activation or deactivation */
 };
 
 /*
@@ -1130,6 +1134,26 @@ static DBusMessage *pri_get_properties(DBusConnection *conn,
 	return reply;
 }
 
+/* A context has at most one request in progress at a time */
+static void pri_metrics_start(struct pri_context *ctx,
+					enum ofono_metrics_op op)
+{
+	ctx->request_started = g_get_monotonic_time();
+	ctx->request_op = op;
+}
+
+static void pri_metrics_done(struct pri_context *ctx,
+					enum ofono_metrics_op op,
+					const struct ofono_error *error)
+{
+	/* Don't time a completion against the start of another request */
+	gint64 started = (ctx->request_op == op) ? ctx->request_started : 0;
+
+	__ofono_metrics_done(__ofono_atom_get_modem(ctx->gprs->atom), op,
+					started, error);
+	ctx->request_started = 0;
+}
+
 static void pri_activate_callback(const struct ofono_error *error, void *data)
 {
 	struct pri_context *ctx = data;
@@ -1137,6 +1161,11 @@ static void pri_activate_callback(const struct ofono_error *error, void *data)
 	DBusConnection *conn = ofono_dbus_get_connection();
 	dbus_bool_t value;
 
+	OFONO_PROBE3(context_activate_done, ctx, ctx->context.cid,
+								error->type);
+	pri_metrics_done(ctx, OFONO_METRICS_GPRS_CONTEXT_ACTIVATE_PRIMARY,
+								error);
+
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
 		DBG("Activating context failed with error: %s",
 				telephony_error_to_str(error));
@@ -1176,6 +1205,11 @@ static void pri_deactivate_callback(const struct ofono_error *error, void *data)
 	DBusConnection *conn = ofono_dbus_get_connection();
 	dbus_bool_t value;
 
+	OFONO_PROBE3(context_deactivate_done, ctx, ctx->context.cid,
+								error->type);
+	pri_metrics_done(ctx, OFONO_METRICS_GPRS_CONTEXT_DEACTIVATE_PRIMARY,
+								error);
+
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
 		DBG("Deactivating context failed with error: %s",
 				telephony_error_to_str(error));
@@ -1577,6 +1611,9 @@ static void pri_activate_filt(const struct ofono_gprs_primary_context *ctx,
 	if (ctx) {
 		struct ofono_gprs_context *gc = pri->context_driver;
 
+		OFONO_PROBE2(context_activate, pri, ctx->cid);
+		pri_metrics_start(pri,
+				OFONO_METRICS_GPRS_CONTEXT_ACTIVATE_PRIMARY);
 		gc->driver->activate_primary(gc, ctx, pri_activate_callback,
 									pri);
 	} else if (pri->pending != NULL) {
@@ -1643,13 +1680,18 @@ static DBusMessage *pri_set_property(DBusConnection *conn,
 
 		ctx->pending = dbus_message_ref(msg);
 
-		if (value)
+		if (value) {
 			__ofono_gprs_filter_chain_activate(gc->gprs->filters,
 				gc, &ctx->context, pri_activate_filt,
 				pri_request_free, pri_request_new(ctx));
-		else
+		} else {
+			OFONO_PROBE2(context_deactivate, ctx,
+						ctx->context.cid);
+			pri_metrics_start(ctx,
+				OFONO_METRICS_GPRS_CONTEXT_DEACTIVATE_PRIMARY);
 			gc->driver->deactivate_primary(gc, ctx->context.cid,
 						pri_deactivate_callback, ctx);
+		}
 
 		return NULL;
 	}
@@ -2045,6 +2087,11 @@ static void gprs_attach_callback(const struct ofono_error *error, void *data)
 
 	DBG("%s error = %d", __ofono_atom_get_path(gprs->atom), error->type);
 
+	__ofono_metrics_done(__ofono_atom_get_modem(gprs->atom),
+				OFONO_METRICS_GPRS_SET_ATTACHED,
+				gprs->attach_started, error);
+	gprs->attach_started = 0;
+
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR)
 		gprs->driver_attached = !gprs->driver_attached;
 
@@ -2112,6 +2159,7 @@ static void gprs_netreg_update(struct ofono_gprs *gprs)
 	gprs->flags |= GPRS_FLAG_ATTACHING;
 
 	gprs->driver_attached = attach;
+	gprs->attach_started = g_get_monotonic_time();
 	gprs->driver->set_attached(gprs, attach, gprs_attach_callback, gprs);
 }
 
@@ -2524,6 +2572,11 @@ static void gprs_deactivate_for_remove(const struct ofono_error *error,
 	const char *atompath;
 	dbus_bool_t value;
 
+	OFONO_PROBE3(context_deactivate_done, ctx, ctx->context.cid,
+								error->type);
+	pri_metrics_done(ctx, OFONO_METRICS_GPRS_CONTEXT_DEACTIVATE_PRIMARY,
+								error);
+
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
 		DBG("Removing context failed with error: %s",
 				telephony_error_to_str(error));
@@ -2597,6 +2650,9 @@ static DBusMessage *gprs_remove_context(DBusConnection *conn,
 		struct ofono_gprs_context *gc = ctx->context_driver;
 
 		gprs->pending = dbus_message_ref(msg);
+		OFONO_PROBE2(context_deactivate, ctx, ctx->context.cid);
+		pri_metrics_start(ctx,
+				OFONO_METRICS_GPRS_CONTEXT_DEACTIVATE_PRIMARY);
 		gc->driver->deactivate_primary(gc, ctx->context.cid,
 					gprs_deactivate_for_remove, ctx);
 		return NULL;
@@ -2627,6 +2683,11 @@ static void gprs_deactivate_for_all(const struct ofono_error *error,
 	struct pri_context *ctx = data;
 	struct ofono_gprs *gprs = ctx->gprs;
 
+	OFONO_PROBE3(context_deactivate_done, ctx, ctx->context.cid,
+								error->type);
+	pri_metrics_done(ctx, OFONO_METRICS_GPRS_CONTEXT_DEACTIVATE_PRIMARY,
+								error);
+
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
 		__ofono_dbus_pending_reply(&gprs->pending,
 					__ofono_error_failed(gprs->pending));
@@ -2653,6 +2714,9 @@ static void gprs_deactivate_next(struct ofono_gprs *gprs)
 			continue;
 
 		gc = ctx->context_driver;
+		OFONO_PROBE2(context_deactivate, ctx, ctx->context.cid);
+		pri_metrics_start(ctx,
+				OFONO_METRICS_GPRS_CONTEXT_DEACTIVATE_PRIMARY);
 		gc->driver->deactivate_primary(gc, ctx->context.cid,
 					gprs_deactivate_for_all, ctx);
 
@@ -3058,6 +3122,7 @@ void ofono_gprs_status_notify(struct ofono_gprs *gprs, int status)
 
 detach:
 	gprs->flags |= GPRS_FLAG_ATTACHING;
+	gprs->attach_started = g_get_monotonic_time();
 	gprs->driver->set_attached(gprs, FALSE, gprs_attach_callback, gprs);
 }
 
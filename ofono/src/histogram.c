@@ -0,0 +1,105 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2021 Jolla Ltd. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "histogram.h"
+
+void histogram_reset(struct histogram *h)
+{
+	memset(h, 0, sizeof(*h));
+}
+
+void histogram_add(struct histogram *h, guint64 usec)
+{
+	guint64 msec = usec / 1000;
+	unsigned int i = msec ? (64 - __builtin_clzll(msec)) : 0;
+
+	h->bucket[MIN(i, HISTOGRAM_BUCKETS - 1)]++;
+	h->count++;
+	h->sum_us += usec;
+
+	if (usec > h->max_us)
+		h->max_us = usec;
+}
+
+/* Upper limit of the bucket in milliseconds, zero if there's none */
+unsigned int histogram_bucket_limit(unsigned int bucket)
+{
+	if (bucket >= HISTOGRAM_BUCKETS - 1)
+		return 0;
+
+	return 1U << bucket;
+}
+
+/*
+ * Returns the upper limit (in milliseconds) of the bucket containing
+ * the given percentile, zero if it's in the last bucket or there's
+ * no samples at all.
+ */
+unsigned int histogram_percentile(const struct histogram *h,
+						unsigned int percent)
+{
+	guint64 target;
+	guint64 n = 0;
+	unsigned int i;
+
+	if (!h->count)
+		return 0;
+
+	target = ((guint64) h->count * MIN(percent, 100) + 99) / 100;
+
+	for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+		n += h->bucket[i];
+
+		if (n >= target && n)
+			return histogram_bucket_limit(i);
+	}
+
+	return 0;
+}
+
+char *histogram_to_string(const struct histogram *h)
+{
+	GString *buf = g_string_new(NULL);
+	unsigned int i;
+
+	g_string_append_printf(buf, "%u samples, avg %u us, max %u us",
+			h->count, h->count ? (guint) (h->sum_us / h->count) : 0,
+			(guint) h->max_us);
+
+	for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+		unsigned int limit = histogram_bucket_limit(i);
+
+		if (!h->bucket[i])
+			continue;
+
+		if (limit)
+			g_string_append_printf(buf, ", <%u ms: %u", limit,
+								h->bucket[i]);
+		else
+			g_string_append_printf(buf, ", >=%u ms: %u",
+					1U << (HISTOGRAM_BUCKETS - 2),
+					h->bucket[i]);
+	}
+
+	return g_string_free(buf, FALSE);
+}
@@ -0,0 +1,35 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2021 Jolla Ltd. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+/*
+ * Latency histogram with power of two millisecond buckets. Bucket 0
+ * counts samples below 1 ms, bucket n (n > 0) samples in the range
+ * [2^(n-1), 2^n) ms and the last bucket everything above that.
+ */
+#define HISTOGRAM_BUCKETS 16
+
+struct histogram {
+	unsigned int bucket[HISTOGRAM_BUCKETS];
+	unsigned int count;
+	guint64 sum_us;
+	guint64 max_us;
+};
+
+void histogram_reset(struct histogram *h);
+void histogram_add(struct histogram *h, guint64 usec);
+unsigned int histogram_bucket_limit(unsigned int bucket);
+unsigned int histogram_percentile(const struct histogram *h,
+						unsigned int percent);
+char *histogram_to_string(const struct histogram *h);
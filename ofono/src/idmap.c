@@ -37,6 +37,9 @@ struct idmap {
 	unsigned int size;
 	unsigned int min;
 	unsigned int max;
+	unsigned int count;	/* Number of ids taken */
+	unsigned int hint;	/* No free bits below this one */
+	unsigned int cursor;	/* Where idmap_alloc_cyclic continues */
 };
 
 static inline int ffz(unsigned long word)
@@ -123,32 +126,65 @@ void idmap_free(struct idmap *idmap)
 	g_free(idmap);
 }
 
-void idmap_put(struct idmap *idmap, unsigned int id)
+static inline unsigned long bit_mask(unsigned int bit)
 {
-	unsigned int offset = (id - idmap->min) / BITS_PER_LONG;
+	return 1UL << (bit % BITS_PER_LONG);
+}
+
+static inline int bit_is_set(struct idmap *idmap, unsigned int bit)
+{
+	return (idmap->bits[bit / BITS_PER_LONG] & bit_mask(bit)) != 0;
+}
+
+static void set_bit(struct idmap *idmap, unsigned int bit)
+{
+	unsigned int offset = bit / BITS_PER_LONG;
+
+	if (idmap->bits[offset] & bit_mask(bit))
+		return;
 
-	id -= idmap->min;
+	idmap->bits[offset] |= bit_mask(bit);
+	idmap->count++;
+}
+
+static void clear_bit(struct idmap *idmap, unsigned int bit)
+{
+	unsigned int offset = bit / BITS_PER_LONG;
 
-	if (id > idmap->size)
+	if (!(idmap->bits[offset] & bit_mask(bit)))
 		return;
 
-	id %= BITS_PER_LONG;
+	idmap->bits[offset] &= ~bit_mask(bit);
+	idmap->count--;
+
+	if (bit < idmap->hint)
+		idmap->hint = bit;
+}
+
+void idmap_put(struct idmap *idmap, unsigned int id)
+{
+	unsigned int bit = id - idmap->min;
+
+	if (bit >= idmap->size)
+		return;
 
-	idmap->bits[offset] &= ~(1UL << id);
+	clear_bit(idmap, bit);
 }
 
 unsigned int idmap_alloc(struct idmap *idmap)
 {
 	unsigned int bit;
-	unsigned int offset;
 
-	bit = find_next_zero_bit(idmap->bits, idmap->size, 0);
+	if (idmap->count == idmap->size)
+		return idmap->max + 1;
+
+	bit = find_next_zero_bit(idmap->bits, idmap->size, idmap->hint);
 
 	if (bit >= idmap->size)
 		return idmap->max + 1;
 
-	offset = bit / BITS_PER_LONG;
-	idmap->bits[offset] |= 1UL << (bit % BITS_PER_LONG);
+	set_bit(idmap, bit);
+	idmap->hint = bit + 1;
 
 	return bit + idmap->min;
 }
@@ -156,25 +192,21 @@ unsigned int idmap_alloc(struct idmap *idmap)
 void idmap_take(struct idmap *idmap, unsigned int id)
 {
 	unsigned int bit = id - idmap->min;
-	unsigned int offset;
 
 	if (bit >= idmap->size)
 		return;
 
-	offset = bit / BITS_PER_LONG;
-	idmap->bits[offset] |= 1UL << (bit % BITS_PER_LONG);
+	set_bit(idmap, bit);
 }
 
 int idmap_find(struct idmap *idmap, unsigned int id)
 {
 	unsigned int bit = id - idmap->min;
-	unsigned int offset;
 
 	if (bit >= idmap->size)
 		return 0;
 
-	offset = bit / BITS_PER_LONG;
-	return (idmap->bits[offset] & (1UL << (bit % BITS_PER_LONG))) != 0;
+	return bit_is_set(idmap, bit);
 }
 
 /*
@@ -185,23 +217,120 @@ int idmap_find(struct idmap *idmap, unsigned int id)
 unsigned int idmap_alloc_next(struct idmap *idmap, unsigned int last)
 {
 	unsigned int bit;
-	unsigned int offset;
 
 	if (last < idmap->min || last > idmap->max)
 		return idmap->max + 1;
 
+	if (idmap->count == idmap->size)
+		return idmap->max + 1;
+
 	bit = find_next_zero_bit(idmap->bits, idmap->size,
 					last - idmap->min + 1);
 
 	if (bit >= idmap->size)
 		return idmap_alloc(idmap);
 
-	offset = bit / BITS_PER_LONG;
-	idmap->bits[offset] |= 1UL << (bit % BITS_PER_LONG);
+	set_bit(idmap, bit);
 
 	return bit + idmap->min;
 }
 
+/*
+ * Allocate ids in a round-robin fashion, continuing from the id allocated
+ * last time.  A released id is therefore not handed out again until the
+ * rest of the range has been gone through, and the search doesn't start
+ * from the beginning of a mostly allocated map every time.
+ */
+unsigned int idmap_alloc_cyclic(struct idmap *idmap)
+{
+	unsigned int bit;
+
+	if (idmap->count == idmap->size)
+		return idmap->max + 1;
+
+	bit = find_next_zero_bit(idmap->bits, idmap->size, idmap->cursor);
+
+	if (bit >= idmap->size)
+		bit = find_next_zero_bit(idmap->bits, idmap->size,
+								idmap->hint);
+
+	set_bit(idmap, bit);
+	idmap->cursor = bit + 1;
+
+	return bit + idmap->min;
+}
+
+/*
+ * Calls fn for each word touched by the [first, last] id range with the
+ * mask of the bits within the range.  The range is clipped to the map.
+ */
+static void foreach_range_word(struct idmap *idmap, unsigned int first,
+				unsigned int last,
+				void (*fn)(struct idmap *idmap,
+						unsigned int offset,
+						unsigned long mask))
+{
+	unsigned int bit;
+	unsigned int end;
+
+	if (first > last || last < idmap->min || first > idmap->max)
+		return;
+
+	bit = MAX(first, idmap->min) - idmap->min;
+	end = MIN(last, idmap->max) - idmap->min + 1;
+
+	while (bit < end) {
+		unsigned int shift = bit % BITS_PER_LONG;
+		unsigned int n = MIN(BITS_PER_LONG - shift, end - bit);
+		unsigned long mask = (n == BITS_PER_LONG) ? ~0UL :
+							((1UL << n) - 1);
+
+		fn(idmap, bit / BITS_PER_LONG, mask << shift);
+		bit += n;
+	}
+}
+
+static void take_word(struct idmap *idmap, unsigned int offset,
+							unsigned long mask)
+{
+	idmap->count += __builtin_popcountl(mask & ~idmap->bits[offset]);
+	idmap->bits[offset] |= mask;
+}
+
+static void put_word(struct idmap *idmap, unsigned int offset,
+							unsigned long mask)
+{
+	unsigned long cleared = mask & idmap->bits[offset];
+	unsigned int bit;
+
+	if (!cleared)
+		return;
+
+	idmap->count -= __builtin_popcountl(cleared);
+	idmap->bits[offset] &= ~mask;
+
+	bit = offset * BITS_PER_LONG + __builtin_ctzl(cleared);
+	if (bit < idmap->hint)
+		idmap->hint = bit;
+}
+
+void idmap_take_range(struct idmap *idmap, unsigned int first,
+							unsigned int last)
+{
+	foreach_range_word(idmap, first, last, take_word);
+}
+
+void idmap_put_range(struct idmap *idmap, unsigned int first,
+							unsigned int last)
+{
+	foreach_range_word(idmap, first, last, put_word);
+}
+
+unsigned int idmap_count(struct idmap *idmap)
+{
+	return idmap->count;
+}
+
 unsigned int idmap_get_min(struct idmap *idmap)
 {
 	return idmap->min;
@@ -28,6 +28,12 @@ void idmap_take(struct idmap *idmap, unsigned int id);
 int idmap_find(struct idmap *idmap, unsigned int id);
 unsigned int idmap_alloc(struct idmap *idmap);
 unsigned int idmap_alloc_next(struct idmap *idmap, unsigned int last);
+unsigned int idmap_alloc_cyclic(struct idmap *idmap);
+void idmap_take_range(struct idmap *idmap, unsigned int first,
+							unsigned int last);
+void idmap_put_range(struct idmap *idmap, unsigned int first,
+							unsigned int last);
+unsigned int idmap_count(struct idmap *idmap);
 struct idmap *idmap_new_from_range(unsigned int min, unsigned int max);
 unsigned int idmap_get_min(struct idmap *idmap);
 unsigned int idmap_get_max(struct idmap *idmap);
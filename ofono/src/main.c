@@ -39,6 +39,7 @@
 #endif
 
 #include "ofono.h"
+#include "capture.h"
 
 #define SHUTDOWN_GRACE_SECONDS 10
 
@@ -137,6 +138,7 @@ static void system_bus_disconnected(DBusConnection *conn, void *user_data)
 static gchar *option_debug = NULL;
 static gchar *option_plugin = NULL;
 static gchar *option_noplugin = NULL;
+static gchar *option_capture = NULL;
 static gboolean option_detach = TRUE;
 static gboolean option_version = FALSE;
 static gboolean option_backtrace = TRUE;
@@ -169,6 +171,8 @@ static GOptionEntry options[] = {
 				"Specify plugins to load", "NAME,..," },
 	{ "noplugin", 'P', 0, G_OPTION_ARG_STRING, &option_noplugin,
 				"Specify plugins not to load", "NAME,..." },
+	{ "capture", 'c', 0, G_OPTION_ARG_FILENAME, &option_capture,
+				"Capture modem traffic, saved on exit", "FILE" },
 	{ "nodetach", 'n', G_OPTION_FLAG_REVERSE,
 				G_OPTION_ARG_NONE, &option_detach,
 				"Don't run as daemon in background" },
@@ -238,6 +242,16 @@ int main(int argc, char **argv)
 		exit(0);
 	}
 
+	/* daemon() changes the working directory to / */
+	if (option_capture && !g_path_is_absolute(option_capture)) {
+		char *cwd = g_get_current_dir();
+		char *path = g_build_filename(cwd, option_capture, NULL);
+
+		g_free(option_capture);
+		option_capture = path;
+		g_free(cwd);
+	}
+
 	if (option_detach == TRUE) {
 		if (daemon(0, 0)) {
 			perror("Can't start daemon");
@@ -269,6 +283,9 @@ int main(int argc, char **argv)
 	__ofono_log_init(argv[0], option_debug, option_detach,
 							option_backtrace);
 
+	if (option_capture && capture_start(CAPTURE_DEFAULT_SIZE) < 0)
+		ofono_error("Unable to start capturing modem traffic");
+
 	dbus_error_init(&error);
 
 	conn = g_dbus_setup_bus(DBUS_BUS_SYSTEM, NULL, &error);
@@ -289,6 +306,10 @@ int main(int argc, char **argv)
 
 	__ofono_dbus_init(conn);
 
+	__ofono_dbus_coalesce_init();
+
+	__ofono_storage_init();
+
 	__ofono_modemwatch_init();
 
 	__ofono_manager_init();
@@ -309,12 +330,24 @@ int main(int argc, char **argv)
 
 	__ofono_plugin_cleanup();
 
+	if (capture_active) {
+		int err = capture_ring_save(capture_active, option_capture);
+
+		if (err < 0)
+			ofono_error("Unable to save capture to %s: %s",
+					option_capture, strerror(-err));
+	}
+
         __ofono_slot_manager_cleanup();
 
 	__ofono_manager_cleanup();
 
 	__ofono_modemwatch_cleanup();
 
+	__ofono_storage_cleanup();
+
+	__ofono_dbus_coalesce_cleanup();
+
 	__ofono_dbus_cleanup();
 	dbus_connection_unref(conn);
 
@@ -327,9 +360,12 @@ cleanup:
 #endif
 	g_main_loop_unref(event_loop);
 
+	capture_stop();
+
 	__ofono_log_cleanup(option_backtrace);
 
 	g_free(option_debug);
+	g_free(option_capture);
 
 	return 0;
 }
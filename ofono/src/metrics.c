@@ -0,0 +1,290 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2021 Jolla Ltd. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+
+#include <glib.h>
+#include <gdbus.h>
+
+#include "ofono.h"
+#include "histogram.h"
+
+/*
+ * Round trip times of driver requests, from the core call site to the
+ * driver callback. Callers keep the g_get_monotonic_time() of each
+ * request next to its other state and hand it in on completion, so
+ * overlapping requests of the same kind are timed separately.
+ * Everything runs in the main loop so the recording path needs no
+ * locking, and all the storage is allocated together with the modem.
+ *
+ * Filters come and go with plugins, so their processing times are kept
+ * in a table keyed by chain and filter name which is filled on demand.
+ */
+
+#define METRICS_FILTER_NAME_MAX 64
+
+static const char *metrics_names[OFONO_METRICS_OPS] = {
+	[OFONO_METRICS_NETREG_REGISTRATION_STATUS] =
+		"netreg/registration_status",
+	[OFONO_METRICS_NETREG_CURRENT_OPERATOR] = "netreg/current_operator",
+	[OFONO_METRICS_NETREG_STRENGTH] = "netreg/strength",
+	[OFONO_METRICS_SIM_READ_FILE_INFO] = "sim/read_file_info",
+	[OFONO_METRICS_SIM_READ_FILE_TRANSPARENT] =
+		"sim/read_file_transparent",
+	[OFONO_METRICS_SIM_READ_FILE_LINEAR] = "sim/read_file_linear",
+	[OFONO_METRICS_SIM_READ_FILE_CYCLIC] = "sim/read_file_cyclic",
+	[OFONO_METRICS_SIM_WRITE_FILE_TRANSPARENT] =
+		"sim/write_file_transparent",
+	[OFONO_METRICS_SIM_WRITE_FILE_LINEAR] = "sim/write_file_linear",
+	[OFONO_METRICS_SIM_WRITE_FILE_CYCLIC] = "sim/write_file_cyclic",
+	[OFONO_METRICS_SIM_SESSION_READ_INFO] = "sim/session_read_info",
+	[OFONO_METRICS_SIM_SESSION_READ_BINARY] = "sim/session_read_binary",
+	[OFONO_METRICS_SIM_SESSION_READ_RECORD] = "sim/session_read_record",
+	[OFONO_METRICS_GPRS_SET_ATTACHED] = "gprs/set_attached",
+	[OFONO_METRICS_GPRS_CONTEXT_ACTIVATE_PRIMARY] =
+		"gprs-context/activate_primary",
+	[OFONO_METRICS_GPRS_CONTEXT_DEACTIVATE_PRIMARY] =
+		"gprs-context/deactivate_primary",
+	[OFONO_METRICS_SMS_SUBMIT] = "sms/submit",
+	[OFONO_METRICS_VOICECALL_DIAL] = "voicecall/dial",
+	[OFONO_METRICS_VOICECALL_DIAL_FILTER] = "voicecall/dial_filter",
+};
+
+struct metrics_entry {
+	unsigned int completed;
+	unsigned int errors;
+	struct histogram latency;
+};
+
+struct ofono_metrics {
+	struct ofono_modem *modem;
+	struct metrics_entry entry[OFONO_METRICS_OPS];
+	GHashTable *filters;	/* "chain/filter" -> struct metrics_entry */
+};
+
+void __ofono_metrics_done(struct ofono_modem *modem,
+					enum ofono_metrics_op op,
+					gint64 started,
+					const struct ofono_error *error)
+{
+	struct ofono_metrics *metrics = __ofono_modem_get_metrics(modem);
+	struct metrics_entry *entry;
+
+	if (metrics == NULL)
+		return;
+
+	entry = metrics->entry + op;
+	entry->completed++;
+
+	if (error && error->type != OFONO_ERROR_TYPE_NO_ERROR)
+		entry->errors++;
+
+	/* Completions without a known start still count, untimed */
+	if (started)
+		histogram_add(&entry->latency,
+					g_get_monotonic_time() - started);
+}
+
+void __ofono_metrics_filter_done(struct ofono_modem *modem,
+					const char *chain, const char *filter,
+					gint64 started)
+{
+	struct ofono_metrics *metrics = __ofono_modem_get_metrics(modem);
+	char name[METRICS_FILTER_NAME_MAX];
+	struct metrics_entry *entry;
+
+	if (metrics == NULL)
+		return;
+
+	/* Overly long names get truncated rather than allocated */
+	snprintf(name, sizeof(name), "%s/%s", chain, filter);
+
+	entry = g_hash_table_lookup(metrics->filters, name);
+	if (entry == NULL) {
+		entry = g_new0(struct metrics_entry, 1);
+		g_hash_table_insert(metrics->filters, g_strdup(name), entry);
+	}
+
+	entry->completed++;
+	histogram_add(&entry->latency, g_get_monotonic_time() - started);
+}
+
+static void metrics_append_histogram(DBusMessageIter *dict,
+					const struct histogram *h)
+{
+	const char *key = "Histogram";
+	const unsigned int *buckets = h->bucket;
+	DBusMessageIter entry, var, array;
+
+	dbus_message_iter_open_container(dict, DBUS_TYPE_DICT_ENTRY,
+						NULL, &entry);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &key);
+	dbus_message_iter_open_container(&entry, DBUS_TYPE_VARIANT,
+						DBUS_TYPE_ARRAY_AS_STRING
+						DBUS_TYPE_UINT32_AS_STRING,
+						&var);
+	dbus_message_iter_open_container(&var, DBUS_TYPE_ARRAY,
+						DBUS_TYPE_UINT32_AS_STRING,
+						&array);
+	dbus_message_iter_append_fixed_array(&array, DBUS_TYPE_UINT32,
+					&buckets, HISTOGRAM_BUCKETS);
+	dbus_message_iter_close_container(&var, &array);
+	dbus_message_iter_close_container(&entry, &var);
+	dbus_message_iter_close_container(dict, &entry);
+}
+
+static void metrics_append_entry(DBusMessageIter *iter, const char *name,
+					const struct metrics_entry *e)
+{
+	const struct histogram *h = &e->latency;
+	dbus_uint32_t count = e->completed;
+	dbus_uint32_t errors = e->errors;
+	dbus_uint32_t average = h->count ? h->sum_us / h->count : 0;
+	dbus_uint64_t max = h->max_us;
+	dbus_uint32_t median = histogram_percentile(h, 50);
+	dbus_uint32_t p90 = histogram_percentile(h, 90);
+	dbus_uint32_t p99 = histogram_percentile(h, 99);
+	DBusMessageIter entry, dict;
+
+	dbus_message_iter_open_container(iter, DBUS_TYPE_DICT_ENTRY,
+						NULL, &entry);
+	dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &name);
+	dbus_message_iter_open_container(&entry, DBUS_TYPE_ARRAY,
+					OFONO_PROPERTIES_ARRAY_SIGNATURE,
+					&dict);
+
+	ofono_dbus_dict_append(&dict, "Count", DBUS_TYPE_UINT32, &count);
+	ofono_dbus_dict_append(&dict, "Errors", DBUS_TYPE_UINT32, &errors);
+	ofono_dbus_dict_append(&dict, "AverageLatency", DBUS_TYPE_UINT32,
+								&average);
+	ofono_dbus_dict_append(&dict, "MaxLatency", DBUS_TYPE_UINT64, &max);
+	ofono_dbus_dict_append(&dict, "Median", DBUS_TYPE_UINT32, &median);
+	ofono_dbus_dict_append(&dict, "Percentile90", DBUS_TYPE_UINT32, &p90);
+	ofono_dbus_dict_append(&dict, "Percentile99", DBUS_TYPE_UINT32, &p99);
+	metrics_append_histogram(&dict, h);
+
+	dbus_message_iter_close_container(&entry, &dict);
+	dbus_message_iter_close_container(iter, &entry);
+}
+
+static DBusMessage *metrics_get_statistics(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	struct ofono_metrics *metrics = data;
+	DBusMessage *reply;
+	DBusMessageIter iter, array;
+	GHashTableIter it;
+	gpointer key, value;
+	unsigned int i;
+
+	reply = dbus_message_new_method_return(msg);
+	if (reply == NULL)
+		return NULL;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+					DBUS_TYPE_STRING_AS_STRING
+					DBUS_TYPE_ARRAY_AS_STRING
+					OFONO_PROPERTIES_ARRAY_SIGNATURE
+					DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
+					&array);
+
+	for (i = 0; i < OFONO_METRICS_OPS; i++) {
+		const struct metrics_entry *e = metrics->entry + i;
+
+		if (e->completed)
+			metrics_append_entry(&array, metrics_names[i], e);
+	}
+
+	g_hash_table_iter_init(&it, metrics->filters);
+	while (g_hash_table_iter_next(&it, &key, &value))
+		metrics_append_entry(&array, key, value);
+
+	dbus_message_iter_close_container(&iter, &array);
+
+	return reply;
+}
+
+static DBusMessage *metrics_reset(DBusConnection *conn,
+					DBusMessage *msg, void *data)
+{
+	struct ofono_metrics *metrics = data;
+	unsigned int i;
+
+	DBG("%s", ofono_modem_get_path(metrics->modem));
+
+	/* Requests in flight still get counted when they complete */
+	for (i = 0; i < OFONO_METRICS_OPS; i++) {
+		metrics->entry[i].completed = 0;
+		metrics->entry[i].errors = 0;
+		histogram_reset(&metrics->entry[i].latency);
+	}
+
+	g_hash_table_remove_all(metrics->filters);
+
+	return dbus_message_new_method_return(msg);
+}
+
+static const GDBusMethodTable metrics_methods[] = {
+	{ GDBUS_METHOD("GetStatistics",
+			NULL, GDBUS_ARGS({ "statistics", "a{sa{sv}}" }),
+			metrics_get_statistics) },
+	{ GDBUS_METHOD("Reset", NULL, NULL, metrics_reset) },
+	{ }
+};
+
+struct ofono_metrics *__ofono_metrics_new(struct ofono_modem *modem)
+{
+	DBusConnection *conn = ofono_dbus_get_connection();
+	const char *path = ofono_modem_get_path(modem);
+	struct ofono_metrics *metrics = g_new0(struct ofono_metrics, 1);
+
+	metrics->modem = modem;
+	metrics->filters = g_hash_table_new_full(g_str_hash, g_str_equal,
+							g_free, g_free);
+
+	if (!g_dbus_register_interface(conn, path,
+					OFONO_DIAGNOSTICS_INTERFACE,
+					metrics_methods, NULL, NULL,
+					metrics, NULL)) {
+		ofono_error("Could not create %s interface",
+						OFONO_DIAGNOSTICS_INTERFACE);
+		g_hash_table_destroy(metrics->filters);
+		g_free(metrics);
+		return NULL;
+	}
+
+	ofono_modem_add_interface(modem, OFONO_DIAGNOSTICS_INTERFACE);
+
+	return metrics;
+}
+
+void __ofono_metrics_free(struct ofono_metrics *metrics)
+{
+	DBusConnection *conn = ofono_dbus_get_connection();
+
+	if (metrics == NULL)
+		return;
+
+	g_dbus_unregister_interface(conn, ofono_modem_get_path(metrics->modem),
+						OFONO_DIAGNOSTICS_INTERFACE);
+	g_hash_table_destroy(metrics->filters);
+	g_free(metrics);
+}
@@ -92,6 +92,8 @@ struct ofono_modem {
 	void			*driver_data;
 	char			*driver_type;
 	char			*name;
+	gint64			power_on_time;
+	struct ofono_metrics	*metrics;
 };
 
 struct ofono_devinfo {
@@ -543,8 +545,13 @@ static void modem_change_state(struct ofono_modem *modem,
 		break;
 
 	case MODEM_STATE_PRE_SIM:
-		if (old_state < MODEM_STATE_PRE_SIM && driver->pre_sim)
-			driver->pre_sim(modem);
+		if (old_state < MODEM_STATE_PRE_SIM) {
+			modem->power_on_time = g_get_monotonic_time();
+
+			if (driver->pre_sim)
+				driver->pre_sim(modem);
+		}
+
 		break;
 
 	case MODEM_STATE_OFFLINE:
@@ -562,6 +569,9 @@ static void modem_change_state(struct ofono_modem *modem,
 		if (driver->post_online)
 			driver->post_online(modem);
 
+		DBG("%s online %d ms after power on", modem->path,
+			(int) ((g_get_monotonic_time() -
+					modem->power_on_time) / 1000));
 		break;
 	}
 }
@@ -1425,14 +1435,6 @@ static void query_svn_cb(const struct ofono_error *error,
 			"SoftwareVersionNumber", DBUS_TYPE_STRING, &info->svn);
 }
 
-static void query_svn(struct ofono_devinfo *info)
-{
-	if (info->driver->query_svn == NULL)
-		return;
-
-	info->driver->query_svn(info, query_svn_cb, info);
-}
-
 static void query_serial_cb(const struct ofono_error *error,
 				const char *serial, void *user)
 {
@@ -1441,7 +1443,7 @@ static void query_serial_cb(const struct ofono_error *error,
 	const char *path = __ofono_atom_get_path(info->atom);
 
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR)
-		goto out;
+		return;
 
 	info->serial = g_strdup(serial);
 
@@ -1449,16 +1451,6 @@ static void query_serial_cb(const struct ofono_error *error,
 						OFONO_MODEM_INTERFACE,
 						"Serial", DBUS_TYPE_STRING,
 						&info->serial);
-out:
-	query_svn(info);
-}
-
-static void query_serial(struct ofono_devinfo *info)
-{
-	if (info->driver->query_serial == NULL)
-		return;
-
-	info->driver->query_serial(info, query_serial_cb, info);
 }
 
 static void query_revision_cb(const struct ofono_error *error,
@@ -1469,7 +1461,7 @@ static void query_revision_cb(const struct ofono_error *error,
 	const char *path = __ofono_atom_get_path(info->atom);
 
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR)
-		goto out;
+		return;
 
 	info->revision = g_strdup(revision);
 
@@ -1477,19 +1469,6 @@ static void query_revision_cb(const struct ofono_error *error,
 						OFONO_MODEM_INTERFACE,
 						"Revision", DBUS_TYPE_STRING,
 						&info->revision);
-
-out:
-	query_serial(info);
-}
-
-static void query_revision(struct ofono_devinfo *info)
-{
-	if (info->driver->query_revision == NULL) {
-		query_serial(info);
-		return;
-	}
-
-	info->driver->query_revision(info, query_revision_cb, info);
 }
 
 static void query_model_cb(const struct ofono_error *error,
@@ -1500,7 +1479,7 @@ static void query_model_cb(const struct ofono_error *error,
 	const char *path = __ofono_atom_get_path(info->atom);
 
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR)
-		goto out;
+		return;
 
 	info->model = g_strdup(model);
 
@@ -1508,20 +1487,6 @@ static void query_model_cb(const struct ofono_error *error,
 						OFONO_MODEM_INTERFACE,
 						"Model", DBUS_TYPE_STRING,
 						&info->model);
-
-out:
-	query_revision(info);
-}
-
-static void query_model(struct ofono_devinfo *info)
-{
-	if (info->driver->query_model == NULL) {
-		/* If model is not supported, don't bother querying revision */
-		query_serial(info);
-		return;
-	}
-
-	info->driver->query_model(info, query_model_cb, info);
 }
 
 static void query_manufacturer_cb(const struct ofono_error *error,
@@ -1532,7 +1497,7 @@ static void query_manufacturer_cb(const struct ofono_error *error,
 	const char *path = __ofono_atom_get_path(info->atom);
 
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR)
-		goto out;
+		return;
 
 	info->manufacturer = g_strdup(manufacturer);
 
@@ -1541,23 +1506,34 @@ static void query_manufacturer_cb(const struct ofono_error *error,
 						"Manufacturer",
 						DBUS_TYPE_STRING,
 						&info->manufacturer);
-
-out:
-	query_model(info);
 }
 
-static gboolean query_manufacturer(gpointer user)
+/*
+ * The queries don't depend on each other's results, so they are all
+ * issued up front rather than one after another. The driver is free to
+ * pipeline them, which saves a round trip per attribute.
+ */
+static void query_devinfo(struct ofono_devinfo *info)
 {
-	struct ofono_devinfo *info = user;
+	const struct ofono_devinfo_driver *driver = info->driver;
 
-	if (info->driver->query_manufacturer == NULL) {
-		query_model(info);
-		return FALSE;
+	if (driver->query_manufacturer)
+		driver->query_manufacturer(info, query_manufacturer_cb, info);
+
+	if (driver->query_model) {
+		driver->query_model(info, query_model_cb, info);
+
+		/* If model is not supported, don't bother querying revision */
+		if (driver->query_revision)
+			driver->query_revision(info, query_revision_cb, info);
 	}
 
-	info->driver->query_manufacturer(info, query_manufacturer_cb, info);
+	if (driver->query_serial) {
+		driver->query_serial(info, query_serial_cb, info);
 
-	return FALSE;
+		if (driver->query_svn)
+			driver->query_svn(info, query_svn_cb, info);
+	}
 }
 
 static void attr_template(struct ofono_emulator *em,
@@ -1726,7 +1702,7 @@ void ofono_devinfo_register(struct ofono_devinfo *info)
 						OFONO_ATOM_TYPE_EMULATOR_DUN,
 						dun_watch, info, NULL);
 
-	query_manufacturer(info);
+	query_devinfo(info);
 }
 
 void ofono_devinfo_remove(struct ofono_devinfo *info)
@@ -2111,6 +2087,7 @@ int ofono_modem_register(struct ofono_modem *modem)
 	modem->atom_watches = __ofono_watchlist_new(g_free);
 	modem->online_watches = __ofono_watchlist_new(g_free);
 	modem->powered_watches = __ofono_watchlist_new(g_free);
+	modem->metrics = __ofono_metrics_new(modem);
 
 	emit_modem_added(modem);
 	call_modemwatches(modem, TRUE);
@@ -2186,6 +2163,9 @@ static void modem_unregister(struct ofono_modem *modem)
 					&modem->lockdown);
 	}
 
+	__ofono_metrics_free(modem->metrics);
+	modem->metrics = NULL;
+
 	g_dbus_unregister_interface(conn, modem->path, OFONO_MODEM_INTERFACE);
 
 	if (modem->driver && modem->driver->remove)
@@ -2374,6 +2354,11 @@ out:
 	modem->emergency--;
 }
 
+struct ofono_metrics *__ofono_modem_get_metrics(struct ofono_modem *modem)
+{
+	return modem ? modem->metrics : NULL;
+}
+
 /* Since 1.25+git2 */
 
 unsigned int ofono_modem_add_watch(ofono_modemwatch_cb_t cb, void *user,
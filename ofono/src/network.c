@@ -76,6 +76,14 @@ struct ofono_netreg {
 	struct ofono_atom *atom;
 	unsigned int hfp_watch;
 	unsigned int spn_watch;
+	GSList *requests; /* struct netreg_request */
+};
+
+/* Driver query in progress, for timing each one separately */
+struct netreg_request {
+	struct ofono_netreg *netreg;
+	gint64 started;
+	ofono_netreg_status_cb_t status_cb;
 };
 
 struct network_operator_data {
@@ -142,6 +150,56 @@ static char **network_operator_technologies(struct network_operator_data *opd)
 	return techs;
 }
 
+static struct netreg_request *netreg_request_new(
+						struct ofono_netreg *netreg)
+{
+	struct netreg_request *req = g_new0(struct netreg_request, 1);
+
+	req->netreg = netreg;
+	req->started = g_get_monotonic_time();
+	netreg->requests = g_slist_prepend(netreg->requests, req);
+
+	return req;
+}
+
+static struct ofono_netreg *netreg_request_done(struct netreg_request *req,
+					enum ofono_metrics_op op,
+					const struct ofono_error *error)
+{
+	struct ofono_netreg *netreg = req->netreg;
+
+	__ofono_metrics_done(__ofono_atom_get_modem(netreg->atom), op,
+							req->started, error);
+
+	netreg->requests = g_slist_remove(netreg->requests, req);
+	g_free(req);
+
+	return netreg;
+}
+
+static void netreg_status_request_cb(const struct ofono_error *error,
+					int status, int lac, int ci, int tech,
+					void *data)
+{
+	struct netreg_request *req = data;
+	ofono_netreg_status_cb_t cb = req->status_cb;
+	struct ofono_netreg *netreg = netreg_request_done(req,
+				OFONO_METRICS_NETREG_REGISTRATION_STATUS,
+				error);
+
+	cb(error, status, lac, ci, tech, netreg);
+}
+
+static void netreg_query_status(struct ofono_netreg *netreg,
+					ofono_netreg_status_cb_t cb)
+{
+	struct netreg_request *req = netreg_request_new(netreg);
+
+	req->status_cb = cb;
+	netreg->driver->registration_status(netreg,
+					netreg_status_request_cb, req);
+}
+
 static void registration_status_callback(const struct ofono_error *error,
 					int status, int lac, int ci, int tech,
 					void *data)
@@ -163,8 +221,7 @@ static void init_register(const struct ofono_error *error, void *data)
 	if (netreg->driver->registration_status == NULL)
 		return;
 
-	netreg->driver->registration_status(netreg,
-					registration_status_callback, netreg);
+	netreg_query_status(netreg, registration_status_callback);
 }
 
 static void enforce_auto_only(struct ofono_netreg *netreg)
@@ -227,9 +284,7 @@ static void register_callback(const struct ofono_error *error, void *data)
 	if (netreg->driver->registration_status == NULL)
 		return;
 
-	netreg->driver->registration_status(netreg,
-						registration_status_callback,
-						netreg);
+	netreg_query_status(netreg, registration_status_callback);
 }
 
 static struct network_operator_data *
@@ -1115,7 +1170,7 @@ static void set_registration_location(struct ofono_netreg *netreg, int lac)
 	if (netreg->location == -1)
 		return;
 
-	ofono_dbus_signal_property_changed(conn, path,
+	__ofono_dbus_coalesce_property_changed(conn, path,
 					OFONO_NETWORK_REGISTRATION_INTERFACE,
 					"LocationAreaCode",
 					DBUS_TYPE_UINT16, &dbus_lac);
@@ -1132,7 +1187,7 @@ static void set_registration_cellid(struct ofono_netreg *netreg, int ci)
 	if (netreg->cellid == -1)
 		return;
 
-	ofono_dbus_signal_property_changed(conn, path,
+	__ofono_dbus_coalesce_property_changed(conn, path,
 					OFONO_NETWORK_REGISTRATION_INTERFACE,
 					"CellId", DBUS_TYPE_UINT32, &dbus_ci);
 }
@@ -1148,7 +1203,7 @@ static void set_registration_technology(struct ofono_netreg *netreg, int tech)
 	if (netreg->technology == -1)
 		return;
 
-	ofono_dbus_signal_property_changed(conn, path,
+	__ofono_dbus_coalesce_property_changed(conn, path,
 					OFONO_NETWORK_REGISTRATION_INTERFACE,
 					"Technology", DBUS_TYPE_STRING,
 					&tech_str);
@@ -1366,6 +1421,37 @@ static void signal_strength_callback(const struct ofono_error *error,
 	ofono_netreg_strength_notify(netreg, strength);
 }
 
+static void netreg_operator_request_cb(const struct ofono_error *error,
+				const struct ofono_network_operator *current,
+				void *data)
+{
+	struct ofono_netreg *netreg = netreg_request_done(data,
+				OFONO_METRICS_NETREG_CURRENT_OPERATOR, error);
+
+	current_operator_callback(error, current, netreg);
+}
+
+static void netreg_query_operator(struct ofono_netreg *netreg)
+{
+	netreg->driver->current_operator(netreg, netreg_operator_request_cb,
+						netreg_request_new(netreg));
+}
+
+static void netreg_strength_request_cb(const struct ofono_error *error,
+					int strength, void *data)
+{
+	struct ofono_netreg *netreg = netreg_request_done(data,
+				OFONO_METRICS_NETREG_STRENGTH, error);
+
+	signal_strength_callback(error, strength, netreg);
+}
+
+static void netreg_query_strength(struct ofono_netreg *netreg)
+{
+	netreg->driver->strength(netreg, netreg_strength_request_cb,
+						netreg_request_new(netreg));
+}
+
 static void notify_emulator_status(struct ofono_atom *atom, void *data)
 {
 	struct ofono_emulator *em = __ofono_atom_get_data(atom);
@@ -1418,12 +1504,10 @@ void ofono_netreg_status_notify(struct ofono_netreg *netreg, int status,
 	if (netreg->status == NETWORK_REGISTRATION_STATUS_REGISTERED ||
 		netreg->status == NETWORK_REGISTRATION_STATUS_ROAMING) {
 		if (netreg->driver->current_operator != NULL)
-			netreg->driver->current_operator(netreg,
-					current_operator_callback, netreg);
+			netreg_query_operator(netreg);
 
 		if (netreg->driver->strength != NULL)
-			netreg->driver->strength(netreg,
-					signal_strength_callback, netreg);
+			netreg_query_strength(netreg);
 	} else {
 		struct ofono_error error;
 
@@ -1522,8 +1606,7 @@ static void init_registration_status(const struct ofono_error *error,
 	if (netreg->status == NETWORK_REGISTRATION_STATUS_REGISTERED ||
 		netreg->status == NETWORK_REGISTRATION_STATUS_ROAMING) {
 		if (netreg->driver->strength != NULL)
-			netreg->driver->strength(netreg,
-					signal_strength_callback, netreg);
+			netreg_query_strength(netreg);
 	}
 
 	if (netreg->mode != NETWORK_REGISTRATION_MODE_MANUAL &&
@@ -1586,7 +1669,7 @@ void ofono_netreg_strength_notify(struct ofono_netreg *netreg, int strength)
 		const char *path = __ofono_atom_get_path(netreg->atom);
 		unsigned char strength_byte = netreg->signal_strength;
 
-		ofono_dbus_signal_property_changed(conn, path,
+		__ofono_dbus_coalesce_property_changed(conn, path,
 					OFONO_NETWORK_REGISTRATION_INTERFACE,
 					"Strength", DBUS_TYPE_BYTE,
 					&strength_byte);
@@ -1896,6 +1979,8 @@ static void netreg_unregister(struct ofono_atom *atom)
 
 	netreg->sim = NULL;
 
+	__ofono_dbus_coalesce_cancel(path,
+					OFONO_NETWORK_REGISTRATION_INTERFACE);
 	g_dbus_unregister_interface(conn, path,
 					OFONO_NETWORK_REGISTRATION_INTERFACE);
 	ofono_modem_remove_interface(modem,
@@ -1914,6 +1999,8 @@ static void netreg_remove(struct ofono_atom *atom)
 	if (netreg->driver != NULL && netreg->driver->remove != NULL)
 		netreg->driver->remove(netreg);
 
+	/* Queries the driver dropped without calling back */
+	g_slist_free_full(netreg->requests, g_free);
 	__ofono_dbus_queue_free(netreg->q);
 
 	sim_eons_free(netreg->eons);
@@ -2147,8 +2234,7 @@ void ofono_netreg_register(struct ofono_netreg *netreg)
 	ofono_modem_add_interface(modem, OFONO_NETWORK_REGISTRATION_INTERFACE);
 
 	if (netreg->driver->registration_status != NULL)
-		netreg->driver->registration_status(netreg,
-					init_registration_status, netreg);
+		netreg_query_status(netreg, init_registration_status);
 
 	netreg->sim = __ofono_atom_find(OFONO_ATOM_TYPE_SIM, modem);
 	if (netreg->sim != NULL) {
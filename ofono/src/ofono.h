@@ -79,6 +79,26 @@ DBusMessage *__ofono_error_from_error(const struct ofono_error *error,
 
 void __ofono_dbus_pending_reply(DBusMessage **msg, DBusMessage *reply);
 
+struct ofono_dbus_coalesce_stats {
+	unsigned int emitted;
+	unsigned int suppressed;
+};
+
+void __ofono_dbus_coalesce_init(void);
+void __ofono_dbus_coalesce_cleanup(void);
+int __ofono_dbus_coalesce_property_changed(DBusConnection *conn,
+					const char *path,
+					const char *interface,
+					const char *name,
+					int type, const void *value);
+void __ofono_dbus_coalesce_cancel(const char *path, const char *interface);
+void __ofono_dbus_coalesce_flush(void);
+void __ofono_dbus_coalesce_set_policy(const char *interface,
+			const char *name, unsigned int interval_ms,
+			unsigned int hysteresis);
+ofono_bool_t __ofono_dbus_coalesce_enabled(void);
+void __ofono_dbus_coalesce_get_stats(struct ofono_dbus_coalesce_stats *stats);
+
 struct ofono_watchlist_item {
 	unsigned int id;
 	void *notify;
@@ -255,6 +275,43 @@ void __ofono_modem_sim_reset(struct ofono_modem *modem);
 void __ofono_modem_inc_emergency_mode(struct ofono_modem *modem);
 void __ofono_modem_dec_emergency_mode(struct ofono_modem *modem);
 
+/* Driver request round trip times, see doc/diagnostics-api.txt */
+enum ofono_metrics_op {
+	OFONO_METRICS_NETREG_REGISTRATION_STATUS,
+	OFONO_METRICS_NETREG_CURRENT_OPERATOR,
+	OFONO_METRICS_NETREG_STRENGTH,
+	OFONO_METRICS_SIM_READ_FILE_INFO,
+	OFONO_METRICS_SIM_READ_FILE_TRANSPARENT,
+	OFONO_METRICS_SIM_READ_FILE_LINEAR,
+	OFONO_METRICS_SIM_READ_FILE_CYCLIC,
+	OFONO_METRICS_SIM_WRITE_FILE_TRANSPARENT,
+	OFONO_METRICS_SIM_WRITE_FILE_LINEAR,
+	OFONO_METRICS_SIM_WRITE_FILE_CYCLIC,
+	OFONO_METRICS_SIM_SESSION_READ_INFO,
+	OFONO_METRICS_SIM_SESSION_READ_BINARY,
+	OFONO_METRICS_SIM_SESSION_READ_RECORD,
+	OFONO_METRICS_GPRS_SET_ATTACHED,
+	OFONO_METRICS_GPRS_CONTEXT_ACTIVATE_PRIMARY,
+	OFONO_METRICS_GPRS_CONTEXT_DEACTIVATE_PRIMARY,
+	OFONO_METRICS_SMS_SUBMIT,
+	OFONO_METRICS_VOICECALL_DIAL,
+	OFONO_METRICS_VOICECALL_DIAL_FILTER,
+	OFONO_METRICS_OPS
+};
+
+struct ofono_metrics;
+
+struct ofono_metrics *__ofono_metrics_new(struct ofono_modem *modem);
+void __ofono_metrics_free(struct ofono_metrics *metrics);
+void __ofono_metrics_done(struct ofono_modem *modem,
+					enum ofono_metrics_op op,
+					gint64 started,
+					const struct ofono_error *error);
+void __ofono_metrics_filter_done(struct ofono_modem *modem,
+					const char *chain, const char *filter,
+					gint64 started);
+struct ofono_metrics *__ofono_modem_get_metrics(struct ofono_modem *modem);
+
 #include <ofono/call-barring.h>
 
 gboolean __ofono_call_barring_is_busy(struct ofono_call_barring *cb);
@@ -428,6 +485,7 @@ const struct sim_aid *__ofono_sim_session_get_aid(
 		struct ofono_sim_aid_session *session);
 
 const char *__ofono_sim_get_impi(struct ofono_sim *sim);
+struct ofono_modem *__ofono_sim_get_modem(struct ofono_sim *sim);
 void __ofono_sim_clear_cached_pins(struct ofono_sim *sim);
 
 #include <ofono/stk.h>
@@ -664,6 +722,18 @@ void __ofono_voicecall_filter_chain_incoming(struct voicecall_filter_chain *c,
 				ofono_destroy_func destroy, void *user_data);
 
 #include <ofono/dbus-access.h>
+
+struct ofono_dbus_access_cache_stats {
+	unsigned int hits;
+	unsigned int misses;
+	unsigned int uncached;
+	unsigned int flushes;
+	unsigned int senders;
+};
+
+void __ofono_dbus_access_get_cache_stats
+			(struct ofono_dbus_access_cache_stats *stats);
+
 #include <ofono/slot.h>
 
 void __ofono_slot_manager_init(void);
@@ -678,3 +748,14 @@ void __ofono_slot_manager_cleanup(void);
 #include <ofono/storage.h>
 
 void __ofono_set_config_dir(const char *dir);
+
+struct ofono_storage_stats {
+	unsigned int syncs;		/* storage_sync calls */
+	unsigned int writes;		/* Files actually written */
+	unsigned int avoided;		/* Writes merged or skipped */
+};
+
+void __ofono_storage_init(void);
+void __ofono_storage_cleanup(void);
+void __ofono_storage_flush(void);
+void __ofono_storage_get_stats(struct ofono_storage_stats *stats);
@@ -0,0 +1,90 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2021 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "phonebook-cache.h"
+
+struct phonebook_cache {
+	void *key;
+	size_t key_len;
+	GString *vcards;
+};
+
+struct phonebook_cache *phonebook_cache_new(void)
+{
+	return g_new0(struct phonebook_cache, 1);
+}
+
+void phonebook_cache_invalidate(struct phonebook_cache *cache)
+{
+	g_free(cache->key);
+	cache->key = NULL;
+	cache->key_len = 0;
+
+	if (cache->vcards) {
+		g_string_free(cache->vcards, TRUE);
+		cache->vcards = NULL;
+	}
+}
+
+void phonebook_cache_free(struct phonebook_cache *cache)
+{
+	if (cache == NULL)
+		return;
+
+	phonebook_cache_invalidate(cache);
+	g_free(cache);
+}
+
+void phonebook_cache_store(struct phonebook_cache *cache,
+				const void *key, size_t key_len,
+				const char *vcards, size_t len)
+{
+	phonebook_cache_invalidate(cache);
+
+	if (key == NULL || key_len == 0)
+		return;
+
+	cache->key = g_memdup(key, key_len);
+	cache->key_len = key_len;
+	cache->vcards = g_string_new_len(vcards, len);
+}
+
+const char *phonebook_cache_lookup(struct phonebook_cache *cache,
+				const void *key, size_t key_len,
+				size_t *len)
+{
+	if (cache->key == NULL)
+		return NULL;
+
+	/* Changed by someone else, maybe on another device */
+	if (key == NULL || key_len != cache->key_len ||
+					memcmp(key, cache->key, key_len)) {
+		phonebook_cache_invalidate(cache);
+		return NULL;
+	}
+
+	if (len)
+		*len = cache->vcards->len;
+
+	return cache->vcards->str;
+}
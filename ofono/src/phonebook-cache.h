@@ -0,0 +1,33 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2021 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ */
+
+/*
+ * Exported phonebook kept in memory together with the SIM state it was
+ * read with, typically the phonebook change counter. A lookup only hits
+ * if the caller presents the same key again; without a key nothing is
+ * ever cached.
+ */
+
+struct phonebook_cache;
+
+struct phonebook_cache *phonebook_cache_new(void);
+void phonebook_cache_free(struct phonebook_cache *cache);
+void phonebook_cache_store(struct phonebook_cache *cache,
+				const void *key, size_t key_len,
+				const char *vcards, size_t len);
+const char *phonebook_cache_lookup(struct phonebook_cache *cache,
+				const void *key, size_t key_len,
+				size_t *len);
+void phonebook_cache_invalidate(struct phonebook_cache *cache);
@@ -23,11 +23,15 @@
 #include <config.h>
 #endif
 
+#define _GNU_SOURCE
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
 #include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 
 #include <glib.h>
 #include <gdbus.h>
@@ -35,11 +39,20 @@
 #include "ofono.h"
 
 #include "common.h"
+#include "simutil.h"
+#include "phonebook-cache.h"
 
 #define LEN_MAX 128
 #define TYPE_INTERNATIONAL 145
 
-#define PHONEBOOK_FLAG_CACHED 0x1
+#define PHONEBOOK_FLAG_CHANGED 0x1
+
+/* EFcc of the global USIM phonebook, TS 31.102 4.4.2.12.2 */
+#define PHONEBOOK_CC_LEN 2
+
+static const unsigned char phonebook_cc_path[] = {
+	0x3F, 0x00, 0x7F, 0x10, 0x5F, 0x3A
+};
 
 static GSList *g_drivers = NULL;
 
@@ -57,6 +70,11 @@ struct ofono_phonebook {
 	int flags;
 	GString *vcards; /* entries with vcard 3.0 format */
 	GSList *merge_list; /* cache the entries that may need a merge */
+	GHashTable *merge_index; /* person text => merge_list entry */
+	struct phonebook_cache *cache;
+	unsigned char cc[PHONEBOOK_CC_LEN];
+	size_t cc_len; /* 0 if the change counter couldn't be read */
+	struct ofono_sim_context *sim_context;
 	const struct ofono_phonebook_driver *driver;
 	void *driver_data;
 	struct ofono_atom *atom;
@@ -275,8 +293,8 @@ static void destroy_merged_entry(gpointer pointer)
 	g_free(person);
 }
 
-static DBusMessage *generate_export_entries_reply(struct ofono_phonebook *pb,
-							DBusMessage *msg)
+static DBusMessage *generate_export_entries_reply(DBusMessage *msg,
+							const char *vcards)
 {
 	DBusMessage *reply;
 	DBusMessageIter iter;
@@ -286,7 +304,7 @@ static DBusMessage *generate_export_entries_reply(struct ofono_phonebook *pb,
 		return NULL;
 
 	dbus_message_iter_init_append(reply, &iter);
-	dbus_message_iter_append_basic(&iter, DBUS_TYPE_STRING, pb->vcards);
+	dbus_message_iter_append_basic(&iter, DBUS_TYPE_STRING, &vcards);
 
 	return reply;
 }
@@ -368,22 +386,21 @@ void ofono_phonebook_entry(struct ofono_phonebook *phonebook, int index,
 	 * are deemed as entries of one person.
 	 */
 	if (need_merge(text)) {
-		GSList *l;
 		size_t len_text = strlen(text) - 2;
+		char *key = g_strndup(text, len_text);
 		struct phonebook_person *person;
 
-		for (l = phonebook->merge_list; l; l = l->next) {
-			person = l->data;
-			if (!strncmp(text, person->text, len_text) &&
-					(strlen(person->text) == len_text))
-				break;
-		}
+		person = g_hash_table_lookup(phonebook->merge_index, key);
 
-		if (l == NULL) {
+		if (person == NULL) {
 			person = g_new0(struct phonebook_person, 1);
 			phonebook->merge_list =
 				g_slist_prepend(phonebook->merge_list, person);
-			person->text = g_strndup(text, len_text);
+			person->text = key;
+			g_hash_table_insert(phonebook->merge_index,
+							person->text, person);
+		} else {
+			g_free(key);
 		}
 
 		merge_field_number(&(person->number_list), number, type,
@@ -414,6 +431,110 @@ void ofono_phonebook_entry(struct ofono_phonebook *phonebook, int index,
 	vcard_printf_end(phonebook->vcards);
 }
 
+static void phonebook_file_changed(int id, void *userdata)
+{
+	struct ofono_phonebook *pb = userdata;
+
+	DBG("%04x", id);
+
+	pb->flags |= PHONEBOOK_FLAG_CHANGED;
+	phonebook_cache_invalidate(pb->cache);
+}
+
+#ifdef HAVE_MEMFD_CREATE
+static int phonebook_export_fd(void)
+{
+	return memfd_create("phonebook", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+}
+#else
+static int phonebook_export_fd(void)
+{
+	char *path = NULL;
+	int fd = g_file_open_tmp("ofono-phonebook-XXXXXX", &path, NULL);
+
+	if (fd < 0) {
+		errno = EIO;
+		return -1;
+	}
+
+	/* Nobody but the receiver of the fd needs to see it */
+	unlink(path);
+	g_free(path);
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+	return fd;
+}
+#endif
+
+/*
+ * The whole export in a sealed memfd (or an unlinked temporary file if
+ * memfd_create isn't available), so that the client can mmap it instead
+ * of receiving a (possibly multi-megabyte) string over the bus. It's
+ * written in chunks to bound the size of each write.
+ */
+#define PHONEBOOK_EXPORT_CHUNK (64 * 1024)
+
+static int phonebook_memfd(const char *vcards, size_t len)
+{
+	int fd = phonebook_export_fd();
+
+	if (fd < 0)
+		return -errno;
+
+	while (len > 0) {
+		size_t chunk = MIN(len, PHONEBOOK_EXPORT_CHUNK);
+		ssize_t written = write(fd, vcards, chunk);
+
+		if (written < 0 && errno == EINTR)
+			continue;
+
+		if (written <= 0) {
+			close(fd);
+			return -EIO;
+		}
+
+		vcards += written;
+		len -= written;
+	}
+
+#ifdef F_ADD_SEALS
+	fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW |
+					F_SEAL_WRITE | F_SEAL_SEAL);
+#endif
+	lseek(fd, 0, SEEK_SET);
+
+	return fd;
+}
+
+static DBusMessage *generate_export_fd_reply(DBusMessage *msg,
+						const char *vcards, size_t len)
+{
+	DBusMessage *reply;
+	int fd = phonebook_memfd(vcards, len);
+
+	if (fd < 0) {
+		ofono_error("Failed to export phonebook: %s", strerror(-fd));
+		return __ofono_error_failed(msg);
+	}
+
+	reply = dbus_message_new_method_return(msg);
+	if (reply)
+		dbus_message_append_args(reply, DBUS_TYPE_UNIX_FD, &fd,
+							DBUS_TYPE_INVALID);
+
+	close(fd);
+	return reply;
+}
+
+static DBusMessage *generate_reply(DBusMessage *msg, const char *vcards,
+							size_t len)
+{
+	if (dbus_message_has_member(msg, "ImportFd"))
+		return generate_export_fd_reply(msg, vcards, len);
+
+	return generate_export_entries_reply(msg, vcards);
+}
+
 static void export_phonebook_cb(const struct ofono_error *error, void *data)
 {
 	struct ofono_phonebook *phonebook = data;
@@ -426,6 +547,7 @@ static void export_phonebook_cb(const struct ofono_error *error, void *data)
 	phonebook->merge_list = g_slist_reverse(phonebook->merge_list);
 	g_slist_foreach(phonebook->merge_list, print_merged_entry,
 				phonebook->vcards);
+	g_hash_table_remove_all(phonebook->merge_index);
 	g_slist_free_full(phonebook->merge_list, destroy_merged_entry);
 	phonebook->merge_list = NULL;
 
@@ -434,13 +556,20 @@ static void export_phonebook_cb(const struct ofono_error *error, void *data)
 	return;
 }
 
-static void phonebook_reply(gpointer data, gpointer user_data)
+static void phonebook_reply_all(struct ofono_phonebook *pb,
+					const char *vcards, size_t len)
 {
-	DBusMessage *msg = data;
-	struct ofono_phonebook *phonebook = user_data;
-	DBusMessage *reply = generate_export_entries_reply(phonebook, msg);
+	GSList *l;
+
+	for (l = pb->pending; l; l = l->next) {
+		DBusMessage *msg = l->data;
+
+		__ofono_dbus_pending_reply(&msg,
+					generate_reply(msg, vcards, len));
+	}
 
-	__ofono_dbus_pending_reply(&msg, reply);
+	g_slist_free(pb->pending);
+	pb->pending = NULL;
 }
 
 static void phonebook_cancel(gpointer data)
@@ -460,23 +589,70 @@ static void export_phonebook(struct ofono_phonebook *phonebook)
 		return;
 	}
 
-	g_slist_foreach(phonebook->pending, phonebook_reply, phonebook);
-	g_slist_free(phonebook->pending);
-	phonebook->pending = NULL;
-	phonebook->flags |= PHONEBOOK_FLAG_CACHED;
+	phonebook_reply_all(phonebook, phonebook->vcards->str,
+					phonebook->vcards->len);
+
+	/* Don't cache what may have changed while it was being read */
+	if (phonebook->flags & PHONEBOOK_FLAG_CHANGED)
+		return;
+
+	phonebook_cache_store(phonebook->cache, phonebook->cc,
+				phonebook->cc_len, phonebook->vcards->str,
+				phonebook->vcards->len);
+}
+
+static void phonebook_cc_cb(int ok, int total_length, int record,
+				const unsigned char *data,
+				int record_length, void *userdata)
+{
+	struct ofono_phonebook *phonebook = userdata;
+	const char *vcards;
+	size_t len;
+
+	phonebook->cc_len = 0;
+
+	if (ok && total_length == PHONEBOOK_CC_LEN) {
+		memcpy(phonebook->cc, data, PHONEBOOK_CC_LEN);
+		phonebook->cc_len = PHONEBOOK_CC_LEN;
+	}
+
+	DBG("change counter %s", phonebook->cc_len ? "read" : "not available");
+
+	vcards = phonebook_cache_lookup(phonebook->cache, phonebook->cc,
+					phonebook->cc_len, &len);
+	if (vcards) {
+		phonebook_reply_all(phonebook, vcards, len);
+		return;
+	}
+
+	g_string_set_size(phonebook->vcards, 0);
+	phonebook->storage_index = 0;
+	export_phonebook(phonebook);
+}
+
+/*
+ * The cached export is only used if the phonebook change counter on the
+ * SIM still has the value it had when the export was read. SIMs without
+ * one are read every time.
+ */
+static void phonebook_validate(struct ofono_phonebook *phonebook)
+{
+	phonebook->flags &= ~PHONEBOOK_FLAG_CHANGED;
+
+	if (phonebook->sim_context == NULL ||
+			ofono_sim_read_path(phonebook->sim_context,
+					SIM_EFCC_FILEID,
+					OFONO_SIM_FILE_STRUCTURE_TRANSPARENT,
+					phonebook_cc_path,
+					sizeof(phonebook_cc_path),
+					phonebook_cc_cb, phonebook) < 0)
+		phonebook_cc_cb(0, 0, 0, NULL, 0, phonebook);
 }
 
 static DBusMessage *import_entries(DBusConnection *conn, DBusMessage *msg,
 					void *data)
 {
 	struct ofono_phonebook *phonebook = data;
-	DBusMessage *reply;
-
-	if (phonebook->flags & PHONEBOOK_FLAG_CACHED) {
-		reply = generate_export_entries_reply(phonebook, msg);
-		g_dbus_send_message(conn, reply);
-		return NULL;
-	}
 
 	if (phonebook->pending) {
 		phonebook->pending = g_slist_append(phonebook->pending,
@@ -484,9 +660,7 @@ static DBusMessage *import_entries(DBusConnection *conn, DBusMessage *msg,
 	} else {
 		phonebook->pending = g_slist_append(NULL,
 							dbus_message_ref(msg));
-		g_string_set_size(phonebook->vcards, 0);
-		phonebook->storage_index = 0;
-		export_phonebook(phonebook);
+		phonebook_validate(phonebook);
 	}
 
 	return NULL;
@@ -496,6 +670,9 @@ static const GDBusMethodTable phonebook_methods[] = {
 	{ GDBUS_ASYNC_METHOD("Import",
 			NULL, GDBUS_ARGS({ "entries", "s" }),
 			import_entries) },
+	{ GDBUS_ASYNC_METHOD("ImportFd",
+			NULL, GDBUS_ARGS({ "fd", "h" }),
+			import_entries) },
 	{ }
 };
 
@@ -534,6 +711,13 @@ static void phonebook_unregister(struct ofono_atom *atom)
 		pb->pending = NULL;
 	}
 
+	if (pb->sim_context) {
+		ofono_sim_context_free(pb->sim_context);
+		pb->sim_context = NULL;
+	}
+
+	phonebook_cache_invalidate(pb->cache);
+
 	ofono_modem_remove_interface(modem, OFONO_PHONEBOOK_INTERFACE);
 	g_dbus_unregister_interface(conn, path, OFONO_PHONEBOOK_INTERFACE);
 }
@@ -550,7 +734,10 @@ static void phonebook_remove(struct ofono_atom *atom)
 	if (pb->driver && pb->driver->remove)
 		pb->driver->remove(pb);
 
+	g_hash_table_destroy(pb->merge_index);
+	g_slist_free_full(pb->merge_list, destroy_merged_entry);
 	g_string_free(pb->vcards, TRUE);
+	phonebook_cache_free(pb->cache);
 	g_free(pb);
 }
 
@@ -570,6 +757,8 @@ struct ofono_phonebook *ofono_phonebook_create(struct ofono_modem *modem,
 		return NULL;
 
 	pb->vcards = g_string_new(NULL);
+	pb->cache = phonebook_cache_new();
+	pb->merge_index = g_hash_table_new(g_str_hash, g_str_equal);
 	pb->atom = __ofono_modem_add_atom(modem, OFONO_ATOM_TYPE_PHONEBOOK,
 						phonebook_remove, pb);
 
@@ -594,6 +783,7 @@ void ofono_phonebook_register(struct ofono_phonebook *pb)
 	DBusConnection *conn = ofono_dbus_get_connection();
 	const char *path = __ofono_atom_get_path(pb->atom);
 	struct ofono_modem *modem = __ofono_atom_get_modem(pb->atom);
+	struct ofono_atom *sim_atom;
 
 	if (!g_dbus_register_interface(conn, path, OFONO_PHONEBOOK_INTERFACE,
 					phonebook_methods, phonebook_signals,
@@ -606,6 +796,22 @@ void ofono_phonebook_register(struct ofono_phonebook *pb)
 
 	ofono_modem_add_interface(modem, OFONO_PHONEBOOK_INTERFACE);
 
+	/*
+	 * The exported phonebook is kept in memory, and thrown away when
+	 * the SIM tells us that the phonebook files have changed.
+	 */
+	sim_atom = __ofono_modem_find_atom(modem, OFONO_ATOM_TYPE_SIM);
+	if (sim_atom) {
+		struct ofono_sim *sim = __ofono_atom_get_data(sim_atom);
+
+		pb->sim_context = ofono_sim_context_create(sim);
+
+		ofono_sim_add_file_watch(pb->sim_context, SIM_EFADN_FILEID,
+					phonebook_file_changed, pb, NULL);
+		ofono_sim_add_file_watch(pb->sim_context, SIM_EFPBR_FILEID,
+					phonebook_file_changed, pb, NULL);
+	}
+
 	__ofono_atom_register(pb->atom, phonebook_unregister);
 }
 
@@ -0,0 +1,49 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2021 Jolla Ltd. All rights reserved.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#ifndef OFONO_PROBES_H
+#define OFONO_PROBES_H
+
+/*
+ * Static tracepoints, see doc/probes.txt for the list. With --enable-usdt
+ * each probe compiles to a single nop plus an ELF note which bpftrace,
+ * perf or SystemTap can attach to. Otherwise they compile to nothing.
+ * Arguments are evaluated even when nothing is attached, so only pass
+ * values that are already at hand.
+ */
+
+#ifdef HAVE_USDT
+
+#include <sys/sdt.h>
+
+#define OFONO_PROBE(name) DTRACE_PROBE(ofono, name)
+#define OFONO_PROBE1(name, a1) DTRACE_PROBE1(ofono, name, a1)
+#define OFONO_PROBE2(name, a1, a2) DTRACE_PROBE2(ofono, name, a1, a2)
+#define OFONO_PROBE3(name, a1, a2, a3) \
+	DTRACE_PROBE3(ofono, name, a1, a2, a3)
+#define OFONO_PROBE4(name, a1, a2, a3, a4) \
+	DTRACE_PROBE4(ofono, name, a1, a2, a3, a4)
+
+#else
+
+#define OFONO_PROBE(name) do { } while (0)
+#define OFONO_PROBE1(name, a1) do { } while (0)
+#define OFONO_PROBE2(name, a1, a2) do { } while (0)
+#define OFONO_PROBE3(name, a1, a2, a3) do { } while (0)
+#define OFONO_PROBE4(name, a1, a2, a3, a4) do { } while (0)
+
+#endif
+
+#endif /* OFONO_PROBES_H */
@@ -1769,7 +1769,10 @@ static void sim_set_ready(struct ofono_sim *sim)
 
 	sim_fs_check_version(sim->simfs);
 
+	/* Let the atoms queue their reads and then schedule them together */
+	sim_fs_plan_begin(sim->simfs);
 	call_state_watches(sim);
+	sim_fs_plan_end(sim->simfs);
 }
 
 static void impi_read_cb(int ok, int total_length, int record,
@@ -3900,6 +3903,11 @@ const char *__ofono_sim_get_impi(struct ofono_sim *sim)
 	return sim->impi;
 }
 
+struct ofono_modem *__ofono_sim_get_modem(struct ofono_sim *sim)
+{
+	return __ofono_atom_get_modem(sim->atom);
+}
+
 static void open_channel_cb(const struct ofono_error *error, int session_id,
 		void *data);
 
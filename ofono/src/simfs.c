@@ -40,6 +40,7 @@
 #include "simfs.h"
 #include "simutil.h"
 #include "storage.h"
+#include "probes.h"
 
 #define SIM_CACHE_MODE 0600
 #define SIM_CACHE_BASEPATH STORAGEDIR "/%s-%i"
@@ -72,6 +73,18 @@ struct sim_fs_op {
 	gboolean is_read;
 	void *userdata;
 	struct ofono_sim_context *context;
+	int plan_segment;
+	gint64 queued;
+	gint64 started;
+};
+
+/* File information obtained from the SIM while the plan is active */
+struct sim_fs_info {
+	int length;
+	enum ofono_sim_file_structure structure;
+	int record_length;
+	unsigned char access[3];
+	unsigned char file_status;
 };
 
 struct ofono_sim_context {
@@ -90,6 +103,13 @@ struct sim_fs {
 	struct ofono_sim_aid_session *session;
 	int session_id;
 	unsigned int watch_id;
+	gboolean planning;
+	unsigned int plan_first;
+	unsigned int plan_count;
+	gint64 plan_start;
+	GHashTable *info;
+	enum ofono_metrics_op request;
+	gint64 request_started;
 };
 
 static void sim_fs_op_free(gpointer pointer)
@@ -125,6 +145,9 @@ void sim_fs_free(struct sim_fs *fs)
 	if (fs->watch_id)
 		__ofono_sim_remove_session_watch(fs->session, fs->watch_id);
 
+	if (fs->info)
+		g_hash_table_destroy(fs->info);
+
 	g_free(fs);
 }
 
@@ -265,14 +288,48 @@ void sim_fs_notify_file_watches(struct sim_fs *fs, int id)
 
 }
 
+static void sim_fs_plan_done(struct sim_fs *fs)
+{
+	DBG("%u file(s), critical path %d ms", fs->plan_count,
+			(int) ((g_get_monotonic_time() - fs->plan_start) /
+								1000));
+
+	fs->plan_start = 0;
+	fs->plan_count = 0;
+
+	if (fs->info) {
+		g_hash_table_destroy(fs->info);
+		fs->info = NULL;
+	}
+}
+
 static void sim_fs_end_current(struct sim_fs *fs)
 {
 	struct sim_fs_op *op = g_queue_pop_head(fs->op_q);
 
+	if (op->started) {
+		const gint64 now = g_get_monotonic_time();
+
+		OFONO_PROBE3(simfs_op_end, fs, op, op->id);
+
+		DBG("%04x done in %d ms, %d ms in queue", op->id,
+				(int) ((now - op->started) / 1000),
+				(int) ((op->started - op->queued) / 1000));
+	}
+
+	if (fs->plan_start)
+		fs->plan_count++;
+
 	if (g_queue_get_length(fs->op_q) > 0)
 		fs->op_source = g_idle_add(sim_fs_op_next, fs);
-	else if (fs->watch_id) /* release the session if no pending reads */
-		__ofono_sim_remove_session_watch(fs->session, fs->watch_id);
+	else {
+		if (fs->watch_id) /* release the session if no pending reads */
+			__ofono_sim_remove_session_watch(fs->session,
+							fs->watch_id);
+
+		if (fs->plan_start && !fs->planning)
+			sim_fs_plan_done(fs);
+	}
 
 	if (fs->fd != -1) {
 		TFR(close(fs->fd));
@@ -346,12 +403,33 @@ static gboolean cache_block(struct sim_fs *fs, int block, int block_len,
 	return TRUE;
 }
 
+/* Only one driver request is outstanding at a time */
+static void sim_fs_request_start(struct sim_fs *fs, enum ofono_metrics_op op)
+{
+	fs->request = op;
+	fs->request_started = g_get_monotonic_time();
+}
+
+static void sim_fs_request_done(struct sim_fs *fs,
+					const struct ofono_error *error)
+{
+	/* Answered from the cache, the driver wasn't involved */
+	if (!fs->request_started)
+		return;
+
+	__ofono_metrics_done(__ofono_sim_get_modem(fs->sim), fs->request,
+					fs->request_started, error);
+	fs->request_started = 0;
+}
+
 static void sim_fs_op_write_cb(const struct ofono_error *error, void *data)
 {
 	struct sim_fs *fs = data;
 	struct sim_fs_op *op = g_queue_peek_head(fs->op_q);
 	ofono_sim_file_write_cb_t cb = op->cb;
 
+	sim_fs_request_done(fs, error);
+
 	if (cb == NULL) {
 		sim_fs_end_current(fs);
 		return;
@@ -373,6 +451,8 @@ static void sim_fs_op_read_record_cb(const struct ofono_error *error,
 	struct sim_fs_op *op = g_queue_peek_head(fs->op_q);
 	ofono_sim_file_read_cb_t cb = op->cb;
 
+	sim_fs_request_done(fs, error);
+
 	if (cb == NULL) {
 		sim_fs_end_current(fs);
 		return;
@@ -398,6 +478,8 @@ static void sim_fs_op_read_block_cb(const struct ofono_error *error,
 	int dataoff;
 	int tocopy;
 
+	sim_fs_request_done(fs, error);
+
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
 		sim_fs_op_error(fs);
 		return;
@@ -521,6 +603,7 @@ static gboolean sim_fs_op_read_block(gpointer user_data)
 	}
 
 	read_bytes = MIN(op->length - op->current * 256, 256);
+	sim_fs_request_start(fs, OFONO_METRICS_SIM_READ_FILE_TRANSPARENT);
 	fs->driver->read_file_transparent(fs->sim, op->id,
 						op->current * 256,
 						read_bytes,
@@ -540,6 +623,8 @@ static void sim_fs_op_retrieve_cb(const struct ofono_error *error,
 	int total = op->length / op->record_length;
 	ofono_sim_file_read_cb_t cb = op->cb;
 
+	sim_fs_request_done(fs, error);
+
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
 		sim_fs_op_error(fs);
 		return;
@@ -613,6 +698,7 @@ static gboolean sim_fs_op_read_record(gpointer user)
 			return FALSE;
 		}
 
+		sim_fs_request_start(fs, OFONO_METRICS_SIM_READ_FILE_LINEAR);
 		driver->read_file_linear(fs->sim, op->id, op->current,
 						op->record_length,
 						op->path_len ? op->path : NULL,
@@ -625,6 +711,7 @@ static gboolean sim_fs_op_read_record(gpointer user)
 			return FALSE;
 		}
 
+		sim_fs_request_start(fs, OFONO_METRICS_SIM_READ_FILE_CYCLIC);
 		driver->read_file_cyclic(fs->sim, op->id, op->current,
 						op->record_length,
 						op->path_len ? op->path : NULL,
@@ -707,6 +794,8 @@ static void sim_fs_op_info_cb(const struct ofono_error *error, int length,
 	struct sim_fs *fs = data;
 	struct sim_fs_op *op = g_queue_peek_head(fs->op_q);
 
+	sim_fs_request_done(fs, error);
+
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
 		sim_fs_op_error(fs);
 		return;
@@ -715,6 +804,19 @@ static void sim_fs_op_info_cb(const struct ofono_error *error, int length,
 	sim_fs_op_cache_fileinfo(fs, error, length, structure, record_length,
 					access, file_status);
 
+	/* Remember it for the subsequent reads of the same file */
+	if (fs->info && op->path_len == 0 && !g_hash_table_lookup(fs->info,
+						GINT_TO_POINTER(op->id))) {
+		struct sim_fs_info *info = g_new(struct sim_fs_info, 1);
+
+		info->length = length;
+		info->structure = structure;
+		info->record_length = record_length;
+		memcpy(info->access, access, sizeof(info->access));
+		info->file_status = file_status;
+		g_hash_table_insert(fs->info, GINT_TO_POINTER(op->id), info);
+	}
+
 	if (structure != op->structure) {
 		ofono_error("Requested file structure differs from SIM: %x",
 				op->id);
@@ -854,6 +956,35 @@ error:
 	return FALSE;
 }
 
+/*
+ * Multiple atoms tend to query the same files while the SIM is getting
+ * ready, often first the info and then the contents. Reuse the info
+ * obtained from the SIM rather than asking for it again.
+ */
+static gboolean sim_fs_op_check_info(struct sim_fs *fs)
+{
+	struct sim_fs_op *op = g_queue_peek_head(fs->op_q);
+	struct ofono_error error;
+	struct sim_fs_info *info;
+
+	if (fs->info == NULL || op->path_len)
+		return FALSE;
+
+	info = g_hash_table_lookup(fs->info, GINT_TO_POINTER(op->id));
+	if (info == NULL)
+		return FALSE;
+
+	DBG("%04x", op->id);
+
+	error.type = OFONO_ERROR_TYPE_NO_ERROR;
+	error.error = 0;
+
+	sim_fs_op_info_cb(&error, info->length, info->structure,
+				info->record_length, info->access,
+				info->file_status, fs);
+	return TRUE;
+}
+
 static void sim_fs_read_session_cb(const struct ofono_error *error,
 		const unsigned char *sdata, int length, void *data)
 {
@@ -861,6 +992,8 @@ static void sim_fs_read_session_cb(const struct ofono_error *error,
 	struct sim_fs_op *op = g_queue_peek_head(fs->op_q);
 	ofono_sim_file_read_cb_t cb;
 
+	sim_fs_request_done(fs, error);
+
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
 		sim_fs_op_error(fs);
 		return;
@@ -883,6 +1016,8 @@ static void session_read_info_cb(const struct ofono_error *error,
 	struct sim_fs *fs = data;
 	struct sim_fs_op *op = g_queue_peek_head(fs->op_q);
 
+	sim_fs_request_done(fs, error);
+
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
 		sim_fs_op_error(fs);
 		return;
@@ -906,6 +1041,8 @@ static void session_read_info_cb(const struct ofono_error *error,
 			return;
 		}
 
+		sim_fs_request_start(fs,
+				OFONO_METRICS_SIM_SESSION_READ_BINARY);
 		fs->driver->session_read_binary(fs->sim, fs->session_id,
 				op->id, op->offset, filelength, op->path,
 				op->path_len, sim_fs_read_session_cb, fs);
@@ -915,6 +1052,8 @@ static void session_read_info_cb(const struct ofono_error *error,
 			return;
 		}
 
+		sim_fs_request_start(fs,
+				OFONO_METRICS_SIM_SESSION_READ_RECORD);
 		fs->driver->session_read_record(fs->sim, fs->session_id,
 				op->id, op->offset, recordlength, op->path,
 				op->path_len, sim_fs_read_session_cb, fs);
@@ -943,6 +1082,7 @@ static void get_session_cb(ofono_bool_t active, int session_id,
 
 	fs->session_id = session_id;
 
+	sim_fs_request_start(fs, OFONO_METRICS_SIM_SESSION_READ_INFO);
 	fs->driver->session_read_info(fs->sim, session_id, op->id, op->path,
 			op->path_len, session_read_info_cb, fs);
 }
@@ -965,9 +1105,16 @@ static gboolean sim_fs_op_next(gpointer user_data)
 		return FALSE;
 	}
 
+	if (!op->started) {
+		op->started = g_get_monotonic_time();
+		OFONO_PROBE4(simfs_op_start, fs, op, op->id, op->is_read);
+	}
+
 	if (op->is_read == TRUE && op->current > 0) {
 		switch (op->structure) {
 		case OFONO_SIM_FILE_STRUCTURE_FIXED:
+			sim_fs_request_start(fs,
+					OFONO_METRICS_SIM_READ_FILE_LINEAR);
 			driver->read_file_linear(fs->sim, op->id,
 						op->current, op->record_length,
 						op->path_len ? op->path : NULL,
@@ -975,6 +1122,8 @@ static gboolean sim_fs_op_next(gpointer user_data)
 						sim_fs_op_read_record_cb, fs);
 			break;
 		case OFONO_SIM_FILE_STRUCTURE_CYCLIC:
+			sim_fs_request_start(fs,
+					OFONO_METRICS_SIM_READ_FILE_CYCLIC);
 			driver->read_file_cyclic(fs->sim, op->id,
 						op->current, op->record_length,
 						op->path_len ? op->path : NULL,
@@ -991,17 +1140,24 @@ static gboolean sim_fs_op_next(gpointer user_data)
 			return FALSE;
 
 		if (!fs->session) {
+			if (sim_fs_op_check_info(fs))
+				return FALSE;
+
+			sim_fs_request_start(fs,
+					OFONO_METRICS_SIM_READ_FILE_INFO);
 			driver->read_file_info(fs->sim, op->id,
 						op->path_len ? op->path : NULL,
 						op->path_len,
 						sim_fs_op_info_cb, fs);
 		} else {
-			if (fs->watch_id)
+			if (fs->watch_id) {
+				sim_fs_request_start(fs,
+					OFONO_METRICS_SIM_SESSION_READ_INFO);
 				fs->driver->session_read_info(fs->sim,
 						fs->session_id, op->id,
 						op->path, op->path_len,
 						session_read_info_cb, fs);
-			else
+			} else
 				fs->watch_id = __ofono_sim_add_session_watch(
 						fs->session, get_session_cb,
 						fs, session_destroy_cb);
@@ -1009,16 +1165,22 @@ static gboolean sim_fs_op_next(gpointer user_data)
 	} else {
 		switch (op->structure) {
 		case OFONO_SIM_FILE_STRUCTURE_TRANSPARENT:
+			sim_fs_request_start(fs,
+				OFONO_METRICS_SIM_WRITE_FILE_TRANSPARENT);
 			driver->write_file_transparent(fs->sim, op->id, 0,
 					op->length, op->buffer,
 					NULL, 0, sim_fs_op_write_cb, fs);
 			break;
 		case OFONO_SIM_FILE_STRUCTURE_FIXED:
+			sim_fs_request_start(fs,
+				OFONO_METRICS_SIM_WRITE_FILE_LINEAR);
 			driver->write_file_linear(fs->sim, op->id, op->current,
 					op->length, op->buffer,
 					NULL, 0, sim_fs_op_write_cb, fs);
 			break;
 		case OFONO_SIM_FILE_STRUCTURE_CYCLIC:
+			sim_fs_request_start(fs,
+				OFONO_METRICS_SIM_WRITE_FILE_CYCLIC);
 			driver->write_file_cyclic(fs->sim, op->id,
 					op->length, op->buffer,
 					NULL, 0, sim_fs_op_write_cb, fs);
@@ -1035,6 +1197,15 @@ static gboolean sim_fs_op_next(gpointer user_data)
 	return FALSE;
 }
 
+static void sim_fs_op_queue(struct sim_fs *fs, struct sim_fs_op *op)
+{
+	op->queued = g_get_monotonic_time();
+	g_queue_push_tail(fs->op_q, op);
+
+	if (g_queue_get_length(fs->op_q) == 1)
+		fs->op_source = g_idle_add(sim_fs_op_next, fs);
+}
+
 int sim_fs_read_info(struct ofono_sim_context *context, int id,
 			enum ofono_sim_file_structure expected_type,
 			const unsigned char *path, unsigned int pth_len,
@@ -1069,10 +1240,7 @@ int sim_fs_read_info(struct ofono_sim_context *context, int id,
 	memcpy(op->path, path, pth_len);
 	op->path_len = pth_len;
 
-	g_queue_push_tail(fs->op_q, op);
-
-	if (g_queue_get_length(fs->op_q) == 1)
-		fs->op_source = g_idle_add(sim_fs_op_next, fs);
+	sim_fs_op_queue(fs, op);
 
 	return 0;
 }
@@ -1124,10 +1292,7 @@ int sim_fs_read(struct ofono_sim_context *context, int id,
 	memcpy(op->path, path, path_len);
 	op->path_len = path_len;
 
-	g_queue_push_tail(fs->op_q, op);
-
-	if (g_queue_get_length(fs->op_q) == 1)
-		fs->op_source = g_idle_add(sim_fs_op_next, fs);
+	sim_fs_op_queue(fs, op);
 
 	return 0;
 }
@@ -1177,10 +1342,7 @@ int sim_fs_read_record(struct ofono_sim_context *context, int id,
 	memcpy(op->path, path, path_len);
 	op->path_len = path_len;
 
-	g_queue_push_tail(fs->op_q, op);
-
-	if (g_queue_get_length(fs->op_q) == 1)
-		fs->op_source = g_idle_add(sim_fs_op_next, fs);
+	sim_fs_op_queue(fs, op);
 
 	return 0;
 }
@@ -1234,14 +1396,102 @@ int sim_fs_write(struct ofono_sim_context *context, int id,
 	op->current = record;
 	op->context = context;
 
-	g_queue_push_tail(fs->op_q, op);
-
-	if (g_queue_get_length(fs->op_q) == 1)
-		fs->op_source = g_idle_add(sim_fs_op_next, fs);
+	sim_fs_op_queue(fs, op);
 
 	return 0;
 }
 
+void sim_fs_plan_begin(struct sim_fs *fs)
+{
+	if (fs->planning)
+		return;
+
+	fs->planning = TRUE;
+	fs->plan_first = fs->op_q ? g_queue_get_length(fs->op_q) : 0;
+
+	if (!fs->plan_start)
+		fs->plan_start = g_get_monotonic_time();
+
+	if (fs->info == NULL)
+		fs->info = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+								NULL, g_free);
+}
+
+static int sim_fs_op_plan_class(const struct sim_fs_op *op)
+{
+	if (op->info_only)
+		return 0;
+
+	if (op->structure == OFONO_SIM_FILE_STRUCTURE_TRANSPARENT)
+		return 1;
+
+	return 2;
+}
+
+static gint sim_fs_op_plan_compare(gconstpointer a, gconstpointer b)
+{
+	const struct sim_fs_op *op1 = a;
+	const struct sim_fs_op *op2 = b;
+
+	if (op1->plan_segment != op2->plan_segment)
+		return op1->plan_segment - op2->plan_segment;
+
+	return sim_fs_op_plan_class(op1) - sim_fs_op_plan_class(op2);
+}
+
+/*
+ * Reorders the operations queued since sim_fs_plan_begin() so that
+ * info requests go first, then transparent files and finally record
+ * based files which take the longest to read. Writes are never moved
+ * and nothing gets reordered across a write. The operations queued
+ * before sim_fs_plan_begin() (including the one in progress) stay
+ * where they are.
+ */
+void sim_fs_plan_end(struct sim_fs *fs)
+{
+	GList *planned = NULL;
+	GList *l;
+	unsigned int n;
+	int segment = 0;
+
+	if (!fs->planning)
+		return;
+
+	fs->planning = FALSE;
+	n = fs->op_q ? g_queue_get_length(fs->op_q) : 0;
+
+	if (n <= fs->plan_first) {
+		/* Nothing has been queued */
+		if (!n)
+			sim_fs_plan_done(fs);
+
+		return;
+	}
+
+	DBG("%u file(s) requested", n - fs->plan_first);
+
+	while (g_queue_get_length(fs->op_q) > fs->plan_first)
+		planned = g_list_prepend(planned, g_queue_pop_tail(fs->op_q));
+
+	for (l = planned; l; l = l->next) {
+		struct sim_fs_op *op = l->data;
+
+		if (!op->is_read) {
+			op->plan_segment = ++segment;
+			segment++;
+		} else
+			op->plan_segment = segment;
+	}
+
+	/* g_list_sort() is stable, so the original order is preserved */
+	planned = g_list_sort(planned, sim_fs_op_plan_compare);
+
+	for (l = planned; l; l = l->next)
+		g_queue_push_tail(fs->op_q, l->data);
+
+	g_list_free(planned);
+}
+
 void sim_fs_cache_image(struct sim_fs *fs, const char *image, int id)
 {
 	const char *imsi;
@@ -1386,6 +1636,9 @@ void sim_fs_cache_flush(struct sim_fs *fs)
 		g_free(entries);
 	}
 
+	if (fs->info)
+		g_hash_table_remove_all(fs->info);
+
 	sim_fs_image_cache_flush(fs);
 }
 
@@ -1397,6 +1650,9 @@ void sim_fs_cache_flush_file(struct sim_fs *fs, int id)
 
 	remove(path);
 	g_free(path);
+
+	if (fs->info)
+		g_hash_table_remove(fs->info, GINT_TO_POINTER(id));
 }
 
 void sim_fs_image_cache_flush(struct sim_fs *fs)
@@ -63,6 +63,14 @@ int sim_fs_read_info(struct ofono_sim_context *context, int id,
 
 void sim_fs_check_version(struct sim_fs *fs);
 
+/*
+ * Reads requested between these two calls are reordered to minimize
+ * the time until the first results arrive. Per-file timing and the
+ * total time until all the reads have completed get logged.
+ */
+void sim_fs_plan_begin(struct sim_fs *fs);
+void sim_fs_plan_end(struct sim_fs *fs);
+
 int sim_fs_write(struct ofono_sim_context *context, int id,
 			ofono_sim_file_write_cb_t cb,
 			enum ofono_sim_file_structure structure, int record,
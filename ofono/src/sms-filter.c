@@ -74,6 +74,9 @@ struct sms_filter_message {
 	GSList *filter_link;
 	guint pending_id;
 	guint continue_id;
+	GSourceFunc sync_next;
+	gboolean in_process;
+	gint64 start;
 };
 
 struct sms_filter_chain_send_text {
@@ -128,6 +131,15 @@ struct sms_filter_chain {
 
 static GSList *sms_filter_list = NULL;
 
+static void sms_filter_latency_add(struct sms_filter_message *msg)
+{
+	const struct ofono_sms_filter *filter = msg->filter_link->data;
+
+	if (msg->chain)
+		__ofono_metrics_filter_done(msg->chain->modem, "sms-filter",
+						filter->name, msg->start);
+}
+
 static void sms_filter_convert_sms_address(struct ofono_sms_address *dest,
 						const struct sms_address *src)
 {
@@ -188,33 +200,70 @@ static void sms_filter_message_init(struct sms_filter_message *msg,
 	chain->msg_list = g_slist_append(chain->msg_list, msg);
 }
 
+static GSList *sms_filter_message_find(struct sms_filter_message *msg,
+							GSList *filter_link)
+{
+	while (filter_link && !msg->fn->can_process(filter_link->data)) {
+		filter_link = filter_link->next;
+	}
+	return filter_link;
+}
+
+static gboolean sms_filter_message_continue(gpointer data);
+static int sms_filter_message_unref(struct sms_filter_message *msg);
+
 static void sms_filter_message_process(struct sms_filter_message *msg)
 {
-	GSList *filter_link = msg->filter_link;
-	const struct ofono_sms_filter *filter = filter_link->data;
-	const struct sms_filter_message_fn *fn = msg->fn;
+	GSList *filter_link = sms_filter_message_find(msg, msg->filter_link);
 
-	while (filter && !fn->can_process(filter)) {
-		filter_link = filter_link->next;
-		filter = filter_link ? filter_link->data : NULL;
+	if (!filter_link) {
+		msg->fn->passthrough(msg);
+		return;
 	}
 
-	if (filter) {
+	msg->refcount++;
+	while (filter_link) {
+		GSourceFunc next;
 		guint id;
 
+		msg->filter_link = filter_link;
+		msg->start = g_get_monotonic_time();
+		msg->in_process = TRUE;
+		id = msg->fn->process(filter_link->data, msg);
+		msg->in_process = FALSE;
+
+		next = msg->sync_next;
+		if (!next) {
+			/* The filter will call us back later */
+			if (id) {
+				msg->pending_id = id;
+			}
+			break;
+		}
+
+		msg->sync_next = NULL;
+		if (msg->destroyed) {
+			/* The chain has been deleted by the callback */
+			break;
+		}
+
 		/*
-		 * If fn->process returns zero, the message may have
-		 * already been deallocated. It's only guaranteed to
-		 * be alive if fn->process returns non-zero id.
+		 * The filter has completed synchronously. Go straight
+		 * to the next one without a round trip through the main
+		 * loop. The message is still handed over to its final
+		 * destination from idle callback, as it always has been.
 		 */
-		msg->filter_link = filter_link;
-		id = fn->process(filter, msg);
-		if (id) {
-			msg->pending_id = id;
+		if (next == sms_filter_message_continue) {
+			filter_link = sms_filter_message_find(msg,
+							filter_link->next);
+			if (filter_link) {
+				continue;
+			}
 		}
-	} else {
-		fn->passthrough(msg);
+		msg->continue_id = g_idle_add(next, msg);
+		break;
 	}
+	sms_filter_message_unref(msg);
 }
 
 static void sms_filter_message_destroy(struct sms_filter_message *msg)
@@ -299,8 +348,14 @@ static void sms_filter_message_free(struct sms_filter_message *msg)
 static void sms_filter_message_next(struct sms_filter_message *msg,
 							GSourceFunc fn)
 {
+	sms_filter_latency_add(msg);
 	msg->pending_id = 0;
-	msg->continue_id = g_idle_add(fn, msg);
+	if (msg->in_process) {
+		/* Picked up by sms_filter_message_process() */
+		msg->sync_next = fn;
+	} else {
+		msg->continue_id = g_idle_add(fn, msg);
+	}
 }
 
 static gboolean sms_filter_message_continue(gpointer data)
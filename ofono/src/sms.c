@@ -39,6 +39,7 @@
 #include "storage.h"
 #include "simutil.h"
 #include "message.h"
+#include "probes.h"
 
 #define uninitialized_var(x) x = x
 
@@ -70,6 +71,7 @@ struct ofono_sms {
 	struct sms_filter_chain *filter_chain;
 	guint ref;
 	GQueue *txq;
+	gint64 submit_started; /* only one submit is in progress */
 	unsigned long tx_counter;
 	guint tx_source;
 	struct ofono_message_waiting *mw;
@@ -732,6 +734,11 @@ static void tx_finished(const struct ofono_error *error, int mr, void *data)
 	enum message_state tx_state;
 
 	DBG("tx_finished %p", entry);
+	OFONO_PROBE4(sms_submit_done, sms, entry->id, entry->cur_pdu,
+								error->type);
+	__ofono_metrics_done(__ofono_atom_get_modem(sms->atom),
+					OFONO_METRICS_SMS_SUBMIT,
+					sms->submit_started, error);
 
 	sms->flags &= ~MESSAGE_MANAGER_FLAG_TXQ_ACTIVE;
 
@@ -820,6 +827,9 @@ static gboolean tx_next(gpointer user_data)
 
 	sms->flags |= MESSAGE_MANAGER_FLAG_TXQ_ACTIVE;
 
+	OFONO_PROBE4(sms_submit, sms, entry->id, entry->cur_pdu,
+							pdu->tpdu_len);
+	sms->submit_started = g_get_monotonic_time();
 	sms->driver->submit(sms, pdu->pdu, pdu->pdu_len, pdu->tpdu_len,
 				send_mms, tx_finished, sms);
 
@@ -1685,6 +1695,7 @@ void ofono_sms_deliver_notify(struct ofono_sms *sms, const unsigned char *pdu,
 	enum sms_class cls;
 
 	DBG("len %d tpdu len %d", len, tpdu_len);
+	OFONO_PROBE2(sms_deliver, sms, tpdu_len);
 
 	if (!sms_decode(pdu, len, FALSE, tpdu_len, &s)) {
 		ofono_error("Unable to decode PDU");
@@ -4280,7 +4280,13 @@ static inline gboolean cbs_is_update_newer(unsigned int n, unsigned int o)
 
 struct cbs_assembly *cbs_assembly_new(void)
 {
-	return g_new0(struct cbs_assembly, 1);
+	struct cbs_assembly *assembly = g_new0(struct cbs_assembly, 1);
+
+	assembly->recv_plmn = g_hash_table_new(g_direct_hash, g_direct_equal);
+	assembly->recv_loc = g_hash_table_new(g_direct_hash, g_direct_equal);
+	assembly->recv_cell = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	return assembly;
 }
 
 void cbs_assembly_free(struct cbs_assembly *assembly)
@@ -4295,9 +4301,9 @@ void cbs_assembly_free(struct cbs_assembly *assembly)
 	}
 
 	g_slist_free(assembly->assembly_list);
-	g_slist_free(assembly->recv_plmn);
-	g_slist_free(assembly->recv_loc);
-	g_slist_free(assembly->recv_cell);
+	g_hash_table_destroy(assembly->recv_plmn);
+	g_hash_table_destroy(assembly->recv_loc);
+	g_hash_table_destroy(assembly->recv_cell);
 
 	g_free(assembly);
 }
@@ -4327,17 +4333,6 @@ static gint cbs_compare_node_by_update(gconstpointer a, gconstpointer b)
 	return 0;
 }
 
-static gint cbs_compare_recv_by_serial(gconstpointer a, gconstpointer b)
-{
-	unsigned int old_serial = GPOINTER_TO_UINT(a);
-	unsigned int new_serial = GPOINTER_TO_UINT(b);
-
-	if ((old_serial & (~0xf)) == (new_serial & (~0xf)))
-		return 0;
-
-	return 1;
-}
-
 static void cbs_assembly_expire(struct cbs_assembly *assembly,
 				GCompareFunc func, gconstpointer *userdata)
 {
@@ -4397,8 +4392,7 @@ void cbs_assembly_location_changed(struct cbs_assembly *assembly, gboolean plmn,
 
 	if (plmn) {
 		lac = TRUE;
-		g_slist_free(assembly->recv_plmn);
-		assembly->recv_plmn = NULL;
+		g_hash_table_remove_all(assembly->recv_plmn);
 
 		cbs_assembly_expire(assembly, cbs_compare_node_by_gs,
 				GUINT_TO_POINTER(CBS_GEO_SCOPE_PLMN));
@@ -4407,16 +4401,14 @@ void cbs_assembly_location_changed(struct cbs_assembly *assembly, gboolean plmn,
 	if (lac) {
 		/* If LAC changed, then cell id has changed */
 		ci = TRUE;
-		g_slist_free(assembly->recv_loc);
-		assembly->recv_loc = NULL;
+		g_hash_table_remove_all(assembly->recv_loc);
 
 		cbs_assembly_expire(assembly, cbs_compare_node_by_gs,
 				GUINT_TO_POINTER(CBS_GEO_SCOPE_SERVICE_AREA));
 	}
 
 	if (ci) {
-		g_slist_free(assembly->recv_cell);
-		assembly->recv_cell = NULL;
+		g_hash_table_remove_all(assembly->recv_cell);
 		cbs_assembly_expire(assembly, cbs_compare_node_by_gs,
 				GUINT_TO_POINTER(CBS_GEO_SCOPE_CELL_IMMEDIATE));
 		cbs_assembly_expire(assembly, cbs_compare_node_by_gs,
@@ -4431,7 +4423,9 @@ GSList *cbs_assembly_add_page(struct cbs_assembly *assembly,
 	struct cbs_assembly_node *node;
 	GSList *completed;
 	unsigned int new_serial;
-	GSList **recv;
+	GHashTable *recv;
+	gpointer recv_key;
+	gpointer old_serial;
 	GSList *l;
 	GSList *prev;
 	int position;
@@ -4442,27 +4436,25 @@ GSList *cbs_assembly_add_page(struct cbs_assembly *assembly,
 	new_serial |= cbs->message_identifier << 16;
 
 	if (cbs->gs == CBS_GEO_SCOPE_PLMN)
-		recv = &assembly->recv_plmn;
+		recv = assembly->recv_plmn;
 	else if (cbs->gs == CBS_GEO_SCOPE_SERVICE_AREA)
-		recv = &assembly->recv_loc;
+		recv = assembly->recv_loc;
 	else
-		recv = &assembly->recv_cell;
+		recv = assembly->recv_cell;
 
-	/* Have we seen this message before? */
-	l = g_slist_find_custom(*recv, GUINT_TO_POINTER(new_serial),
-				cbs_compare_recv_by_serial);
+	/* Messages are told apart by everything but the update number */
+	recv_key = GUINT_TO_POINTER(new_serial & (~0xf));
 
-	/* If we have, is the message newer? */
-	if (l && !cbs_is_update_newer(new_serial, GPOINTER_TO_UINT(l->data)))
+	/* Have we seen this message before? If we have, is it newer? */
+	if (g_hash_table_lookup_extended(recv, recv_key, NULL, &old_serial) &&
+			!cbs_is_update_newer(new_serial,
+					GPOINTER_TO_UINT(old_serial)))
 		return NULL;
 
 	/* Easy case first, page 1 of 1 */
 	if (cbs->max_pages == 1 && cbs->page == 1) {
-		if (l)
-			l->data = GUINT_TO_POINTER(new_serial);
-		else
-			*recv = g_slist_prepend(*recv,
-						GUINT_TO_POINTER(new_serial));
+		g_hash_table_insert(recv, recv_key,
+					GUINT_TO_POINTER(new_serial));
 
 		newcbs = g_new(struct cbs, 1);
 		memcpy(newcbs, cbs, sizeof(struct cbs));
@@ -4522,7 +4514,7 @@ out:
 
 	cbs_assembly_expire(assembly, cbs_compare_node_by_update,
 				GUINT_TO_POINTER(new_serial));
-	*recv = g_slist_prepend(*recv, GUINT_TO_POINTER(new_serial));
+	g_hash_table_insert(recv, recv_key, GUINT_TO_POINTER(new_serial));
 
 	return completed;
 }
@@ -4766,6 +4758,42 @@ gboolean cbs_topic_in_range(unsigned int topic, GSList *ranges)
 					cbs_topic_compare) != NULL;
 }
 
+struct cbs_topic_set *cbs_topic_set_new(GSList *ranges)
+{
+	struct cbs_topic_set *set = g_new0(struct cbs_topic_set, 1);
+	GSList *l;
+
+	for (l = ranges; l; l = l->next) {
+		const struct cbs_topic_range *range = l->data;
+		unsigned int topic = range->min;
+
+		/* Leading bits up to a word boundary */
+		while (topic <= range->max && (topic & 0x1f)) {
+			set->bits[topic >> 5] |= 1U << (topic & 0x1f);
+			topic++;
+		}
+
+		/* Whole words */
+		while (topic + 31 <= range->max) {
+			set->bits[topic >> 5] = 0xffffffff;
+			topic += 32;
+		}
+
+		/* And whatever is left */
+		while (topic <= range->max) {
+			set->bits[topic >> 5] |= 1U << (topic & 0x1f);
+			topic++;
+		}
+	}
+
+	return set;
+}
+
+void cbs_topic_set_free(struct cbs_topic_set *set)
+{
+	g_free(set);
+}
+
 char *ussd_decode(int dcs, int len, const unsigned char *data)
 {
 	gboolean udhi;
@@ -429,9 +429,10 @@ struct cbs_assembly_node {
 
 struct cbs_assembly {
 	GSList *assembly_list;
-	GSList *recv_plmn;
-	GSList *recv_loc;
-	GSList *recv_cell;
+	/* Serial without the update number -> last received serial */
+	GHashTable *recv_plmn;
+	GHashTable *recv_loc;
+	GHashTable *recv_cell;
 };
 
 struct cbs_topic_range {
@@ -439,6 +440,11 @@ struct cbs_topic_range {
 	unsigned short max;
 };
 
+/* One bit for each of the 65536 message identifiers */
+struct cbs_topic_set {
+	guint32 bits[65536 / 32];
+};
+
 struct txq_backup_entry {
 	GSList *msg_list;
 	unsigned char uuid[SMS_MSGID_LEN];
@@ -613,5 +619,17 @@ GSList *cbs_extract_topic_ranges(const char *ranges);
 GSList *cbs_optimize_ranges(GSList *ranges);
 gboolean cbs_topic_in_range(unsigned int topic, GSList *ranges);
 
+struct cbs_topic_set *cbs_topic_set_new(GSList *ranges);
+void cbs_topic_set_free(struct cbs_topic_set *set);
+
+static inline gboolean cbs_topic_set_contains(const struct cbs_topic_set *set,
+							unsigned int topic)
+{
+	if (set == NULL || topic > 0xffff)
+		return FALSE;
+
+	return (set->bits[topic >> 5] >> (topic & 0x1f)) & 1;
+}
+
 char *ussd_decode(int dcs, int len, const unsigned char *data);
 gboolean ussd_encode(const char *str, long *items_written, unsigned char *pdu);
@@ -1781,6 +1781,13 @@ const uint8_t *stk_pdu_from_response(const struct stk_response *response,
 						unsigned int *out_length);
 const uint8_t *stk_pdu_from_envelope(const struct stk_envelope *envelope,
 						unsigned int *out_length);
+const uint8_t *stk_pdu_from_response_buf(const struct stk_response *response,
+						uint8_t *pdu, unsigned int size,
+						unsigned int *out_length);
+const uint8_t *stk_pdu_from_envelope_buf(const struct stk_envelope *envelope,
+						uint8_t *buffer,
+						unsigned int size,
+						unsigned int *out_length);
 char *stk_text_to_html(const char *text, const uint16_t *attrs, int num_attrs);
 char *stk_image_to_xpm(const uint8_t *img, unsigned int len,
 			enum stk_img_scheme scheme, const uint8_t *clut,
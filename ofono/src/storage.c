@@ -38,8 +38,28 @@
 #include "storage.h"
 #include "ofono.h"
 
+/* How long dirty stores are kept in memory before being written */
+#define STORAGE_WRITE_DELAY_MS (2000)
+
 static char* config_dir = NULL;
 
+/*
+ * Once __ofono_storage_init() has been called, the contents of every
+ * store are cached in memory.  storage_sync() only updates the cache
+ * and the dirty stores are written out together after a short delay
+ * or on shutdown.  Without init (e.g. in unit tests) everything goes
+ * straight to the file system as it always did.
+ */
+struct storage_entry {
+	char *data;			/* Keyfile contents or NULL */
+	gsize length;
+	gboolean dirty;
+};
+
+static GHashTable *storage_cache = NULL;
+static guint storage_flush_id = 0;
+static struct ofono_storage_stats storage_stats;
+
 void __ofono_set_config_dir(const char *dir)
 {
 	g_free(config_dir);
@@ -180,6 +200,58 @@ error_create_dirs:
 	return r;
 }
 
+static char *storage_path(const char *imsi, const char *store)
+{
+	if (imsi)
+		return g_strdup_printf(STORAGEDIR "/%s/%s", imsi, store);
+	else
+		return g_strdup_printf(STORAGEDIR "/%s", store);
+}
+
+static void storage_entry_free(gpointer data)
+{
+	struct storage_entry *entry = data;
+
+	g_free(entry->data);
+	g_free(entry);
+}
+
+static gboolean storage_write(const char *path, const char *data,
+								gsize length)
+{
+	if (create_dirs(path, S_IRUSR | S_IWUSR | S_IXUSR) != 0)
+		return FALSE;
+
+	/* g_file_set_contents writes a temporary file and renames it */
+	return g_file_set_contents(path, data, length, NULL);
+}
+
+static struct storage_entry *storage_cache_lookup(const char *path)
+{
+	struct storage_entry *entry = g_hash_table_lookup(storage_cache, path);
+
+	if (entry == NULL) {
+		entry = g_new0(struct storage_entry, 1);
+
+		/* Missing file is cached as NULL data */
+		if (!g_file_get_contents(path, &entry->data, &entry->length,
+									NULL))
+			entry->data = NULL;
+
+		g_hash_table_insert(storage_cache, g_strdup(path), entry);
+	}
+
+	return entry;
+}
+
+static gboolean storage_flush_cb(gpointer user_data)
+{
+	storage_flush_id = 0;
+	__ofono_storage_flush();
+
+	return G_SOURCE_REMOVE;
+}
+
 GKeyFile *storage_open(const char *imsi, const char *store)
 {
 	GKeyFile *keyfile;
@@ -188,46 +260,65 @@ GKeyFile *storage_open(const char *imsi, const char *store)
 	if (store == NULL)
 		return NULL;
 
-	if (imsi)
-		path = g_strdup_printf(STORAGEDIR "/%s/%s", imsi, store);
-	else
-		path = g_strdup_printf(STORAGEDIR "/%s", store);
-
+	path = storage_path(imsi, store);
 	keyfile = g_key_file_new();
 
-	if (path) {
+	if (storage_cache) {
+		struct storage_entry *entry = storage_cache_lookup(path);
+
+		if (entry->data)
+			g_key_file_load_from_data(keyfile, entry->data,
+						entry->length, 0, NULL);
+	} else {
 		g_key_file_load_from_file(keyfile, path, 0, NULL);
-		g_free(path);
 	}
 
+	g_free(path);
 	return keyfile;
 }
 
 void storage_sync(const char *imsi, const char *store, GKeyFile *keyfile)
 {
+	struct storage_entry *entry;
 	char *path;
 	char *data;
 	gsize length = 0;
 
-	if (imsi)
-		path = g_strdup_printf(STORAGEDIR "/%s/%s", imsi, store);
-	else
-		path = g_strdup_printf(STORAGEDIR "/%s", store);
+	path = storage_path(imsi, store);
+	data = g_key_file_to_data(keyfile, &length, NULL);
 
-	if (path == NULL)
+	if (storage_cache == NULL) {
+		storage_write(path, data, length);
+		g_free(data);
+		g_free(path);
 		return;
+	}
 
-	if (create_dirs(path, S_IRUSR | S_IWUSR | S_IXUSR) != 0) {
-		g_free(path);
+	storage_stats.syncs++;
+	entry = storage_cache_lookup(path);
+	g_free(path);
+
+	if (entry->data && entry->length == length &&
+				!memcmp(entry->data, data, length)) {
+		/* Nothing has changed */
+		storage_stats.avoided++;
+		g_free(data);
 		return;
 	}
 
-	data = g_key_file_to_data(keyfile, &length, NULL);
+	if (entry->dirty) {
+		/* Replaces the write which hasn't happened yet */
+		storage_stats.avoided++;
+	}
 
-	g_file_set_contents(path, data, length, NULL);
+	g_free(entry->data);
+	entry->data = data;
+	entry->length = length;
+	entry->dirty = TRUE;
 
-	g_free(data);
-	g_free(path);
+	if (!storage_flush_id)
+		storage_flush_id = g_timeout_add(STORAGE_WRITE_DELAY_MS,
+						storage_flush_cb, NULL);
 }
 
 void storage_close(const char *imsi, const char *store, GKeyFile *keyfile,
@@ -238,3 +329,54 @@ void storage_close(const char *imsi, const char *store, GKeyFile *keyfile,
 
 	g_key_file_free(keyfile);
 }
+
+void __ofono_storage_flush(void)
+{
+	GHashTableIter it;
+	gpointer key, value;
+
+	if (storage_flush_id) {
+		g_source_remove(storage_flush_id);
+		storage_flush_id = 0;
+	}
+
+	if (storage_cache == NULL)
+		return;
+
+	g_hash_table_iter_init(&it, storage_cache);
+	while (g_hash_table_iter_next(&it, &key, &value)) {
+		struct storage_entry *entry = value;
+
+		if (!entry->dirty)
+			continue;
+
+		entry->dirty = FALSE;
+		storage_stats.writes++;
+		storage_write(key, entry->data, entry->length);
+	}
+}
+
+void __ofono_storage_get_stats(struct ofono_storage_stats *stats)
+{
+	*stats = storage_stats;
+}
+
+void __ofono_storage_init(void)
+{
+	if (storage_cache)
+		return;
+
+	storage_cache = g_hash_table_new_full(g_str_hash, g_str_equal,
+						g_free, storage_entry_free);
+	memset(&storage_stats, 0, sizeof(storage_stats));
+}
+
+void __ofono_storage_cleanup(void)
+{
+	if (storage_cache == NULL)
+		return;
+
+	__ofono_storage_flush();
+	g_hash_table_destroy(storage_cache);
+	storage_cache = NULL;
+}
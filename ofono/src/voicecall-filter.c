@@ -37,6 +37,9 @@ struct voicecall_filter_request {
 	GSList *filter_link;
 	guint pending_id;
 	guint next_id;
+	GSourceFunc sync_next;
+	gboolean in_process;
+	gint64 start;
 	ofono_destroy_func destroy;
 	void* user_data;
 };
@@ -60,6 +63,16 @@ struct voicecall_filter_chain {
 
 static GSList *voicecall_filters = NULL;
 
+static void voicecall_filter_latency_add(struct voicecall_filter_request *req)
+{
+	const struct ofono_voicecall_filter *f = req->filter_link->data;
+
+	if (req->chain)
+		__ofono_metrics_filter_done(
+				ofono_voicecall_get_modem(req->chain->vc),
+				"voicecall-filter", f->name, req->start);
+}
+
 static void voicecall_filter_request_init(struct voicecall_filter_request *req,
 	const struct voicecall_filter_request_fn *fn,
 	struct voicecall_filter_chain *chain, const struct ofono_call *call,
@@ -165,24 +178,63 @@ static void voicecall_filter_request_complete
 	voicecall_filter_request_unref(req);
 }
 
+static GSList *voicecall_filter_request_find
+		(struct voicecall_filter_request *req, GSList *l)
+{
+	while (l && !req->fn->can_process(l->data)) {
+		l = l->next;
+	}
+	return l;
+}
+
+static gboolean voicecall_filter_request_continue_cb(gpointer data);
+
 static void voicecall_filter_request_process
 		(struct voicecall_filter_request *req)
 {
-	GSList *l = req->filter_link;
-	const struct ofono_voicecall_filter *f = l->data;
-	const struct voicecall_filter_request_fn *fn = req->fn;
+	GSList *l = voicecall_filter_request_find(req, req->filter_link);
 
-	while (f && !fn->can_process(f)) {
-		l = l->next;
-		f = l ? l->data : NULL;
+	voicecall_filter_request_ref(req);
+	if (!l) {
+		voicecall_filter_request_complete(req, req->fn->allow);
 	}
 
-	voicecall_filter_request_ref(req);
-	if (f) {
+	while (l) {
+		GSourceFunc next;
+
 		req->filter_link = l;
-		req->pending_id = fn->process(f, req);
-	} else {
-		voicecall_filter_request_complete(req, fn->allow);
+		req->start = g_get_monotonic_time();
+		req->in_process = TRUE;
+		req->pending_id = req->fn->process(l->data, req);
+		req->in_process = FALSE;
+
+		next = req->sync_next;
+		if (!next) {
+			/* The filter will call us back later */
+			break;
+		}
+
+		req->sync_next = NULL;
+		req->pending_id = 0;
+		if (!req->chain) {
+			/* Request has been canceled by the callback */
+			break;
+		}
+
+		/*
+		 * The filter has completed synchronously. Go straight
+		 * to the next one without a round trip through the main
+		 * loop. The final result is still delivered from idle
+		 * callback, as it always has been.
+		 */
+		if (next == voicecall_filter_request_continue_cb) {
+			l = voicecall_filter_request_find(req, l->next);
+			if (l) {
+				continue;
+			}
+		}
+		req->next_id = g_idle_add(next, req);
+		break;
 	}
 	voicecall_filter_request_unref(req);
 }
@@ -190,8 +242,14 @@ static void voicecall_filter_request_process
 static void voicecall_filter_request_next(struct voicecall_filter_request *req,
 							GSourceFunc fn)
 {
+	voicecall_filter_latency_add(req);
 	req->pending_id = 0;
-	req->next_id = g_idle_add(fn, req);
+	if (req->in_process) {
+		/* Picked up by voicecall_filter_request_process() */
+		req->sync_next = fn;
+	} else {
+		req->next_id = g_idle_add(fn, req);
+	}
 }
 
 static gboolean voicecall_filter_request_continue_cb(gpointer data)
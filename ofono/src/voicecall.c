@@ -51,11 +51,33 @@
 
 static GSList *g_drivers = NULL;
 
+/*
+ * Call list queries issued by the driver. At most one query is in
+ * flight, requests arriving in the meantime are merged into a single
+ * follow-up query. While calls are in a transient state and no call
+ * state indications arrive, the query is repeated with exponential
+ * backoff between min_interval and max_interval.
+ */
+struct voicecall_poll {
+	ofono_voicecall_query_cb_t query;
+	unsigned int min_interval;
+	unsigned int max_interval;
+	unsigned int interval;
+	guint source;
+	gint64 due;
+	gboolean fallback;
+	gboolean in_flight;
+	gboolean requery;
+	unsigned int queries;
+	unsigned int merged;
+};
+
 struct ofono_voicecall {
 	GSList *call_list;
 	GSList *release_list;
 	GSList *multiparty_list;
-	GHashTable *en_list; /* emergency number list */
+	GHashTable *en_list; /* emergency number => generation */
+	unsigned int en_generation;
 	GSList *sim_en_list; /* Emergency numbers already read from SIM */
 	GSList *new_sim_en_list; /* Emergency numbers being read from SIM */
 	char **nw_en_list; /* Emergency numbers from modem/network */
@@ -77,9 +99,11 @@ struct ofono_voicecall {
 	ofono_voicecall_cb_t release_queue_done_cb;
 	struct ofono_emulator *pending_em;
 	unsigned int pending_id;
+	gint64 dial_started; /* driver dial in progress */
 	struct voicecall_agent *vc_agent;
 	struct voicecall_filter_chain *filters;
 	GSList *incoming_filter_list;
+	struct voicecall_poll poll;
 };
 
 struct voicecall {
@@ -126,6 +150,7 @@ struct dial_filter_req {
 	enum ofono_clir_option clir;
 	ofono_voicecall_cb_t cb;
 	void *data;
+	gint64 start;
 };
 
 static const char *default_en_list[] = { "911", "112", NULL };
@@ -167,12 +192,57 @@ static gint call_compare(gconstpointer a, gconstpointer b)
 	return 0;
 }
 
-static void add_to_en_list(struct ofono_voicecall *vc, char **list)
+/*
+ * The emergency number table is updated in place: every update stamps
+ * the numbers from all the sources with a new generation, and whatever
+ * is left with an older one is dropped at the end. Returns TRUE if a
+ * number was added.
+ */
+static gboolean en_list_add(struct ofono_voicecall *vc, const char *number)
 {
+	gpointer gen = GUINT_TO_POINTER(vc->en_generation);
+	gpointer key;
+
+	if (g_hash_table_lookup_extended(vc->en_list, number, &key, NULL)) {
+		/* Keep the key, only update the generation */
+		g_hash_table_steal(vc->en_list, key);
+		g_hash_table_insert(vc->en_list, key, gen);
+		return FALSE;
+	}
+
+	g_hash_table_insert(vc->en_list, g_strdup(number), gen);
+	return TRUE;
+}
+
+static gboolean add_to_en_list(struct ofono_voicecall *vc, char **list)
+{
+	gboolean added = FALSE;
 	int i = 0;
 
 	while (list[i])
-		g_hash_table_insert(vc->en_list, g_strdup(list[i++]), NULL);
+		added |= en_list_add(vc, list[i++]);
+
+	return added;
+}
+
+/* Returns TRUE if anything was removed */
+static gboolean en_list_drop_stale(struct ofono_voicecall *vc)
+{
+	gpointer gen = GUINT_TO_POINTER(vc->en_generation);
+	gboolean removed = FALSE;
+	GHashTableIter iter;
+	gpointer value;
+
+	g_hash_table_iter_init(&iter, vc->en_list);
+
+	while (g_hash_table_iter_next(&iter, NULL, &value)) {
+		if (value != gen) {
+			g_hash_table_iter_remove(&iter);
+			removed = TRUE;
+		}
+	}
+
+	return removed;
 }
 
 static const char *disconnect_reason_to_string(enum ofono_disconnect_reason r)
@@ -1449,6 +1519,14 @@ static struct voicecall *dial_handle_result(struct ofono_voicecall *vc,
 
 	*need_to_emit = FALSE;
 
+	/* Dials blocked by a filter never reached the driver */
+	if (vc->dial_started) {
+		__ofono_metrics_done(__ofono_atom_get_modem(vc->atom),
+					OFONO_METRICS_VOICECALL_DIAL,
+					vc->dial_started, error);
+		vc->dial_started = 0;
+	}
+
 	if (error->type != OFONO_ERROR_TYPE_NO_ERROR) {
 		DBG("Dial callback returned error: %s",
 			telephony_error_to_str(error));
@@ -1671,16 +1749,22 @@ static void dial_filter_cb(enum ofono_voicecall_filter_dial_result result,
 {
 	struct dial_filter_req *req = req_data;
 
+	struct ofono_voicecall *vc = req->vc;
+	struct ofono_modem *modem = __ofono_atom_get_modem(vc->atom);
+
 	if (result == OFONO_VOICECALL_FILTER_DIAL_BLOCK) {
 		struct ofono_error error;
 
 		error.type = OFONO_ERROR_TYPE_ERRNO;
 		error.error = EACCES;
+		__ofono_metrics_done(modem, OFONO_METRICS_VOICECALL_DIAL_FILTER,
+							req->start, &error);
 		req->cb(&error, req->data);
 	} else {
-		struct ofono_voicecall *vc = req->vc;
-
 		/* OFONO_VOICECALL_FILTER_DIAL_CONTINUE */
+		__ofono_metrics_done(modem, OFONO_METRICS_VOICECALL_DIAL_FILTER,
+							req->start, NULL);
+		vc->dial_started = g_get_monotonic_time();
 		vc->driver->dial(vc, &req->pn, req->clir, req->cb, req->data);
 	}
 }
@@ -1697,6 +1781,7 @@ static void dial_filter(struct ofono_voicecall *vc,
 	req->clir = clir;
 	req->cb = cb;
 	req->data = data;
+	req->start = g_get_monotonic_time();
 	__ofono_voicecall_filter_chain_dial(vc->filters, &req->pn, clir,
 						dial_filter_cb, g_free, req);
 }
@@ -3027,29 +3112,30 @@ static void emit_en_list_changed(struct ofono_voicecall *vc)
 
 static void set_new_ecc(struct ofono_voicecall *vc)
 {
-	g_hash_table_destroy(vc->en_list);
+	gboolean changed = FALSE;
 
-	vc->en_list = g_hash_table_new_full(g_str_hash, g_str_equal,
-							g_free, NULL);
+	vc->en_generation++;
 
 	/* Emergency numbers from modem/network */
 	if (vc->nw_en_list)
-		add_to_en_list(vc, vc->nw_en_list);
+		changed |= add_to_en_list(vc, vc->nw_en_list);
 
 	/* Emergency numbers read from SIM */
 	if (vc->flags & VOICECALL_FLAG_SIM_ECC_READY) {
 		GSList *l;
 
 		for (l = vc->sim_en_list; l; l = l->next)
-			g_hash_table_insert(vc->en_list, g_strdup(l->data),
-							NULL);
+			changed |= en_list_add(vc, l->data);
 	} else
-		add_to_en_list(vc, (char **) default_en_list_no_sim);
+		changed |= add_to_en_list(vc,
+					(char **) default_en_list_no_sim);
 
 	/* Default emergency numbers */
-	add_to_en_list(vc, (char **) default_en_list);
+	changed |= add_to_en_list(vc, (char **) default_en_list);
+	changed |= en_list_drop_stale(vc);
 
-	emit_en_list_changed(vc);
+	if (changed)
+		emit_en_list_changed(vc);
 }
 
 static void free_sim_ecc_numbers(struct ofono_voicecall *vc, gboolean old_only)
@@ -3335,6 +3421,14 @@ static void voicecall_remove(struct ofono_atom *atom)
 
 	__ofono_voicecall_filter_chain_free(vc->filters);
 
+	if (vc->poll.source) {
+		g_source_remove(vc->poll.source);
+		vc->poll.source = 0;
+	}
+
+	DBG("%u call list queries, %u merged", vc->poll.queries,
+							vc->poll.merged);
+
 	if (vc->driver && vc->driver->remove)
 		vc->driver->remove(vc);
 
@@ -4121,6 +4215,7 @@ void ofono_voicecall_register(struct ofono_voicecall *vc)
 
 	vc->en_list = g_hash_table_new_full(g_str_hash, g_str_equal,
 							g_free, NULL);
+	vc->en_generation = 0;
 
 	/*
 	 * Start out with the 22.101 mandated numbers, if we have a SIM and
@@ -4662,3 +4757,113 @@ ofono_bool_t ofono_voicecall_is_emergency_number(struct ofono_voicecall *vc,
 {
 	return vc && number && is_emergency_number(vc, number);
 }
+
+static gboolean voicecall_poll_cb(gpointer user_data)
+{
+	struct ofono_voicecall *vc = user_data;
+	struct voicecall_poll *poll = &vc->poll;
+
+	poll->source = 0;
+	poll->in_flight = TRUE;
+	poll->requery = FALSE;
+	poll->queries++;
+	poll->query(vc);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void voicecall_poll_schedule(struct ofono_voicecall *vc,
+				unsigned int delay_ms, gboolean fallback)
+{
+	struct voicecall_poll *poll = &vc->poll;
+	gint64 due = g_get_monotonic_time() + delay_ms * (gint64) 1000;
+
+	if (poll->source) {
+		/* The earlier query wins, explicit request beats fallback */
+		if (poll->due <= due) {
+			poll->fallback = poll->fallback && fallback;
+			poll->merged++;
+			return;
+		}
+
+		g_source_remove(poll->source);
+	}
+
+	poll->due = due;
+	poll->fallback = fallback;
+
+	if (delay_ms)
+		poll->source = g_timeout_add(delay_ms, voicecall_poll_cb, vc);
+	else
+		poll->source = g_idle_add(voicecall_poll_cb, vc);
+}
+
+/* Since mer/1.29+git1 */
+void ofono_voicecall_poll_init(struct ofono_voicecall *vc,
+				ofono_voicecall_query_cb_t query,
+				unsigned int min_interval_ms,
+				unsigned int max_interval_ms)
+{
+	struct voicecall_poll *poll = &vc->poll;
+
+	poll->query = query;
+	poll->min_interval = min_interval_ms;
+	poll->max_interval = MAX(min_interval_ms, max_interval_ms);
+	poll->interval = poll->min_interval;
+}
+
+/* Since mer/1.29+git1 */
+void ofono_voicecall_poll_request(struct ofono_voicecall *vc,
+						unsigned int delay_ms)
+{
+	struct voicecall_poll *poll = &vc->poll;
+
+	if (!poll->query)
+		return;
+
+	/* Something is going on, restart the backoff */
+	poll->interval = poll->min_interval;
+
+	if (poll->in_flight) {
+		/* The result of the pending query may already be stale */
+		if (poll->requery)
+			poll->merged++;
+
+		poll->requery = TRUE;
+		return;
+	}
+
+	voicecall_poll_schedule(vc, delay_ms, FALSE);
+}
+
+/* Since mer/1.29+git1 */
+void ofono_voicecall_poll_event(struct ofono_voicecall *vc)
+{
+	struct voicecall_poll *poll = &vc->poll;
+
+	/* The modem is talking to us, push the fallback poll back */
+	if (poll->source && poll->fallback) {
+		g_source_remove(poll->source);
+		poll->source = 0;
+		voicecall_poll_schedule(vc, poll->interval, TRUE);
+	}
+}
+
+/* Since mer/1.29+git1 */
+void ofono_voicecall_poll_done(struct ofono_voicecall *vc,
+						ofono_bool_t transient)
+{
+	struct voicecall_poll *poll = &vc->poll;
+
+	poll->in_flight = FALSE;
+
+	if (poll->requery) {
+		poll->requery = FALSE;
+		voicecall_poll_schedule(vc, 0, FALSE);
+	} else if (transient) {
+		voicecall_poll_schedule(vc, poll->interval, TRUE);
+		poll->interval = MIN(poll->interval * 2, poll->max_interval);
+	} else {
+		poll->interval = poll->min_interval;
+	}
+}
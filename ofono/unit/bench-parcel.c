@@ -0,0 +1,446 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2021 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ */
+
+/*
+ * Decodes RIL parcels taken from captures made with ofonod --capture,
+ * once with the allocating string readers and once with string views
+ * and a scratch buffer, and builds a SIM IO request with a growing and
+ * with a caller provided buffer. Only inbound parcels shaped like a
+ * string array, or like a SIM IO response, are used. Reports parcels
+ * per second and heap allocations per parcel for each variant. Without
+ * arguments a few synthetic parcels are used.
+ *
+ * Usage: bench-parcel [-n ROUNDS] [CAPTURE...]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "parcel.h"
+#include "capture.h"
+
+#define RIL_HEADER_MAX 12
+#define RIL_STRV_MAX 64
+
+enum bench_shape {
+	BENCH_STRV,		/* int32 count followed by strings */
+	BENCH_SIM_IO,		/* sw1, sw2 and a hex string */
+};
+
+struct bench {
+	GArray *parcels;	/* struct bench_parcel */
+	GByteArray *data;
+	GHashTable *streams;	/* RIL channel -> GByteArray */
+	guint skipped;
+};
+
+struct bench_parcel {
+	enum bench_shape shape;
+	guint offset;
+	guint len;
+};
+
+static unsigned long alloc_count;
+
+/*
+ * Count heap allocations. glib allocates through the system malloc,
+ * which is what gets interposed here (glibc only).
+ */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+	alloc_count++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	alloc_count++;
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	alloc_count++;
+	return __libc_realloc(ptr, size);
+}
+
+static void bench_reader(struct parcel *p, const struct bench *bench,
+				const struct bench_parcel *bp)
+{
+	parcel_init_buf(p, bench->data->data + bp->offset, bp->len);
+	p->size = bp->len;
+}
+
+static gboolean bench_check_shape(const void *data, guint len,
+					enum bench_shape shape)
+{
+	struct parcel p;
+	struct parcel_str str;
+	int n;
+
+	parcel_init_buf(&p, (void *) data, len);
+	p.size = len;
+
+	if (shape == BENCH_STRV) {
+		n = parcel_r_int32(&p);
+		if (n <= 0 || n > RIL_STRV_MAX)
+			return FALSE;
+	} else {
+		parcel_r_int32(&p);
+		parcel_r_int32(&p);
+		n = 1;
+	}
+
+	while (n-- && !p.malformed)
+		parcel_r_str(&p, &str);
+
+	return !p.malformed && p.offset == p.size;
+}
+
+static void bench_add(struct bench *bench, const void *data, guint len)
+{
+	struct bench_parcel bp;
+
+	/* Keeps the parcels 4-byte aligned in the data array */
+	if (len % 4)
+		return;
+
+	if (bench_check_shape(data, len, BENCH_STRV))
+		bp.shape = BENCH_STRV;
+	else if (bench_check_shape(data, len, BENCH_SIM_IO))
+		bp.shape = BENCH_SIM_IO;
+	else {
+		bench->skipped++;
+		return;
+	}
+
+	bp.offset = bench->data->len;
+	bp.len = len;
+	g_byte_array_append(bench->data, data, len);
+	g_array_append_val(bench->parcels, bp);
+}
+
+/* Strips the response header, the rest is what the drivers parse */
+static void bench_add_response(struct bench *bench, const guint8 *data,
+								guint len)
+{
+	struct parcel p;
+	guint header;
+
+	parcel_init_buf(&p, (void *) data, len);
+	p.size = len;
+
+	/* Solicited responses carry serial and error, unsolicited the id */
+	if (parcel_r_int32(&p) == 0)
+		header = 12;
+	else
+		header = 8;
+
+	if (p.malformed || len < header) {
+		bench->skipped++;
+		return;
+	}
+
+	bench_add(bench, data + header, len - header);
+}
+
+static void bench_load_record(const struct capture_record *rec,
+					const void *data, void *user_data)
+{
+	struct bench *bench = user_data;
+	gpointer key = GUINT_TO_POINTER(rec->channel);
+	GByteArray *stream;
+
+	if (rec->transport != CAPTURE_RIL || rec->direction != CAPTURE_IN)
+		return;
+
+	stream = g_hash_table_lookup(bench->streams, key);
+	if (stream == NULL) {
+		stream = g_byte_array_new();
+		g_hash_table_insert(bench->streams, key, stream);
+	}
+
+	g_byte_array_append(stream, data, rec->length);
+
+	/* Socket reads don't follow parcel boundaries */
+	while (stream->len >= 4) {
+		const guint8 *hdr = stream->data;
+		guint32 len = (hdr[0] << 24) | (hdr[1] << 16) |
+				(hdr[2] << 8) | hdr[3];
+
+		if (stream->len - 4 < len)
+			break;
+
+		if (len >= RIL_HEADER_MAX)
+			bench_add_response(bench, stream->data + 4, len);
+		else
+			bench->skipped++;
+
+		g_byte_array_remove_range(stream, 0, len + 4);
+	}
+}
+
+static void bench_add_strv(struct bench *bench, const char **strv)
+{
+	struct parcel p;
+	guint n = g_strv_length((char **) strv);
+	guint i;
+
+	parcel_init(&p);
+	parcel_w_int32(&p, n);
+
+	for (i = 0; i < n; i++)
+		parcel_w_string(&p, strv[i][0] ? strv[i] : NULL);
+
+	bench_add(bench, p.data, p.size);
+	parcel_free(&p);
+}
+
+/* Synthetic parcels used when no files are given, empty means null */
+static void bench_add_synthetic(struct bench *bench)
+{
+	static const char *cops[] = {
+		"Elisa", "Elisa", "24405", NULL
+	};
+	static const char *cops_list[] = {
+		"Elisa", "Elisa", "24405", "current",
+		"DNA", "DNA", "24412", "available",
+		"Telia FI", "Telia", "24491", "available",
+		"Operator \xc3\x84\xc3\xa4kk\xc3\xb6nen", "Oper", "24499",
+		"forbidden",
+		NULL
+	};
+	static const char *data_reg[] = {
+		"1", "00C3", "0000F73A", "14", "", "20", NULL
+	};
+	static const char *hex = "62228202412183022F02"
+					"A506C0018000000005000000"
+					"00000000000000000000000000";
+	struct parcel p;
+
+	bench_add_strv(bench, cops);
+	bench_add_strv(bench, cops_list);
+	bench_add_strv(bench, data_reg);
+
+	parcel_init(&p);
+	parcel_w_int32(&p, 0x90);
+	parcel_w_int32(&p, 0);
+	parcel_w_string(&p, hex);
+	bench_add(bench, p.data, p.size);
+	parcel_free(&p);
+}
+
+static guint decode_alloc(struct parcel *p, enum bench_shape shape)
+{
+	guint len = 0;
+	char *str;
+	int n;
+
+	if (shape == BENCH_SIM_IO) {
+		parcel_r_int32(p);
+		parcel_r_int32(p);
+		n = 1;
+	} else
+		n = parcel_r_int32(p);
+
+	/* What the drivers did, parcel_r_strv stops at null strings */
+	while (n-- > 0) {
+		str = parcel_r_string(p);
+		len += str ? strlen(str) : 0;
+		g_free(str);
+	}
+
+	return len;
+}
+
+static guint decode_view(struct parcel *p, enum bench_shape shape,
+					struct parcel_scratch *scratch)
+{
+	struct parcel_str str;
+	const char *utf8;
+	guint len = 0;
+	int n;
+
+	if (shape == BENCH_SIM_IO) {
+		parcel_r_int32(p);
+		parcel_r_int32(p);
+		n = 1;
+	} else
+		n = parcel_r_int32(p);
+
+	while (n-- > 0) {
+		parcel_r_str(p, &str);
+		utf8 = parcel_str_utf8(p, &str, scratch);
+		len += utf8 ? strlen(utf8) : 0;
+	}
+
+	return len;
+}
+
+static void bench_report(const char *name, guint count, gdouble elapsed,
+					unsigned long allocs, guint check)
+{
+	printf("%-8s %10.0f parcels/s, %.2f allocations per parcel "
+				"(check %u)\n", name, count / elapsed,
+				(gdouble) allocs / count, check);
+}
+
+static void bench_read(struct bench *bench, guint rounds, gboolean view)
+{
+	struct parcel_scratch scratch;
+	GTimer *timer = g_timer_new();
+	unsigned long allocs;
+	guint check = 0;
+	guint i, r;
+
+	parcel_scratch_init(&scratch);
+	allocs = alloc_count;
+	g_timer_start(timer);
+
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < bench->parcels->len; i++) {
+			struct bench_parcel *bp = &g_array_index(
+					bench->parcels, struct bench_parcel, i);
+			struct parcel p;
+
+			bench_reader(&p, bench, bp);
+
+			if (view)
+				check += decode_view(&p, bp->shape, &scratch);
+			else
+				check += decode_alloc(&p, bp->shape);
+		}
+	}
+
+	bench_report(view ? "view" : "alloc", bench->parcels->len * rounds,
+				g_timer_elapsed(timer, NULL),
+				alloc_count - allocs, check);
+
+	parcel_scratch_free(&scratch);
+	g_timer_destroy(timer);
+}
+
+/* Same layout as the rilmodem SIM driver uses for READ BINARY */
+static guint write_sim_io(struct parcel *p)
+{
+	parcel_w_int32(p, 0xb0);
+	parcel_w_int32(p, 0x6f07);
+	parcel_w_string(p, "3F007FFF");
+	parcel_w_int32(p, 0);
+	parcel_w_int32(p, 0);
+	parcel_w_int32(p, 9);
+	parcel_w_string(p, NULL);
+	parcel_w_string(p, NULL);
+	parcel_w_string(p, "A0000000871002FF33FF018900000100");
+
+	return p->size;
+}
+
+static void bench_write(guint count, gboolean inline_buf)
+{
+	GTimer *timer = g_timer_new();
+	unsigned long allocs = alloc_count;
+	guint check = 0;
+	guint i;
+
+	g_timer_start(timer);
+
+	for (i = 0; i < count; i++) {
+		uint32_t buf[32];
+		struct parcel p;
+
+		if (inline_buf)
+			parcel_init_buf(&p, buf, sizeof(buf));
+		else
+			parcel_init(&p);
+
+		check += write_sim_io(&p);
+		parcel_free(&p);
+	}
+
+	bench_report(inline_buf ? "w-inline" : "w-grow", count,
+				g_timer_elapsed(timer, NULL),
+				alloc_count - allocs, check);
+
+	g_timer_destroy(timer);
+}
+
+int main(int argc, char **argv)
+{
+	struct bench bench;
+	guint rounds = 10000;
+	int i;
+
+	if (argc > 2 && !strcmp(argv[1], "-n")) {
+		rounds = atoi(argv[2]);
+		argc -= 2;
+		argv += 2;
+	}
+
+	memset(&bench, 0, sizeof(bench));
+	bench.parcels = g_array_new(FALSE, FALSE, sizeof(struct bench_parcel));
+	bench.data = g_byte_array_new();
+	bench.streams = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+				NULL, (GDestroyNotify) g_byte_array_unref);
+
+	for (i = 1; i < argc; i++) {
+		int n = capture_load(argv[i], bench_load_record, &bench);
+
+		if (n < 0) {
+			fprintf(stderr, "%s: %s\n", argv[i], strerror(-n));
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (argc < 2)
+		bench_add_synthetic(&bench);
+
+	if (bench.skipped)
+		printf("%u RIL parcels skipped\n", bench.skipped);
+
+	if (bench.parcels->len && rounds) {
+		printf("%u parcels, %u rounds\n", bench.parcels->len, rounds);
+		bench_read(&bench, rounds, FALSE);
+		bench_read(&bench, rounds, TRUE);
+		bench_write(bench.parcels->len * rounds, FALSE);
+		bench_write(bench.parcels->len * rounds, TRUE);
+	} else
+		printf("Nothing to decode\n");
+
+	g_hash_table_destroy(bench.streams);
+	g_array_free(bench.parcels, TRUE);
+	g_byte_array_free(bench.data, TRUE);
+
+	return EXIT_SUCCESS;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 8
+ * indent-tabs-mode: t
+ * End:
+ */
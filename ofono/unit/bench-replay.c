@@ -0,0 +1,287 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2021 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ */
+
+/*
+ * Replays captures taken with ofonod --capture through the AT parser.
+ * Inbound AT records, and the DLC payload of inbound MUX records, are
+ * written into a socketpair one record at a time and the GAtChat on the
+ * other end parses them in a single main loop iteration. Reports
+ * messages per second, per-record latency percentiles and the number
+ * of heap allocations made per record. Without arguments a built-in
+ * synthetic capture is used.
+ *
+ * Usage: bench-replay [-n ROUNDS] [CAPTURE...]
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <glib.h>
+
+#include "gatchat.h"
+#include "capture.h"
+
+struct replay {
+	GArray *records;	/* struct replay_record */
+	GByteArray *data;
+	guint skipped[CAPTURE_ISI + 1];
+};
+
+struct replay_record {
+	guint offset;
+	guint len;
+};
+
+static const char *notify_prefixes[] = {
+	"RING", "+CRING:", "+CLIP:", "+CCWA:", "+CREG:", "+CGREG:", "+CEREG:",
+	"+CSQ:", "+CIEV:", "+CMT:", "+CMTI:", "+CDS:", "+CBM:", "+CUSD:",
+	"+CSSI:", "+CSSU:", "NO CARRIER", "+CGEV:", "+CTZV:",
+};
+
+/* Synthetic capture used when no files are given */
+static const char *synthetic_at[] = {
+	"\r\n+CREG: 1,\"00C3\",\"0000F73A\",2\r\n",
+	"\r\n+CSQ: 20,99\r\n",
+	"\r\nRING\r\n\r\n+CLIP: \"+358401234567\",145,,,,0\r\n",
+	"\r\n+CIEV: 2,3\r\n",
+	"\r\n+CMTI: \"SM\",3\r\n",
+	"\r\n+CGEV: NW DETACH\r\n",
+	"\r\n+CUSD: 0,\"Your balance is 12.34 EUR\",15\r\n",
+	"\r\nNO CARRIER\r\n",
+	"\r\n+CGREG: 1,\"00C3\",\"0000F73A\",7\r\n\r\n+CSQ: 18,99\r\n",
+	"\r\nOK\r\n",
+};
+
+static unsigned long alloc_count;
+static guint notify_count;
+
+/*
+ * Count heap allocations. glib allocates through the system malloc,
+ * which is what gets interposed here (glibc only).
+ */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+	alloc_count++;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	alloc_count++;
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	alloc_count++;
+	return __libc_realloc(ptr, size);
+}
+
+static void replay_add(struct replay *replay, const void *data, guint len)
+{
+	struct replay_record rec;
+
+	rec.offset = replay->data->len;
+	rec.len = len;
+	g_byte_array_append(replay->data, data, len);
+	g_array_append_val(replay->records, rec);
+}
+
+static void replay_load_record(const struct capture_record *rec,
+					const void *data, void *user_data)
+{
+	struct replay *replay = user_data;
+
+	if (rec->direction != CAPTURE_IN || !rec->length)
+		return;
+
+	switch (rec->transport) {
+	case CAPTURE_AT:
+	case CAPTURE_MUX:
+		replay_add(replay, data, rec->length);
+		break;
+	default:
+		if (rec->transport < G_N_ELEMENTS(replay->skipped))
+			replay->skipped[rec->transport]++;
+		break;
+	}
+}
+
+static void notify(GAtResult *result, gpointer user_data)
+{
+	notify_count++;
+}
+
+static int compare_times(gconstpointer a, gconstpointer b)
+{
+	gdouble ta = *(const gdouble *) a;
+	gdouble tb = *(const gdouble *) b;
+
+	return (ta > tb) - (ta < tb);
+}
+
+static gdouble percentile(GArray *times, guint p)
+{
+	guint i = (times->len - 1) * p / 100;
+
+	return g_array_index(times, gdouble, i) * 1000000;
+}
+
+static void replay_run(struct replay *replay, guint rounds)
+{
+	GAtSyntax *syntax;
+	GIOChannel *channel;
+	GAtChat *chat;
+	GArray *times;
+	GTimer *timer;
+	unsigned long allocs;
+	gdouble total = 0;
+	guint i, r;
+	int fds[2];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+		perror("socketpair");
+		exit(EXIT_FAILURE);
+	}
+
+	channel = g_io_channel_unix_new(fds[0]);
+	g_io_channel_set_close_on_unref(channel, TRUE);
+	syntax = g_at_syntax_new_gsm_permissive();
+	chat = g_at_chat_new(channel, syntax);
+	g_at_syntax_unref(syntax);
+	g_io_channel_unref(channel);
+
+	for (i = 0; i < G_N_ELEMENTS(notify_prefixes); i++)
+		g_at_chat_register(chat, notify_prefixes[i], notify,
+							FALSE, NULL, NULL);
+
+	times = g_array_sized_new(FALSE, FALSE, sizeof(gdouble),
+					replay->records->len * rounds);
+	timer = g_timer_new();
+	allocs = alloc_count;
+
+	for (r = 0; r < rounds; r++) {
+		for (i = 0; i < replay->records->len; i++) {
+			struct replay_record *rec = &g_array_index(
+					replay->records, struct replay_record, i);
+			gdouble t;
+
+			g_timer_start(timer);
+
+			if (write(fds[1], replay->data->data + rec->offset,
+						rec->len) != (ssize_t) rec->len) {
+				perror("write");
+				exit(EXIT_FAILURE);
+			}
+
+			/* The read handler parses all of it in one go */
+			g_main_context_iteration(NULL, TRUE);
+
+			t = g_timer_elapsed(timer, NULL);
+			g_array_append_val(times, t);
+			total += t;
+		}
+	}
+
+	allocs = alloc_count - allocs;
+
+	g_array_sort(times, compare_times);
+
+	printf("%u records, %u notifications in %.3f s\n", times->len,
+						notify_count, total);
+	printf("%.0f records/s\n", times->len / total);
+	printf("latency (us): p50 %.1f p90 %.1f p99 %.1f max %.1f\n",
+				percentile(times, 50), percentile(times, 90),
+				percentile(times, 99), percentile(times, 100));
+	printf("%lu allocations, %.2f per record\n", allocs,
+					(gdouble) allocs / times->len);
+
+	g_timer_destroy(timer);
+	g_array_free(times, TRUE);
+	g_at_chat_unref(chat);
+	close(fds[1]);
+}
+
+int main(int argc, char **argv)
+{
+	static const char *names[] = {
+		[CAPTURE_RIL] = "RIL",
+		[CAPTURE_QMI] = "QMI",
+		[CAPTURE_MBIM] = "MBIM",
+		[CAPTURE_ISI] = "ISI",
+	};
+	struct replay replay;
+	guint rounds = 1000;
+	int i;
+
+	if (argc > 2 && !strcmp(argv[1], "-n")) {
+		rounds = atoi(argv[2]);
+		argc -= 2;
+		argv += 2;
+	}
+
+	memset(&replay, 0, sizeof(replay));
+	replay.records = g_array_new(FALSE, FALSE,
+					sizeof(struct replay_record));
+	replay.data = g_byte_array_new();
+
+	for (i = 1; i < argc; i++) {
+		int n = capture_load(argv[i], replay_load_record, &replay);
+
+		if (n < 0) {
+			fprintf(stderr, "%s: %s\n", argv[i], strerror(-n));
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (argc < 2)
+		for (i = 0; i < (int) G_N_ELEMENTS(synthetic_at); i++)
+			replay_add(&replay, synthetic_at[i],
+						strlen(synthetic_at[i]));
+
+	for (i = CAPTURE_RIL; i <= CAPTURE_ISI; i++)
+		if (replay.skipped[i])
+			printf("%u %s records skipped\n", replay.skipped[i],
+								names[i]);
+
+	if (replay.records->len && rounds)
+		replay_run(&replay, rounds);
+	else
+		printf("Nothing to replay\n");
+
+	g_array_free(replay.records, TRUE);
+	g_byte_array_free(replay.data, TRUE);
+
+	return EXIT_SUCCESS;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 8
+ * indent-tabs-mode: t
+ * End:
+ */
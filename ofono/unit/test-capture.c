@@ -0,0 +1,187 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2021 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#include "capture.h"
+
+struct test_check {
+	guint count;
+	guint first_channel;
+};
+
+/* Record n is a prefix of the alphabet, n % 10 long, followed by "xyz" */
+static void test_add(struct capture_ring *ring, guint n)
+{
+	enum capture_direction dir = n % 2 ? CAPTURE_OUT : CAPTURE_IN;
+	struct iovec iov[2];
+
+	iov[0].iov_base = "abcdefghij";
+	iov[0].iov_len = n % 10;
+	iov[1].iov_base = "xyz";
+	iov[1].iov_len = 3;
+
+	capture_ring_addv(ring, CAPTURE_AT, n, dir, iov, 2);
+}
+
+static void test_check_record(const struct capture_record *rec,
+					const void *data, void *user_data)
+{
+	struct test_check *check = user_data;
+	guint n = check->first_channel + check->count;
+	guint len = n % 10;
+	guint dir = n % 2 ? CAPTURE_OUT : CAPTURE_IN;
+
+	g_assert_cmpuint(rec->transport, ==, CAPTURE_AT);
+	g_assert_cmpuint(rec->channel, ==, n);
+	g_assert_cmpuint(rec->direction, ==, dir);
+	g_assert_cmpuint(rec->length, ==, len + 3);
+	g_assert(!memcmp(data, "abcdefghij", len));
+	g_assert(!memcmp((const char *) data + len, "xyz", 3));
+
+	check->count++;
+}
+
+static void test_ring(void)
+{
+	struct capture_ring *ring;
+	struct test_check check;
+	guint i;
+
+	g_assert(!capture_ring_new(sizeof(struct capture_record)));
+
+	ring = capture_ring_new(4096);
+
+	for (i = 0; i < 10; i++)
+		test_add(ring, i);
+
+	g_assert_cmpuint(capture_ring_count(ring), ==, 10);
+	g_assert_cmpuint(capture_ring_dropped(ring), ==, 0);
+
+	memset(&check, 0, sizeof(check));
+	capture_ring_foreach(ring, test_check_record, &check);
+	g_assert_cmpuint(check.count, ==, 10);
+
+	capture_ring_free(ring);
+}
+
+static void test_wrap(void)
+{
+	struct capture_ring *ring;
+	struct test_check check;
+	guint count, i;
+
+	/* Not a multiple of the record size, records wrap around */
+	ring = capture_ring_new(7 * sizeof(struct capture_record) + 5);
+
+	for (i = 0; i < 100; i++)
+		test_add(ring, i);
+
+	count = capture_ring_count(ring);
+	g_assert_cmpuint(count, >, 0);
+	g_assert_cmpuint(count + capture_ring_dropped(ring), ==, 100);
+
+	/* The most recent records are kept */
+	memset(&check, 0, sizeof(check));
+	check.first_channel = 100 - count;
+	capture_ring_foreach(ring, test_check_record, &check);
+	g_assert_cmpuint(check.count, ==, count);
+
+	capture_ring_free(ring);
+}
+
+static void test_save_load(void)
+{
+	struct capture_ring *ring;
+	struct test_check check;
+	struct stat st;
+	char *path;
+	int fd;
+	guint i;
+
+	fd = g_file_open_tmp("test-capture-XXXXXX", &path, NULL);
+	g_assert(fd >= 0);
+	g_assert(!fchmod(fd, 0644));
+	close(fd);
+
+	ring = capture_ring_new(4096);
+
+	for (i = 0; i < 20; i++)
+		test_add(ring, i);
+
+	g_assert_cmpint(capture_ring_save(ring, path), ==, 0);
+	capture_ring_free(ring);
+
+	/* Only readable by the owner, even if it existed before */
+	g_assert(!stat(path, &st));
+	g_assert_cmpuint(st.st_mode & 0777, ==, 0600);
+
+	memset(&check, 0, sizeof(check));
+	g_assert_cmpint(capture_load(path, test_check_record, &check), ==, 20);
+	g_assert_cmpuint(check.count, ==, 20);
+
+	/* Not a capture file */
+	g_assert(g_file_set_contents(path, "garbage", -1, NULL));
+	g_assert_cmpint(capture_load(path, test_check_record, &check), ==,
+								-EINVAL);
+
+	unlink(path);
+	g_free(path);
+}
+
+static void test_active(void)
+{
+	g_assert(!capture_active);
+
+	/* Nothing happens unless started */
+	capture_data(CAPTURE_QMI, 1, CAPTURE_IN, "x", 1);
+
+	g_assert_cmpint(capture_start(1024), ==, 0);
+	capture_data(CAPTURE_QMI, 1, CAPTURE_IN, "x", 1);
+	capture_data(CAPTURE_QMI, 1, CAPTURE_OUT, "y", 1);
+	g_assert_cmpuint(capture_ring_count(capture_active), ==, 2);
+
+	capture_stop();
+	g_assert(!capture_active);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testcapture/ring", test_ring);
+	g_test_add_func("/testcapture/wrap", test_wrap);
+	g_test_add_func("/testcapture/save_load", test_save_load);
+	g_test_add_func("/testcapture/active", test_active);
+
+	return g_test_run();
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 8
+ * indent-tabs-mode: t
+ * End:
+ */
@@ -16,8 +16,79 @@
 
 #include "ofono.h"
 
+#include <gdbus.h>
+
 #include <errno.h>
 
+/*==========================================================================*
+ * Stubs
+ *==========================================================================*/
+
+struct test_watch {
+	guint id;
+	char *name;
+	GDBusWatchFunction disconnect;
+	void *user_data;
+};
+
+static DBusConnection *test_conn;
+static GSList *test_watches;
+static guint test_last_watch_id;
+static guint test_method_calls;
+
+DBusConnection *ofono_dbus_get_connection(void)
+{
+	return test_conn;
+}
+
+guint g_dbus_add_disconnect_watch(DBusConnection *connection,
+				const char *name, GDBusWatchFunction func,
+				void *user_data, GDBusDestroyFunction destroy)
+{
+	struct test_watch *watch = g_new0(struct test_watch, 1);
+
+	g_assert(connection == test_conn);
+	g_assert(!destroy);
+	watch->id = ++test_last_watch_id;
+	watch->name = g_strdup(name);
+	watch->disconnect = func;
+	watch->user_data = user_data;
+	test_watches = g_slist_append(test_watches, watch);
+	return watch->id;
+}
+
+gboolean g_dbus_remove_watch(DBusConnection *connection, guint id)
+{
+	GSList *l;
+
+	for (l = test_watches; l; l = l->next) {
+		struct test_watch *watch = l->data;
+
+		if (watch->id == id) {
+			test_watches = g_slist_delete_link(test_watches, l);
+			g_free(watch->name);
+			g_free(watch);
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+static void test_name_lost(const char *name)
+{
+	GSList *l;
+
+	for (l = test_watches; l; l = l->next) {
+		struct test_watch *watch = l->data;
+
+		if (!strcmp(watch->name, name)) {
+			watch->disconnect(test_conn, watch->user_data);
+			return;
+		}
+	}
+	g_assert_not_reached();
+}
+
 static enum ofono_dbus_access dontcare_method_access(const char *sender,
 	enum ofono_dbus_access_intf intf, int method, const char *arg)
 {
@@ -40,6 +111,13 @@ static enum ofono_dbus_access broken_method_access(const char *sender,
 	return (enum ofono_dbus_access)(-1);
 }
 
+static enum ofono_dbus_access counting_method_access(const char *sender,
+	enum ofono_dbus_access_intf intf, int method, const char *arg)
+{
+	test_method_calls++;
+	return method ? OFONO_DBUS_ACCESS_ALLOW : OFONO_DBUS_ACCESS_DENY;
+}
+
 struct ofono_dbus_access_plugin access_inval;
 struct ofono_dbus_access_plugin access_dontcare = {
 	.name = "DontCare",
@@ -63,6 +141,12 @@ struct ofono_dbus_access_plugin access_broken = {
 	.method_access = broken_method_access
 };
 
+struct ofono_dbus_access_plugin access_counting = {
+	.name = "Counting",
+	.priority = OFONO_DBUS_ACCESS_PRIORITY_DEFAULT,
+	.method_access = counting_method_access
+};
+
 /*==========================================================================*
  * Tests
  *==========================================================================*/
@@ -187,6 +271,148 @@ static void test_register()
 	ofono_dbus_access_plugin_unregister(&access_dontcare);
 }
 
+static void test_cache()
+{
+	const enum ofono_dbus_access_intf intf = OFONO_DBUS_ACCESS_INTF_SIMMGR;
+	const int set = OFONO_DBUS_ACCESS_SIMMGR_SET_PROPERTY;
+	const int enter = OFONO_DBUS_ACCESS_SIMMGR_ENTER_PIN;
+	struct ofono_dbus_access_cache_stats stats;
+	struct ofono_dbus_access_cache_stats base;
+
+	test_conn = (DBusConnection *) &test_conn;
+	test_method_calls = 0;
+	__ofono_dbus_access_get_cache_stats(&base);
+	g_assert(!ofono_dbus_access_plugin_register(&access_counting));
+
+	/* The second call doesn't go to the plugin */
+	g_assert(!ofono_dbus_access_method_allowed(":1.0", intf, set, NULL));
+	g_assert(!ofono_dbus_access_method_allowed(":1.0", intf, set, NULL));
+	g_assert_cmpuint(test_method_calls, == ,1);
+
+	/* Neither does this one, but the ones below do */
+	g_assert(ofono_dbus_access_method_allowed(":1.0", intf, enter, NULL));
+	g_assert(ofono_dbus_access_method_allowed(":1.0", intf, enter, NULL));
+	g_assert(!ofono_dbus_access_method_allowed(":1.0", intf, set, "A"));
+	g_assert(!ofono_dbus_access_method_allowed(":1.0", intf, set, "B"));
+	g_assert(!ofono_dbus_access_method_allowed(":1.1", intf, set, "B"));
+	g_assert(!ofono_dbus_access_method_allowed(":1.0", intf, set, "A"));
+	g_assert_cmpuint(test_method_calls, == ,5);
+
+	__ofono_dbus_access_get_cache_stats(&stats);
+	g_assert_cmpuint(stats.hits - base.hits, == ,3);
+	g_assert_cmpuint(stats.misses - base.misses, == ,5);
+	g_assert_cmpuint(stats.senders, == ,2);
+	g_assert_cmpuint(g_slist_length(test_watches), == ,2);
+
+	/* Sender leaves the bus */
+	test_name_lost(":1.0");
+	__ofono_dbus_access_get_cache_stats(&stats);
+	g_assert_cmpuint(stats.senders, == ,1);
+	g_assert_cmpuint(g_slist_length(test_watches), == ,1);
+	g_assert(!ofono_dbus_access_method_allowed(":1.0", intf, set, NULL));
+	g_assert(!ofono_dbus_access_method_allowed(":1.1", intf, set, "B"));
+	g_assert_cmpuint(test_method_calls, == ,6);
+
+	/* Policy change */
+	ofono_dbus_access_invalidate();
+	__ofono_dbus_access_get_cache_stats(&stats);
+	g_assert_cmpuint(stats.flushes - base.flushes, == ,1);
+	g_assert_cmpuint(stats.senders, == ,0);
+	g_assert(!test_watches);
+	g_assert(!ofono_dbus_access_method_allowed(":1.1", intf, set, "B"));
+	g_assert_cmpuint(test_method_calls, == ,7);
+
+	/* Unregistering the plugin flushes the cache too */
+	ofono_dbus_access_plugin_unregister(&access_counting);
+	g_assert(!test_watches);
+	g_assert(ofono_dbus_access_method_allowed(":1.1", intf, set, "B"));
+	g_assert_cmpuint(test_method_calls, == ,7);
+
+	/* No caching without a connection */
+	test_conn = NULL;
+	g_assert(!ofono_dbus_access_plugin_register(&access_counting));
+	g_assert(!ofono_dbus_access_method_allowed(":1.0", intf, set, NULL));
+	g_assert(!ofono_dbus_access_method_allowed(":1.0", intf, set, NULL));
+	g_assert_cmpuint(test_method_calls, == ,9);
+	ofono_dbus_access_plugin_unregister(&access_counting);
+}
+
+static void test_cache_args()
+{
+	const enum ofono_dbus_access_intf intf = OFONO_DBUS_ACCESS_INTF_MODEM;
+	const int set = OFONO_DBUS_ACCESS_MODEM_SET_PROPERTY;
+	struct ofono_dbus_access_cache_stats stats;
+	struct ofono_dbus_access_cache_stats base;
+	const guint n = 1000;
+	guint i;
+
+	test_conn = (DBusConnection *) &test_conn;
+	test_method_calls = 0;
+	__ofono_dbus_access_get_cache_stats(&base);
+	g_assert(!ofono_dbus_access_plugin_register(&access_counting));
+
+	/* A client making up property names doesn't grow the cache */
+	for (i = 0; i < n; i++) {
+		char *arg = g_strdup_printf("Bogus%u", i);
+
+		ofono_dbus_access_method_allowed(":1.0", intf, set, arg);
+		g_free(arg);
+	}
+	g_assert_cmpuint(test_method_calls, == ,n);
+
+	__ofono_dbus_access_get_cache_stats(&stats);
+	g_assert_cmpuint(stats.misses - base.misses, <= ,32);
+	g_assert_cmpuint(stats.misses - base.misses + stats.uncached -
+					base.uncached, == ,n);
+
+	/* Argument-less decisions are still cached */
+	ofono_dbus_access_method_allowed(":1.0", intf, set, NULL);
+	ofono_dbus_access_method_allowed(":1.0", intf, set, NULL);
+	g_assert_cmpuint(test_method_calls, == ,n + 1);
+
+	/* Cached ones keep working too */
+	ofono_dbus_access_method_allowed(":1.0", intf, set, "Bogus0");
+	g_assert_cmpuint(test_method_calls, == ,n + 1);
+
+	ofono_dbus_access_plugin_unregister(&access_counting);
+	test_conn = NULL;
+	g_assert(!test_watches);
+}
+
+static double test_bench_run(guint n)
+{
+	const enum ofono_dbus_access_intf intf = OFONO_DBUS_ACCESS_INTF_SIMMGR;
+	const int set = OFONO_DBUS_ACCESS_SIMMGR_SET_PROPERTY;
+	guint i;
+
+	g_assert(!ofono_dbus_access_plugin_register(&access_dontcare));
+	g_assert(!ofono_dbus_access_plugin_register(&access_counting));
+	g_test_timer_start();
+	for (i = 0; i < n; i++) {
+		ofono_dbus_access_method_allowed(":1.0", intf, set,
+						(i & 1) ? "Powered" : "Online");
+	}
+	ofono_dbus_access_plugin_unregister(&access_counting);
+	ofono_dbus_access_plugin_unregister(&access_dontcare);
+	return g_test_timer_elapsed();
+}
+
+static void test_bench()
+{
+	const guint n = g_test_perf() ? 1000000 : 1000;
+	double uncached, cached;
+
+	test_conn = NULL;
+	uncached = test_bench_run(n);
+	test_conn = (DBusConnection *) &test_conn;
+	cached = test_bench_run(n);
+	test_conn = NULL;
+	g_assert(!test_watches);
+
+	g_test_message("%u checks: %.3f s uncached, %.3f s cached",
+						n, uncached, cached);
+}
+
 #define TEST_(test) "/dbus-access/" test
 
 int main(int argc, char *argv[])
@@ -208,6 +434,9 @@ int main(int argc, char *argv[])
 		g_free(name);
 	}
 	g_test_add_func(TEST_("register"), test_register);
+	g_test_add_func(TEST_("cache"), test_cache);
+	g_test_add_func(TEST_("cache_args"), test_cache_args);
+	g_test_add_func(TEST_("bench"), test_bench);
 	return g_test_run();
 }
 
@@ -0,0 +1,351 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2021 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ */
+
+#include "ofono.h"
+
+#include <gutil_log.h>
+
+#include <stdio.h>
+
+#define TMP_DIR_TEMPLATE "test-dbus-coalesce-XXXXXX"
+#define TEST_TIMEOUT_SEC (20)
+#define TEST_PATH "/test"
+#define TEST_IFACE "org.ofono.Test"
+
+static GMainLoop *test_loop = NULL;
+static guint test_timeout_id = 0;
+
+/* Recorded signals */
+
+struct test_signal {
+	char *name;
+	int type;
+	unsigned int uval;
+	char *sval;
+};
+
+static GSList *test_signals = NULL;
+
+static void test_signal_free(gpointer data)
+{
+	struct test_signal *sig = data;
+
+	g_free(sig->name);
+	g_free(sig->sval);
+	g_free(sig);
+}
+
+static const struct test_signal *test_signal_nth(guint n)
+{
+	return g_slist_nth_data(test_signals, n);
+}
+
+/* Stubs */
+
+DBusConnection *ofono_dbus_get_connection(void)
+{
+	return NULL;
+}
+
+int ofono_dbus_signal_property_changed(DBusConnection *conn,
+					const char *path,
+					const char *interface,
+					const char *name,
+					int type, const void *value)
+{
+	struct test_signal *sig = g_new0(struct test_signal, 1);
+
+	DBG("%s %s.%s", path, interface, name);
+	sig->name = g_strdup(name);
+	sig->type = type;
+
+	switch (type) {
+	case DBUS_TYPE_BYTE:
+		sig->uval = *(const unsigned char *) value;
+		break;
+	case DBUS_TYPE_UINT32:
+		sig->uval = *(const dbus_uint32_t *) value;
+		break;
+	case DBUS_TYPE_STRING:
+		sig->sval = g_strdup(*(const char **) value);
+		break;
+	default:
+		g_assert_not_reached();
+	}
+
+	test_signals = g_slist_append(test_signals, sig);
+	return 0;
+}
+
+/* Code shared by all tests */
+
+static gboolean test_timeout_cb(gpointer user_data)
+{
+	ofono_error("Timeout!");
+	g_main_loop_quit(test_loop);
+	test_timeout_id = 0;
+	return G_SOURCE_REMOVE;
+}
+
+static gboolean test_quit_cb(gpointer user_data)
+{
+	g_main_loop_quit(test_loop);
+	return G_SOURCE_REMOVE;
+}
+
+static char *test_init(const char *conf)
+{
+	char *dir = g_dir_make_tmp(TMP_DIR_TEMPLATE, NULL);
+
+	if (conf) {
+		char *file = g_build_filename(dir, "main.conf", NULL);
+
+		g_assert(g_file_set_contents(file, conf, -1, NULL));
+		g_free(file);
+	}
+
+	__ofono_set_config_dir(dir);
+	__ofono_dbus_coalesce_init();
+
+	test_loop = g_main_loop_new(NULL, FALSE);
+	test_timeout_id = g_timeout_add_seconds(TEST_TIMEOUT_SEC,
+						test_timeout_cb, NULL);
+	return dir;
+}
+
+static void test_run(guint ms)
+{
+	g_timeout_add(ms, test_quit_cb, NULL);
+	g_main_loop_run(test_loop);
+	g_assert(test_timeout_id);
+}
+
+static void test_deinit(char *dir)
+{
+	char *file = g_build_filename(dir, "main.conf", NULL);
+
+	__ofono_dbus_coalesce_cleanup();
+	__ofono_set_config_dir(NULL);
+
+	remove(file);
+	remove(dir);
+	g_free(file);
+	g_free(dir);
+
+	g_source_remove(test_timeout_id);
+	g_main_loop_unref(test_loop);
+	test_timeout_id = 0;
+	test_loop = NULL;
+
+	g_slist_free_full(test_signals, test_signal_free);
+	test_signals = NULL;
+}
+
+static void test_set_uint(const char *name, dbus_uint32_t value)
+{
+	__ofono_dbus_coalesce_property_changed(NULL, TEST_PATH, TEST_IFACE,
+					name, DBUS_TYPE_UINT32, &value);
+}
+
+static void test_set_byte(const char *name, unsigned char value)
+{
+	__ofono_dbus_coalesce_property_changed(NULL, TEST_PATH, TEST_IFACE,
+					name, DBUS_TYPE_BYTE, &value);
+}
+
+static void test_set_string(const char *name, const char *value)
+{
+	__ofono_dbus_coalesce_property_changed(NULL, TEST_PATH, TEST_IFACE,
+					name, DBUS_TYPE_STRING, &value);
+}
+
+/* ==== disabled ==== */
+
+static void test_disabled(void)
+{
+	char *dir = test_init(NULL);
+	struct ofono_dbus_coalesce_stats stats;
+
+	g_assert(!__ofono_dbus_coalesce_enabled());
+
+	/* Everything goes through immediately */
+	test_set_uint("CellId", 1);
+	test_set_uint("CellId", 2);
+	g_assert_cmpuint(g_slist_length(test_signals), == ,2);
+	g_assert_cmpuint(test_signal_nth(1)->uval, == ,2);
+
+	__ofono_dbus_coalesce_get_stats(&stats);
+	g_assert(!stats.emitted);
+	g_assert(!stats.suppressed);
+	test_deinit(dir);
+}
+
+/* ==== idle ==== */
+
+static void test_idle(void)
+{
+	char *dir = test_init("[PropertyChanged]\nCoalesce=true\n");
+	struct ofono_dbus_coalesce_stats stats;
+
+	g_assert(__ofono_dbus_coalesce_enabled());
+
+	test_set_uint("CellId", 1);
+	test_set_string("Technology", "gsm");
+	test_set_uint("CellId", 2);
+	test_set_uint("CellId", 3);
+	test_set_string("Technology", "lte");
+	g_assert(!test_signals);
+
+	test_run(50);
+
+	/* Last value of each property, in the original order */
+	g_assert_cmpuint(g_slist_length(test_signals), == ,2);
+	g_assert_cmpstr(test_signal_nth(0)->name, == ,"CellId");
+	g_assert_cmpuint(test_signal_nth(0)->uval, == ,3);
+	g_assert_cmpstr(test_signal_nth(1)->name, == ,"Technology");
+	g_assert_cmpstr(test_signal_nth(1)->sval, == ,"lte");
+
+	/* Same value again doesn't generate any signals */
+	test_set_uint("CellId", 3);
+	test_run(50);
+	g_assert_cmpuint(g_slist_length(test_signals), == ,2);
+
+	__ofono_dbus_coalesce_get_stats(&stats);
+	g_assert_cmpuint(stats.emitted, == ,2);
+	g_assert_cmpuint(stats.suppressed, == ,4);
+	test_deinit(dir);
+}
+
+/* ==== revert ==== */
+
+static void test_revert(void)
+{
+	char *dir = test_init("[PropertyChanged]\nCoalesce=true\nDelay=20\n");
+	struct ofono_dbus_coalesce_stats stats;
+
+	test_set_uint("CellId", 1);
+	test_run(100);
+	g_assert_cmpuint(g_slist_length(test_signals), == ,1);
+
+	/* Goes back to the emitted value before the delay expires */
+	test_set_uint("CellId", 2);
+	test_set_uint("CellId", 1);
+	test_run(100);
+	g_assert_cmpuint(g_slist_length(test_signals), == ,1);
+
+	__ofono_dbus_coalesce_get_stats(&stats);
+	g_assert_cmpuint(stats.emitted, == ,1);
+	g_assert_cmpuint(stats.suppressed, == ,1);
+	test_deinit(dir);
+}
+
+/* ==== urgent ==== */
+
+static void test_urgent(void)
+{
+	char *dir = test_init("[PropertyChanged]\nCoalesce=true\n"
+					TEST_IFACE ".Strength=1000\n");
+
+	test_set_byte("Strength", 50);
+	test_run(10);
+	g_assert_cmpuint(g_slist_length(test_signals), == ,1);
+
+	/* Strength is held back, CellId must not wait for it */
+	test_set_byte("Strength", 70);
+	test_set_uint("CellId", 1);
+	test_run(100);
+	g_assert_cmpuint(g_slist_length(test_signals), == ,2);
+	g_assert_cmpstr(test_signal_nth(1)->name, == ,"CellId");
+	test_deinit(dir);
+}
+
+/* ==== hysteresis ==== */
+
+static void test_hysteresis(void)
+{
+	char *dir = test_init("[PropertyChanged]\nCoalesce=true\n"
+					TEST_IFACE ".Strength=30,5\n");
+
+	test_set_byte("Strength", 50);
+	test_run(10);
+	g_assert_cmpuint(g_slist_length(test_signals), == ,1);
+
+	/* Small fluctuations are ignored */
+	test_set_byte("Strength", 52);
+	test_set_byte("Strength", 47);
+	test_run(100);
+	g_assert_cmpuint(g_slist_length(test_signals), == ,1);
+
+	/* Changes within the minimum interval are merged */
+	test_set_byte("Strength", 60);
+	test_run(1);
+	test_set_byte("Strength", 70);
+	test_run(10);
+	test_set_byte("Strength", 80);
+	test_run(100);
+	g_assert_cmpuint(g_slist_length(test_signals), == ,3);
+	g_assert_cmpuint(test_signal_nth(1)->uval, == ,60);
+	g_assert_cmpuint(test_signal_nth(2)->uval, == ,80);
+	test_deinit(dir);
+}
+
+/* ==== cancel ==== */
+
+static void test_cancel(void)
+{
+	char *dir = test_init("[PropertyChanged]\nCoalesce=true\n");
+
+	test_set_uint("CellId", 1);
+	__ofono_dbus_coalesce_cancel(TEST_PATH, NULL);
+	test_run(50);
+	g_assert(!test_signals);
+
+	/* Flush sends everything immediately */
+	test_set_uint("CellId", 2);
+	__ofono_dbus_coalesce_flush();
+	g_assert_cmpuint(g_slist_length(test_signals), == ,1);
+	test_deinit(dir);
+}
+
+#define TEST_(name) "/dbus-coalesce/" name
+
+int main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	gutil_log_timestamp = FALSE;
+	gutil_log_default.level = g_test_verbose() ?
+		GLOG_LEVEL_VERBOSE : GLOG_LEVEL_NONE;
+	__ofono_log_init("test-dbus-coalesce",
+		g_test_verbose() ? "*" : NULL,
+		FALSE, FALSE);
+
+	g_test_add_func(TEST_("disabled"), test_disabled);
+	g_test_add_func(TEST_("idle"), test_idle);
+	g_test_add_func(TEST_("revert"), test_revert);
+	g_test_add_func(TEST_("hysteresis"), test_hysteresis);
+	g_test_add_func(TEST_("urgent"), test_urgent);
+	g_test_add_func(TEST_("cancel"), test_cancel);
+
+	return g_test_run();
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 8
+ * indent-tabs-mode: t
+ * End:
+ */
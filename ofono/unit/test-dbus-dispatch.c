@@ -0,0 +1,387 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2021 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+#include "test-dbus.h"
+
+#include <ofono/dbus.h>
+#include <ofono/log.h>
+#include "ofono.h"
+
+#include <gutil_log.h>
+#include <gutil_macros.h>
+
+#define TEST_TIMEOUT                    (10)   /* seconds */
+#define TEST_DBUS_PATH                  "/test"
+#define TEST_DBUS_INTERFACE             "test.interface"
+#define TEST_INTERFACE_COUNT            (12)
+#define TEST_INTERFACE_(n)              TEST_DBUS_INTERFACE #n
+#define TEST_LAST_INTERFACE             TEST_INTERFACE_(11)
+
+#ifndef DBUS_INTERFACE_OBJECT_MANAGER
+#define DBUS_INTERFACE_OBJECT_MANAGER   "org.freedesktop.DBus.ObjectManager"
+#endif
+
+struct test_data;
+
+struct test_step {
+	const char *interface;
+	const char *member;
+	const char *arg[2];
+	const char *reply;
+	const char *error;
+	const char *path;
+	void (*done)(struct test_data *test);
+};
+
+struct test_data {
+	struct test_dbus_context dbus;
+	char *name[TEST_INTERFACE_COUNT];
+	const struct test_step *steps;
+	guint nsteps;
+	guint step;
+	guint repeat;
+	GDBusCacheStats stats;
+};
+
+static gboolean test_debug;
+
+static const struct test_step test_dispatch_steps[] = {
+	{ TEST_LAST_INTERFACE, "Echo", { "foo" }, "foo" },
+	{ TEST_LAST_INTERFACE, "Echo", { "foo", "bar" }, "foobar" },
+	{ TEST_LAST_INTERFACE, "Echo", { NULL }, NULL,
+		DBUS_ERROR_UNKNOWN_METHOD },
+	{ TEST_LAST_INTERFACE, "Nope", { "foo" }, NULL,
+		DBUS_ERROR_UNKNOWN_METHOD },
+	{ TEST_INTERFACE_(99), "Echo", { "foo" }, NULL,
+		DBUS_ERROR_UNKNOWN_METHOD },
+	{ DBUS_INTERFACE_PROPERTIES, "Get",
+		{ TEST_INTERFACE_(3), "Name" }, TEST_INTERFACE_(3) },
+	{ DBUS_INTERFACE_PROPERTIES, "Get",
+		{ TEST_LAST_INTERFACE, "Name" }, TEST_LAST_INTERFACE },
+	{ DBUS_INTERFACE_PROPERTIES, "Get",
+		{ TEST_LAST_INTERFACE, "Nope" }, NULL,
+		DBUS_ERROR_INVALID_ARGS },
+	{ DBUS_INTERFACE_PROPERTIES, "Get",
+		{ TEST_INTERFACE_(99), "Name" }, NULL,
+		DBUS_ERROR_INVALID_ARGS }
+};
+
+static const struct test_step test_bench_steps[] = {
+	{ TEST_LAST_INTERFACE, "Echo", { "foo" }, "foo" },
+	{ DBUS_INTERFACE_PROPERTIES, "Get",
+		{ TEST_LAST_INTERFACE, "Name" }, TEST_LAST_INTERFACE }
+};
+
+static void test_cache_emit(struct test_data *test)
+{
+	g_dbus_emit_property_changed(ofono_dbus_get_connection(),
+				TEST_DBUS_PATH, test->name[0], "Name");
+}
+
+static void test_cache_check(struct test_data *test)
+{
+	GDBusCacheStats stats;
+
+	g_dbus_get_cache_stats(&stats);
+	g_assert_cmpuint(stats.objects_misses - test->stats.objects_misses,
+								== ,2);
+	g_assert_cmpuint(stats.objects_hits - test->stats.objects_hits,
+								== ,1);
+	g_assert_cmpuint(stats.introspect_misses -
+				test->stats.introspect_misses, == ,1);
+	g_assert_cmpuint(stats.introspect_hits -
+				test->stats.introspect_hits, == ,1);
+}
+
+static const struct test_step test_cache_steps[] = {
+	{ DBUS_INTERFACE_OBJECT_MANAGER, "GetManagedObjects", { NULL },
+		NULL, NULL, "/" },
+	{ DBUS_INTERFACE_OBJECT_MANAGER, "GetManagedObjects", { NULL },
+		NULL, NULL, "/" },
+	{ DBUS_INTERFACE_INTROSPECTABLE, "Introspect", { NULL } },
+	{ DBUS_INTERFACE_INTROSPECTABLE, "Introspect", { NULL } },
+	{ TEST_LAST_INTERFACE, "Echo", { "foo" }, "foo", NULL, NULL,
+		test_cache_emit },
+	{ DBUS_INTERFACE_OBJECT_MANAGER, "GetManagedObjects", { NULL },
+		NULL, NULL, "/", test_cache_check }
+};
+
+/* ==== test interface ==== */
+
+static DBusMessage *test_echo(DBusConnection *conn, DBusMessage *msg,
+								void *data)
+{
+	DBusMessageIter it;
+	GString *str = g_string_new(NULL);
+	DBusMessage *reply;
+
+	dbus_message_iter_init(msg, &it);
+	while (dbus_message_iter_get_arg_type(&it) == DBUS_TYPE_STRING)
+		g_string_append(str, test_dbus_get_string(&it));
+
+	reply = dbus_message_new_method_return(msg);
+	dbus_message_append_args(reply, DBUS_TYPE_STRING, &str->str,
+							DBUS_TYPE_INVALID);
+	g_string_free(str, TRUE);
+	return reply;
+}
+
+static gboolean test_property_get_name(const GDBusPropertyTable *property,
+					DBusMessageIter *it, void *data)
+{
+	const char *name = data;
+
+	dbus_message_iter_append_basic(it, DBUS_TYPE_STRING, &name);
+	return TRUE;
+}
+
+static const GDBusMethodTable test_methods[] = {
+	{ GDBUS_METHOD("Echo", GDBUS_ARGS({ "a", "s" }),
+			GDBUS_ARGS({ "result", "s" }), test_echo) },
+	{ GDBUS_METHOD("Echo", GDBUS_ARGS({ "a", "s" }, { "b", "s" }),
+			GDBUS_ARGS({ "result", "s" }), test_echo) },
+	{ }
+};
+
+static const GDBusPropertyTable test_properties[] = {
+	{ "Name", "s", test_property_get_name },
+	{ }
+};
+
+/* ==== common ==== */
+
+static gboolean test_timeout(gpointer param)
+{
+	g_assert(!"TIMEOUT");
+	return G_SOURCE_REMOVE;
+}
+
+static guint test_setup_timeout(void)
+{
+	if (test_debug) {
+		return 0;
+	} else {
+		return g_timeout_add_seconds(TEST_TIMEOUT, test_timeout, NULL);
+	}
+}
+
+static gboolean test_loop_quit(gpointer data)
+{
+	g_main_loop_quit(data);
+	return G_SOURCE_REMOVE;
+}
+
+static void test_register(struct test_data *test)
+{
+	DBusConnection *conn = ofono_dbus_get_connection();
+	int i;
+
+	g_assert(g_dbus_attach_object_manager(conn));
+	for (i = 0; i < TEST_INTERFACE_COUNT; i++) {
+		test->name[i] = g_strdup_printf(TEST_DBUS_INTERFACE "%d", i);
+		g_assert(g_dbus_register_interface(conn, TEST_DBUS_PATH,
+				test->name[i], test_methods, NULL,
+				test_properties, test->name[i], NULL));
+	}
+
+	/* Can't register the same interface twice */
+	g_assert(!g_dbus_register_interface(conn, TEST_DBUS_PATH,
+				test->name[0], test_methods, NULL,
+				test_properties, test->name[0], NULL));
+}
+
+static void test_unregister(struct test_data *test)
+{
+	DBusConnection *conn = ofono_dbus_get_connection();
+	int i;
+
+	for (i = 0; i < TEST_INTERFACE_COUNT; i++) {
+		g_assert(g_dbus_unregister_interface(conn, TEST_DBUS_PATH,
+							test->name[i]));
+		g_free(test->name[i]);
+	}
+	g_assert(g_dbus_detach_object_manager(conn));
+}
+
+static void test_check_reply(const struct test_step *step, DBusMessage *reply)
+{
+	if (step->error) {
+		g_assert_cmpint(dbus_message_get_type(reply), == ,
+						DBUS_MESSAGE_TYPE_ERROR);
+		g_assert_cmpstr(dbus_message_get_error_name(reply), == ,
+								step->error);
+	} else {
+		DBusMessageIter it, var;
+
+		g_assert_cmpint(dbus_message_get_type(reply), == ,
+					DBUS_MESSAGE_TYPE_METHOD_RETURN);
+		dbus_message_iter_init(reply, &it);
+		if (!step->reply) {
+			/* Any reply will do */
+		} else if (dbus_message_iter_get_arg_type(&it) ==
+						DBUS_TYPE_VARIANT) {
+			dbus_message_iter_recurse(&it, &var);
+			g_assert_cmpstr(test_dbus_get_string(&var), == ,
+								step->reply);
+		} else {
+			g_assert_cmpstr(test_dbus_get_string(&it), == ,
+								step->reply);
+		}
+	}
+}
+
+static void test_call(struct test_data *test);
+
+static void test_call_done(DBusPendingCall *call, void *data)
+{
+	struct test_data *test = data;
+	const struct test_step *step = test->steps + test->step;
+	DBusMessage *reply = dbus_pending_call_steal_reply(call);
+
+	test_check_reply(step, reply);
+	dbus_message_unref(reply);
+	dbus_pending_call_unref(call);
+	if (step->done)
+		step->done(test);
+
+	test->step++;
+	if (test->step == test->nsteps) {
+		test->step = 0;
+		test->repeat--;
+	}
+
+	if (test->repeat) {
+		test_call(test);
+	} else {
+		g_idle_add(test_loop_quit, test->dbus.loop);
+	}
+}
+
+static void test_call(struct test_data *test)
+{
+	const struct test_step *step = test->steps + test->step;
+	DBusMessage *msg = dbus_message_new_method_call(NULL,
+				step->path ? step->path : TEST_DBUS_PATH,
+				step->interface, step->member);
+	DBusPendingCall *call;
+	int i;
+
+	for (i = 0; i < G_N_ELEMENTS(step->arg) && step->arg[i]; i++)
+		dbus_message_append_args(msg, DBUS_TYPE_STRING, step->arg + i,
+							DBUS_TYPE_INVALID);
+
+	g_assert(dbus_connection_send_with_reply(test->dbus.client_connection,
+					msg, &call, DBUS_TIMEOUT_INFINITE));
+	dbus_pending_call_set_notify(call, test_call_done, test, NULL);
+	dbus_message_unref(msg);
+}
+
+static void test_start(struct test_dbus_context *dbus)
+{
+	struct test_data *test = G_CAST(dbus, struct test_data, dbus);
+
+	test_register(test);
+	g_dbus_get_cache_stats(&test->stats);
+	test_call(test);
+}
+
+static void test_run(const struct test_step *steps, guint nsteps,
+							guint repeat)
+{
+	struct test_data test;
+	guint timeout = test_setup_timeout();
+
+	memset(&test, 0, sizeof(test));
+	test.steps = steps;
+	test.nsteps = nsteps;
+	test.repeat = repeat;
+	test_dbus_setup(&test.dbus);
+	test.dbus.start = test_start;
+
+	g_main_loop_run(test.dbus.loop);
+
+	test_unregister(&test);
+	test_dbus_shutdown(&test.dbus);
+	if (timeout) {
+		g_source_remove(timeout);
+	}
+}
+
+/* ==== dispatch ==== */
+
+static void test_dispatch(void)
+{
+	test_run(test_dispatch_steps, G_N_ELEMENTS(test_dispatch_steps), 1);
+}
+
+/* ==== cache ==== */
+
+static void test_cache(void)
+{
+	test_run(test_cache_steps, G_N_ELEMENTS(test_cache_steps), 1);
+}
+
+/* ==== bench ==== */
+
+static void test_bench(void)
+{
+	const guint n = g_test_perf() ? 10000 : 100;
+	double elapsed;
+
+	g_test_timer_start();
+	test_run(test_bench_steps, G_N_ELEMENTS(test_bench_steps), n);
+	elapsed = g_test_timer_elapsed();
+	g_test_message("%u calls in %.3f s (%.1f us per call)",
+		n * (guint) G_N_ELEMENTS(test_bench_steps), elapsed,
+		elapsed * 1e6 / (n * G_N_ELEMENTS(test_bench_steps)));
+}
+
+#define TEST_(name) "/dbus-dispatch/" name
+
+int main(int argc, char *argv[])
+{
+	int i;
+
+	g_test_init(&argc, &argv, NULL);
+	for (i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		if (!strcmp(arg, "-d") || !strcmp(arg, "--debug")) {
+			test_debug = TRUE;
+		} else {
+			GWARN("Unsupported command line option %s", arg);
+		}
+	}
+
+	gutil_log_timestamp = FALSE;
+	gutil_log_default.level = g_test_verbose() ?
+		GLOG_LEVEL_VERBOSE : GLOG_LEVEL_NONE;
+	__ofono_log_init("test-dbus-dispatch",
+				g_test_verbose() ? "*" : NULL,
+				FALSE, FALSE);
+
+	g_test_add_func(TEST_("dispatch"), test_dispatch);
+	g_test_add_func(TEST_("cache"), test_cache);
+	g_test_add_func(TEST_("bench"), test_bench);
+
+	return g_test_run();
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 8
+ * indent-tabs-mode: t
+ * End:
+ */
@@ -0,0 +1,320 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2021 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include <glib.h>
+
+#include "gatserver.h"
+
+#define TEST_TIMEOUT_SEC (20)
+
+struct test_reply {
+	const char *lines[4];
+};
+
+struct test_step {
+	const char *cmd;
+	const char *reply;
+};
+
+struct test_session {
+	GAtServer *server;
+	int fd;
+	guint writes;
+	gboolean timed_out;
+	guint timeout_id;
+};
+
+static const struct test_reply brsf_reply = {
+	{ "+BRSF: 871" }
+};
+
+static const struct test_reply cind_test_reply = {
+	{ "+CIND: (\"service\",(0,1)),(\"call\",(0,1)),"
+		"(\"callsetup\",(0-3)),(\"callheld\",(0-2)),"
+		"(\"signal\",(0-5)),(\"roam\",(0,1)),(\"battchg\",(0-5))" }
+};
+
+static const struct test_reply cind_query_reply = {
+	{ "+CIND: 1,1,0,0,4,0,5" }
+};
+
+static const struct test_reply clcc_reply = {
+	{ "+CLCC: 1,1,0,0,0,\"+358401234567\",145",
+	  "+CLCC: 2,1,1,0,0,\"+358407654321\",145",
+	  "+CLCC: 3,1,5,0,0,\"+358409999999\",145" }
+};
+
+static const struct test_reply empty_reply = {
+	{ NULL }
+};
+
+static const struct test_step headset_session[] = {
+	{ "AT+BRSF=127\r", "\r\n+BRSF: 871\r\n\r\nOK\r\n" },
+	{ "AT+CIND=?\r", NULL },
+	{ "AT+CIND?\r", "\r\n+CIND: 1,1,0,0,4,0,5\r\n\r\nOK\r\n" },
+	{ "AT+CMER=3,0,0,1\r", "\r\nOK\r\n" },
+	{ "AT+CLCC\r", "\r\n+CLCC: 1,1,0,0,0,\"+358401234567\",145"
+			"\r\n+CLCC: 2,1,1,0,0,\"+358407654321\",145"
+			"\r\n+CLCC: 3,1,5,0,0,\"+358409999999\",145"
+			"\r\n\r\nOK\r\n" },
+	{ "AT+BIA=0,1,1,1,0,0,0\r", "\r\nOK\r\n" },
+	{ "AT+CIND?;+CMER=3,0,0,0\r",
+		"\r\n+CIND: 1,1,0,0,4,0,5\r\n\r\nOK\r\n" },
+	{ "AT+NREC=0\r", "\r\nERROR\r\n" },
+};
+
+static void reply_cb(GAtServer *server, GAtServerRequestType type,
+				GAtResult *result, gpointer user_data)
+{
+	const struct test_reply *reply = user_data;
+	int i;
+
+	for (i = 0; i < 4 && reply->lines[i]; i++)
+		g_at_server_send_info(server, reply->lines[i],
+					i == 3 || reply->lines[i + 1] == NULL);
+
+	g_at_server_send_final(server, G_AT_SERVER_RESULT_OK);
+}
+
+static void cind_cb(GAtServer *server, GAtServerRequestType type,
+				GAtResult *result, gpointer user_data)
+{
+	switch (type) {
+	case G_AT_SERVER_REQUEST_TYPE_SUPPORT:
+		reply_cb(server, type, result, (gpointer) &cind_test_reply);
+		break;
+	case G_AT_SERVER_REQUEST_TYPE_QUERY:
+		reply_cb(server, type, result, (gpointer) &cind_query_reply);
+		break;
+	default:
+		g_at_server_send_final(server, G_AT_SERVER_RESULT_ERROR);
+		break;
+	}
+}
+
+static void count_writes(const char *str, gpointer user_data)
+{
+	struct test_session *session = user_data;
+
+	if (str[0] == '>')
+		session->writes++;
+}
+
+static gboolean session_timeout(gpointer user_data)
+{
+	struct test_session *session = user_data;
+
+	session->timed_out = TRUE;
+	session->timeout_id = 0;
+
+	return FALSE;
+}
+
+static void session_init(struct test_session *session)
+{
+	int fds[2];
+	GIOChannel *io;
+
+	memset(session, 0, sizeof(*session));
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+	g_assert(fcntl(fds[1], F_SETFL, O_NONBLOCK) == 0);
+
+	io = g_io_channel_unix_new(fds[0]);
+	g_io_channel_set_close_on_unref(io, TRUE);
+
+	session->server = g_at_server_new(io);
+	session->fd = fds[1];
+	g_io_channel_unref(io);
+
+	g_assert(session->server);
+	g_at_server_set_echo(session->server, FALSE);
+	g_at_server_set_debug(session->server, count_writes, session);
+
+	g_at_server_register(session->server, "+BRSF", reply_cb,
+					(gpointer) &brsf_reply, NULL);
+	g_at_server_register(session->server, "+CIND", cind_cb, NULL, NULL);
+	g_at_server_register(session->server, "+CMER", reply_cb,
+					(gpointer) &empty_reply, NULL);
+	g_at_server_register(session->server, "+CLCC", reply_cb,
+					(gpointer) &clcc_reply, NULL);
+	g_at_server_register(session->server, "+BIA", reply_cb,
+					(gpointer) &empty_reply, NULL);
+
+	session->timeout_id = g_timeout_add_seconds(TEST_TIMEOUT_SEC,
+						session_timeout, session);
+}
+
+static void session_cleanup(struct test_session *session)
+{
+	g_at_server_unref(session->server);
+	close(session->fd);
+
+	if (session->timeout_id)
+		g_source_remove(session->timeout_id);
+}
+
+static gboolean reply_complete(const GString *reply)
+{
+	return g_str_has_suffix(reply->str, "\r\nOK\r\n") ||
+			g_str_has_suffix(reply->str, "\r\nERROR\r\n");
+}
+
+static char *session_command(struct test_session *session, const char *cmd)
+{
+	GString *reply = g_string_new(NULL);
+	gsize len = strlen(cmd);
+	char buf[512];
+
+	g_assert(write(session->fd, cmd, len) == (ssize_t) len);
+
+	while (!reply_complete(reply)) {
+		ssize_t n;
+
+		g_main_context_iteration(NULL, TRUE);
+		g_assert(!session->timed_out);
+
+		while ((n = read(session->fd, buf, sizeof(buf))) > 0)
+			g_string_append_len(reply, buf, n);
+	}
+
+	return g_string_free(reply, FALSE);
+}
+
+static void run_session(struct test_session *session)
+{
+	unsigned int i;
+
+	for (i = 0; i < G_N_ELEMENTS(headset_session); i++) {
+		const struct test_step *step = headset_session + i;
+		char *reply = session_command(session, step->cmd);
+
+		if (step->reply)
+			g_assert_cmpstr(reply, ==, step->reply);
+
+		g_free(reply);
+	}
+}
+
+static void test_session(void)
+{
+	struct test_session session;
+	char *reply;
+
+	session_init(&session);
+	run_session(&session);
+
+	/* A multi-line reply goes out in a single write */
+	session.writes = 0;
+	reply = session_command(&session, "AT+CLCC\r");
+	g_assert_cmpstr(reply, ==, headset_session[4].reply);
+	g_assert_cmpuint(session.writes, ==, 1);
+	g_free(reply);
+
+	session_cleanup(&session);
+}
+
+static void test_dispatch(void)
+{
+	struct test_session session;
+	char prefix[16];
+	char cmd[32];
+	char *reply;
+	int i;
+
+	session_init(&session);
+
+	for (i = 0; i < 200; i++) {
+		snprintf(prefix, sizeof(prefix), "+T%d", i);
+		g_at_server_register(session.server, prefix, reply_cb,
+					(gpointer) &empty_reply, NULL);
+	}
+
+	for (i = 1; i < 200; i += 2) {
+		snprintf(prefix, sizeof(prefix), "+T%d", i);
+		g_assert(g_at_server_unregister(session.server, prefix));
+	}
+
+	for (i = 0; i < 200; i += 7) {
+		snprintf(cmd, sizeof(cmd), "AT+t%d\r", i);
+		reply = session_command(&session, cmd);
+		g_assert_cmpstr(reply, ==, (i & 1) ? "\r\nERROR\r\n" :
+							"\r\nOK\r\n");
+		g_free(reply);
+	}
+
+	/* Replacing a handler takes effect immediately */
+	g_at_server_register(session.server, "+T0", reply_cb,
+					(gpointer) &brsf_reply, NULL);
+	reply = session_command(&session, "AT+T0\r");
+	g_assert_cmpstr(reply, ==, headset_session[0].reply);
+	g_free(reply);
+
+	/* Basic commands go through the same table */
+	reply = session_command(&session, "ATE0\r");
+	g_assert_cmpstr(reply, ==, "\r\nOK\r\n");
+	g_free(reply);
+
+	session_cleanup(&session);
+}
+
+static void test_bench(void)
+{
+	struct test_session session;
+	unsigned int n = g_test_perf() ? 10000 : 100;
+	unsigned int i;
+	double elapsed;
+
+	session_init(&session);
+	g_test_timer_start();
+
+	for (i = 0; i < n; i++)
+		run_session(&session);
+
+	elapsed = g_test_timer_elapsed();
+	g_test_message("%u commands in %.3f s, %u writes",
+			n * (unsigned int) G_N_ELEMENTS(headset_session),
+			elapsed, session.writes);
+
+	session_cleanup(&session);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testatserver/session", test_session);
+	g_test_add_func("/testatserver/dispatch", test_dispatch);
+	g_test_add_func("/testatserver/bench", test_bench);
+
+	return g_test_run();
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 8
+ * indent-tabs-mode: t
+ * End:
+ */
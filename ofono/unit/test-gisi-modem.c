@@ -0,0 +1,340 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2021 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <glib.h>
+
+#include "gisi/modem.h"
+#include "gisi/socket.h"
+
+#define TEST_TIMEOUT_SEC (20)
+#define TEST_INDEX (1)
+
+#define PN_CALL		0x01
+#define PN_NETWORK	0x0A
+#define PN_FIREWALL	0x43
+
+enum test_channel {
+	TEST_IND,
+	TEST_REQ,
+	TEST_CHANNELS
+};
+
+struct test_record {
+	enum test_channel channel;
+	uint8_t resource;
+	const char *data;
+	size_t len;
+};
+
+struct test_session {
+	GIsiModem *modem;
+	GByteArray *received;
+	guint destroy_after;
+	gboolean timed_out;
+	guint timeout_id;
+};
+
+/* Recorded N900 traffic, a network indication burst plus a call */
+static const struct test_record test_traffic[] = {
+	{ TEST_IND, PN_NETWORK, "\x00\x1e\x3a\x00", 4 },	/* RSSI */
+	{ TEST_IND, PN_NETWORK, "\x00\xe2\x00\x00\x00\x02"
+		"\x00\x13\x00\x00\x01\x00\x00\x02", 14 },	/* Reg status */
+	{ TEST_IND, PN_NETWORK, "\x00\x1e\x3c\x00", 4 },	/* RSSI */
+	{ TEST_IND, PN_NETWORK, "\x00\x27\x00\x01\x10\x10\x0a"
+		"\x15\x0b\x22\x11\x08\x00\x00", 14 },		/* Time */
+	{ TEST_IND, PN_FIREWALL, "\x00\x00\x2a", 3 },		/* Firewall */
+	{ TEST_IND, 0x62, "\x00\x01\x00\x00", 4 },		/* Unknown */
+	{ TEST_IND, PN_NETWORK, "\x00", 1 },			/* Truncated */
+	{ TEST_REQ, PN_CALL, "\x00\x0f\x01\x00\x02\x00", 6 },	/* Call */
+	{ TEST_IND, PN_NETWORK, "\x00\x1e\x3e\x00", 4 },	/* RSSI */
+};
+
+/* Resource and message ID of the ones that get dispatched */
+static const uint8_t test_dispatched[] = {
+	PN_NETWORK, 0x1e,
+	PN_NETWORK, 0xe2,
+	PN_NETWORK, 0x1e,
+	PN_NETWORK, 0x27,
+	PN_NETWORK, 0x1e,
+	PN_CALL, 0x0f
+};
+
+static int test_peer[TEST_CHANNELS] = { -1, -1 };
+static guint test_channels;
+static guint test_reads;
+
+/*
+ * Stubs for gisi/socket.c, the modem gets a socketpair for each channel.
+ * The indication channel is created first.
+ */
+
+GIOChannel *g_isi_phonet_new(unsigned int ifindex)
+{
+	GIOChannel *channel;
+	int fds[2];
+
+	g_assert(test_channels < TEST_CHANNELS);
+	g_assert(!socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds));
+	test_peer[test_channels++] = fds[1];
+
+	channel = g_io_channel_unix_new(fds[0]);
+	g_io_channel_set_close_on_unref(channel, TRUE);
+	g_io_channel_set_encoding(channel, NULL, NULL);
+	g_io_channel_set_buffered(channel, FALSE);
+	return channel;
+}
+
+/*
+ * Replayed datagrams carry the Phonet address in front of the ISI
+ * message, scatter it to where recvmmsg() on a Phonet socket puts it.
+ */
+int g_isi_phonet_read_batch(GIOChannel *channel, struct mmsghdr *msgs,
+				unsigned int vlen)
+{
+	struct mmsghdr hdrs[vlen];
+	struct iovec iov[vlen][2];
+	unsigned int i;
+	int n;
+
+	memset(hdrs, 0, sizeof(hdrs));
+
+	for (i = 0; i < vlen; i++) {
+		iov[i][0].iov_base = msgs[i].msg_hdr.msg_name;
+		iov[i][0].iov_len = sizeof(struct sockaddr_pn);
+		iov[i][1] = msgs[i].msg_hdr.msg_iov[0];
+		hdrs[i].msg_hdr.msg_iov = iov[i];
+		hdrs[i].msg_hdr.msg_iovlen = 2;
+	}
+
+	test_reads++;
+	n = recvmmsg(g_io_channel_unix_get_fd(channel), hdrs, vlen,
+							MSG_DONTWAIT, NULL);
+
+	for (i = 0; (int) i < n; i++)
+		msgs[i].msg_len = hdrs[i].msg_len - sizeof(struct sockaddr_pn);
+
+	return n;
+}
+
+/* Code shared by all tests */
+
+static void test_send(const struct test_record *rec)
+{
+	struct sockaddr_pn addr;
+	struct iovec iov[2];
+	ssize_t len = sizeof(addr) + rec->len;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.spn_family = AF_PHONET;
+	addr.spn_resource = rec->resource;
+
+	iov[0].iov_base = &addr;
+	iov[0].iov_len = sizeof(addr);
+	iov[1].iov_base = (void *) rec->data;
+	iov[1].iov_len = rec->len;
+
+	g_assert(writev(test_peer[rec->channel], iov, 2) == len);
+}
+
+static void test_notify(const GIsiMessage *msg, void *data)
+{
+	struct test_session *session = data;
+	uint8_t entry[2];
+
+	entry[0] = g_isi_msg_resource(msg);
+	entry[1] = g_isi_msg_id(msg);
+	g_byte_array_append(session->received, entry, sizeof(entry));
+
+	if (session->destroy_after &&
+			session->received->len / 2 == session->destroy_after) {
+		g_isi_modem_destroy(session->modem);
+		session->modem = NULL;
+	}
+}
+
+static gboolean test_timeout(gpointer user_data)
+{
+	struct test_session *session = user_data;
+
+	session->timed_out = TRUE;
+	session->timeout_id = 0;
+
+	return FALSE;
+}
+
+static void test_init(struct test_session *session)
+{
+	memset(session, 0, sizeof(*session));
+	test_channels = 0;
+	test_reads = 0;
+
+	session->modem = g_isi_modem_create(TEST_INDEX);
+	g_assert(session->modem);
+	g_assert_cmpuint(test_channels, ==, TEST_CHANNELS);
+
+	session->received = g_byte_array_new();
+	g_assert(g_isi_ind_subscribe(session->modem, PN_NETWORK, 0x1e,
+					test_notify, session, NULL));
+	g_assert(g_isi_ind_subscribe(session->modem, PN_NETWORK, 0xe2,
+					test_notify, session, NULL));
+	g_assert(g_isi_ind_subscribe(session->modem, PN_NETWORK, 0x27,
+					test_notify, session, NULL));
+	g_assert(g_isi_ntf_subscribe(session->modem, PN_CALL, 0x0f,
+					test_notify, session, NULL));
+
+	session->timeout_id = g_timeout_add_seconds(TEST_TIMEOUT_SEC,
+							test_timeout, session);
+}
+
+static void test_wait(struct test_session *session, guint count)
+{
+	while (session->received->len / 2 < count) {
+		g_main_context_iteration(NULL, TRUE);
+		g_assert(!session->timed_out);
+	}
+}
+
+static void test_cleanup(struct test_session *session)
+{
+	int i;
+
+	g_isi_modem_destroy(session->modem);
+	g_byte_array_free(session->received, TRUE);
+
+	for (i = 0; i < TEST_CHANNELS; i++) {
+		close(test_peer[i]);
+		test_peer[i] = -1;
+	}
+
+	if (session->timeout_id)
+		g_source_remove(session->timeout_id);
+
+	/* Let the idle subscription update run */
+	while (g_main_context_iteration(NULL, FALSE));
+}
+
+/* ==== replay ==== */
+
+static void test_replay(void)
+{
+	struct test_session session;
+	GByteArray *ind = g_byte_array_new();
+	guint i;
+
+	test_init(&session);
+
+	for (i = 0; i < G_N_ELEMENTS(test_traffic); i++)
+		test_send(test_traffic + i);
+
+	test_wait(&session, sizeof(test_dispatched) / 2);
+
+	/* One read per channel drains the whole burst */
+	g_assert_cmpuint(test_reads, ==, TEST_CHANNELS);
+	g_assert_cmpuint(session.received->len, ==, sizeof(test_dispatched));
+
+	/* Indications are dispatched in the order they were received */
+	for (i = 0; i < session.received->len; i += 2)
+		if (session.received->data[i] != PN_CALL)
+			g_byte_array_append(ind,
+					session.received->data + i, 2);
+
+	g_assert_cmpuint(ind->len, ==, sizeof(test_dispatched) - 2);
+	g_assert(!memcmp(ind->data, test_dispatched, ind->len));
+
+	g_byte_array_free(ind, TRUE);
+	test_cleanup(&session);
+}
+
+/* ==== destroy ==== */
+
+static void test_destroy(void)
+{
+	struct test_session session;
+	guint i;
+
+	test_init(&session);
+	session.destroy_after = 2;
+
+	for (i = 0; i < 4; i++)
+		test_send(test_traffic + i);
+
+	test_wait(&session, 2);
+	g_assert(!session.modem);
+
+	/* The rest of the batch is dropped along with the modem */
+	while (g_main_context_iteration(NULL, FALSE));
+	g_assert_cmpuint(session.received->len, ==, 4);
+
+	test_cleanup(&session);
+}
+
+/* ==== bench ==== */
+
+static void test_bench(void)
+{
+	struct test_session session;
+	guint n = g_test_perf() ? 100000 : 1000;
+	guint burst = 64;
+	guint i, j;
+	double elapsed;
+
+	test_init(&session);
+	g_test_timer_start();
+
+	for (i = 0; i < n; i += burst) {
+		for (j = 0; j < burst; j++)
+			test_send(test_traffic);
+
+		test_wait(&session, burst);
+		g_byte_array_set_size(session.received, 0);
+	}
+
+	elapsed = g_test_timer_elapsed();
+	g_test_message("%u indications in %.3f s, %u reads", n, elapsed,
+								test_reads);
+	g_assert_cmpuint(test_reads, <, n);
+
+	test_cleanup(&session);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testgisimodem/replay", test_replay);
+	g_test_add_func("/testgisimodem/destroy", test_destroy);
+	g_test_add_func("/testgisimodem/bench", test_bench);
+
+	return g_test_run();
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 8
+ * indent-tabs-mode: t
+ * End:
+ */
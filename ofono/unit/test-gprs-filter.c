@@ -51,6 +51,26 @@ struct ofono_gprs {
 	struct gprs_filter_chain *chain;
 };
 
+/* Stubs */
+
+static GString *test_metrics = NULL;
+
+void __ofono_metrics_filter_done(struct ofono_modem *modem,
+					const char *chain, const char *filter,
+					gint64 started)
+{
+	g_assert(started);
+	if (test_metrics) {
+		g_string_append_printf(test_metrics, "%s%s/%s",
+				test_metrics->len ? "," : "", chain, filter);
+	}
+}
+
+struct ofono_modem *ofono_gprs_get_modem(struct ofono_gprs *gprs)
+{
+	return NULL;
+}
+
 /* Code shared by all tests */
 
 static gboolean test_timeout_cb(gpointer user_data)
@@ -1084,6 +1104,55 @@ static void test_priorities2(void)
 	test_common_deinit();
 }
 
+/* ==== sync ==== */
+
+static void test_sync(void)
+{
+	static struct ofono_gprs_filter filter1 = {
+		.name = "sync1",
+		.api_version = OFONO_GPRS_FILTER_API_VERSION,
+		.priority = OFONO_GPRS_FILTER_PRIORITY_HIGH,
+		.filter_check = filter_check_allow
+	};
+
+	static struct ofono_gprs_filter filter2 = {
+		.name = "sync2",
+		.api_version = OFONO_GPRS_FILTER_API_VERSION,
+		.priority = OFONO_GPRS_FILTER_PRIORITY_LOW,
+		.filter_check = filter_check_allow
+	};
+
+	int count = 0;
+	struct ofono_gprs gprs;
+
+	test_common_init();
+	test_metrics = g_string_new(NULL);
+
+	g_assert(ofono_gprs_filter_register(&filter2) == 0);
+	g_assert(ofono_gprs_filter_register(&filter1) == 0);
+	g_assert((gprs.chain = __ofono_gprs_filter_chain_new(&gprs)) != NULL);
+
+	/* Both filters get invoked without returning to the main loop */
+	__ofono_gprs_filter_chain_check(gprs.chain,
+			test_check_expect_allow_and_quit, test_inc, &count);
+	g_assert(test_filter_check_count == 2);
+	g_assert(!count);
+
+	/* But the completion callback is still invoked asynchronously */
+	g_main_loop_run(test_loop);
+	g_assert(count == 2);
+
+	g_assert_cmpstr(test_metrics->str, == ,
+			"gprs-filter/sync1,gprs-filter/sync2");
+
+	__ofono_gprs_filter_chain_free(gprs.chain);
+	ofono_gprs_filter_unregister(&filter1);
+	ofono_gprs_filter_unregister(&filter2);
+	g_string_free(test_metrics, TRUE);
+	test_metrics = NULL;
+	test_common_deinit();
+}
+
 #define TEST_(name) "/gprs-filter/" name
 
 int main(int argc, char *argv[])
@@ -1120,6 +1189,7 @@ int main(int argc, char *argv[])
 	g_test_add_func(TEST_("cancel6"), test_cancel6);
 	g_test_add_func(TEST_("priorities1"), test_priorities1);
 	g_test_add_func(TEST_("priorities2"), test_priorities2);
+	g_test_add_func(TEST_("sync"), test_sync);
 
 	return g_test_run();
 }
@@ -0,0 +1,95 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2021 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+
+#include "histogram.h"
+
+static void test_buckets(void)
+{
+	struct histogram h;
+
+	histogram_reset(&h);
+
+	histogram_add(&h, 0);
+	histogram_add(&h, 999);
+	histogram_add(&h, 1000);
+	histogram_add(&h, 1999);
+	histogram_add(&h, 2000);
+	histogram_add(&h, 3999);
+	histogram_add(&h, 1000000);
+	histogram_add(&h, G_GUINT64_CONSTANT(3600000000));
+
+	g_assert_cmpuint(h.count, ==, 8);
+	g_assert_cmpuint(h.bucket[0], ==, 2);
+	g_assert_cmpuint(h.bucket[1], ==, 2);
+	g_assert_cmpuint(h.bucket[2], ==, 2);
+	g_assert_cmpuint(h.bucket[10], ==, 1);
+	g_assert_cmpuint(h.bucket[HISTOGRAM_BUCKETS - 1], ==, 1);
+	g_assert_cmpuint(h.max_us, ==, G_GUINT64_CONSTANT(3600000000));
+
+	g_assert_cmpuint(histogram_bucket_limit(0), ==, 1);
+	g_assert_cmpuint(histogram_bucket_limit(10), ==, 1024);
+	g_assert_cmpuint(histogram_bucket_limit(HISTOGRAM_BUCKETS - 1), ==, 0);
+}
+
+static void test_percentile(void)
+{
+	struct histogram h;
+	char *str;
+	int i;
+
+	histogram_reset(&h);
+	g_assert_cmpuint(histogram_percentile(&h, 50), ==, 0);
+
+	for (i = 0; i < 90; i++)
+		histogram_add(&h, 500);
+
+	for (i = 0; i < 10; i++)
+		histogram_add(&h, 100000);
+
+	g_assert_cmpuint(histogram_percentile(&h, 50), ==, 1);
+	g_assert_cmpuint(histogram_percentile(&h, 90), ==, 1);
+	g_assert_cmpuint(histogram_percentile(&h, 91), ==, 128);
+	g_assert_cmpuint(histogram_percentile(&h, 100), ==, 128);
+	g_assert_cmpuint(histogram_percentile(&h, 200), ==, 128);
+
+	str = histogram_to_string(&h);
+	g_assert_cmpstr(str, ==, "100 samples, avg 10450 us, max 100000 us, "
+					"<1 ms: 90, <128 ms: 10");
+	g_free(str);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testhistogram/buckets", test_buckets);
+	g_test_add_func("/testhistogram/percentile", test_percentile);
+
+	return g_test_run();
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 8
+ * indent-tabs-mode: t
+ * End:
+ */
@@ -110,12 +110,133 @@ static void test_alloc_next(void)
 	idmap_free(idmap);
 }
 
+static void test_alloc_cyclic(void)
+{
+	struct idmap *idmap;
+	unsigned int bit;
+
+	idmap = idmap_new(4);
+
+	g_assert(idmap);
+	g_assert(idmap_alloc_cyclic(idmap) == 1);
+	g_assert(idmap_alloc_cyclic(idmap) == 2);
+
+	/* Released ids are not reused until the cursor wraps around */
+	idmap_put(idmap, 1);
+	g_assert(idmap_alloc_cyclic(idmap) == 3);
+	g_assert(idmap_alloc_cyclic(idmap) == 4);
+	g_assert(idmap_alloc_cyclic(idmap) == 1);
+	g_assert(idmap_alloc_cyclic(idmap) == 5);
+	g_assert_cmpuint(idmap_count(idmap), ==, 4);
+
+	idmap_put(idmap, 3);
+	g_assert(idmap_alloc_cyclic(idmap) == 3);
+
+	idmap_free(idmap);
+
+	idmap = idmap_new(200);
+
+	for (bit = 1; bit <= 200; bit++)
+		g_assert(idmap_alloc_cyclic(idmap) == bit);
+
+	idmap_put(idmap, 70);
+	idmap_put(idmap, 130);
+	g_assert(idmap_alloc_cyclic(idmap) == 70);
+	g_assert(idmap_alloc_cyclic(idmap) == 130);
+	g_assert(idmap_alloc_cyclic(idmap) == 201);
+
+	idmap_free(idmap);
+}
+
+static void test_range(void)
+{
+	struct idmap *idmap;
+
+	idmap = idmap_new_from_range(10, 209);
+
+	g_assert(idmap);
+	g_assert_cmpuint(idmap_count(idmap), ==, 0);
+
+	idmap_take_range(idmap, 20, 150);
+	g_assert_cmpuint(idmap_count(idmap), ==, 131);
+	g_assert(!idmap_find(idmap, 19));
+	g_assert(idmap_find(idmap, 20));
+	g_assert(idmap_find(idmap, 150));
+	g_assert(!idmap_find(idmap, 151));
+
+	/* Overlapping ranges are only counted once */
+	idmap_take(idmap, 20);
+	idmap_take_range(idmap, 140, 160);
+	g_assert_cmpuint(idmap_count(idmap), ==, 141);
+
+	idmap_put_range(idmap, 30, 99);
+	g_assert_cmpuint(idmap_count(idmap), ==, 71);
+	g_assert(idmap_find(idmap, 29));
+	g_assert(!idmap_find(idmap, 30));
+	g_assert(!idmap_find(idmap, 99));
+	g_assert(idmap_find(idmap, 100));
+
+	g_assert(idmap_alloc(idmap) == 10);
+	idmap_take_range(idmap, 11, 19);
+	g_assert(idmap_alloc(idmap) == 30);
+
+	/* Ranges are clipped to the map */
+	idmap_take_range(idmap, 0, 1000);
+	g_assert_cmpuint(idmap_count(idmap), ==, 200);
+	g_assert(idmap_alloc(idmap) == 210);
+	g_assert(idmap_alloc_cyclic(idmap) == 210);
+
+	idmap_put_range(idmap, 1000, 2000);
+	idmap_put_range(idmap, 100, 50);
+	g_assert_cmpuint(idmap_count(idmap), ==, 200);
+
+	idmap_put_range(idmap, 0, 1000);
+	g_assert_cmpuint(idmap_count(idmap), ==, 0);
+	g_assert(idmap_alloc(idmap) == 10);
+
+	idmap_free(idmap);
+}
+
+static void test_bench(void)
+{
+	const unsigned int size = 4096;
+	const unsigned int n = g_test_perf() ? 10000000 : 100000;
+	struct idmap *idmap = idmap_new(size);
+	unsigned int i;
+	double elapsed;
+
+	/* Mostly full map with a steady churn of allocations */
+	idmap_take_range(idmap, 1, size - 16);
+
+	g_test_timer_start();
+
+	for (i = 0; i < n; i++)
+		idmap_put(idmap, idmap_alloc(idmap));
+
+	elapsed = g_test_timer_elapsed();
+	g_test_message("idmap_alloc: %u ops in %.3f s", n, elapsed);
+
+	g_test_timer_start();
+
+	for (i = 0; i < n; i++)
+		idmap_put(idmap, idmap_alloc_cyclic(idmap));
+
+	elapsed = g_test_timer_elapsed();
+	g_test_message("idmap_alloc_cyclic: %u ops in %.3f s", n, elapsed);
+
+	g_assert_cmpuint(idmap_count(idmap), ==, size - 16);
+	idmap_free(idmap);
+}
+
 int main(int argc, char **argv)
 {
 	g_test_init(&argc, &argv, NULL);
 
 	g_test_add_func("/testidmap/alloc", test_alloc);
 	g_test_add_func("/testidmap/alloc_next", test_alloc_next);
+	g_test_add_func("/testidmap/alloc_cyclic", test_alloc_cyclic);
+	g_test_add_func("/testidmap/range", test_range);
+	g_test_add_func("/testidmap/bench", test_bench);
 
 	return g_test_run();
 }
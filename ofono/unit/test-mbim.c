@@ -26,6 +26,7 @@
 #include <sys/uio.h>
 #include <linux/types.h>
 #include <assert.h>
+#include <time.h>
 
 #include <ell/ell.h>
 
@@ -245,9 +246,10 @@ static void do_debug(const char *str, void *user_data)
 	l_info("%s%s", prefix, str);
 }
 
-static struct mbim_message *build_message(const struct message_data *msg_data)
+static struct mbim_message *build_message_frags(
+					const struct message_data *msg_data,
+					unsigned int frag_size)
 {
-	static const unsigned int frag_size = 64;
 	struct mbim_message *msg;
 	struct iovec *iov;
 	size_t n_iov;
@@ -281,6 +283,11 @@ done:
 	return msg;
 }
 
+static struct mbim_message *build_message(const struct message_data *msg_data)
+{
+	return build_message_frags(msg_data, 64);
+}
+
 static bool check_message(struct mbim_message *message,
 					const struct message_data *msg_data)
 {
@@ -303,9 +310,8 @@ done:
 	return r;
 }
 
-static void parse_device_caps(const void *data)
+static void check_device_caps(struct mbim_message *msg)
 {
-	struct mbim_message *msg = build_message(data);
 	uint32_t device_type;
 	uint32_t cellular_class;
 	uint32_t voice_class;
@@ -351,6 +357,17 @@ static void parse_device_caps(const void *data)
 	mbim_message_unref(msg);
 }
 
+static void parse_device_caps(const void *data)
+{
+	check_device_caps(build_message(data));
+}
+
+static void parse_device_caps_fragmented(const void *data)
+{
+	/* Strings end up spread over up to three fragments */
+	check_device_caps(build_message_frags(data, 48));
+}
+
 static void build_device_caps(const void *data)
 {
 	const struct message_data *msg_data = data;
@@ -718,6 +735,66 @@ static void parse_ip_configuration_query(const void *data)
 	mbim_message_unref(msg);
 }
 
+static double elapsed(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - start->tv_sec) +
+			(now.tv_nsec - start->tv_nsec) / 1000000000.0;
+}
+
+static void bench_messages(const void *data)
+{
+	static const unsigned int n = 10000;
+	struct timespec start;
+	unsigned int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (i = 0; i < n; i++) {
+		struct mbim_message *msg = build_message(data);
+		uint32_t u[8];
+		char *s[4];
+		unsigned int j;
+
+		assert(mbim_message_get_arguments(msg, "uuuuuuuussss",
+						u, u + 1, u + 2, u + 3,
+						u + 4, u + 5, u + 6, u + 7,
+						s, s + 1, s + 2, s + 3));
+
+		for (j = 0; j < L_ARRAY_SIZE(s); j++)
+			l_free(s[j]);
+
+		mbim_message_unref(msg);
+	}
+
+	l_info("%u parsed in %.3f s", n, elapsed(&start));
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (i = 0; i < n; i++) {
+		struct mbim_message *msg;
+
+		msg = mbim_message_new(mbim_uuid_basic_connect,
+					MBIM_CID_DEVICE_SERVICE_SUBSCRIBE_LIST,
+					MBIM_COMMAND_TYPE_SET);
+		assert(mbim_message_set_arguments(msg, "av", 2,
+					"16yuuuuuu", mbim_uuid_basic_connect, 5,
+					MBIM_CID_SIGNAL_STATE,
+					MBIM_CID_REGISTER_STATE,
+					MBIM_CID_CONNECT,
+					MBIM_CID_SUBSCRIBER_READY_STATUS,
+					MBIM_CID_PACKET_SERVICE,
+					"16yuuu", mbim_uuid_sms, 2,
+					MBIM_CID_SMS_READ,
+					MBIM_CID_SMS_MESSAGE_STORE_STATUS));
+		mbim_message_unref(msg);
+	}
+
+	l_info("%u built in %.3f s", n, elapsed(&start));
+}
+
 int main(int argc, char *argv[])
 {
 	l_test_init(&argc, &argv);
@@ -726,6 +803,8 @@ int main(int argc, char *argv[])
 			parse_device_caps, &message_data_device_caps);
 	l_test_add("Device Caps (build)",
 			build_device_caps, &message_data_device_caps);
+	l_test_add("Device Caps [fragmented] (parse)",
+			parse_device_caps_fragmented, &message_data_device_caps);
 
 	l_test_add("Device Caps Query (build)", build_device_caps_query,
 					&message_data_device_caps_query);
@@ -762,5 +841,8 @@ int main(int argc, char *argv[])
 				parse_ip_configuration_query,
 				&message_data_ip_configuration_query);
 
+	l_test_add("Messages (bench)", bench_messages,
+			&message_data_device_caps);
+
 	return l_test_run();
 }
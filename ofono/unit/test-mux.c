@@ -24,6 +24,7 @@
 #endif
 
 #include <unistd.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
@@ -556,6 +557,417 @@ static void test_extract_advanced(void)
 	g_assert(total == sizeof(advanced_input2) - 1);
 }
 
+static GIOChannel *socket_channel(int fd)
+{
+	GIOChannel *io = g_io_channel_unix_new(fd);
+
+	g_io_channel_set_close_on_unref(io, TRUE);
+	g_io_channel_set_encoding(io, NULL, NULL);
+	g_io_channel_set_buffered(io, FALSE);
+	g_io_channel_set_flags(io, G_IO_FLAG_NONBLOCK, NULL);
+
+	return io;
+}
+
+static GIOChannel *mux_channel(GAtMux *m)
+{
+	GIOChannel *io = g_at_mux_create_channel(m);
+
+	g_assert(io);
+	g_io_channel_set_encoding(io, NULL, NULL);
+	g_io_channel_set_buffered(io, FALSE);
+
+	return io;
+}
+
+static int peer_read(int fd, guint8 *buf, int size)
+{
+	int len = 0;
+	int n;
+
+	while ((n = read(fd, buf + len, size - len)) > 0)
+		len += n;
+
+	return len;
+}
+
+static gboolean quit_loop(gpointer user_data)
+{
+	g_main_loop_quit(user_data);
+
+	return FALSE;
+}
+
+static void run_loop(guint ms)
+{
+	GMainLoop *loop = g_main_loop_new(NULL, FALSE);
+
+	g_timeout_add(ms, quit_loop, loop);
+	g_main_loop_run(loop);
+	g_main_loop_unref(loop);
+}
+
+static const char batch_cmd[] = "AT+CGMI\r";
+
+/* Same as MUX_WRITE_BUFFER_SIZE in gatmux.c */
+#define MUX_TEST_WRITE_BUFFER_SIZE 4096
+
+static gboolean batch_write_cb(GIOChannel *io, GIOCondition cond,
+							gpointer user_data)
+{
+	int *count = user_data;
+	gsize written;
+
+	g_io_channel_write_chars(io, batch_cmd, sizeof(batch_cmd) - 1,
+							&written, NULL);
+	g_assert(written == sizeof(batch_cmd) - 1);
+
+	return --(*count) > 0;
+}
+
+static void test_batch_write(void)
+{
+	GAtMux *m;
+	GIOChannel *io;
+	GIOChannel *dlc[3];
+	int count[3] = { 1, 2, 3 };
+	int seen[3] = { 0, 0, 0 };
+	guint8 buf[1024];
+	guint8 *frame;
+	guint8 id, ctrl;
+	int frame_len;
+	int fds[2];
+	int total;
+	int len;
+	int i;
+
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+	g_assert(fcntl(fds[1], F_SETFL, O_NONBLOCK) == 0);
+
+	io = socket_channel(fds[0]);
+	m = g_at_mux_new_gsm0710_basic(io, 31);
+	g_io_channel_unref(io);
+
+	g_assert(g_at_mux_start(m));
+
+	for (i = 0; i < 3; i++)
+		dlc[i] = mux_channel(m);
+
+	/* Control frames are not delayed */
+	len = peer_read(fds[1], buf, sizeof(buf));
+	g_assert(len == 4 * sizeof(basic_open));
+
+	for (i = 0; i < 3; i++)
+		g_io_add_watch(dlc[i], G_IO_OUT, batch_write_cb, count + i);
+
+	run_loop(100);
+
+	/* All DLCs got their turn on every wakeup */
+	len = peer_read(fds[1], buf, sizeof(buf));
+
+	for (total = 0; total < len; ) {
+		frame = NULL;
+		total += gsm0710_basic_extract_frame(buf + total, len - total,
+							&id, &ctrl, &frame,
+							&frame_len);
+		if (frame == NULL)
+			break;
+
+		g_assert(id >= 1 && id <= 3);
+		g_assert(ctrl == GSM0710_DATA);
+		g_assert(frame_len == sizeof(batch_cmd) - 1);
+		g_assert(memcmp(frame, batch_cmd, frame_len) == 0);
+		seen[id - 1]++;
+	}
+
+	g_assert(seen[0] == 1);
+	g_assert(seen[1] == 2);
+	g_assert(seen[2] == 3);
+
+	for (i = 0; i < 3; i++)
+		g_io_channel_unref(dlc[i]);
+
+	g_at_mux_unref(m);
+	close(fds[1]);
+}
+
+static void test_write_backlog(void)
+{
+	GAtMux *m;
+	GIOChannel *io;
+	GIOChannel *dlc;
+	GByteArray *out = g_byte_array_new();
+	GByteArray *payload = g_byte_array_new();
+	guint8 data[3 * MUX_TEST_WRITE_BUFFER_SIZE];
+	guint8 buf[1024];
+	guint8 *frame;
+	guint8 id, ctrl;
+	gsize written;
+	int frame_len;
+	int expected;
+	int junk = 0;
+	int fds[2];
+	int total;
+	int len;
+	int i;
+
+	for (i = 0; i < (int) sizeof(data); i++)
+		data[i] = i % 251;
+
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+	g_assert(fcntl(fds[1], F_SETFL, O_NONBLOCK) == 0);
+
+	io = socket_channel(fds[0]);
+	m = g_at_mux_new_gsm0710_basic(io, 31);
+	g_io_channel_unref(io);
+
+	g_assert(g_at_mux_start(m));
+	dlc = mux_channel(m);
+
+	len = peer_read(fds[1], buf, sizeof(buf));
+	g_assert(len == 2 * sizeof(basic_open));
+
+	/* The peer stops reading, the tty takes nothing more */
+	memset(buf, 0xaa, sizeof(buf));
+	while ((len = write(fds[0], buf, sizeof(buf))) > 0)
+		junk += len;
+
+	/* More frames than fit the write buffer, none may be lost */
+	g_io_channel_write_chars(dlc, (gchar *) data, sizeof(data),
+							&written, NULL);
+	g_assert(written == sizeof(data));
+
+	/* 31 bytes of payload per frame, plus 6 bytes of framing */
+	expected = junk + sizeof(data) + (sizeof(data) + 30) / 31 * 6;
+
+	for (i = 0; i < 100 && (int) out->len < expected; i++) {
+		while ((len = read(fds[1], buf, sizeof(buf))) > 0)
+			g_byte_array_append(out, buf, len);
+
+		run_loop(10);
+	}
+
+	for (total = junk; total < (int) out->len; ) {
+		frame = NULL;
+		total += gsm0710_basic_extract_frame(out->data + total,
+							out->len - total,
+							&id, &ctrl, &frame,
+							&frame_len);
+		if (frame == NULL)
+			break;
+
+		g_assert(id == 1);
+		g_assert(ctrl == GSM0710_DATA);
+		g_byte_array_append(payload, frame, frame_len);
+	}
+
+	g_assert((int) out->len == expected);
+	g_assert(payload->len == sizeof(data));
+	g_assert(memcmp(payload->data, data, sizeof(data)) == 0);
+
+	g_byte_array_free(payload, TRUE);
+	g_byte_array_free(out, TRUE);
+	g_io_channel_unref(dlc);
+	g_at_mux_unref(m);
+	close(fds[1]);
+}
+
+static void test_peek(void)
+{
+	GAtMux *m;
+	GIOChannel *io;
+	GIOChannel *dlc;
+	const guint8 *data;
+	guint8 payload[64];
+	gsize len;
+	int fds[2];
+	int i;
+
+	for (i = 0; i < (int) sizeof(payload); i++)
+		payload[i] = i;
+
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+	io = socket_channel(fds[0]);
+	m = g_at_mux_new_gsm0710_basic(io, 31);
+	g_io_channel_unref(io);
+
+	g_assert(g_at_mux_start(m));
+	dlc = mux_channel(m);
+
+	g_assert(g_at_mux_channel_peek(dlc, &len) == NULL);
+	g_assert(len == 0);
+
+	/* Not a mux channel */
+	g_assert(g_at_mux_channel_peek(io, &len) == NULL);
+	g_assert(len == 0);
+
+	g_at_mux_feed_dlc_data(m, 1, payload, 16);
+	g_at_mux_feed_dlc_data(m, 1, payload + 16, 16);
+
+	data = g_at_mux_channel_peek(dlc, &len);
+	g_assert(len == 32);
+	g_assert(memcmp(data, payload, len) == 0);
+
+	/* Data stays where it is until consumed */
+	g_assert(g_at_mux_channel_peek(dlc, &len) == data);
+	g_at_mux_channel_consume(dlc, 10);
+
+	data = g_at_mux_channel_peek(dlc, &len);
+	g_assert(len == 22);
+	g_assert(memcmp(data, payload + 10, len) == 0);
+
+	g_at_mux_channel_consume(dlc, len);
+	g_assert(g_at_mux_channel_peek(dlc, &len) == NULL);
+
+	g_io_channel_unref(dlc);
+	g_at_mux_unref(m);
+	close(fds[1]);
+}
+
+struct sched_writer {
+	int dlc;
+	int count;
+	int len;
+	GString *order;
+};
+
+static gboolean sched_write_cb(GIOChannel *io, GIOCondition cond,
+							gpointer user_data)
+{
+	struct sched_writer *w = user_data;
+	char buf[512];
+	gsize written;
+
+	memset(buf, 'a', w->len);
+	g_io_channel_write_chars(io, buf, w->len, &written, NULL);
+	g_string_append_c(w->order, '0' + w->dlc);
+
+	return --w->count > 0;
+}
+
+static void test_schedule(void)
+{
+	GAtMux *m;
+	GIOChannel *io;
+	GIOChannel *dlc[3];
+	GAtMuxChannelStats stats;
+	GString *order = g_string_new(NULL);
+	struct sched_writer w[3] = {
+		{ 1, 40, 200, order },
+		{ 2, 1, 8, order },
+		{ 3, 40, 200, order },
+	};
+	guint8 buf[256];
+	int fds[2];
+	int n1, n3;
+	int i;
+
+	g_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+	g_assert(fcntl(fds[1], F_SETFL, O_NONBLOCK) == 0);
+
+	io = socket_channel(fds[0]);
+	m = g_at_mux_new_gsm0710_basic(io, 31);
+	g_io_channel_unref(io);
+
+	g_assert(g_at_mux_start(m));
+
+	for (i = 0; i < 3; i++)
+		dlc[i] = mux_channel(m);
+
+	g_assert(!g_at_mux_channel_set_priority(io, G_AT_MUX_PRIORITY_NORMAL,
+								1, 0));
+	g_assert(!g_at_mux_channel_set_priority(dlc[0],
+					G_AT_MUX_PRIORITY_NORMAL, 0, 0));
+	g_assert(g_at_mux_channel_set_priority(dlc[1],
+					G_AT_MUX_PRIORITY_CONTROL, 1, 0));
+	g_assert(g_at_mux_channel_set_priority(dlc[2],
+					G_AT_MUX_PRIORITY_NORMAL, 3, 0));
+
+	peer_read(fds[1], buf, sizeof(buf));
+
+	for (i = 0; i < 3; i++)
+		g_io_add_watch(dlc[i], G_IO_OUT, sched_write_cb, w + i);
+
+	run_loop(200);
+
+	/* The control channel doesn't wait behind the bulk ones */
+	g_assert(order->str[0] == '2');
+
+	/* Weight 3 gets about three times as many turns as weight 1 */
+	for (i = 1, n1 = n3 = 0; i < 33; i++) {
+		if (order->str[i] == '1')
+			n1++;
+		else if (order->str[i] == '3')
+			n3++;
+	}
+
+	g_assert(n1 > 0);
+	g_assert(n3 >= 2 * n1);
+
+	g_assert(g_at_mux_channel_get_stats(dlc[2], &stats));
+	g_assert(stats.queue_depth == 0);
+	g_assert(stats.max_queue_depth > 0);
+	g_assert(stats.frames == 40 * 7);
+	g_assert(stats.total_wait >= stats.max_wait);
+
+	for (i = 0; i < 3; i++)
+		g_io_channel_unref(dlc[i]);
+
+	g_at_mux_unref(m);
+	g_string_free(order, TRUE);
+	close(fds[1]);
+}
+
+#define BENCH_FRAMES 100000
+
+static void bench_frames(const char *name, int frame_size,
+		int (*fill)(guint8 *frame, guint8 dlc, guint8 type,
+					const guint8 *data, int len),
+		int (*extract)(guint8 *data, int len, guint8 *out_dlc,
+					guint8 *out_type, guint8 **frame,
+					int *out_len))
+{
+	guint8 *payload = g_malloc(frame_size);
+	guint8 *buf = g_malloc(frame_size * 2 + 8);
+	guint8 *frame;
+	guint8 dlc, ctrl;
+	int frame_len;
+	gsize bytes = 0;
+	gdouble elapsed;
+	int i;
+
+	for (i = 0; i < frame_size; i++)
+		payload[i] = g_random_int_range(0, 256);
+
+	g_test_timer_start();
+
+	for (i = 0; i < BENCH_FRAMES; i++) {
+		int len = fill(buf, 1 + i % 3, GSM0710_DATA,
+						payload, frame_size);
+
+		bytes += len;
+		frame = NULL;
+		extract(buf, len, &dlc, &ctrl, &frame, &frame_len);
+		g_assert(frame && frame_len == frame_size);
+	}
+
+	elapsed = g_test_timer_elapsed();
+	g_test_message("%s: %d frames, %.1f MB/s", name, BENCH_FRAMES,
+			elapsed > 0 ? bytes / elapsed / 1000000 : 0.0);
+
+	g_free(payload);
+	g_free(buf);
+}
+
+static void test_bench_frames(void)
+{
+	bench_frames("basic", 127, gsm0710_basic_fill_frame,
+					gsm0710_basic_extract_frame);
+	bench_frames("advanced", 64, gsm0710_advanced_fill_frame,
+					gsm0710_advanced_extract_frame);
+}
+
 int main(int argc, char **argv)
 {
 	g_test_init(&argc, &argv, NULL);
@@ -565,6 +977,11 @@ int main(int argc, char **argv)
 	g_test_add_func("/testmux/extract_basic", test_extract_basic);
 	g_test_add_func("/testmux/extract_advanced", test_extract_advanced);
 	g_test_add_func("/testmux/basic", test_basic);
+	g_test_add_func("/testmux/batch_write", test_batch_write);
+	g_test_add_func("/testmux/write_backlog", test_write_backlog);
+	g_test_add_func("/testmux/peek", test_peek);
+	g_test_add_func("/testmux/schedule", test_schedule);
+	g_test_add_func("/testmux/bench_frames", test_bench_frames);
 
 	return g_test_run();
 }
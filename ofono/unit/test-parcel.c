@@ -0,0 +1,219 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2021 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "parcel.h"
+
+/* "abc" as written by Android, padded to a multiple of 4 bytes */
+static const unsigned char parcel_abc[] = {
+	0x03, 0x00, 0x00, 0x00, 'a', 0x00, 'b', 0x00, 'c', 0x00, 0x00, 0x00
+};
+
+/* U+00E4, U+20AC, U+1F600 and 'x' */
+static const char utf8_str[] = "\xc3\xa4\xe2\x82\xac\xf0\x9f\x98\x80x";
+
+static void test_rewind(struct parcel *r, const struct parcel *w)
+{
+	parcel_init_buf(r, w->data, w->size);
+	r->size = w->size;
+}
+
+static void test_write_string(void)
+{
+	struct parcel p;
+
+	parcel_init(&p);
+	parcel_w_string(&p, "abc");
+	g_assert_cmpuint(p.size, ==, sizeof(parcel_abc));
+	g_assert(!memcmp(p.data, parcel_abc, sizeof(parcel_abc)));
+	parcel_free(&p);
+
+	g_assert_cmpuint(parcel_string_size(NULL), ==, 4);
+	g_assert_cmpuint(parcel_string_size(""), ==, 8);
+	g_assert_cmpuint(parcel_string_size("a"), ==, 8);
+	g_assert_cmpuint(parcel_string_size("ab"), ==, 12);
+	g_assert_cmpuint(parcel_string_size("abc"), ==, 12);
+
+	/* Surrogate pair for the emoji */
+	g_assert_cmpuint(parcel_string_size(utf8_str), ==, 4 + 12);
+
+	/* Invalid UTF-8 is written as a null string */
+	parcel_init(&p);
+	g_assert_cmpint(parcel_w_string(&p, "\xc3("), ==, -1);
+	g_assert_cmpuint(p.size, ==, 4);
+	g_assert_cmpint(*(int32_t *) (void *) p.data, ==, -1);
+	parcel_free(&p);
+}
+
+static void test_read_str(void)
+{
+	struct parcel w, r;
+	struct parcel_str str;
+	struct parcel_scratch scratch;
+	char *copy;
+
+	parcel_init(&w);
+	parcel_w_string(&w, "abc");
+	parcel_w_string(&w, utf8_str);
+	parcel_w_string(&w, NULL);
+	parcel_w_int32(&w, 42);
+
+	test_rewind(&r, &w);
+	parcel_scratch_init(&scratch);
+
+	parcel_r_str(&r, &str);
+	g_assert_cmpuint(str.len, ==, 3);
+	g_assert(parcel_str_equal(&str, "abc"));
+	g_assert(!parcel_str_equal(&str, "ab"));
+	g_assert(!parcel_str_equal(&str, "abcd"));
+	g_assert(!parcel_str_equal(&str, NULL));
+
+	parcel_r_str(&r, &str);
+	g_assert_cmpuint(str.len, ==, 5);
+	g_assert_cmpstr(parcel_str_utf8(&r, &str, &scratch), ==, utf8_str);
+
+	parcel_r_str(&r, &str);
+	g_assert(str.data == NULL);
+	g_assert(parcel_str_equal(&str, NULL));
+	g_assert(parcel_str_utf8(&r, &str, &scratch) == NULL);
+
+	g_assert_cmpint(parcel_r_int32(&r), ==, 42);
+	g_assert(!r.malformed);
+
+	/* The allocating variants still work the same */
+	test_rewind(&r, &w);
+	copy = parcel_r_string(&r);
+	g_assert_cmpstr(copy, ==, "abc");
+	g_free(copy);
+	copy = parcel_r_string(&r);
+	g_assert_cmpstr(copy, ==, utf8_str);
+	g_free(copy);
+
+	parcel_scratch_free(&scratch);
+	parcel_free(&w);
+}
+
+static void test_scratch(void)
+{
+	struct parcel w, r;
+	struct parcel_str str;
+	struct parcel_scratch scratch;
+	char big[PARCEL_SCRATCH_SIZE * 2];
+
+	memset(big, 'z', sizeof(big) - 1);
+	big[sizeof(big) - 1] = 0;
+
+	parcel_init(&w);
+	parcel_w_string(&w, "abc");
+	parcel_w_string(&w, big);
+	test_rewind(&r, &w);
+
+	parcel_scratch_init(&scratch);
+
+	parcel_r_str(&r, &str);
+	g_assert_cmpstr(parcel_str_utf8(&r, &str, &scratch), ==, "abc");
+	g_assert(scratch.buf == scratch.inline_buf);
+
+	/* Moves to the heap and stays there */
+	parcel_r_str(&r, &str);
+	g_assert_cmpstr(parcel_str_utf8(&r, &str, &scratch), ==, big);
+	g_assert(scratch.buf != scratch.inline_buf);
+
+	parcel_scratch_free(&scratch);
+	g_assert(scratch.buf == scratch.inline_buf);
+	parcel_free(&w);
+}
+
+static void test_malformed(void)
+{
+	static const uint16_t lone_surrogate[] = { 'a', 0xd800, 'b' };
+	struct parcel_str bad = { lone_surrogate, 3 };
+	struct parcel_scratch scratch;
+	struct parcel w, r;
+	struct parcel_str str;
+
+	/* String longer than the parcel */
+	parcel_init(&w);
+	parcel_w_int32(&w, 100);
+	parcel_w_int32(&w, 0);
+	test_rewind(&r, &w);
+
+	parcel_r_str(&r, &str);
+	g_assert(r.malformed);
+	g_assert(str.data == NULL);
+	parcel_free(&w);
+
+	/* Wrong UTF-16 coding marks the parcel as malformed */
+	parcel_init(&r);
+	parcel_scratch_init(&scratch);
+	g_assert(parcel_str_utf8(&r, &bad, &scratch) == NULL);
+	g_assert(r.malformed);
+	parcel_scratch_free(&scratch);
+	parcel_free(&r);
+}
+
+static void test_inline(void)
+{
+	struct parcel p;
+	uint32_t buf[4];
+
+	parcel_init_buf(&p, buf, sizeof(buf));
+	parcel_w_int32(&p, 1);
+	parcel_w_string(&p, "abc");
+	g_assert(p.data == (char *) buf);
+	g_assert_cmpuint(p.size, ==, sizeof(buf));
+
+	/* Doesn't fit anymore, moves to the heap */
+	parcel_w_string(&p, "defgh");
+	g_assert(p.data != (char *) buf);
+	g_assert_cmpuint(p.size, ==, 4 + 12 + 16);
+	g_assert(!memcmp(p.data + 4, parcel_abc, sizeof(parcel_abc)));
+	parcel_free(&p);
+
+	/* Exactly sized, nothing gets reallocated */
+	parcel_init_sized(&p, PARCEL_INT32_SIZE + parcel_string_size("abc"));
+	parcel_w_int32(&p, 1);
+	parcel_w_string(&p, "abc");
+	g_assert_cmpuint(p.capacity, ==, p.size);
+	parcel_free(&p);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testparcel/write_string", test_write_string);
+	g_test_add_func("/testparcel/read_str", test_read_str);
+	g_test_add_func("/testparcel/scratch", test_scratch);
+	g_test_add_func("/testparcel/malformed", test_malformed);
+	g_test_add_func("/testparcel/inline", test_inline);
+
+	return g_test_run();
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 8
+ * indent-tabs-mode: t
+ * End:
+ */
@@ -0,0 +1,118 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2021 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "phonebook-cache.h"
+
+static const char vcards[] = "BEGIN:VCARD\r\nVERSION:3.0\r\n"
+				"FN:Alice\r\nTEL:+35840123\r\nEND:VCARD\r\n";
+static const unsigned char cc1[] = { 0x00, 0x01 };
+static const unsigned char cc2[] = { 0x00, 0x02 };
+
+static void test_load(void)
+{
+	struct phonebook_cache *cache = phonebook_cache_new();
+	const char *data;
+	size_t len = 0;
+
+	g_assert(!phonebook_cache_lookup(cache, cc1, sizeof(cc1), &len));
+
+	phonebook_cache_store(cache, cc1, sizeof(cc1), vcards,
+							strlen(vcards));
+
+	/* Hits as long as the key stays the same */
+	data = phonebook_cache_lookup(cache, cc1, sizeof(cc1), &len);
+	g_assert(data);
+	g_assert_cmpuint(len, ==, strlen(vcards));
+	g_assert_cmpstr(data, ==, vcards);
+
+	data = phonebook_cache_lookup(cache, cc1, sizeof(cc1), NULL);
+	g_assert_cmpstr(data, ==, vcards);
+
+	phonebook_cache_free(cache);
+	phonebook_cache_free(NULL);
+}
+
+static void test_invalidate(void)
+{
+	struct phonebook_cache *cache = phonebook_cache_new();
+
+	phonebook_cache_store(cache, cc1, sizeof(cc1), vcards,
+							strlen(vcards));
+	phonebook_cache_invalidate(cache);
+	g_assert(!phonebook_cache_lookup(cache, cc1, sizeof(cc1), NULL));
+
+	/* Can be filled again */
+	phonebook_cache_store(cache, cc2, sizeof(cc2), vcards,
+							strlen(vcards));
+	g_assert(phonebook_cache_lookup(cache, cc2, sizeof(cc2), NULL));
+
+	phonebook_cache_free(cache);
+}
+
+static void test_mismatch(void)
+{
+	struct phonebook_cache *cache = phonebook_cache_new();
+
+	phonebook_cache_store(cache, cc1, sizeof(cc1), vcards,
+							strlen(vcards));
+
+	/* Changed elsewhere, and dropped for good */
+	g_assert(!phonebook_cache_lookup(cache, cc2, sizeof(cc2), NULL));
+	g_assert(!phonebook_cache_lookup(cache, cc1, sizeof(cc1), NULL));
+
+	/* Different length */
+	phonebook_cache_store(cache, cc1, sizeof(cc1), vcards,
+							strlen(vcards));
+	g_assert(!phonebook_cache_lookup(cache, cc1, 1, NULL));
+
+	/* Change counter couldn't be read this time */
+	phonebook_cache_store(cache, cc1, sizeof(cc1), vcards,
+							strlen(vcards));
+	g_assert(!phonebook_cache_lookup(cache, NULL, 0, NULL));
+	g_assert(!phonebook_cache_lookup(cache, cc1, sizeof(cc1), NULL));
+
+	/* Nothing is cached without a key */
+	phonebook_cache_store(cache, NULL, 0, vcards, strlen(vcards));
+	g_assert(!phonebook_cache_lookup(cache, NULL, 0, NULL));
+
+	phonebook_cache_free(cache);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/testphonebookcache/load", test_load);
+	g_test_add_func("/testphonebookcache/invalidate", test_invalidate);
+	g_test_add_func("/testphonebookcache/mismatch", test_mismatch);
+
+	return g_test_run();
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 8
+ * indent-tabs-mode: t
+ * End:
+ */
@@ -0,0 +1,526 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2021 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <glib.h>
+
+#include <ofono/log.h>
+
+#include "drivers/qmimodem/qmi.h"
+#include "drivers/qmimodem/ctl.h"
+#include "drivers/qmimodem/nas.h"
+#include "drivers/qmimodem/wds.h"
+
+#define TEST_TIMEOUT_SEC (20)
+#define TEST_CLIENT_ID (1)
+#define TEST_PKT_HANDLE (0x11223344)
+
+struct test_tlv {
+	uint8_t type;
+	uint16_t length;
+	const char *value;
+};
+
+struct test_modem {
+	int fd;
+	guint watch;
+	GByteArray *request;
+	guint requests;
+	guint released;
+};
+
+struct test_session {
+	struct test_modem modem;
+	struct qmi_device *device;
+	struct qmi_service *nas;
+	struct qmi_service *wds;
+	guint discovered;
+	guint indications;
+	guint replies;
+	uint32_t pkt_handle;
+	gboolean timed_out;
+	guint timeout_id;
+};
+
+/* Recorded serving system indication, a dozen TLVs */
+static const struct test_tlv ss_info_ind[] = {
+	{ 0x01, 6, "\x01\x01\x01\x01\x01\x08" },	/* Serving system */
+	{ 0x10, 1, "\x01" },				/* Roaming status */
+	{ 0x11, 2, "\x01\x0b" },			/* Data capabilities */
+	{ 0x12, 10, "\xf4\x00\x5b\x00\x05Telia" },	/* Current PLMN */
+	{ 0x15, 3, "\x01\x08\x00" },			/* Roaming list */
+	{ 0x1a, 1, "\x08" },				/* Time zone */
+	{ 0x1b, 1, "\x00" },				/* Daylight saving */
+	{ 0x1c, 5, "\x01\x00\x00\x00\x00" },		/* Default roaming */
+	{ 0x1d, 2, "\x34\x12" },			/* Location area code */
+	{ 0x1e, 4, "\x04\x03\x02\x01" },		/* Cell id */
+	{ 0x21, 5, "\x02\x03\x00\x00\x01" },		/* Detailed info */
+	{ 0x26, 2, "\x0e\x00" },			/* TAC */
+	{ 0x10, 1, "\x00" },				/* Duplicate */
+	{ 0x30, 100, NULL }				/* Truncated */
+};
+
+static const struct test_tlv wds_start_net_resp[] = {
+	{ 0x02, 4, "\x00\x00\x00\x00" },
+	{ QMI_WDS_RESULT_PKT_HANDLE, 4, "\x44\x33\x22\x11" }
+};
+
+static const char test_apn[] = "internet.example.com.with.a.fairly.long."
+	"access.point.name.that.does.not.fit.into.the.inline.buffer";
+
+/* ==== fake modem ==== */
+
+static void test_append_tlvs(GByteArray *buf, const struct test_tlv *tlvs,
+							unsigned int count)
+{
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		const struct test_tlv *tlv = tlvs + i;
+		uint8_t hdr[3];
+
+		hdr[0] = tlv->type;
+		hdr[1] = tlv->length & 0xff;
+		hdr[2] = tlv->length >> 8;
+		g_byte_array_append(buf, hdr, sizeof(hdr));
+
+		/* A TLV without value claims more data than there is */
+		if (tlv->value)
+			g_byte_array_append(buf, (void *) tlv->value,
+								tlv->length);
+	}
+}
+
+static void test_modem_send(struct test_modem *modem, uint8_t service,
+				uint8_t client, uint8_t type, uint16_t tid,
+				uint16_t message, const struct test_tlv *tlvs,
+				unsigned int count)
+{
+	GByteArray *buf = g_byte_array_new();
+	GByteArray *payload = g_byte_array_new();
+	uint8_t hdr[10];
+	guint len = 0;
+
+	test_append_tlvs(payload, tlvs, count);
+
+	/* Mux header, length is patched below */
+	hdr[len++] = 0x01;
+	hdr[len++] = 0;
+	hdr[len++] = 0;
+	hdr[len++] = 0x80;
+	hdr[len++] = service;
+	hdr[len++] = client;
+
+	if (service == QMI_SERVICE_CONTROL) {
+		hdr[len++] = type;
+		hdr[len++] = tid;
+	} else {
+		hdr[len++] = type;
+		hdr[len++] = tid & 0xff;
+		hdr[len++] = tid >> 8;
+	}
+
+	g_byte_array_append(buf, hdr, len);
+
+	hdr[0] = message & 0xff;
+	hdr[1] = message >> 8;
+	hdr[2] = payload->len & 0xff;
+	hdr[3] = payload->len >> 8;
+	g_byte_array_append(buf, hdr, 4);
+	g_byte_array_append(buf, payload->data, payload->len);
+
+	buf->data[1] = (buf->len - 1) & 0xff;
+	buf->data[2] = (buf->len - 1) >> 8;
+
+	g_assert(write(modem->fd, buf->data, buf->len) == (ssize_t) buf->len);
+
+	g_byte_array_free(payload, TRUE);
+	g_byte_array_free(buf, TRUE);
+}
+
+static void test_modem_control(struct test_modem *modem, uint8_t tid,
+				uint16_t message, const uint8_t *data,
+				uint16_t length)
+{
+	static const struct test_tlv version_info[] = {
+		{ 0x02, 4, "\x00\x00\x00\x00" },
+		{ 0x01, 16, "\x03"
+			"\x00\x01\x00\x05\x00"		/* CTL 1.5 */
+			"\x01\x01\x00\x0c\x00"		/* WDS 1.12 */
+			"\x03\x01\x00\x19\x00" }	/* NAS 1.25 */
+	};
+	static const struct test_tlv released[] = {
+		{ 0x02, 4, "\x00\x00\x00\x00" }
+	};
+	struct test_tlv client_id[] = {
+		{ 0x02, 4, "\x00\x00\x00\x00" },
+		{ 0x01, 2, NULL }
+	};
+	char id[3];
+
+	switch (message) {
+	case QMI_CTL_GET_VERSION_INFO:
+		test_modem_send(modem, QMI_SERVICE_CONTROL, 0, 0x01, tid,
+				message, version_info,
+				G_N_ELEMENTS(version_info));
+		break;
+	case QMI_CTL_GET_CLIENT_ID:
+		/* TLV 0x01 carries the service type */
+		g_assert_cmpuint(length, == ,4);
+		id[0] = data[3];
+		id[1] = TEST_CLIENT_ID;
+		id[2] = 0;
+		client_id[1].value = id;
+		test_modem_send(modem, QMI_SERVICE_CONTROL, 0, 0x01, tid,
+				message, client_id, G_N_ELEMENTS(client_id));
+		break;
+	case QMI_CTL_RELEASE_CLIENT_ID:
+		test_modem_send(modem, QMI_SERVICE_CONTROL, 0, 0x01, tid,
+				message, released, G_N_ELEMENTS(released));
+		modem->released++;
+		break;
+	}
+}
+
+static gboolean test_modem_read(GIOChannel *io, GIOCondition cond,
+							gpointer user_data)
+{
+	struct test_modem *modem = user_data;
+	uint8_t buf[2048];
+	const uint8_t *msg;
+	uint16_t message, length;
+	ssize_t n = read(modem->fd, buf, sizeof(buf));
+
+	if (n <= 0)
+		return G_SOURCE_CONTINUE;
+
+	g_assert_cmpint(n, >= ,6);
+	if (buf[4] == QMI_SERVICE_CONTROL) {
+		msg = buf + 8;
+		message = msg[0] | (msg[1] << 8);
+		length = msg[2] | (msg[3] << 8);
+		test_modem_control(modem, buf[7], message, msg + 4, length);
+	} else {
+		uint16_t tid = buf[7] | (buf[8] << 8);
+
+		msg = buf + 9;
+		message = msg[0] | (msg[1] << 8);
+		length = msg[2] | (msg[3] << 8);
+
+		g_byte_array_set_size(modem->request, 0);
+		g_byte_array_append(modem->request, msg + 4, length);
+		modem->requests++;
+
+		if (message == QMI_WDS_START_NET)
+			test_modem_send(modem, buf[4], buf[5], 0x02, tid,
+					message, wds_start_net_resp,
+					G_N_ELEMENTS(wds_start_net_resp));
+	}
+
+	return G_SOURCE_CONTINUE;
+}
+
+/* ==== session ==== */
+
+static gboolean test_session_timeout(gpointer user_data)
+{
+	struct test_session *session = user_data;
+
+	session->timed_out = TRUE;
+	session->timeout_id = 0;
+	return G_SOURCE_REMOVE;
+}
+
+static void test_session_wait(struct test_session *session, guint *counter,
+								guint count)
+{
+	while (*counter < count) {
+		g_main_context_iteration(NULL, TRUE);
+		g_assert(!session->timed_out);
+	}
+}
+
+static void test_discovered(void *user_data)
+{
+	struct test_session *session = user_data;
+
+	session->discovered++;
+}
+
+static void test_created(struct qmi_service *service, void *user_data)
+{
+	struct qmi_service **out = user_data;
+
+	g_assert(service);
+	*out = qmi_service_ref(service);
+}
+
+static void test_session_wait_service(struct test_session *session,
+						struct qmi_service **service)
+{
+	while (!*service) {
+		g_main_context_iteration(NULL, TRUE);
+		g_assert(!session->timed_out);
+	}
+}
+
+static void test_session_init(struct test_session *session)
+{
+	int fds[2];
+	GIOChannel *io;
+
+	memset(session, 0, sizeof(*session));
+	g_assert(!socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds));
+
+	session->modem.fd = fds[1];
+	session->modem.request = g_byte_array_new();
+	io = g_io_channel_unix_new(fds[1]);
+	session->modem.watch = g_io_add_watch(io, G_IO_IN, test_modem_read,
+							&session->modem);
+	g_io_channel_unref(io);
+
+	session->timeout_id = g_timeout_add_seconds(TEST_TIMEOUT_SEC,
+					test_session_timeout, session);
+
+	session->device = qmi_device_new(fds[0]);
+	g_assert(session->device);
+	qmi_device_set_close_on_unref(session->device, true);
+
+	g_assert(qmi_device_discover(session->device, test_discovered,
+							session, NULL));
+	test_session_wait(session, &session->discovered, 1);
+	g_assert(qmi_device_has_service(session->device, QMI_SERVICE_NAS));
+	g_assert(qmi_device_has_service(session->device, QMI_SERVICE_WDS));
+
+	g_assert(qmi_service_create(session->device, QMI_SERVICE_NAS,
+					test_created, &session->nas, NULL));
+	test_session_wait_service(session, &session->nas);
+	g_assert(qmi_service_create(session->device, QMI_SERVICE_WDS,
+					test_created, &session->wds, NULL));
+	test_session_wait_service(session, &session->wds);
+}
+
+static void test_session_cleanup(struct test_session *session)
+{
+	qmi_service_unref(session->nas);
+	qmi_service_unref(session->wds);
+
+	/* Let the services go before the device does */
+	test_session_wait(session, &session->modem.released, 2);
+	while (g_main_context_iteration(NULL, FALSE));
+	qmi_device_unref(session->device);
+
+	g_source_remove(session->modem.watch);
+	g_byte_array_free(session->modem.request, TRUE);
+	close(session->modem.fd);
+
+	if (session->timeout_id)
+		g_source_remove(session->timeout_id);
+}
+
+static void test_send_ss_info(struct test_session *session)
+{
+	test_modem_send(&session->modem, QMI_SERVICE_NAS, TEST_CLIENT_ID,
+				0x04, 0, QMI_NAS_SS_INFO_IND, ss_info_ind,
+				G_N_ELEMENTS(ss_info_ind));
+}
+
+static void test_ss_info_notify(struct qmi_result *result, void *user_data)
+{
+	struct test_session *session = user_data;
+	const uint8_t *ptr;
+	uint16_t len;
+	uint8_t u8;
+	uint16_t u16;
+	uint32_t u32;
+
+	ptr = qmi_result_get(result, QMI_NAS_RESULT_SERVING_SYSTEM, &len);
+	g_assert(ptr);
+	g_assert_cmpuint(len, == ,6);
+	g_assert_cmpuint(ptr[5], == ,8);
+
+	/* The first TLV of each type wins */
+	g_assert(qmi_result_get_uint8(result,
+				QMI_NAS_RESULT_ROAMING_STATUS, &u8));
+	g_assert_cmpuint(u8, == ,1);
+
+	g_assert(qmi_result_get_uint16(result,
+				QMI_NAS_RESULT_LOCATION_AREA_CODE, &u16));
+	g_assert_cmpuint(u16, == ,0x1234);
+	g_assert(qmi_result_get_uint32(result,
+				QMI_NAS_RESULT_CELL_ID, &u32));
+	g_assert_cmpuint(u32, == ,0x01020304);
+	g_assert(qmi_result_get_uint16(result, 0x26, &u16));
+	g_assert_cmpuint(u16, == ,14);
+
+	ptr = qmi_result_get(result, QMI_NAS_RESULT_CURRENT_PLMN, &len);
+	g_assert(ptr);
+	g_assert_cmpuint(len, == ,10);
+	g_assert(!memcmp(ptr + 5, "Telia", 5));
+
+	/* Missing and truncated TLVs */
+	g_assert(!qmi_result_get(result, 0x13, NULL));
+	g_assert(!qmi_result_get(result, 0x30, NULL));
+	g_assert(!qmi_result_get_uint8(result, 0x13, &u8));
+
+	session->indications++;
+}
+
+static void test_start_net_cb(struct qmi_result *result, void *user_data)
+{
+	struct test_session *session = user_data;
+
+	g_assert(!qmi_result_set_error(result, NULL));
+	g_assert(qmi_result_get_uint32(result, QMI_WDS_RESULT_PKT_HANDLE,
+						&session->pkt_handle));
+	session->replies++;
+}
+
+static struct qmi_param *test_start_net_param(void)
+{
+	struct qmi_param *param = qmi_param_new();
+
+	g_assert(param);
+	g_assert(qmi_param_append(param, QMI_WDS_PARAM_APN,
+					strlen(test_apn), test_apn));
+	g_assert(qmi_param_append_uint8(param,
+				QMI_WDS_PARAM_AUTHENTICATION_PREFERENCE, 2));
+	g_assert(qmi_param_append(param, QMI_WDS_PARAM_USERNAME, 4, "user"));
+	g_assert(qmi_param_append(param, QMI_WDS_PARAM_PASSWORD, 4, "pass"));
+	g_assert(qmi_param_append_uint8(param, QMI_WDS_PARAM_IP_FAMILY, 4));
+
+	/* Zero length TLVs are skipped, zero type is invalid */
+	g_assert(qmi_param_append(param, 0x10, 0, NULL));
+	g_assert(!qmi_param_append(param, 0, 1, "x"));
+	return param;
+}
+
+/* ==== indication ==== */
+
+static void test_indication(void)
+{
+	struct test_session session;
+
+	test_session_init(&session);
+	g_assert(qmi_service_register(session.nas, QMI_NAS_SS_INFO_IND,
+				test_ss_info_notify, &session, NULL));
+
+	test_send_ss_info(&session);
+	test_session_wait(&session, &session.indications, 1);
+	test_send_ss_info(&session);
+	test_session_wait(&session, &session.indications, 2);
+
+	test_session_cleanup(&session);
+}
+
+/* ==== request ==== */
+
+static void test_request(void)
+{
+	struct test_session session;
+	const struct test_tlv expected[] = {
+		{ QMI_WDS_PARAM_APN, sizeof(test_apn) - 1, test_apn },
+		{ QMI_WDS_PARAM_AUTHENTICATION_PREFERENCE, 1, "\x02" },
+		{ QMI_WDS_PARAM_USERNAME, 4, "user" },
+		{ QMI_WDS_PARAM_PASSWORD, 4, "pass" },
+		{ QMI_WDS_PARAM_IP_FAMILY, 1, "\x04" }
+	};
+	GByteArray *bytes = g_byte_array_new();
+
+	test_session_init(&session);
+	g_assert(qmi_service_send(session.wds, QMI_WDS_START_NET,
+				test_start_net_param(), test_start_net_cb,
+				&session, NULL));
+	test_session_wait(&session, &session.replies, 1);
+	g_assert_cmpuint(session.pkt_handle, == ,TEST_PKT_HANDLE);
+
+	/* The request went out exactly as appended */
+	test_append_tlvs(bytes, expected, G_N_ELEMENTS(expected));
+	g_assert_cmpuint(session.modem.request->len, == ,bytes->len);
+	g_assert(!memcmp(session.modem.request->data, bytes->data,
+							bytes->len));
+
+	/* Small requests don't need to grow the buffer */
+	g_assert(qmi_service_send(session.wds, QMI_WDS_START_NET,
+				qmi_param_new_uint8(QMI_WDS_PARAM_IP_FAMILY, 6),
+				test_start_net_cb, &session, NULL));
+	test_session_wait(&session, &session.replies, 2);
+	g_assert_cmpuint(session.modem.request->len, == ,4);
+
+	g_byte_array_free(bytes, TRUE);
+	test_session_cleanup(&session);
+}
+
+/* ==== bench ==== */
+
+static void test_bench(void)
+{
+	struct test_session session;
+	const guint n = g_test_perf() ? 100000 : 100;
+	double encode, decode;
+	guint i;
+
+	test_session_init(&session);
+	g_assert(qmi_service_register(session.nas, QMI_NAS_SS_INFO_IND,
+				test_ss_info_notify, &session, NULL));
+
+	g_test_timer_start();
+	for (i = 0; i < n; i++)
+		qmi_param_free(test_start_net_param());
+	encode = g_test_timer_elapsed();
+
+	g_test_timer_start();
+	for (i = 0; i < n; i++) {
+		test_send_ss_info(&session);
+		test_session_wait(&session, &session.indications, i + 1);
+	}
+	decode = g_test_timer_elapsed();
+
+	g_test_message("%u requests encoded in %.3f s, %u indications "
+			"decoded in %.3f s", n, encode, n, decode);
+
+	test_session_cleanup(&session);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	__ofono_log_init("test-qmimodem-qmi",
+				g_test_verbose() ? "*" : NULL,
+				FALSE, FALSE);
+
+	g_test_add_func("/qmimodem-qmi/indication", test_indication);
+	g_test_add_func("/qmimodem-qmi/request", test_request);
+	g_test_add_func("/qmimodem-qmi/bench", test_bench);
+
+	return g_test_run();
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 8
+ * indent-tabs-mode: t
+ * End:
+ */
@@ -15,6 +15,8 @@
 
 #include "ofono.h"
 
+#include <gdbus.h>
+
 #include <dbusaccess_peer.h>
 #include <dbusaccess_policy.h>
 #include <dbusaccess_system.h>
@@ -45,6 +47,26 @@ extern const char *sailfish_access_config_file;
  * Stubs
  *==========================================================================*/
 
+DBusConnection *ofono_dbus_get_connection(void)
+{
+	/* Disables the access decision cache */
+	return NULL;
+}
+
+guint g_dbus_add_disconnect_watch(DBusConnection *connection,
+				const char *name, GDBusWatchFunction func,
+				void *user_data, GDBusDestroyFunction destroy)
+{
+	g_assert_not_reached();
+	return 0;
+}
+
+gboolean g_dbus_remove_watch(DBusConnection *connection, guint id)
+{
+	g_assert_not_reached();
+	return FALSE;
+}
+
 DAPeer *da_peer_get(DA_BUS bus, const char *name)
 {
 	if (name && g_strcmp0(name, INVALID_SENDER)) {
@@ -263,6 +285,56 @@ static void test_config(gconstpointer test_data)
 	g_free(dir);
 }
 
+/* ==== reload ==== */
+
+#define TEST_RELOAD_TIMEOUT_SEC (10)
+
+static gboolean test_reload_timeout(gpointer user_data)
+{
+	g_assert_not_reached();
+	return G_SOURCE_REMOVE;
+}
+
+static void test_reload()
+{
+	const char *default_config_file = sailfish_access_config_file;
+	char *dir = g_dir_make_tmp(TMP_DIR_TEMPLATE, NULL);
+	char *file = g_strconcat(dir, "/test.conf", NULL);
+	guint timeout_id;
+
+	sailfish_access_config_file = file;
+	g_assert(g_file_set_contents(file,
+		"[org.ofono.VoiceCallManager]\n"
+		"Dial = " DA_POLICY_VERSION "; * = allow \n", -1, NULL));
+
+	g_assert(__ofono_builtin_sailfish_access.init() == 0);
+	g_assert(ofono_dbus_access_method_allowed(NON_PRIVILEGED_SENDER,
+			OFONO_DBUS_ACCESS_INTF_VOICECALLMGR,
+			OFONO_DBUS_ACCESS_VOICECALLMGR_DIAL, NULL));
+
+	/* The new policy applies once the change has been noticed */
+	g_assert(g_file_set_contents(file,
+		"[org.ofono.VoiceCallManager]\n"
+		"Dial = " DA_POLICY_VERSION "; * = deny \n", -1, NULL));
+
+	timeout_id = g_timeout_add_seconds(TEST_RELOAD_TIMEOUT_SEC,
+						test_reload_timeout, NULL);
+	while (ofono_dbus_access_method_allowed(NON_PRIVILEGED_SENDER,
+			OFONO_DBUS_ACCESS_INTF_VOICECALLMGR,
+			OFONO_DBUS_ACCESS_VOICECALLMGR_DIAL, NULL))
+		g_main_context_iteration(NULL, TRUE);
+
+	g_source_remove(timeout_id);
+	__ofono_builtin_sailfish_access.exit();
+	sailfish_access_config_file = default_config_file;
+
+	remove(file);
+	remove(dir);
+
+	g_free(file);
+	g_free(dir);
+}
+
 #define TEST_(test) "/sailfish_access/" test
 
 int main(int argc, char *argv[])
@@ -288,6 +360,7 @@ int main(int argc, char *argv[])
 		g_test_add_data_func(name, test, test_config);
 		g_free(name);
 	}
+	g_test_add_func(TEST_("reload"), test_reload);
 	ret = g_test_run();
 	gutil_idle_pool_unref(peer_pool);
 	return ret;
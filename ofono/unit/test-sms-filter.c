@@ -39,6 +39,21 @@ struct ofono_modem {
 	int filter_msg_count;
 };
 
+/* Stubs */
+
+static GString *test_metrics = NULL;
+
+void __ofono_metrics_filter_done(struct ofono_modem *modem,
+					const char *chain, const char *filter,
+					gint64 started)
+{
+	g_assert(started);
+	if (test_metrics) {
+		g_string_append_printf(test_metrics, "%s%s/%s",
+				test_metrics->len ? "," : "", chain, filter);
+	}
+}
+
 /* Code shared by all tests */
 
 static gboolean test_no_timeout_cb(gpointer data)
@@ -1138,6 +1153,55 @@ static void test_early_free(void)
 	test_common_deinit();
 }
 
+/* ==== sync ==== */
+
+static void test_sync(void)
+{
+	static struct ofono_sms_filter sync1 = {
+		.name = "sync1",
+		.priority = 2,
+		.filter_send_text = test_send_message_filter
+	};
+
+	static struct ofono_sms_filter sync2 = {
+		.name = "sync2",
+		.priority = 1,
+		.filter_send_text = test_send_message_filter2
+	};
+
+	struct test_send_message_data test;
+	struct sms_address addr;
+
+	test_common_init();
+	test_metrics = g_string_new(NULL);
+	memset(&test, 0, sizeof(test));
+	memset(&addr, 0, sizeof(addr));
+	g_assert(ofono_sms_filter_register(&sync2) == 0);
+	g_assert(ofono_sms_filter_register(&sync1) == 0);
+	test.chain = __ofono_sms_filter_chain_new(&test.sms, &test.modem);
+
+	/* Both filters get invoked without returning to the main loop */
+	__ofono_sms_filter_chain_send_text(test.chain, &addr, "test",
+		test_default_send_message, test_send_message_destroy, &test);
+	g_assert(test.modem.filter_msg_count == 2);
+	g_assert(!test.sms.msg_count);
+
+	/* But the message is still sent asynchronously */
+	g_main_loop_run(test_loop);
+	g_assert(test.sms.msg_count == 1);
+	g_assert(test.destroy_count == 1);
+
+	g_assert_cmpstr(test_metrics->str, == ,
+			"sms-filter/sync1,sms-filter/sync2");
+
+	__ofono_sms_filter_chain_free(test.chain);
+	ofono_sms_filter_unregister(&sync1);
+	ofono_sms_filter_unregister(&sync2);
+	g_string_free(test_metrics, TRUE);
+	test_metrics = NULL;
+	test_common_deinit();
+}
+
 #define TEST_(name) "/smsfilter/" name
 
 int main(int argc, char *argv[])
@@ -1169,6 +1233,7 @@ int main(int argc, char *argv[])
 	g_test_add_func(TEST_("recv_message3"), test_recv_message3);
 	g_test_add_func(TEST_("recv_message_drop"), test_recv_message_drop);
 	g_test_add_func(TEST_("early_free"), test_early_free);
+	g_test_add_func(TEST_("sync"), test_sync);
 
 	return g_test_run();
 }
@@ -1475,14 +1475,14 @@ static void test_cbs_assembly(void)
 	/* Add an initial page to the assembly */
 	l = cbs_assembly_add_page(assembly, &dec1);
 	g_assert(l);
-	g_assert(g_slist_length(assembly->recv_cell) == 1);
+	g_assert(g_hash_table_size(assembly->recv_cell) == 1);
 	g_slist_free_full(l, g_free);
 
 	/* Can we receive new updates ? */
 	dec1.update_number = 8;
 	l = cbs_assembly_add_page(assembly, &dec1);
 	g_assert(l);
-	g_assert(g_slist_length(assembly->recv_cell) == 1);
+	g_assert(g_hash_table_size(assembly->recv_cell) == 1);
 	g_slist_free_full(l, g_free);
 
 	/* Do we ignore old pages ? */
@@ -1495,7 +1495,7 @@ static void test_cbs_assembly(void)
 	g_assert(l == NULL);
 
 	cbs_assembly_location_changed(assembly, TRUE, TRUE, TRUE);
-	g_assert(assembly->recv_cell == NULL);
+	g_assert(g_hash_table_size(assembly->recv_cell) == 0);
 
 	dec1.update_number = 9;
 	dec1.page = 3;
@@ -1624,6 +1624,111 @@ static void test_range_minimizer(void)
 	}
 }
 
+static void test_topic_set(void)
+{
+	static const struct cbs_topic_range test_ranges[] = {
+		{ 0, 0 }, { 5, 40 }, { 63, 64 }, { 4352, 4356 },
+		{ 9000, 9999 }, { 65530, 65535 }
+	};
+	struct cbs_topic_set *set;
+	GSList *r = NULL;
+	unsigned int topic;
+	unsigned int i;
+
+	for (i = 0; i < G_N_ELEMENTS(test_ranges); i++)
+		r = g_slist_append(r, g_memdup(test_ranges + i,
+					sizeof(struct cbs_topic_range)));
+
+	set = cbs_topic_set_new(r);
+
+	for (topic = 0; topic <= 0xffff; topic++)
+		g_assert(cbs_topic_set_contains(set, topic) ==
+					cbs_topic_in_range(topic, r));
+
+	g_assert(!cbs_topic_set_contains(set, 0x10000));
+	g_assert(!cbs_topic_set_contains(NULL, 0));
+
+	cbs_topic_set_free(set);
+	g_slist_free_full(r, g_free);
+}
+
+#define STORM_TOPICS 50
+#define STORM_PAGES 200000
+
+static void test_cbs_page_storm(void)
+{
+	unsigned char *decoded_pdu;
+	long pdu_len;
+	struct cbs page;
+	struct cbs_assembly *assembly;
+	struct cbs_topic_set *set;
+	GString *str = g_string_new(NULL);
+	GSList *ranges;
+	unsigned int hits_list = 0;
+	unsigned int hits_set = 0;
+	unsigned int completed = 0;
+	gdouble list_time, set_time, assembly_time;
+	int i;
+
+	/* Lots of scattered operator topics */
+	for (i = 0; i < STORM_TOPICS; i++)
+		g_string_append_printf(str, "%s%d", i ? "," : "", i * 97);
+
+	ranges = cbs_extract_topic_ranges(str->str);
+	g_assert(ranges);
+	set = cbs_topic_set_new(ranges);
+
+	g_test_timer_start();
+	for (i = 0; i < STORM_PAGES; i++)
+		hits_list += cbs_topic_in_range(i & 0xffff, ranges);
+	list_time = g_test_timer_elapsed();
+
+	g_test_timer_start();
+	for (i = 0; i < STORM_PAGES; i++)
+		hits_set += cbs_topic_set_contains(set, i & 0xffff);
+	set_time = g_test_timer_elapsed();
+
+	g_assert(hits_list == hits_set);
+
+	/* The same few hundred messages repeated over and over */
+	decoded_pdu = decode_hex(cbs1, -1, &pdu_len, 0);
+	cbs_decode(decoded_pdu, pdu_len, &page);
+	g_free(decoded_pdu);
+
+	assembly = cbs_assembly_new();
+	page.max_pages = 1;
+	page.page = 1;
+
+	g_test_timer_start();
+	for (i = 0; i < STORM_PAGES; i++) {
+		GSList *l;
+
+		page.message_identifier = i % 500;
+		page.message_code = (i / 500) % 4;
+
+		l = cbs_assembly_add_page(assembly, &page);
+		if (l) {
+			completed++;
+			g_slist_free_full(l, g_free);
+		}
+	}
+	assembly_time = g_test_timer_elapsed();
+
+	/* Only the first copy of each message gets through */
+	g_assert(completed == 2000);
+	g_assert(g_hash_table_size(assembly->recv_cell) == 2000);
+
+	if (g_test_verbose())
+		g_print("%d pages: topic list %.3fs, topic set %.3fs, "
+			"assembly %.3fs\n", STORM_PAGES, list_time,
+			set_time, assembly_time);
+
+	cbs_assembly_free(assembly);
+	cbs_topic_set_free(set);
+	g_slist_free_full(ranges, g_free);
+	g_string_free(str, TRUE);
+}
+
 static void test_sr_assembly(void)
 {
 	const char *sr_pdu1 = "06040D91945152991136F00160124130340A0160124130"
@@ -1941,6 +2046,8 @@ int main(int argc, char **argv)
 			test_cbs_padding_character);
 
 	g_test_add_func("/testsms/Range minimizer", test_range_minimizer);
+	g_test_add_func("/testsms/Topic set", test_topic_set);
+	g_test_add_func("/testsms/CBS page storm", test_cbs_page_storm);
 
 	g_test_add_func("/testsms/Status Report Assembly", test_sr_assembly);
 
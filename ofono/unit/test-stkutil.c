@@ -16222,6 +16222,8 @@ static void test_terminal_response_encoding(gconstpointer data)
 	const unsigned char *pdu;
 	unsigned int pdu_len;
 
+	unsigned char buf[512];
+
 	pdu = stk_pdu_from_response(&test->response, &pdu_len);
 
 	if (test->pdu)
@@ -16231,6 +16233,18 @@ static void test_terminal_response_encoding(gconstpointer data)
 
 	g_assert(pdu_len == test->pdu_len);
 	g_assert(memcmp(pdu, test->pdu, pdu_len) == 0);
+
+	/* Same result in a caller supplied buffer */
+	pdu = stk_pdu_from_response_buf(&test->response, buf, sizeof(buf),
+						&pdu_len);
+	g_assert(pdu == buf);
+	g_assert(pdu_len == test->pdu_len);
+	g_assert(memcmp(pdu, test->pdu, pdu_len) == 0);
+
+	/* Which must be big enough */
+	if (test->pdu_len)
+		g_assert(!stk_pdu_from_response_buf(&test->response, buf,
+						test->pdu_len - 1, &pdu_len));
 }
 
 static const struct terminal_response_test display_text_response_data_111 = {
@@ -20209,6 +20223,8 @@ static void test_envelope_encoding(gconstpointer data)
 	const unsigned char *pdu;
 	unsigned int pdu_len;
 
+	unsigned char buf[512];
+
 	pdu = stk_pdu_from_envelope(&test->envelope, &pdu_len);
 
 	if (test->pdu)
@@ -20218,6 +20234,13 @@ static void test_envelope_encoding(gconstpointer data)
 
 	g_assert(pdu_len == test->pdu_len);
 	g_assert(memcmp(pdu, test->pdu, pdu_len) == 0);
+
+	/* Same result in a caller supplied buffer */
+	pdu = stk_pdu_from_envelope_buf(&test->envelope, buf, sizeof(buf),
+						&pdu_len);
+	g_assert(pdu >= buf && pdu < buf + sizeof(buf));
+	g_assert(pdu_len == test->pdu_len);
+	g_assert(memcmp(pdu, test->pdu, pdu_len) == 0);
 }
 
 static const unsigned char sms_pp_data_download_161[] = {
@@ -22275,6 +22298,44 @@ static void test_img_to_xpm(gconstpointer data)
 	g_free(xpm);
 }
 
+static const struct {
+	const unsigned char *pdu;
+	unsigned int pdu_len;
+} parse_bench_data[] = {
+	{ display_text_111, sizeof(display_text_111) },
+	{ setup_menu_111, sizeof(setup_menu_111) },
+	{ select_item_111, sizeof(select_item_111) },
+	{ send_sms_111, sizeof(send_sms_111) },
+	{ setup_call_111, sizeof(setup_call_111) },
+};
+
+static void test_parse_bench(void)
+{
+	unsigned int n = g_test_perf() ? 100000 : 1000;
+	unsigned int i, j;
+	double elapsed;
+
+	g_test_timer_start();
+
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < G_N_ELEMENTS(parse_bench_data); j++) {
+			struct stk_command *command;
+
+			command = stk_command_new_from_pdu(
+						parse_bench_data[j].pdu,
+						parse_bench_data[j].pdu_len);
+			g_assert(command);
+			g_assert(command->status == STK_PARSE_RESULT_OK);
+			stk_command_free(command);
+		}
+	}
+
+	elapsed = g_test_timer_elapsed();
+	g_test_message("%u commands parsed in %.3f s",
+			n * (unsigned int) G_N_ELEMENTS(parse_bench_data),
+			elapsed);
+}
+
 int main(int argc, char **argv)
 {
 	g_test_init(&argc, &argv, NULL);
@@ -24387,5 +24448,7 @@ int main(int argc, char **argv)
 	g_test_add_data_func("/teststk/IMG to XPM Test 6",
 				&xpm_test_6, test_img_to_xpm);
 
+	g_test_add_func("/teststk/Parse benchmark", test_parse_bench);
+
 	return g_test_run();
 }
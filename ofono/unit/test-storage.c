@@ -0,0 +1,208 @@
+/*
+ *  oFono - Open Source Telephony
+ *
+ *  Copyright (C) 2021 Jolla Ltd.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ */
+
+#include "ofono.h"
+#include "storage.h"
+
+#include <gutil_log.h>
+
+#include <sys/stat.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#define TEST_IMSI "244120000000000"
+#define TEST_STORE "settings"
+#define TEST_FILE STORAGEDIR "/" TEST_IMSI "/" TEST_STORE
+#define TEST_GROUP "Settings"
+
+static void test_remove_file(void)
+{
+	remove(TEST_FILE);
+	rmdir(STORAGEDIR "/" TEST_IMSI);
+}
+
+static int test_get_int(void)
+{
+	GKeyFile *k = storage_open(TEST_IMSI, TEST_STORE);
+	int val = g_key_file_get_integer(k, TEST_GROUP, "Value", NULL);
+
+	g_key_file_free(k);
+	return val;
+}
+
+static int test_read_int(void)
+{
+	GKeyFile *k = g_key_file_new();
+	int val = -1;
+
+	if (g_key_file_load_from_file(k, TEST_FILE, 0, NULL))
+		val = g_key_file_get_integer(k, TEST_GROUP, "Value", NULL);
+
+	g_key_file_free(k);
+	return val;
+}
+
+/* ==== direct ==== */
+
+static void test_direct(void)
+{
+	GKeyFile *k;
+
+	test_remove_file();
+
+	/* Without init every sync is written immediately */
+	k = storage_open(TEST_IMSI, TEST_STORE);
+	g_key_file_set_integer(k, TEST_GROUP, "Value", 1);
+	storage_sync(TEST_IMSI, TEST_STORE, k);
+	g_assert_cmpint(test_read_int(), == ,1);
+
+	g_key_file_set_integer(k, TEST_GROUP, "Value", 2);
+	storage_close(TEST_IMSI, TEST_STORE, k, TRUE);
+	g_assert_cmpint(test_read_int(), == ,2);
+
+	test_remove_file();
+}
+
+/* ==== batch ==== */
+
+static void test_batch(void)
+{
+	struct ofono_storage_stats stats;
+	GKeyFile *k;
+	int i;
+
+	test_remove_file();
+	__ofono_storage_init();
+
+	k = storage_open(TEST_IMSI, TEST_STORE);
+	for (i = 1; i <= 3; i++) {
+		g_key_file_set_integer(k, TEST_GROUP, "Value", i);
+		storage_sync(TEST_IMSI, TEST_STORE, k);
+	}
+
+	/* Nothing has been written yet but the data is there */
+	g_assert(!g_file_test(TEST_FILE, G_FILE_TEST_EXISTS));
+	g_assert_cmpint(test_get_int(), == ,3);
+
+	/* Closing without saving doesn't drop the pending changes */
+	storage_close(TEST_IMSI, TEST_STORE, k, FALSE);
+	g_assert_cmpint(test_get_int(), == ,3);
+
+	__ofono_storage_get_stats(&stats);
+	g_assert_cmpuint(stats.syncs, == ,3);
+	g_assert_cmpuint(stats.writes, == ,0);
+	g_assert_cmpuint(stats.avoided, == ,2);
+
+	__ofono_storage_flush();
+	g_assert_cmpint(test_read_int(), == ,3);
+
+	/* Syncing unchanged contents doesn't make it dirty */
+	k = storage_open(TEST_IMSI, TEST_STORE);
+	storage_close(TEST_IMSI, TEST_STORE, k, TRUE);
+
+	__ofono_storage_get_stats(&stats);
+	g_assert_cmpuint(stats.syncs, == ,4);
+	g_assert_cmpuint(stats.writes, == ,1);
+	g_assert_cmpuint(stats.avoided, == ,3);
+
+	/* Cleanup writes whatever is left */
+	k = storage_open(TEST_IMSI, TEST_STORE);
+	g_key_file_set_integer(k, TEST_GROUP, "Value", 4);
+	storage_close(TEST_IMSI, TEST_STORE, k, TRUE);
+	g_assert_cmpint(test_read_int(), == ,3);
+
+	__ofono_storage_cleanup();
+	g_assert_cmpint(test_read_int(), == ,4);
+
+	test_remove_file();
+}
+
+/* ==== migrate ==== */
+
+static void test_migrate(void)
+{
+	static const char data[] = "[" TEST_GROUP "]\nValue=5\n";
+
+	/* Files written by older versions are picked up as they are */
+	test_remove_file();
+	g_assert(!create_dirs(TEST_FILE, S_IRUSR | S_IWUSR | S_IXUSR));
+	g_assert(g_file_set_contents(TEST_FILE, data, -1, NULL));
+
+	__ofono_storage_init();
+	g_assert_cmpint(test_get_int(), == ,5);
+	__ofono_storage_cleanup();
+
+	test_remove_file();
+}
+
+/* ==== timer ==== */
+
+static gboolean test_timer_quit(gpointer loop)
+{
+	g_main_loop_quit(loop);
+	return G_SOURCE_REMOVE;
+}
+
+static void test_timer(void)
+{
+	GMainLoop *loop = g_main_loop_new(NULL, FALSE);
+	GKeyFile *k;
+
+	test_remove_file();
+	__ofono_storage_init();
+
+	k = storage_open(TEST_IMSI, TEST_STORE);
+	g_key_file_set_integer(k, TEST_GROUP, "Value", 6);
+	storage_close(TEST_IMSI, TEST_STORE, k, TRUE);
+	g_assert(!g_file_test(TEST_FILE, G_FILE_TEST_EXISTS));
+
+	/* Gets written after a short delay */
+	g_timeout_add_seconds(3, test_timer_quit, loop);
+	g_main_loop_run(loop);
+	g_assert_cmpint(test_read_int(), == ,6);
+
+	__ofono_storage_cleanup();
+	g_main_loop_unref(loop);
+	test_remove_file();
+}
+
+#define TEST_(name) "/storage/" name
+
+int main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	gutil_log_timestamp = FALSE;
+	gutil_log_default.level = g_test_verbose() ?
+		GLOG_LEVEL_VERBOSE : GLOG_LEVEL_NONE;
+	__ofono_log_init("test-storage",
+		g_test_verbose() ? "*" : NULL,
+		FALSE, FALSE);
+
+	g_test_add_func(TEST_("direct"), test_direct);
+	g_test_add_func(TEST_("batch"), test_batch);
+	g_test_add_func(TEST_("migrate"), test_migrate);
+	g_test_add_func(TEST_("timer"), test_timer);
+
+	return g_test_run();
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 8
+ * indent-tabs-mode: t
+ * End:
+ */
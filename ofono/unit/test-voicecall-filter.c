@@ -34,6 +34,26 @@ struct ofono_voicecall {
 	struct voicecall_filter_chain *chain;
 };
 
+/* Stubs */
+
+static GString *test_metrics = NULL;
+
+void __ofono_metrics_filter_done(struct ofono_modem *modem,
+					const char *chain, const char *filter,
+					gint64 started)
+{
+	g_assert(started);
+	if (test_metrics) {
+		g_string_append_printf(test_metrics, "%s%s/%s",
+				test_metrics->len ? "," : "", chain, filter);
+	}
+}
+
+struct ofono_modem *ofono_voicecall_get_modem(struct ofono_voicecall *vc)
+{
+	return NULL;
+}
+
 /* Code shared by all tests */
 
 static gboolean test_timeout_cb(gpointer user_data)
@@ -1163,6 +1183,60 @@ static void test_cancel6(void)
 	test_common_deinit();
 }
 
+/* ==== sync ==== */
+
+static void test_sync(void)
+{
+	static struct ofono_voicecall_filter filter1 = {
+		.name = "sync1",
+		.api_version = OFONO_VOICECALL_FILTER_API_VERSION,
+		.priority = OFONO_VOICECALL_FILTER_PRIORITY_HIGH,
+		.filter_dial = filter_dial_continue
+	};
+
+	static struct ofono_voicecall_filter filter2 = {
+		.name = "sync2",
+		.api_version = OFONO_VOICECALL_FILTER_API_VERSION,
+		.priority = OFONO_VOICECALL_FILTER_PRIORITY_LOW,
+		.filter_dial = filter_dial_continue
+	};
+
+	struct ofono_voicecall vc;
+	struct ofono_phone_number number;
+	int count = 0;
+
+	test_common_init();
+	test_metrics = g_string_new(NULL);
+	test_voicecall_init(&vc);
+	string_to_phone_number("+1234", &number);
+
+	g_assert(ofono_voicecall_filter_register(&filter2) == 0);
+	g_assert(ofono_voicecall_filter_register(&filter1) == 0);
+	g_assert((vc.chain = __ofono_voicecall_filter_chain_new(&vc)) != NULL);
+
+	/* Both filters get invoked without returning to the main loop */
+	__ofono_voicecall_filter_chain_dial(vc.chain, &number,
+			OFONO_CLIR_OPTION_DEFAULT,
+			test_dial_expect_continue_and_quit,
+			test_inc, &count);
+	g_assert(test_filter_dial_count == 2);
+	g_assert(!count);
+
+	/* But the completion callback is still invoked asynchronously */
+	g_main_loop_run(test_loop);
+	g_assert(count == 1);
+
+	g_assert_cmpstr(test_metrics->str, == ,
+			"voicecall-filter/sync1,voicecall-filter/sync2");
+
+	__ofono_voicecall_filter_chain_free(vc.chain);
+	ofono_voicecall_filter_unregister(&filter1);
+	ofono_voicecall_filter_unregister(&filter2);
+	g_string_free(test_metrics, TRUE);
+	test_metrics = NULL;
+	test_common_deinit();
+}
+
 #define TEST_(name) "/voicecall-filter/" name
 
 int main(int argc, char *argv[])
@@ -1197,6 +1271,7 @@ int main(int argc, char *argv[])
 	g_test_add_func(TEST_("cancel4"), test_cancel4);
 	g_test_add_func(TEST_("cancel5"), test_cancel5);
 	g_test_add_func(TEST_("cancel6"), test_cancel6);
+	g_test_add_func(TEST_("sync"), test_sync);
 
 	return g_test_run();
 }